@@ -29,6 +29,7 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/windowsregistry.cpp \
     ../../wpmcpp/src/commandline.cpp \
     ../../wpmcpp/src/wpmutils.cpp \
+    ../../wpmcpp/src/processrunner.cpp \
     ../../wpmcpp/src/job.cpp \
     ../../wpmcpp/src/hrtimer.cpp \
     ../../wpmcpp/src/version.cpp
@@ -38,6 +39,7 @@ HEADERS += \
     ../../wpmcpp/src/windowsregistry.h \
     ../../wpmcpp/src/commandline.h \
     ../../wpmcpp/src/wpmutils.h \
+    ../../wpmcpp/src/processrunner.h \
     ../../wpmcpp/src/job.h \
     ../../wpmcpp/src/hrtimer.h \
     ../../wpmcpp/src/version.h
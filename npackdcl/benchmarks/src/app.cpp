@@ -0,0 +1,453 @@
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QXmlStreamWriter>
+#include <QJsonObject>
+#include <QXmlSimpleReader>
+#include <QXmlInputSource>
+
+#include "app.h"
+#include "dependency.h"
+#include "packageversion.h"
+#include "repository.h"
+#include "repositoryxmlhandler.h"
+#include "repositoryxmlreader.h"
+#include "dbrepository.h"
+#include "wpmutils.h"
+#include "job.h"
+
+/** number of packages in the synthetic repository */
+static const int PACKAGES = 1000;
+
+/** number of versions per package in the synthetic repository */
+static const int VERSIONS = 5;
+
+static bool versionLessThan(const Version& a, const Version& b)
+{
+    return a.compare(b) < 0;
+}
+
+App::App(): tempDir(0), syntheticDB(0)
+{
+}
+
+QString App::parseRepository(Repository* rep)
+{
+    QString err;
+
+    RepositoryXMLHandler handler(rep);
+    QXmlSimpleReader reader;
+    reader.setContentHandler(&handler);
+    reader.setErrorHandler(&handler);
+    QXmlInputSource inputSource;
+    inputSource.setData(repXML);
+    if (!reader.parse(inputSource))
+        err = handler.errorString();
+
+    return err;
+}
+
+DBRepository* App::openSyntheticDatabase()
+{
+    if (syntheticDB)
+        return syntheticDB;
+
+    Repository rep;
+    QString err = parseRepository(&rep);
+
+    DBRepository* dbr = new DBRepository();
+    if (err.isEmpty())
+        err = dbr->open("benchmarkSynthetic",
+                tempDir->path() + "/synthetic.db");
+
+    if (err.isEmpty()) {
+        Job* job = new Job();
+        Job* sub = job->newSubJob(0.5, "Saving", true, true);
+        dbr->saveAll(sub, &rep);
+        if (job->shouldProceed()) {
+            sub = job->newSubJob(0.5, "Updating the status", true, true);
+            dbr->updateStatusForAll(sub);
+        }
+        err = job->getErrorMessage();
+        delete job;
+    }
+
+    if (err.isEmpty())
+        syntheticDB = dbr;
+    else {
+        qWarning() << err;
+        delete dbr;
+    }
+
+    return syntheticDB;
+}
+
+void App::createRepository(int packages, int versionsPerPackage)
+{
+    repXML.clear();
+    versionXMLs.clear();
+
+    QString pkgs, vs;
+    for (int i = 0; i < packages; i++) {
+        QString name = QString("org.example.Package%1").arg(i);
+        pkgs += QString("<package name=\"%1\">"
+                "<title>Package %2</title>"
+                "<description>Synthetic package number %2 used for "
+                "benchmarks</description>"
+                "<url>http://www.example.org/%2</url>"
+                "<license>org.gnu.GPLv3</license>"
+                "<category>Category%3/Sub%4</category>"
+                "</package>\n").arg(name).arg(i).arg(i % 10).arg(i % 7);
+
+        for (int j = 0; j < versionsPerPackage; j++) {
+            QString v = QString("<version name=\"%1.%2\" package=\"%3\">"
+                    "<url>http://www.example.org/%3-%1.%2.zip</url>"
+                    "<sha1>b728e1cf8948478beb73ead42a227de53f8388ec</sha1>"
+                    "<important-file path=\"bin\\app.exe\" "
+                    "title=\"Package %4\"/>"
+                    "<dependency package=\"org.example.Package%5\" "
+                    "versions=\"[1, 2)\"/>"
+                    "</version>").arg(j + 1).arg(i % 10).arg(name).
+                    arg(i).arg((i + 1) % packages);
+            versionXMLs.append(v.toUtf8());
+            vs += v + "\n";
+        }
+    }
+
+    repXML = ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<root><spec-version>3</spec-version>\n"
+            "<license name=\"org.gnu.GPLv3\"><title>GPLv3</title></license>\n"
+            + pkgs + vs + "</root>\n").toUtf8();
+}
+
+void App::initTestCase()
+{
+    // a deterministic pseudo-random sequence so that the results can be
+    // compared between runs
+    qsrand(42);
+    for (int i = 0; i < 10000; i++) {
+        QString s = QString("%1.%2.%3.%4").arg(qrand() % 20).
+                arg(qrand() % 100).arg(qrand() % 1000).arg(qrand() % 10000);
+        versionStrings.append(s);
+
+        Version v;
+        QVERIFY(v.setVersion(s));
+        versions.append(v);
+    }
+
+    createRepository(PACKAGES, VERSIONS);
+
+    for (int i = 0; i < 10000; i++) {
+        paths.append(WPMUtils::normalizePath(
+                QString("C:\\Program Files\\Dir%1\\Sub%2\\file%3.txt").
+                arg(i % 50).arg(i % 20).arg(i)));
+    }
+
+    tempDir = new QTemporaryDir();
+    QVERIFY(tempDir->isValid());
+}
+
+void App::cleanupTestCase()
+{
+    delete syntheticDB;
+    syntheticDB = 0;
+
+    delete tempDir;
+    tempDir = 0;
+}
+
+void App::versionSetVersion()
+{
+    Version v;
+    QBENCHMARK {
+        for (int i = 0; i < versionStrings.count(); i++) {
+            v.setVersion(versionStrings.at(i));
+        }
+    }
+}
+
+void App::versionSetVersionRef()
+{
+    QString all = versionStrings.join(',');
+
+    Version v;
+    QBENCHMARK {
+        int start = 0;
+        while (start < all.length()) {
+            int end = all.indexOf(',', start);
+            if (end < 0)
+                end = all.length();
+            v.setVersion(all.midRef(start, end - start));
+            start = end + 1;
+        }
+    }
+}
+
+void App::versionCompare()
+{
+    int r = 0;
+    QBENCHMARK {
+        for (int i = 1; i < versions.count(); i++) {
+            r += versions.at(i - 1).compare(versions.at(i));
+        }
+    }
+    Q_UNUSED(r);
+}
+
+void App::versionCompareLong()
+{
+    QList<Version> vs;
+    for (int i = 0; i < versions.count(); i++) {
+        Version v = versions.at(i);
+        v.prepend(i % 3);
+        vs.append(v);
+    }
+
+    int r = 0;
+    QBENCHMARK {
+        for (int i = 1; i < vs.count(); i++) {
+            r += vs.at(i - 1).compare(vs.at(i));
+        }
+    }
+    Q_UNUSED(r);
+}
+
+void App::versionGetVersionString()
+{
+    QBENCHMARK {
+        for (int i = 0; i < versions.count(); i++) {
+            versions.at(i).getVersionString();
+        }
+    }
+}
+
+void App::versionSort()
+{
+    QBENCHMARK {
+        QList<Version> vs = versions;
+        qSort(vs.begin(), vs.end(), versionLessThan);
+    }
+}
+
+void App::dependencySetVersions()
+{
+    QStringList ranges;
+    for (int i = 1; i < versionStrings.count(); i++) {
+        ranges.append("[" + versionStrings.at(i - 1) + ", " +
+                versionStrings.at(i) + ")");
+    }
+
+    Dependency d;
+    QBENCHMARK {
+        for (int i = 0; i < ranges.count(); i++) {
+            d.setVersions(ranges.at(i));
+        }
+    }
+}
+
+void App::dependencyTest()
+{
+    Dependency d;
+    QVERIFY(d.setVersions("[5.10, 15.20.3)"));
+
+    int n = 0;
+    QBENCHMARK {
+        for (int i = 0; i < versions.count(); i++) {
+            if (d.test(versions.at(i)))
+                n++;
+        }
+    }
+    Q_UNUSED(n);
+}
+
+void App::packageVersionParse()
+{
+    QBENCHMARK {
+        for (int i = 0; i < versionXMLs.count(); i++) {
+            QString err;
+            PackageVersion* pv = PackageVersion::parse(versionXMLs.at(i),
+                    &err, false);
+            QVERIFY2(pv, qPrintable(err));
+            delete pv;
+        }
+    }
+}
+
+void App::packageVersionToXML()
+{
+    QString err;
+    PackageVersion* pv = PackageVersion::parse(versionXMLs.at(0), &err);
+    QVERIFY2(pv, qPrintable(err));
+
+    QBENCHMARK {
+        for (int i = 0; i < 1000; i++) {
+            QString s;
+            QXmlStreamWriter w(&s);
+            pv->toXML(&w);
+        }
+    }
+
+    delete pv;
+}
+
+void App::packageVersionToJSON()
+{
+    QString err;
+    PackageVersion* pv = PackageVersion::parse(versionXMLs.at(0), &err);
+    QVERIFY2(pv, qPrintable(err));
+
+    QBENCHMARK {
+        for (int i = 0; i < 1000; i++) {
+            QJsonObject obj;
+            pv->toJSON(obj);
+        }
+    }
+
+    delete pv;
+}
+
+void App::repositoryXMLHandler()
+{
+    QBENCHMARK {
+        Repository rep;
+        QString err = parseRepository(&rep);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(rep.packageVersions.count(), PACKAGES * VERSIONS);
+    }
+}
+
+void App::repositoryXMLReader()
+{
+    QBENCHMARK {
+        Repository rep;
+        RepositoryXMLReader reader(&rep);
+        QString err = reader.read(repXML);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(rep.packageVersions.count(), PACKAGES * VERSIONS);
+    }
+}
+
+void App::dbRepositorySaveAll()
+{
+    Repository rep;
+    QString err = parseRepository(&rep);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    DBRepository dbr;
+    err = dbr.open("benchmarkSaveAll",
+            tempDir->path() + "/saveall.db");
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    QBENCHMARK {
+        err = dbr.clear();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        Job* job = new Job();
+        dbr.saveAll(job, &rep);
+        QVERIFY2(job->getErrorMessage().isEmpty(),
+                qPrintable(job->getErrorMessage()));
+        delete job;
+    }
+}
+
+void App::dbRepositoryFindPackages_data()
+{
+    QTest::addColumn<QString>("query");
+
+    QTest::newRow("all") << "";
+    QTest::newRow("one keyword") << "synthetic";
+    QTest::newRow("two keywords") << "package 12";
+    QTest::newRow("no match") << "nonexistent";
+}
+
+void App::dbRepositoryFindPackages()
+{
+    QFETCH(QString, query);
+
+    DBRepository* dbr = openSyntheticDatabase();
+    QVERIFY(dbr);
+
+    QBENCHMARK {
+        QString err;
+        dbr->findPackages(Package::INSTALLED, false, query, -1, -1, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+}
+
+void App::dbRepositoryGetPackageVersions()
+{
+    DBRepository* dbr = openSyntheticDatabase();
+    QVERIFY(dbr);
+
+    QBENCHMARK {
+        for (int i = 0; i < PACKAGES; i += 10) {
+            QString err;
+            QList<PackageVersion*> pvs = dbr->getPackageVersions_(
+                    QString("org.example.Package%1").arg(i), &err);
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+            qDeleteAll(pvs);
+        }
+    }
+}
+
+void App::wpmutilsNormalizePath()
+{
+    QStringList ps;
+    for (int i = 0; i < 10000; i++) {
+        ps.append(QString("C:/Program Files\\Dir%1/Sub%2\\file%3.txt\\").
+                arg(i % 50).arg(i % 20).arg(i));
+    }
+
+    QBENCHMARK {
+        for (int i = 0; i < ps.count(); i++) {
+            WPMUtils::normalizePath(ps.at(i));
+        }
+    }
+}
+
+void App::wpmutilsIsUnderOrEquals()
+{
+    QStringList dirs;
+    for (int i = 0; i < 50; i += 5) {
+        dirs.append(WPMUtils::normalizePath(
+                QString("C:\\Program Files\\Dir%1").arg(i)));
+    }
+
+    int n = 0;
+    QBENCHMARK {
+        for (int i = 0; i < paths.count(); i++) {
+            if (WPMUtils::isUnderOrEquals(paths.at(i), dirs))
+                n++;
+        }
+    }
+    Q_UNUSED(n);
+}
+
+void App::runNpackdcl(const QStringList& params)
+{
+    QString exe = QProcessEnvironment::systemEnvironment().value(
+            "NPACKDCL_EXE");
+    if (exe.isEmpty())
+        QSKIP("NPACKDCL_EXE is not defined");
+
+    QBENCHMARK {
+        QProcess p;
+        p.start(exe, params);
+        QVERIFY2(p.waitForFinished(-1), qPrintable(p.errorString()));
+    }
+}
+
+void App::startupHelp()
+{
+    runNpackdcl(QStringList() << "help");
+}
+
+void App::startupPath()
+{
+    runNpackdcl(QStringList() << "path" <<
+            "--package=com.googlecode.windows-package-manager.NpackdCL");
+}
+
+void App::startupList()
+{
+    runNpackdcl(QStringList() << "list");
+}
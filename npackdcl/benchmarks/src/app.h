@@ -0,0 +1,195 @@
+#ifndef APP_H
+#define APP_H
+
+#include <QtTest/QtTest>
+#include <QtCore/QCoreApplication>
+#include <qstringlist.h>
+#include <qstring.h>
+#include <QTemporaryDir>
+
+#include "version.h"
+#include "repository.h"
+#include "dbrepository.h"
+
+/**
+ * NpackdCL micro-benchmarks. The results can be stored in a machine-readable
+ * format using the standard QTest options like "-o results.xml,xml".
+ */
+class App: public QObject
+{
+    Q_OBJECT
+private:
+    /** version numbers in the form "a.b.c.d" as strings */
+    QStringList versionStrings;
+
+    /** the same version numbers as in versionStrings */
+    QList<Version> versions;
+
+    /** synthetic repository in the Rep.xml format */
+    QByteArray repXML;
+
+    /** <version> elements from repXML */
+    QList<QByteArray> versionXMLs;
+
+    /** normalized paths to files in a synthetic directory tree */
+    QStringList paths;
+
+    /** directory for the benchmark databases */
+    QTemporaryDir* tempDir;
+
+    /** database with the data from repXML or 0 */
+    DBRepository* syntheticDB;
+
+    /**
+     * Creates a synthetic repository.
+     *
+     * @param packages number of packages
+     * @param versionsPerPackage number of versions per package
+     */
+    void createRepository(int packages, int versionsPerPackage);
+
+    /**
+     * Parses repXML.
+     *
+     * @param rep the data will be stored here
+     * @return error message
+     */
+    QString parseRepository(Repository* rep);
+
+    /**
+     * Creates the database with the data from repXML on the first call.
+     *
+     * @return the database or 0 if an error occured
+     */
+    DBRepository* openSyntheticDatabase();
+
+    /**
+     * Starts npackdcl.exe defined by the environment variable NPACKDCL_EXE
+     * and waits for the end. The benchmark is skipped if the variable is not
+     * defined.
+     *
+     * @param params command line parameters
+     */
+    void runNpackdcl(const QStringList& params);
+public:
+    App();
+private slots:
+    /**
+     * Creates the data for the benchmarks
+     */
+    void initTestCase();
+
+    /**
+     * Deletes the data for the benchmarks
+     */
+    void cleanupTestCase();
+
+    /**
+     * Version::setVersion(QString)
+     */
+    void versionSetVersion();
+
+    /**
+     * Version::setVersion(QStringRef)
+     */
+    void versionSetVersionRef();
+
+    /**
+     * Version::compare for versions with up to 4 parts
+     */
+    void versionCompare();
+
+    /**
+     * Version::compare for versions with more than 4 parts
+     */
+    void versionCompareLong();
+
+    /**
+     * Version::getVersionString
+     */
+    void versionGetVersionString();
+
+    /**
+     * Sorting of versions
+     */
+    void versionSort();
+
+    /**
+     * Dependency::setVersions
+     */
+    void dependencySetVersions();
+
+    /**
+     * Dependency::test
+     */
+    void dependencyTest();
+
+    /**
+     * PackageVersion::parse for one <version>
+     */
+    void packageVersionParse();
+
+    /**
+     * PackageVersion::toXML
+     */
+    void packageVersionToXML();
+
+    /**
+     * PackageVersion::toJSON
+     */
+    void packageVersionToJSON();
+
+    /**
+     * RepositoryXMLHandler for a whole repository
+     */
+    void repositoryXMLHandler();
+
+    /**
+     * RepositoryXMLReader for the same repository as repositoryXMLHandler
+     */
+    void repositoryXMLReader();
+
+    /**
+     * DBRepository::saveAll into an empty database
+     */
+    void dbRepositorySaveAll();
+
+    /**
+     * DBRepository::findPackages with and without keywords
+     */
+    void dbRepositoryFindPackages_data();
+    void dbRepositoryFindPackages();
+
+    /**
+     * DBRepository::getPackageVersions_
+     */
+    void dbRepositoryGetPackageVersions();
+
+    /**
+     * WPMUtils::normalizePath
+     */
+    void wpmutilsNormalizePath();
+
+    /**
+     * WPMUtils::isUnderOrEquals for a list of directories
+     */
+    void wpmutilsIsUnderOrEquals();
+
+    /**
+     * "npackdcl help" end-to-end. This command does not need the database.
+     */
+    void startupHelp();
+
+    /**
+     * "npackdcl path" end-to-end. Opens the database.
+     */
+    void startupPath();
+
+    /**
+     * "npackdcl list" end-to-end. Opens the database and reads the installed
+     * packages.
+     */
+    void startupList();
+};
+
+#endif // APP_H
@@ -0,0 +1,6 @@
+#include <QtTest/QtTest>
+
+#include "app.h"
+
+QTEST_MAIN(App)
+
@@ -3,6 +3,11 @@
 #include <QStringList>
 #include <QCoreApplication>
 #include <QDir>
+#include <QSet>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
 
 #include "app.h"
 #include "job.h"
@@ -235,6 +240,43 @@ void App::updateKeepDirectories()
     QVERIFY2(output.contains("removed successfully"), output.toLatin1());
 }
 
+void App::updatePrefetched()
+{
+    if (!admin)
+        QSKIP("disabled");
+
+    captureNpackdCLOutput("rm -p org.areca-backup.ArecaBackup");
+
+    QString output = captureNpackdCLOutput(
+            "add -p org.areca-backup.ArecaBackup -v 7.3.5");
+    QVERIFY2(output.contains("installed successfully"), output.toLatin1());
+
+    QDir cache(PackageVersion::getDownloadCacheDir());
+    QSet<QString> before = cache.entryList(QDir::Files).toSet();
+
+    output = captureNpackdCLOutput("prefetch");
+    QVERIFY2(output.contains("The updates were downloaded successfully"),
+            output.toLatin1());
+
+    // the newest version is stored in the cache without incomplete files
+    QSet<QString> prefetched = cache.entryList(QDir::Files).toSet();
+    QSet<QString> added = prefetched - before;
+    QVERIFY(!added.isEmpty());
+    QVERIFY(cache.entryList(QStringList("*.part"), QDir::Files).isEmpty());
+
+    output = captureNpackdCLOutput("update -p org.areca-backup.ArecaBackup");
+    QVERIFY2(output.contains(
+            "The packages were updated successfully"),
+            output.toLatin1());
+
+    // the cached file was used by the installation and removed afterwards
+    QSet<QString> used = added - cache.entryList(QDir::Files).toSet();
+    QVERIFY(!used.isEmpty());
+
+    output = captureNpackdCLOutput("rm -p org.areca-backup.ArecaBackup");
+    QVERIFY2(output.contains("removed successfully"), output.toLatin1());
+}
+
 void App::place()
 {
     if (!admin)
@@ -407,6 +449,37 @@ void App::list()
             contains("Reading list of installed packages"));
 }
 
+void App::sqlStats()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString file = QDir::toNativeSeparators(dir.path() + "/stats.json");
+
+    // the statistics are not collected by the service
+    QVERIFY(captureNpackdCLOutput("list --bare-format --sql-stats=\"" +
+            file + "\"").contains("Windows Installer 5.0"));
+
+    QFile f(file);
+    QVERIFY(f.open(QFile::ReadOnly));
+    QJsonObject top = QJsonDocument::fromJson(f.readAll()).object();
+    f.close();
+
+    QVERIFY(top.contains("slowQueryThreshold"));
+    QJsonArray statements = top.value("statements").toArray();
+    QVERIFY(statements.count() > 0);
+    for (int i = 0; i < statements.count(); i++) {
+        QJsonObject s = statements.at(i).toObject();
+        QVERIFY(!s.value("sql").toString().isEmpty());
+        QVERIFY(s.value("count").toInt() > 0);
+        QVERIFY(s.value("totalTime").toDouble() >=
+                s.value("maxTime").toDouble());
+        QVERIFY(s.value("rows").toDouble() >= 0);
+        if (i > 0)
+            QVERIFY(statements.at(i - 1).toObject().value("totalTime").
+                    toDouble() >= s.value("totalTime").toDouble());
+    }
+}
+
 void App::detect()
 {
     if (!admin)
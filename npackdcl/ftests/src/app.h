@@ -53,6 +53,11 @@ private slots:
      */
     void updateKeepDirectories();
 
+    /**
+     * @brief "prefetch" and "update" with the downloaded binary
+     */
+    void updatePrefetched();
+
     /**
      * @brief "place"
      */
@@ -141,6 +146,11 @@ private slots:
      */
     void list();
 
+    /**
+     * @brief "list --sql-stats"
+     */
+    void sqlStats();
+
     /**
      * @brief "help"
      */
@@ -28,6 +28,8 @@ SOURCES += main.cpp \
     ..\..\..\wpmcpp\src\downloader.cpp \
     ..\..\..\wpmcpp\src\commandline.cpp \
     ..\..\..\wpmcpp\src\repositoryxmlhandler.cpp \
+    ..\..\..\wpmcpp\src\repositoryxmlreader.cpp \
+    ..\..\..\wpmcpp\src\stringpool.cpp \
     ..\..\..\wpmcpp\src\mysqlquery.cpp \
     ..\..\..\wpmcpp\src\wellknownprogramsthirdpartypm.cpp \
     ..\..\..\wpmcpp\src\abstractthirdpartypm.cpp \
@@ -36,6 +38,7 @@ SOURCES += main.cpp \
     ..\..\..\wpmcpp\src\controlpanelthirdpartypm.cpp \
     ..\..\..\wpmcpp\src\installoperation.cpp \
     ..\..\..\wpmcpp\src\dependency.cpp \
+    ..\..\..\wpmcpp\src\dependencyindex.cpp \
     ..\..\..\wpmcpp\src\packageversionfile.cpp \
     ..\..\..\wpmcpp\src\dbrepository.cpp \
     ..\..\..\wpmcpp\src\license.cpp \
@@ -50,6 +53,7 @@ SOURCES += main.cpp \
     ..\..\..\wpmcpp\src\windowsregistry.cpp \
     ..\..\..\wpmcpp\src\packageversion.cpp \
     ..\..\..\wpmcpp\src\wpmutils.cpp \
+    ..\..\..\wpmcpp\src\processrunner.cpp \
     ..\..\..\wpmcpp\src\clprogress.cpp
 
 HEADERS += \
@@ -58,6 +62,8 @@ HEADERS += \
     ..\..\..\wpmcpp\src\downloader.h \
     ..\..\..\wpmcpp\src\commandline.h \
     ..\..\..\wpmcpp\src\repositoryxmlhandler.h \
+    ..\..\..\wpmcpp\src\repositoryxmlreader.h \
+    ..\..\..\wpmcpp\src\stringpool.h \
     ..\..\..\wpmcpp\src\mysqlquery.h \
     ..\..\..\wpmcpp\src\wellknownprogramsthirdpartypm.h \
     ..\..\..\wpmcpp\src\abstractthirdpartypm.h \
@@ -66,6 +72,7 @@ HEADERS += \
     ..\..\..\wpmcpp\src\controlpanelthirdpartypm.h \
     ..\..\..\wpmcpp\src\installoperation.h \
     ..\..\..\wpmcpp\src\dependency.h \
+    ..\..\..\wpmcpp\src\dependencyindex.h \
     ..\..\..\wpmcpp\src\packageversionfile.h \
     ..\..\..\wpmcpp\src\dbrepository.h \
     ..\..\..\wpmcpp\src\license.h \
@@ -80,6 +87,7 @@ HEADERS += \
     ..\..\..\wpmcpp\src\windowsregistry.h \
     ..\..\..\wpmcpp\src\packageversion.h \
     ..\..\..\wpmcpp\src\wpmutils.h \
+    ..\..\..\wpmcpp\src\processrunner.h \
     ..\..\..\wpmcpp\src\clprogress.h
 
 CONFIG += static
@@ -0,0 +1,353 @@
+#include <windows.h>
+#include <psapi.h>
+
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include <QFile>
+
+#include "app.h"
+#include "wpmutils.h"
+#include "dbrepository.h"
+#include "abstractrepository.h"
+#include "packageversion.h"
+#include "dependency.h"
+#include "httpserver.h"
+#include "phasetimer.h"
+
+App::App()
+{
+    cl.add("repositories", 'r', "number of repositories (default: 1)",
+            "number", false);
+    cl.add("packages", 'p',
+            "number of packages in each repository (default: 1000)",
+            "number", false);
+    cl.add("versions", 'v',
+            "number of versions for each package (default: 5)",
+            "number", false);
+    cl.add("fan-out", 'f',
+            "number of dependencies for each package version (default: 2)",
+            "number", false);
+    cl.add("categories", 'c',
+            "number of categories on each level (default: 10)",
+            "number", false);
+    cl.add("zip", 'z', "serve the repositories as ZIP files", "", false);
+    cl.add("latency", 'l',
+            "delay before each HTTP response in milliseconds (default: 0)",
+            "ms", false);
+    cl.add("bandwidth", 'b',
+            "bytes per second for each HTTP connection (default: unlimited)",
+            "bytes", false);
+    cl.add("binary-size", 's',
+            "size of each package binary in bytes (default: 65536)",
+            "bytes", false);
+    cl.add("install", 'i',
+            "number of packages to install and remove (default: 0)",
+            "number", false);
+    cl.add("output", 'o', "store the report in this file (JSON)", "file",
+            false);
+    cl.add("help", 'h', "print this help", "", false);
+}
+
+void App::usage()
+{
+    const char* lines[] = {
+        "Load test for F5, planning and installation using synthetic",
+        "repositories served from a local HTTP server.",
+        "Usage:",
+        "    loadtests [options]",
+        "Options:",
+    };
+    for (int i = 0; i < (int) (sizeof(lines) / sizeof(lines[0])); i++) {
+        WPMUtils::writeln(QString(lines[i]));
+    }
+
+    QStringList opts = this->cl.printOptions();
+    for (int i = 0; i < opts.count(); i++) {
+        WPMUtils::writeln(opts.at(i));
+    }
+}
+
+int App::getInt(const QString& name, int def, QString* err)
+{
+    int r = def;
+    QString v = cl.get(name);
+    if (!v.isNull()) {
+        bool ok;
+        r = v.toInt(&ok);
+        if (!ok || r < 0)
+            *err = QString("Invalid value for --%1: %2").arg(name).arg(v);
+    }
+    return r;
+}
+
+qint64 App::getPeakWorkingSet()
+{
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return pmc.PeakWorkingSetSize;
+    else
+        return -1;
+}
+
+void App::startPhase(const QString& name)
+{
+    if (!phase.isEmpty()) {
+        QJsonObject obj;
+        obj["phase"] = phase;
+        obj["ms"] = (double) phaseTimer.elapsed();
+        obj["peakWorkingSet"] = (double) getPeakWorkingSet();
+        phases.append(obj);
+
+        WPMUtils::writeln(QString("%1: %2 ms").arg(phase).
+                arg(phaseTimer.elapsed()));
+    }
+
+    phase = name;
+    phaseTimer.start();
+}
+
+QString App::planInstall(int first, int n, QList<InstallOperation*>* ops)
+{
+    QString err;
+
+    DBRepository* dbr = DBRepository::getDefault();
+
+    QList<Package*> packages;
+    for (int i = first; i < first + n; i++) {
+        Package* p = dbr->findPackage_(RepositoryGenerator::getPackageName(i));
+        if (!p) {
+            err = QString("Package %1 was not found").arg(i);
+            break;
+        }
+        packages.append(p);
+    }
+
+    if (err.isEmpty())
+        err = dbr->planUpdates(packages, QList<Dependency*>(), *ops, false,
+                true);
+
+    qDeleteAll(packages);
+
+    return err;
+}
+
+QString App::planRemove(QList<InstallOperation*>* ops)
+{
+    QString err;
+
+    AbstractRepository* ar = AbstractRepository::getDefault_();
+    QList<PackageVersion*> installed = ar->getInstalled_(&err);
+    QList<PackageVersion*> all = installed;
+
+    if (err.isEmpty()) {
+        QString prefix = RepositoryGenerator::getPackageName(0);
+        prefix.chop(1);
+        for (int i = 0; i < all.count(); i++) {
+            PackageVersion* pv = all.at(i);
+
+            // the package version could be already removed as a dependency
+            if (pv->package.startsWith(prefix) && installed.contains(pv)) {
+                err = pv->planUninstallation(installed, *ops);
+                if (!err.isEmpty())
+                    break;
+            }
+        }
+    }
+
+    qDeleteAll(all);
+
+    return err;
+}
+
+int App::run()
+{
+    QElapsedTimer total;
+    total.start();
+
+    QString err = cl.parse();
+
+    if (err.isEmpty() && cl.isPresent("help")) {
+        usage();
+        return 0;
+    }
+
+    if (err.isEmpty() && cl.getFreeArguments().count() > 0) {
+        usage();
+        err = "Unexpected arguments";
+    }
+
+    if (err.isEmpty())
+        generator.repositories = getInt("repositories", 1, &err);
+    if (err.isEmpty())
+        generator.packages = getInt("packages", 1000, &err);
+    if (err.isEmpty())
+        generator.versions = getInt("versions", 5, &err);
+    if (err.isEmpty())
+        generator.fanOut = getInt("fan-out", 2, &err);
+    if (err.isEmpty())
+        generator.categories = getInt("categories", 10, &err);
+    generator.zip = cl.isPresent("zip");
+
+    int latency = 0, bandwidth = 0, binarySize = 0, install = 0;
+    if (err.isEmpty())
+        latency = getInt("latency", 0, &err);
+    if (err.isEmpty())
+        bandwidth = getInt("bandwidth", 0, &err);
+    if (err.isEmpty())
+        binarySize = getInt("binary-size", 65536, &err);
+    if (err.isEmpty())
+        install = getInt("install", 0, &err);
+    if (err.isEmpty() && install > generator.getPackageCount())
+        err = "Cannot install more packages than available";
+
+    HTTPServer server(latency, bandwidth);
+    if (err.isEmpty()) {
+        startPhase("Starting the HTTP server");
+        err = server.startListening();
+        generator.baseURL = server.getBaseURL();
+    }
+
+    QStringList urls;
+    if (err.isEmpty()) {
+        startPhase("Generating the repositories");
+        for (int i = 0; i < generator.repositories; i++) {
+            QByteArray content = generator.generate(i, &err);
+            if (!err.isEmpty())
+                break;
+
+            server.addFile(generator.getPath(i), content);
+            urls.append(generator.baseURL + generator.getPath(i));
+        }
+        server.addPrefix("/bin/", QByteArray(binarySize, 'x'));
+    }
+
+    QTemporaryDir dir;
+    DBRepository* dbr = DBRepository::getDefault();
+    if (err.isEmpty()) {
+        startPhase("Opening the database");
+        if (!dir.isValid())
+            err = "Cannot create a temporary directory";
+        else
+            err = dbr->open("default", dir.path() + "\\Data.db");
+        dbr->useRepositories(urls);
+    }
+
+    QJsonArray f5;
+    if (err.isEmpty()) {
+        startPhase("F5");
+        Job* job = new Job("F5");
+        PhaseTimer pt(job, 2);
+        dbr->updateF5(job, false);
+        err = job->getErrorMessage();
+        f5 = pt.toJSON();
+        delete job;
+    }
+
+    // the repositories did not change. The server should only answer
+    // conditional requests with "304 Not Modified".
+    QJsonArray f5Unchanged;
+    qint64 bytesBefore = server.getBytesSent();
+    qint64 notModifiedBefore = server.getNotModified();
+    if (err.isEmpty()) {
+        startPhase("F5 (unchanged)");
+        Job* job = new Job("F5 (unchanged)");
+        PhaseTimer pt(job, 2);
+        dbr->updateF5(job, false);
+        err = job->getErrorMessage();
+        f5Unchanged = pt.toJSON();
+        delete job;
+    }
+    QJsonObject unchanged;
+    unchanged["phases"] = f5Unchanged;
+    unchanged["httpBytes"] = (double) (server.getBytesSent() - bytesBefore);
+    unchanged["notModified"] = (double) (server.getNotModified() -
+            notModifiedBefore);
+    if (err.isEmpty() && server.getNotModified() - notModifiedBefore !=
+            generator.repositories)
+        err = "The repositories were downloaded again although they did not change";
+
+    QList<InstallOperation*> ops;
+    if (err.isEmpty() && install > 0) {
+        startPhase("Planning the installation");
+
+        // the dependency tree is shallow in this part of the packages
+        int first = qMin(generator.getPackageCount() / (generator.fanOut + 2),
+                generator.getPackageCount() - install);
+        err = planInstall(first, install, &ops);
+    }
+
+    QJsonArray processPhases;
+    if (err.isEmpty() && install > 0) {
+        startPhase("Installing");
+        Job* job = new Job("Installing");
+        PhaseTimer pt(job, 1);
+        dbr->process(job, ops, WPMUtils::CLOSE_WINDOW, false, false);
+        err = job->getErrorMessage();
+        processPhases = pt.toJSON();
+        delete job;
+    }
+    qDeleteAll(ops);
+    ops.clear();
+
+    // the synthetic packages are always removed
+    if (install > 0) {
+        startPhase("Planning the removal");
+        QString e = planRemove(&ops);
+
+        if (e.isEmpty()) {
+            startPhase("Removing");
+            Job* job = new Job("Removing");
+            dbr->process(job, ops, WPMUtils::CLOSE_WINDOW, false, false);
+            e = job->getErrorMessage();
+            delete job;
+        }
+        qDeleteAll(ops);
+        ops.clear();
+
+        if (err.isEmpty())
+            err = e;
+    }
+
+    startPhase("");
+    server.stop();
+
+    QJsonObject params;
+    params["repositories"] = generator.repositories;
+    params["packages"] = generator.packages;
+    params["versions"] = generator.versions;
+    params["fanOut"] = generator.fanOut;
+    params["categories"] = generator.categories;
+    params["zip"] = generator.zip;
+    params["latency"] = latency;
+    params["bandwidth"] = bandwidth;
+    params["binarySize"] = binarySize;
+    params["install"] = install;
+
+    QJsonObject report;
+    report["parameters"] = params;
+    report["phases"] = phases;
+    report["f5"] = f5;
+    report["f5Unchanged"] = unchanged;
+    report["install"] = processPhases;
+    report["ms"] = (double) total.elapsed();
+    report["peakWorkingSet"] = (double) getPeakWorkingSet();
+    report["httpRequests"] = (double) server.getRequests();
+    report["httpBytes"] = (double) server.getBytesSent();
+    report["error"] = err;
+
+    QByteArray json = QJsonDocument(report).toJson();
+    QString output = cl.get("output");
+    if (!output.isEmpty()) {
+        QFile f(output);
+        if (!f.open(QIODevice::WriteOnly) || f.write(json) != json.length())
+            WPMUtils::writeln(QString("Cannot write %1: %2").arg(output).
+                    arg(f.errorString()), false);
+    } else {
+        WPMUtils::writeln(QString::fromUtf8(json));
+    }
+
+    if (!err.isEmpty())
+        WPMUtils::writeln(err, false);
+
+    return err.isEmpty() ? 0 : 1;
+}
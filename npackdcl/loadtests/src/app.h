@@ -0,0 +1,94 @@
+#ifndef APP_H
+#define APP_H
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QElapsedTimer>
+
+#include "commandline.h"
+#include "job.h"
+#include "installoperation.h"
+#include "repositorygenerator.h"
+
+/**
+ * @brief end-to-end load test for "F5" (DBRepository::updateF5), planning
+ *     (AbstractRepository::planUpdates) and installation
+ *     (AbstractRepository::process).
+ *
+ * Synthetic repositories and package binaries are served by a local HTTP
+ * server so that no Internet access is necessary. F5 is run twice: the
+ * second run checks that the unchanged repositories are answered with
+ * "304 Not Modified" and are not downloaded again. The repository
+ * configuration in the registry is not used or changed. The packages are
+ * installed in the normal installation directory and are removed at the end.
+ */
+class App: public QObject
+{
+    Q_OBJECT
+
+    CommandLine cl;
+
+    /** parameters for the repositories */
+    RepositoryGenerator generator;
+
+    /** phase -> milliseconds */
+    QJsonArray phases;
+
+    /** the timer for the current phase */
+    QElapsedTimer phaseTimer;
+
+    /** name of the current phase */
+    QString phase;
+
+    /**
+     * @brief starts a new phase. The previous phase is finished.
+     * @param name name of the new phase or "" if no phase should be started
+     */
+    void startPhase(const QString& name);
+
+    /**
+     * @brief reads an integer option
+     * @param name name of the option
+     * @param def default value
+     * @param err error message will be stored here
+     * @return the value
+     */
+    int getInt(const QString& name, int def, QString* err);
+
+    /**
+     * @return peak working set of this process in bytes
+     */
+    static qint64 getPeakWorkingSet();
+
+    /**
+     * @brief plans the installation of the specified packages
+     * @param first index of the first package
+     * @param n number of packages
+     * @param ops the operations will be stored here
+     * @return error message
+     */
+    static QString planInstall(int first, int n,
+            QList<InstallOperation*>* ops);
+
+    /**
+     * @brief plans the removal of all installed synthetic packages
+     * @param ops the operations will be stored here
+     * @return error message
+     */
+    static QString planRemove(QList<InstallOperation*>* ops);
+
+    void usage();
+public:
+    App();
+
+    /**
+     * @brief runs the load test
+     * @return exit code
+     */
+    int run();
+};
+
+#endif // APP_H
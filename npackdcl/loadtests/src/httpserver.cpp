@@ -0,0 +1,240 @@
+#include <QMutexLocker>
+#include <QHostAddress>
+#include <QStringList>
+#include <QCryptographicHash>
+
+#include "httpserver.h"
+
+/**
+ * @brief creates a connection object for each accepted socket. Lives in the
+ *     server thread.
+ */
+class HTTPListener: public QTcpServer
+{
+    HTTPServer* server;
+public:
+    HTTPListener(HTTPServer* server): server(server) {}
+protected:
+    void incomingConnection(qintptr socketDescriptor)
+    {
+        QTcpSocket* socket = new QTcpSocket();
+        if (socket->setSocketDescriptor(socketDescriptor)) {
+            HTTPConnection* c = new HTTPConnection(server, socket);
+
+            // the connections are destroyed together with the listener
+            c->setParent(this);
+        } else {
+            delete socket;
+        }
+    }
+};
+
+HTTPConnection::HTTPConnection(HTTPServer* server, QTcpSocket* socket):
+        server(server), socket(socket), sent(0), notModified(false)
+{
+    socket->setParent(this);
+
+    connect(socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(socket, SIGNAL(disconnected()), this, SLOT(deleteLater()));
+    connect(&timer, SIGNAL(timeout()), this, SLOT(sendChunk()));
+}
+
+void HTTPConnection::readyRead()
+{
+    // the request was already received
+    if (request.endsWith("\r\n\r\n"))
+        return;
+
+    request.append(socket->readAll());
+
+    // headers are complete. Requests with a body are not supported.
+    if (request.contains("\r\n\r\n")) {
+        request.truncate(request.indexOf("\r\n\r\n") + 4);
+        QTimer::singleShot(server->getLatency(), this, SLOT(respond()));
+    }
+}
+
+void HTTPConnection::respond()
+{
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).
+            split(' ');
+    QByteArray method = requestLine.value(0);
+    QString path = QString::fromLatin1(requestLine.value(1));
+
+    // the query is ignored
+    int q = path.indexOf('?');
+    if (q >= 0)
+        path = path.left(q);
+
+    // If-None-Match
+    QByteArray ifNoneMatch;
+    QList<QByteArray> headers = request.split('\n');
+    for (int i = 1; i < headers.count(); i++) {
+        QByteArray h = headers.at(i).trimmed();
+        if (h.toLower().startsWith("if-none-match:"))
+            ifNoneMatch = h.mid(14).trimmed();
+    }
+
+    QByteArray content;
+    QByteArray status;
+    QByteArray etag;
+    if (method != "GET" && method != "HEAD")
+        status = "405 Method Not Allowed";
+    else if (server->find(path, &content)) {
+        etag = "\"" + QCryptographicHash::hash(content,
+                QCryptographicHash::Sha1).toHex() + "\"";
+        if (ifNoneMatch == etag) {
+            status = "304 Not Modified";
+            content.clear();
+            notModified = true;
+        } else {
+            status = "200 OK";
+        }
+    } else
+        status = "404 Not Found";
+
+    response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: application/octet-stream\r\n";
+    if (!etag.isEmpty())
+        response.append("ETag: " + etag + "\r\n");
+    if (!notModified)
+        response.append("Content-Length: " +
+                QByteArray::number(content.length()) + "\r\n");
+    response.append("Connection: close\r\n\r\n");
+    if (method == "GET")
+        response.append(content);
+
+    if (server->getBandwidth() > 0) {
+        timer.start(CHUNK_INTERVAL);
+        sendChunk();
+    } else {
+        socket->write(response);
+        server->sent(response.length(), notModified);
+        socket->disconnectFromHost();
+    }
+}
+
+void HTTPConnection::sendChunk()
+{
+    int chunk = qMax(1, server->getBandwidth() * CHUNK_INTERVAL / 1000);
+    int n = qMin(chunk, response.length() - sent);
+    socket->write(response.constData() + sent, n);
+    sent += n;
+
+    if (sent == response.length()) {
+        timer.stop();
+        server->sent(response.length(), notModified);
+        socket->disconnectFromHost();
+    }
+}
+
+HTTPServer::HTTPServer(int latency, int bandwidth): latency(latency),
+        bandwidth(bandwidth), port(0), requests(0), bytesSent(0),
+        notModified(0)
+{
+}
+
+void HTTPServer::addFile(const QString& path, const QByteArray& content)
+{
+    QMutexLocker ml(&mutex);
+    files.insert(path, content);
+}
+
+void HTTPServer::addPrefix(const QString& prefix, const QByteArray& content)
+{
+    QMutexLocker ml(&mutex);
+    prefixes.insert(prefix, content);
+}
+
+bool HTTPServer::find(const QString& path, QByteArray* content) const
+{
+    QMutexLocker ml(&mutex);
+
+    QMap<QString, QByteArray>::const_iterator it = files.find(path);
+    if (it != files.end()) {
+        *content = it.value();
+        return true;
+    }
+
+    for (it = prefixes.begin(); it != prefixes.end(); ++it) {
+        if (path.startsWith(it.key())) {
+            *content = it.value();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void HTTPServer::sent(qint64 bytes, bool notModified)
+{
+    QMutexLocker ml(&mutex);
+    requests++;
+    bytesSent += bytes;
+    if (notModified)
+        this->notModified++;
+}
+
+void HTTPServer::run()
+{
+    HTTPListener listener(this);
+
+    mutex.lock();
+    if (listener.listen(QHostAddress::LocalHost, 0))
+        port = listener.serverPort();
+    else
+        error = listener.errorString();
+    listening.wakeAll();
+    mutex.unlock();
+
+    if (listener.isListening())
+        exec();
+}
+
+QString HTTPServer::startListening()
+{
+    QMutexLocker ml(&mutex);
+    start();
+    listening.wait(&mutex);
+    return error;
+}
+
+void HTTPServer::stop()
+{
+    quit();
+    wait();
+}
+
+QString HTTPServer::getBaseURL() const
+{
+    QMutexLocker ml(&mutex);
+    return "http://127.0.0.1:" + QString::number(port);
+}
+
+qint64 HTTPServer::getRequests() const
+{
+    QMutexLocker ml(&mutex);
+    return requests;
+}
+
+qint64 HTTPServer::getBytesSent() const
+{
+    QMutexLocker ml(&mutex);
+    return bytesSent;
+}
+
+qint64 HTTPServer::getNotModified() const
+{
+    QMutexLocker ml(&mutex);
+    return notModified;
+}
+
+int HTTPServer::getLatency() const
+{
+    return latency;
+}
+
+int HTTPServer::getBandwidth() const
+{
+    return bandwidth;
+}
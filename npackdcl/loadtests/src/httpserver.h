@@ -0,0 +1,158 @@
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QMap>
+#include <QByteArray>
+#include <QString>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+class HTTPServer;
+
+/**
+ * @brief one HTTP connection. The request is answered after the configured
+ *     latency and the response is sent with the configured bandwidth.
+ */
+class HTTPConnection: public QObject
+{
+    Q_OBJECT
+
+    /** interval between two chunks of data in milliseconds */
+    static const int CHUNK_INTERVAL = 50;
+
+    HTTPServer* server;
+    QTcpSocket* socket;
+    QByteArray request;
+    QByteArray response;
+    int sent;
+
+    /** true if the response is "304 Not Modified" */
+    bool notModified;
+    QTimer timer;
+public:
+    /**
+     * @param server the server
+     * @param socket [ownership:this] connected socket
+     */
+    HTTPConnection(HTTPServer* server, QTcpSocket* socket);
+private slots:
+    void readyRead();
+    void respond();
+    void sendChunk();
+};
+
+/**
+ * @brief a minimal HTTP/1.1 server for the load tests. Only GET and HEAD are
+ *     supported. Every response contains an ETag (SHA-1 of the content) and
+ *     a matching If-None-Match is answered with "304 Not Modified". Every
+ *     connection is closed after one response. The server
+ *     runs its own event loop in a separate thread so that it can answer
+ *     while the tested code blocks the main thread.
+ */
+class HTTPServer: public QThread
+{
+    Q_OBJECT
+
+    friend class HTTPConnection;
+
+    mutable QMutex mutex;
+    QWaitCondition listening;
+
+    /** path -> content */
+    QMap<QString, QByteArray> files;
+
+    /** path prefix -> content */
+    QMap<QString, QByteArray> prefixes;
+
+    int latency;
+    int bandwidth;
+    quint16 port;
+    QString error;
+    qint64 requests;
+    qint64 bytesSent;
+    qint64 notModified;
+
+    /**
+     * @param path requested path
+     * @param content the content will be stored here
+     * @return true if the path was found
+     */
+    bool find(const QString& path, QByteArray* content) const;
+
+    /**
+     * @brief counts a response
+     * @param bytes number of bytes sent
+     * @param notModified true for "304 Not Modified"
+     */
+    void sent(qint64 bytes, bool notModified);
+protected:
+    void run();
+public:
+    /**
+     * @param latency delay before each response in milliseconds
+     * @param bandwidth bytes per second for each connection or 0 for
+     *     "unlimited"
+     */
+    HTTPServer(int latency, int bandwidth);
+
+    /**
+     * @brief defines the content for a path
+     * @param path path like "/rep0/Rep.xml"
+     * @param content file content
+     */
+    void addFile(const QString& path, const QByteArray& content);
+
+    /**
+     * @brief defines the content for all paths with the specified prefix
+     * @param prefix path prefix like "/bin/"
+     * @param content file content
+     */
+    void addPrefix(const QString& prefix, const QByteArray& content);
+
+    /**
+     * @brief starts the server thread and waits until it listens
+     * @return error message
+     */
+    QString startListening();
+
+    /**
+     * @brief stops the server and waits for the thread to end
+     */
+    void stop();
+
+    /**
+     * @return "http://127.0.0.1:<port>"
+     */
+    QString getBaseURL() const;
+
+    /**
+     * @return number of answered requests
+     */
+    qint64 getRequests() const;
+
+    /**
+     * @return number of sent bytes
+     */
+    qint64 getBytesSent() const;
+
+    /**
+     * @return number of "304 Not Modified" responses
+     */
+    qint64 getNotModified() const;
+
+    /**
+     * @return latency in milliseconds
+     */
+    int getLatency() const;
+
+    /**
+     * @return bytes per second or 0
+     */
+    int getBandwidth() const;
+};
+
+#endif // HTTPSERVER_H
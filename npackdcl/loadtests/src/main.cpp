@@ -0,0 +1,26 @@
+#include <windows.h>
+#include <QCoreApplication>
+
+#include "abstractrepository.h"
+#include "dbrepository.h"
+#include "version.h"
+
+#include "app.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication ca(argc, argv);
+
+    AbstractRepository::setDefault_(DBRepository::getDefault());
+
+    CoInitializeEx(0, COINIT_MULTITHREADED);
+
+    qRegisterMetaType<Version>("Version");
+
+    App app;
+    int r = app.run();
+
+    CoUninitialize();
+
+    return r;
+}
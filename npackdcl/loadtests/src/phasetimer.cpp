@@ -0,0 +1,76 @@
+#include <QMutexLocker>
+#include <QJsonObject>
+
+#include "phasetimer.h"
+
+PhaseWatcher::PhaseWatcher(PhaseTimer* timer, int index): timer(timer),
+        index(index)
+{
+    elapsed.start();
+}
+
+void PhaseWatcher::jobCompleted()
+{
+    timer->completed(index, elapsed.elapsed());
+}
+
+PhaseTimer::PhaseTimer(Job* job, int maxLevel): maxLevel(maxLevel)
+{
+    titles.insert(job, job->getTitle());
+
+    // the sub-jobs are created in different threads
+    connect(job, SIGNAL(subJobCreated(Job*)), this,
+            SLOT(subJobCreated(Job*)), Qt::DirectConnection);
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    qDeleteAll(watchers);
+}
+
+void PhaseTimer::subJobCreated(Job* sub)
+{
+    int level = sub->getLevel();
+    QString subTitle = sub->getTitle();
+
+    QMutexLocker ml(&mutex);
+
+    QString title = titles.value(sub->parentJob) + " / " + subTitle;
+    titles.insert(sub, title);
+
+    if (level <= maxLevel) {
+        Phase p;
+        p.title = title;
+        p.level = level;
+        p.ms = -1;
+        phases.append(p);
+
+        PhaseWatcher* w = new PhaseWatcher(this, phases.count() - 1);
+        watchers.append(w);
+        connect(sub, SIGNAL(jobCompleted()), w, SLOT(jobCompleted()),
+                Qt::DirectConnection);
+    }
+}
+
+void PhaseTimer::completed(int index, qint64 ms)
+{
+    QMutexLocker ml(&mutex);
+    phases[index].ms = ms;
+}
+
+QJsonArray PhaseTimer::toJSON()
+{
+    QMutexLocker ml(&mutex);
+
+    QJsonArray r;
+    for (int i = 0; i < phases.count(); i++) {
+        const Phase& p = phases.at(i);
+        QJsonObject obj;
+        obj["phase"] = p.title;
+        obj["level"] = p.level;
+        obj["ms"] = (double) p.ms;
+        r.append(obj);
+    }
+
+    return r;
+}
@@ -0,0 +1,87 @@
+#ifndef PHASETIMER_H
+#define PHASETIMER_H
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QElapsedTimer>
+#include <QJsonArray>
+
+#include "job.h"
+
+class PhaseTimer;
+
+/**
+ * @brief measures the time of one sub-job
+ */
+class PhaseWatcher: public QObject
+{
+    Q_OBJECT
+
+    PhaseTimer* timer;
+    int index;
+    QElapsedTimer elapsed;
+public:
+    /**
+     * @param timer the results are reported here
+     * @param index index of the phase in the timer
+     */
+    PhaseWatcher(PhaseTimer* timer, int index);
+public slots:
+    void jobCompleted();
+};
+
+/**
+ * @brief measures the time of all sub-jobs of a job up to the specified
+ *     level. The sub-jobs may be created and completed in any thread.
+ */
+class PhaseTimer: public QObject
+{
+    Q_OBJECT
+
+    friend class PhaseWatcher;
+
+    class Phase
+    {
+    public:
+        /** "title 1 / title 2 / ..." as it was when the job was created */
+        QString title;
+
+        /** level of the job (1 = sub-job of the top job) */
+        int level;
+
+        /** duration in milliseconds or -1 if not yet completed */
+        qint64 ms;
+    };
+
+    int maxLevel;
+
+    QMutex mutex;
+    QList<Phase> phases;
+    QList<PhaseWatcher*> watchers;
+
+    /** job -> "title 1 / title 2 / ..." */
+    QHash<Job*, QString> titles;
+
+    void completed(int index, qint64 ms);
+public:
+    /**
+     * @param job top-level job
+     * @param maxLevel sub-jobs with the level up to this value are measured
+     */
+    PhaseTimer(Job* job, int maxLevel);
+
+    ~PhaseTimer();
+
+    /**
+     * @return [{"phase": "...", "level": 1, "ms": 123}, ...] in the order the
+     *     sub-jobs were created
+     */
+    QJsonArray toJSON();
+private slots:
+    void subJobCreated(Job* sub);
+};
+
+#endif // PHASETIMER_H
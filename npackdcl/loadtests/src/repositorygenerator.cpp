@@ -0,0 +1,122 @@
+#include <QBuffer>
+#include <QXmlStreamWriter>
+
+#include "quazip.h"
+#include "quazipfile.h"
+
+#include "repositorygenerator.h"
+
+RepositoryGenerator::RepositoryGenerator(): repositories(1), packages(1000),
+        versions(5), fanOut(2), categories(10), zip(false)
+{
+}
+
+int RepositoryGenerator::getPackageCount() const
+{
+    return repositories * packages;
+}
+
+QString RepositoryGenerator::getPackageName(int index)
+{
+    return QString("org.example.loadtest.Package%1").arg(index);
+}
+
+QString RepositoryGenerator::getPath(int index) const
+{
+    return QString("/rep%1/Rep.%2").arg(index).arg(zip ? "zip" : "xml");
+}
+
+QByteArray RepositoryGenerator::generate(int index, QString* err) const
+{
+    *err = "";
+
+    int total = getPackageCount();
+    int first = index * packages;
+
+    QByteArray xml;
+    QXmlStreamWriter w(&xml);
+    w.setAutoFormatting(true);
+    w.writeStartDocument();
+    w.writeStartElement("root");
+    w.writeTextElement("spec-version", "3");
+
+    w.writeStartElement("license");
+    w.writeAttribute("name", "org.example.loadtest.License");
+    w.writeTextElement("title", "Load test license");
+    w.writeEndElement();
+
+    for (int i = first; i < first + packages; i++) {
+        w.writeStartElement("package");
+        w.writeAttribute("name", getPackageName(i));
+        w.writeTextElement("title", QString("Load test package %1").arg(i));
+        w.writeTextElement("description", QString(
+                "Synthetic package number %1 in the repository %2").
+                arg(i).arg(index));
+        w.writeTextElement("url", baseURL + QString("/package/%1").arg(i));
+        w.writeTextElement("license", "org.example.loadtest.License");
+        if (categories > 0)
+            w.writeTextElement("category", QString("Category%1/Sub%2").
+                    arg(i % categories).arg((i / categories) % categories));
+        w.writeEndElement();
+    }
+
+    for (int i = first; i < first + packages; i++) {
+        QString name = getPackageName(i);
+        for (int j = 0; j < versions; j++) {
+            QString version = QString("%1.%2").arg(j + 1).arg(i % 10);
+
+            w.writeStartElement("version");
+            w.writeAttribute("name", version);
+            w.writeAttribute("package", name);
+            w.writeAttribute("type", "one-file");
+            w.writeTextElement("url", baseURL + "/bin/" + name + "-" +
+                    version + ".bin");
+            for (int k = 1; k <= fanOut; k++) {
+                int d = i * fanOut + k;
+                if (d >= total)
+                    break;
+
+                w.writeStartElement("dependency");
+                w.writeAttribute("package", getPackageName(d));
+                w.writeAttribute("versions", "[1, 1000)");
+                w.writeEndElement();
+            }
+            w.writeEndElement();
+        }
+    }
+
+    w.writeEndElement();
+    w.writeEndDocument();
+
+    if (zip)
+        return createZIP(xml, err);
+    else
+        return xml;
+}
+
+QByteArray RepositoryGenerator::createZIP(const QByteArray& xml,
+        QString* err)
+{
+    *err = "";
+
+    QBuffer buffer;
+    QuaZip zip(&buffer);
+    if (!zip.open(QuaZip::mdCreate))
+        *err = QObject::tr("Cannot create a ZIP file: %1").
+                arg(zip.getZipError());
+
+    if (err->isEmpty()) {
+        QuaZipFile file(&zip);
+        if (file.open(QIODevice::WriteOnly, QuaZipNewInfo("Rep.xml"))) {
+            if (file.write(xml) != xml.length())
+                *err = file.errorString();
+            file.close();
+        } else {
+            *err = QObject::tr("Cannot add Rep.xml to the ZIP file: %1").
+                    arg(file.getZipError());
+        }
+        zip.close();
+    }
+
+    return buffer.data();
+}
@@ -0,0 +1,75 @@
+#ifndef REPOSITORYGENERATOR_H
+#define REPOSITORYGENERATOR_H
+
+#include <QString>
+#include <QByteArray>
+
+/**
+ * @brief generates synthetic repositories for the load tests.
+ *
+ * The packages are numbered from 0 to getPackageCount() - 1 and distributed
+ * over the repositories in blocks. The dependencies form a tree: the
+ * package i depends on the packages i * fanOut + 1 ... i * fanOut + fanOut
+ * if they exist. All versions are of the type "one-file" and are downloaded
+ * from "<base URL>/bin/...".
+ */
+class RepositoryGenerator
+{
+public:
+    /** number of repositories */
+    int repositories;
+
+    /** number of packages in each repository */
+    int packages;
+
+    /** number of versions for each package */
+    int versions;
+
+    /** number of dependencies for each package version */
+    int fanOut;
+
+    /** number of categories on each level */
+    int categories;
+
+    /** true = the repositories are stored in ZIP files */
+    bool zip;
+
+    /** base URL like "http://127.0.0.1:8080" */
+    QString baseURL;
+
+    RepositoryGenerator();
+
+    /**
+     * @return number of packages in all repositories
+     */
+    int getPackageCount() const;
+
+    /**
+     * @param index index of the package
+     * @return full package name
+     */
+    static QString getPackageName(int index);
+
+    /**
+     * @param index index of the repository
+     * @return path for the repository like "/rep0/Rep.xml"
+     */
+    QString getPath(int index) const;
+
+    /**
+     * @param index index of the repository
+     * @param err error message will be stored here
+     * @return content for getPath(index). This is either a Rep.xml or a ZIP
+     *     file with Rep.xml inside.
+     */
+    QByteArray generate(int index, QString* err) const;
+
+    /**
+     * @param xml content of Rep.xml
+     * @param err error message will be stored here
+     * @return ZIP file with one entry named Rep.xml
+     */
+    static QByteArray createZIP(const QByteArray& xml, QString* err);
+};
+
+#endif // REPOSITORYGENERATOR_H
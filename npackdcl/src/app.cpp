@@ -15,7 +15,10 @@
 #include "installedpackageversion.h"
 #include "abstractrepository.h"
 #include "dbrepository.h"
+#include "dependencyindex.h"
 #include "hrtimer.h"
+#include "service.h"
+#include "serviceprotocol.h"
 
 static bool compareByPackageTitle(const QPair<PackageVersion*, QString>& e1,
         const QPair<PackageVersion*, QString>& e2) {
@@ -61,8 +64,20 @@ QStringList App::sortPackageVersionsByPackageTitle(
     return titles;
 }
 
-int App::process()
+bool App::readOnlyDatabaseOpen = false;
+
+bool App::installedPackagesCurrent = false;
+
+App::App(): debug(false), interactive(true), forClient(false),
+        serviceStarted(false)
 {
+}
+
+void App::addOptions()
+{
+    cl.add("bandwidth", 0,
+            "maximum download speed in KiB/s (0 = unlimited)",
+            "KiB/s", false, "prefetch");
     cl.add("bare-format", 'b', "bare format (no heading or summary)",
             "", false, "list,list-repos,search,install-dir,which,where,info");
     cl.add("debug", 'd', "turn on the debug output", "", false);
@@ -85,6 +100,9 @@ int App::process()
             "package", true, "add,info,path,place,remove,update,rm");
     cl.add("query", 'q', "search terms (e.g. editor)",
             "search terms", false, "search");
+    cl.add("sql-stats", 0,
+            "save the statistics for the executed SQL statements in a JSON file",
+            "file", false);
     cl.add("status", 's', "filters package versions by status",
             "status", false, "list,search");
     cl.add("url", 'u', "repository URL (e.g. https://www.example.com/Rep.xml)",
@@ -93,16 +111,76 @@ int App::process()
             "version", false, "add,info,path,place,rm,remove");
     cl.add("versions", 'r', "versions range (e.g. [1.5,2))",
             "range", true, "add,path,update");
+}
+
+int App::process()
+{
+    addOptions();
 
     QString err = cl.parse();
+
+    // cl.dump();
+
+    // the read-only commands are executed by the service if it is running.
+    // The debug output and the SQL statistics are only available locally.
+    QStringList fr = cl.getFreeArguments();
+    if (err.isEmpty() && fr.count() == 1 &&
+            ServiceProtocol::isServed(fr.at(0)) &&
+            !cl.isPresent("debug") && !cl.isPresent("sql-stats")) {
+        QStringList args = ServiceProtocol::createRequest(cl);
+
+        int r;
+        QString out, errOut;
+        if (Service::call(args, &r, &out, &errOut)) {
+            WPMUtils::outputTextConsole(out);
+            if (!errOut.isEmpty())
+                WPMUtils::outputTextConsole(errOut, false);
+
+            QCoreApplication::instance()->exit(r);
+            return r;
+        }
+    }
+
+    int r = execute(err);
+
+    // the service runs until the process is terminated
+    if (!serviceStarted)
+        QCoreApplication::instance()->exit(r);
+
+    return r;
+}
+
+int App::processRequest(const QStringList& args, QString* out,
+        QString* errOut)
+{
+    forClient = true;
+
+    addOptions();
+
+    QString err = cl.parse(args);
+    if (err.isEmpty()) {
+        QStringList fr = cl.getFreeArguments();
+        if (fr.count() == 1 && !ServiceProtocol::isServed(fr.at(0)))
+            err = "The command " + fr.at(0) +
+                    " cannot be executed by the service";
+    }
+
+    WPMUtils::captureOutput(out, errOut);
+    int r = execute(err);
+    WPMUtils::captureOutput(0, 0);
+
+    return r;
+}
+
+int App::execute(QString err)
+{
     if (!err.isEmpty()) {
         err = "Error: " + err;
     }
 
-    // cl.dump();
-
     if (err.isEmpty()) {
-        this->interactive = !cl.isPresent("non-interactive");
+        // there is nobody to answer questions for the service
+        this->interactive = !cl.isPresent("non-interactive") && !forClient;
 
         this->debug = cl.isPresent("debug");
 
@@ -111,6 +189,9 @@ int App::process()
             MySQLQuery::debug = true;
             Downloader::debug = true;
         }
+
+        if (cl.isPresent("sql-stats"))
+            MySQLQuery::collectStatistics.store(1);
     }
 
     QStringList fr = cl.getFreeArguments();
@@ -138,7 +219,7 @@ int App::process()
         }
 
         Job* job;
-        if (cl.isPresent("bare-format") || cl.isPresent("json"))
+        if (cl.isPresent("bare-format") || cl.isPresent("json") || forClient)
             job = new Job();
         else
             job = clp.createJob();
@@ -177,12 +258,16 @@ int App::process()
             info(job);
         } else if (cmd == "update") {
             update(job);
+        } else if (cmd == "prefetch") {
+            prefetch(job);
         } else if (cmd == "detect") {
             detect(job);
         } else if (cmd == "set-install-dir") {
             setInstallPath(job);
         } else if (cmd == "install-dir") {
             getInstallPath(job);
+        } else if (cmd == "service") {
+            service(job);
         } else {
             job->setErrorMessage("Wrong command: " + cmd +
                     ". Try npackdcl help");
@@ -191,6 +276,12 @@ int App::process()
         err = job->getErrorMessage();
 
         delete job;
+
+        if (cl.isPresent("sql-stats")) {
+            QString e = saveSQLStatistics(cl.get("sql-stats"));
+            if (err.isEmpty())
+                err = e;
+        }
     }
 
     int r = 0;
@@ -201,11 +292,58 @@ int App::process()
         WPMUtils::writeln(err, false);
     }
 
-    QCoreApplication::instance()->exit(r);
-
     return r;
 }
 
+QString App::openReadOnlyDatabase()
+{
+    QString err;
+
+    // the service keeps the database open
+    if (!readOnlyDatabaseOpen) {
+        err = DBRepository::getDefault()->openDefault("default", true);
+        if (err.isEmpty())
+            readOnlyDatabaseOpen = true;
+    }
+
+    return err;
+}
+
+QString App::readInstalledPackages()
+{
+    // the service only reads the registry again if it was changed
+    if (installedPackagesCurrent)
+        return "";
+
+    return InstalledPackages::getDefault()->readRegistryDatabase();
+}
+
+void App::service(Job* job)
+{
+    job->setTitle("Starting the service");
+
+    if (job->shouldProceed()) {
+        QString err = openReadOnlyDatabase();
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        Service* s = new Service(this);
+        QString err = s->start();
+        if (err.isEmpty()) {
+            serviceStarted = true;
+            WPMUtils::writeln(QString(
+                    "The service is running. Press Ctrl+C to stop it."));
+        } else {
+            job->setErrorMessage(err);
+            delete s;
+        }
+    }
+
+    job->complete();
+}
+
 void App::printJSON(const QJsonObject &obj)
 {
     // WPMUtils::writeln does not work for very long texts
@@ -222,6 +360,28 @@ void App::printJSON(const QJsonObject &obj)
     }
 }
 
+QString App::saveSQLStatistics(const QString& filename)
+{
+    QString err;
+
+    QJsonDocument d(MySQLQuery::getStatistics());
+
+    QFile f(filename);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        err = f.errorString();
+    else {
+        if (f.write(d.toJson(QJsonDocument::Indented)) == -1)
+            err = f.errorString();
+        f.close();
+    }
+
+    if (!err.isEmpty())
+        err = QString("Cannot save the SQL statistics in %1: %2").
+                arg(filename, err);
+
+    return err;
+}
+
 QString App::addNpackdCL()
 {
     QString err;
@@ -285,6 +445,11 @@ void App::usage(Job* job)
         "    ncl place --package=<package>",
         "            --version=<version> --file=<directory>",
         "        registers a package version installed without Npackd",
+        "    ncl prefetch [--bandwidth=<KiB/s>]",
+        "        downloads the binaries of the available updates in the",
+        "        background. A following \"update\" uses the downloaded files",
+        "        without network access. This command can be started",
+        "        regularly by the Windows task scheduler.",
         "    ncl remove|rm (--package=<package> [--version=<version>])+",
         "           [--end-process=<types>]",
         "        removes packages. The version number may be omitted, ",
@@ -297,6 +462,9 @@ void App::usage(Job* job)
         "            [--bare-format | --json]",
         "        full text search. Lists found packages sorted by package name.",
         "        All packages are shown by default.",
+        "    ncl service",
+        "        keeps the data in memory and executes the commands info, list,",
+        "        path, search, where and which for other ncl processes",
         "    ncl set-install-dir [--file=<directory>]",
         "        changes the directory where packages will be installed. The",
         "        default directory for program files is used if the --file",
@@ -395,13 +563,13 @@ void App::which(Job* job)
 
     InstalledPackages* ip = InstalledPackages::getDefault();
     if (job->shouldProceed()) {
-        QString r = ip->readRegistryDatabase();
+        QString r = readInstalledPackages();
         if (!r.isEmpty())
             job->setErrorMessage(r);
     }
 
     if (job->shouldProceed()) {
-        QString r = DBRepository::getDefault()->openDefault("default", true);
+        QString r = openReadOnlyDatabase();
         if (!r.isEmpty())
             job->setErrorMessage(r);
     }
@@ -461,7 +629,7 @@ void App::where(Job* job)
 {
     InstalledPackages* ip = InstalledPackages::getDefault();
     if (job->shouldProceed()) {
-        QString r = ip->readRegistryDatabase();
+        QString r = readInstalledPackages();
         if (!r.isEmpty())
             job->setErrorMessage(r);
     }
@@ -579,18 +747,20 @@ void App::check(Job* job)
 
         job->setProgress(1);
 
+        // the installed versions unknown to the repository are only
+        // consulted for dependencies not satisfied by the list
+        DependencyIndex index(list);
+        const QList<DependencyIndex::Edge*>& edges = index.getEdges();
         int n = 0;
-        for (int i = 0; i < list.count(); i++) {
-            PackageVersion* pv = list.at(i);
-            for (int j = 0; j < pv->dependencies.count(); j++) {
-                Dependency* d = pv->dependencies.at(j);
-                if (!ip->isInstalled(*d)) {
-                    WPMUtils::writeln(QString(
-                            "%1 depends on %2, which is not installed").
-                            arg(pv->toString(true)).
-                            arg(rep->toString(*d, true)));
-                    n++;
-                }
+        for (int i = 0; i < edges.count(); i++) {
+            DependencyIndex::Edge* e = edges.at(i);
+            Dependency* d = e->dependency;
+            if (e->satisfied == 0 && !ip->isInstalled(*d)) {
+                WPMUtils::writeln(QString(
+                        "%1 depends on %2, which is not installed").
+                        arg(e->owner->toString(true)).
+                        arg(rep->toString(*d, true)));
+                n++;
             }
         }
 
@@ -706,7 +876,7 @@ void App::list(Job* job)
     job->setTitle("Listing package versions");
 
     if (job->shouldProceed()) {
-        QString err = DBRepository::getDefault()->openDefault("default", true);
+        QString err = openReadOnlyDatabase();
         if (!err.isEmpty())
             job->setErrorMessage(err);
     }
@@ -714,8 +884,7 @@ void App::list(Job* job)
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.01,
                 "Reading list of installed packages from the registry");
-        InstalledPackages* ip = InstalledPackages::getDefault();
-        QString err = ip->readRegistryDatabase();
+        QString err = readInstalledPackages();
         if (!err.isEmpty())
             job->setErrorMessage(err);
         else
@@ -728,10 +897,13 @@ void App::list(Job* job)
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.99,
                 "Getting the list of installed packages from the registry");
-        AbstractRepository* rep = AbstractRepository::getDefault_();
+        DBRepository* rep = DBRepository::getDefault();
 
-        QString err;
-        list = rep->getInstalled_(&err);
+        QString err = rep->beginSnapshot();
+        if (err.isEmpty()) {
+            list = rep->getInstalled_(&err);
+            rep->endSnapshot();
+        }
         if (err.isEmpty()) {
             titles = sortPackageVersionsByPackageTitle(&list);
             sub->completeWithProgress();
@@ -787,7 +959,7 @@ void App::search(Job* job)
     job->setTitle("Searching for packages");
 
     if (job->shouldProceed()) {
-        QString err = DBRepository::getDefault()->openDefault("default", true);
+        QString err = openReadOnlyDatabase();
         if (!err.isEmpty())
             job->setErrorMessage(err);
     }
@@ -811,14 +983,24 @@ void App::search(Job* job)
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.96,
                 "Reading list of installed packages from the registry");
-        InstalledPackages* ip = InstalledPackages::getDefault();
-        QString err = ip->readRegistryDatabase();
+        QString err = readInstalledPackages();
         if (!err.isEmpty())
             job->setErrorMessage(err);
         else
             sub->completeWithProgress();
     }
 
+    // both queries should see the same data even if the database is being
+    // updated in parallel
+    bool snapshot = false;
+    if (job->shouldProceed()) {
+        QString err = rep->beginSnapshot();
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+        else
+            snapshot = true;
+    }
+
     QStringList packageNames;
     QList<Package*> list;
     if (job->shouldProceed()) {
@@ -842,6 +1024,9 @@ void App::search(Job* job)
             sub->completeWithProgress();
     }
 
+    if (snapshot)
+        rep->endSnapshot();
+
     if (job->shouldProceed()) {
         qSort(list.begin(), list.end(), packageLessThan);
 
@@ -986,7 +1171,7 @@ void App::path(Job* job)
     }
 
     if (job->shouldProceed() && path.isEmpty() && !package.contains('.')) {
-        QString err = DBRepository::getDefault()->openDefault("default", true);
+        QString err = openReadOnlyDatabase();
         if (err.isEmpty()) {
             Package* p = AbstractRepository::findOnePackage(package, &err);
             if (!err.isEmpty()) {
@@ -1149,6 +1334,54 @@ void App::place(Job* job)
     job->complete();
 }
 
+void App::prefetch(Job* job)
+{
+    job->setTitle("Downloading the available updates");
+
+    // the downloads should not disturb other programs
+    SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_BEGIN);
+
+    if (job->shouldProceed()) {
+        QString err = DBRepository::getDefault()->openDefault();
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        QString err = InstalledPackages::getDefault()->readRegistryDatabase();
+        if (!err.isEmpty()) {
+            job->setErrorMessage(err);
+        } else {
+            job->setProgress(0.05);
+        }
+    }
+
+    DWORD kibPerSecond;
+    WPMUtils::getPrefetchUpdates(&kibPerSecond);
+    QString bandwidth = cl.get("bandwidth");
+    if (job->shouldProceed() && !bandwidth.isNull()) {
+        bool ok;
+        kibPerSecond = bandwidth.toUInt(&ok);
+        if (!ok)
+            job->setErrorMessage("Invalid download speed: " + bandwidth);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(0.95, "Downloading");
+        DBRepository::getDefault()->prefetchUpdates(sub,
+                ((qint64) kibPerSecond) * 1024);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed())
+        WPMUtils::writeln("The updates were downloaded successfully");
+
+    SetPriorityClass(GetCurrentProcess(), PROCESS_MODE_BACKGROUND_END);
+
+    job->complete();
+}
+
 void App::update(Job* job)
 {
     DBRepository* rep = DBRepository::getDefault();
@@ -1780,14 +2013,13 @@ void App::info(Job* job)
     job->setTitle("Showing information");
 
     if (job->shouldProceed()) {
-        QString err = DBRepository::getDefault()->openDefault("default", true);
+        QString err = openReadOnlyDatabase();
         if (!err.isEmpty())
             job->setErrorMessage(err);
     }
 
     if (job->shouldProceed()) {
-        InstalledPackages* ip = InstalledPackages::getDefault();
-        QString err = ip->readRegistryDatabase();
+        QString err = readInstalledPackages();
         if (!err.isEmpty())
             job->setErrorMessage(err);
         else
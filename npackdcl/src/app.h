@@ -24,8 +24,47 @@ private:
     bool debug;
     bool interactive;
 
+    /** true = the command is executed by the service for a client */
+    bool forClient;
+
+    /** true = the service was started and the process should not exit */
+    bool serviceStarted;
+
+    /** true if openReadOnlyDatabase() was successful */
+    static bool readOnlyDatabaseOpen;
+
+    void addOptions();
+
+    /**
+     * @brief executes the parsed command line
+     * @param err error message from parsing the command line
+     * @return exit code
+     */
+    int execute(QString err);
+
+    /**
+     * @brief opens the database for the read-only commands if it is not yet
+     *     open
+     * @return error message
+     */
+    QString openReadOnlyDatabase();
+
+    /**
+     * @brief reads the installed packages from the registry if necessary
+     *     (see installedPackagesCurrent)
+     * @return error message
+     */
+    QString readInstalledPackages();
+
     static void printJSON(const QJsonObject & obj);
 
+    /**
+     * @brief saves the statistics collected by MySQLQuery
+     * @param filename output JSON file
+     * @return error message
+     */
+    static QString saveSQLStatistics(const QString& filename);
+
     /**
      * @brief defines the NPACKD_CL variable and adds the NpackdCL package to
      *     the local repository
@@ -45,6 +84,7 @@ private:
     void list(Job *job);
     void info(Job *job);
     void update(Job *job);
+    void prefetch(Job *job);
     void detect(Job *job);
     void listRepos(Job *job);
     void which(Job *job);
@@ -52,6 +92,7 @@ private:
     void check(Job *job);
     void getInstallPath(Job *job);
     void setInstallPath(Job *job);
+    void service(Job *job);
 
     bool confirm(const QList<InstallOperation *> ops, QString *title,
             QString *err);
@@ -62,6 +103,27 @@ private:
             bool interactive=true);
     QStringList sortPackageVersionsByPackageTitle(
             QList<PackageVersion *> *list);
+public:
+    /**
+     * true if InstalledPackages contains the current data from the registry
+     * and readInstalledPackages() does not need to read it. This is only
+     * managed by the service.
+     */
+    static bool installedPackagesCurrent;
+
+    App();
+
+    /**
+     * Executes one command for a client of the service. The output is
+     * returned instead of being printed.
+     *
+     * @param args command line arguments without the program name
+     * @param out the output for stdout will be stored here
+     * @param errOut the output for stderr will be stored here
+     * @return exit code
+     */
+    int processRequest(const QStringList& args, QString* out,
+            QString* errOut);
 public slots:
     /**
      * Process the command line.
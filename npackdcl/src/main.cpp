@@ -11,6 +11,7 @@
 #include "dbrepository.h"
 #include "version.h"
 #include "installedpackages.h"
+#include "downloader.h"
 
 #include "app.h"
 
@@ -33,6 +34,10 @@ int main(int argc, char *argv[])
 
     QTimer::singleShot(0, &app, SLOT(process()));
 
-    return ca.exec();
+    int r = ca.exec();
+
+    Downloader::closeInternetSession();
+
+    return r;
 }
 
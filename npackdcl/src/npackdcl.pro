@@ -4,7 +4,7 @@ DEFINES += QT_NO_DEBUG_OUTPUT
 
 PRECOMPILED_HEADER = stable.h
 
-QT += xml sql
+QT += xml sql network
 QT -= gui
 
 TARGET = npackdcl
@@ -32,12 +32,16 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/job.cpp \
     ../../wpmcpp/src/installoperation.cpp \
     ../../wpmcpp/src/dependency.cpp \
+    ../../wpmcpp/src/dependencyindex.cpp \
     ../../wpmcpp/src/wpmutils.cpp \
+    ../../wpmcpp/src/processrunner.cpp \
     ../../wpmcpp/src/downloader.cpp \
     ../../wpmcpp/src/license.cpp \
     ../../wpmcpp/src/windowsregistry.cpp \
     ../../wpmcpp/src/detectfile.cpp \
     app.cpp \
+    service.cpp \
+    serviceprotocol.cpp \
     ../../wpmcpp/src/commandline.cpp \
     ../../wpmcpp/src/installedpackages.cpp \
     ../../wpmcpp/src/installedpackageversion.cpp \
@@ -50,6 +54,8 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.cpp \
     ../../wpmcpp/src/hrtimer.cpp \
     ../../wpmcpp/src/repositoryxmlhandler.cpp \
+    ../../wpmcpp/src/repositoryxmlreader.cpp \
+    ../../wpmcpp/src/stringpool.cpp \
     ../../wpmcpp/src/mysqlquery.cpp \
     ../../wpmcpp/src/installedpackagesthirdpartypm.cpp
 HEADERS += ../../wpmcpp/src/visiblejobs.h \
@@ -61,12 +67,16 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/job.h \
     ../../wpmcpp/src/installoperation.h \
     ../../wpmcpp/src/dependency.h \
+    ../../wpmcpp/src/dependencyindex.h \
     ../../wpmcpp/src/wpmutils.h \
+    ../../wpmcpp/src/processrunner.h \
     ../../wpmcpp/src/downloader.h \
     ../../wpmcpp/src/license.h \
     ../../wpmcpp/src/windowsregistry.h \
     ../../wpmcpp/src/detectfile.h \
     app.h \
+    service.h \
+    serviceprotocol.h \
     ../../wpmcpp/src/installedpackages.h \
     ../../wpmcpp/src/installedpackageversion.h \
     ../../wpmcpp/src/commandline.h \
@@ -79,6 +89,8 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.h \
     ../../wpmcpp/src/hrtimer.h \
     ../../wpmcpp/src/repositoryxmlhandler.h \
+    ../../wpmcpp/src/repositoryxmlreader.h \
+    ../../wpmcpp/src/stringpool.h \
     ../../wpmcpp/src/mysqlquery.h \
     ../../wpmcpp/src/installedpackagesthirdpartypm.h \
     stable.h
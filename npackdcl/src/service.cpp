@@ -0,0 +1,257 @@
+#include <QDataStream>
+#include <QBuffer>
+
+#include "service.h"
+#include "serviceprotocol.h"
+#include "app.h"
+#include "dbrepository.h"
+#include "installedpackages.h"
+#include "wpmutils.h"
+
+/**
+ * @brief reads the user and the elevation of a process
+ * @param process process handle with PROCESS_QUERY_LIMITED_INFORMATION access
+ * @param sid the SID of the user will be stored here
+ * @param elevated true will be stored here if the process is elevated
+ * @return true if the information is available
+ */
+static bool getProcessUser(HANDLE process, QByteArray* sid, bool* elevated)
+{
+    HANDLE token;
+    if (!OpenProcessToken(process, TOKEN_QUERY, &token))
+        return false;
+
+    bool ok = false;
+    DWORD len = 0;
+    GetTokenInformation(token, TokenUser, 0, 0, &len);
+    if (len > 0) {
+        QByteArray buf(len, 0);
+        if (GetTokenInformation(token, TokenUser, buf.data(), len, &len)) {
+            PSID s = ((TOKEN_USER*) buf.data())->User.Sid;
+            *sid = QByteArray((const char*) s, GetLengthSid(s));
+            ok = true;
+        }
+    }
+
+    if (ok) {
+        TOKEN_ELEVATION te;
+        ok = GetTokenInformation(token, TokenElevation, &te, sizeof(te),
+                &len);
+        *elevated = ok && te.TokenIsElevated;
+    }
+
+    CloseHandle(token);
+
+    return ok;
+}
+
+/**
+ * @brief checks whether the server side of a named pipe can be trusted. The
+ *     server process should run as the same user and should be elevated if
+ *     this process is elevated.
+ * @param pipe client end of the pipe
+ * @return true if the server can be trusted
+ */
+static bool isTrustedServer(HANDLE pipe)
+{
+    // GetNamedPipeServerProcessId is only available on Windows Vista and
+    // later
+    BOOL (WINAPI *lpfGetNamedPipeServerProcessId)(HANDLE, PULONG) =
+            (BOOL (WINAPI*) (HANDLE, PULONG)) GetProcAddress(
+            GetModuleHandleA("KERNEL32.DLL"), "GetNamedPipeServerProcessId");
+    if (!lpfGetNamedPipeServerProcessId)
+        return false;
+
+    ULONG pid;
+    if (!lpfGetNamedPipeServerProcessId(pipe, &pid))
+        return false;
+
+    HANDLE server = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE,
+            pid);
+    if (!server)
+        return false;
+
+    QByteArray serverSID, clientSID;
+    bool serverElevated, clientElevated;
+    bool r = getProcessUser(server, &serverSID, &serverElevated) &&
+            getProcessUser(GetCurrentProcess(), &clientSID,
+            &clientElevated) &&
+            serverSID == clientSID && (serverElevated || !clientElevated);
+
+    CloseHandle(server);
+
+    return r;
+}
+
+Service::Service(QObject *parent) : QObject(parent), packagesKey(0),
+        packagesChanged(0)
+{
+}
+
+Service::~Service()
+{
+    if (packagesKey)
+        RegCloseKey(packagesKey);
+    if (packagesChanged)
+        CloseHandle(packagesChanged);
+
+    App::installedPackagesCurrent = false;
+}
+
+QString Service::getServerName()
+{
+    return QString("NpackdCL-") + NPACKD_VERSION;
+}
+
+QString Service::start()
+{
+    QString err;
+
+    // the event is initially signalled so that the registry is read for the
+    // first request
+    packagesChanged = CreateEvent(0, TRUE, TRUE, 0);
+    if (!packagesChanged)
+        WPMUtils::formatMessage(GetLastError(), &err);
+
+    if (err.isEmpty()) {
+        // without the notification the registry is read for every request
+        if (RegOpenKeyExW(HKEY_LOCAL_MACHINE,
+                L"SOFTWARE\\Npackd\\Npackd\\Packages", 0,
+                KEY_NOTIFY, &packagesKey) != ERROR_SUCCESS)
+            packagesKey = 0;
+    }
+
+    if (err.isEmpty()) {
+        connect(&server, SIGNAL(newConnection()), this,
+                SLOT(newConnection()));
+
+        // only processes of the same user can connect
+        server.setSocketOptions(QLocalServer::UserAccessOption);
+        if (!server.listen(getServerName()))
+            err = QString("Cannot start the service: %1").
+                    arg(server.errorString());
+    }
+
+    return err;
+}
+
+QString Service::refreshInstalledPackages()
+{
+    QString err;
+
+    bool changed = !packagesKey ||
+            WaitForSingleObject(packagesChanged, 0) == WAIT_OBJECT_0;
+
+    if (changed) {
+        App::installedPackagesCurrent = false;
+
+        // the notification is registered again before reading so that no
+        // change is lost
+        if (packagesKey) {
+            ResetEvent(packagesChanged);
+            if (RegNotifyChangeKeyValue(packagesKey, TRUE,
+                    REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET,
+                    packagesChanged, TRUE) != ERROR_SUCCESS) {
+                RegCloseKey(packagesKey);
+                packagesKey = 0;
+            }
+        }
+
+        err = InstalledPackages::getDefault()->readRegistryDatabase();
+        if (err.isEmpty() && packagesKey)
+            App::installedPackagesCurrent = true;
+    }
+
+    return err;
+}
+
+QByteArray Service::execute(const QByteArray& request)
+{
+    QStringList args;
+    QDataStream in(request);
+    in.setVersion(QDataStream::Qt_5_0);
+    in >> args;
+
+    int exitCode;
+    QString out, errOut;
+
+    QString err = refreshInstalledPackages();
+
+    // F5 could have re-created the categories with other IDs
+    if (err.isEmpty())
+        err = DBRepository::getDefault()->refreshCaches();
+
+    if (err.isEmpty()) {
+        App app;
+        exitCode = app.processRequest(args, &out, &errOut);
+    } else {
+        exitCode = 1;
+        errOut = err + "\r\n";
+    }
+
+    QByteArray response;
+    QDataStream o(&response, QIODevice::WriteOnly);
+    o.setVersion(QDataStream::Qt_5_0);
+    o << (qint32) exitCode << out << errOut;
+
+    return response;
+}
+
+void Service::newConnection()
+{
+    QLocalSocket* socket;
+    while ((socket = server.nextPendingConnection()) != 0) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+    }
+}
+
+void Service::readRequest()
+{
+    QLocalSocket* socket = qobject_cast<QLocalSocket*>(sender());
+
+    // the requests are executed one after another
+    QByteArray request;
+    if (socket && ServiceProtocol::readMessage(socket, &request)) {
+        ServiceProtocol::writeMessage(socket, execute(request));
+        socket->flush();
+    }
+}
+
+bool Service::call(const QStringList& args, int* exitCode, QString* out,
+        QString* err)
+{
+    QLocalSocket socket;
+    socket.connectToServer(getServerName());
+
+    // connecting to a named pipe either succeeds or fails immediately
+    if (!socket.waitForConnected(100))
+        return false;
+
+    // another process could have created a pipe with the same name
+    if (!isTrustedServer((HANDLE) socket.socketDescriptor()))
+        return false;
+
+    QByteArray request;
+    QDataStream o(&request, QIODevice::WriteOnly);
+    o.setVersion(QDataStream::Qt_5_0);
+    o << args;
+
+    ServiceProtocol::writeMessage(&socket, request);
+    if (!socket.waitForBytesWritten(TIMEOUT))
+        return false;
+
+    QByteArray response;
+    while (!ServiceProtocol::readMessage(&socket, &response)) {
+        if (!socket.waitForReadyRead(TIMEOUT))
+            return false;
+    }
+
+    QDataStream in(response);
+    in.setVersion(QDataStream::Qt_5_0);
+    qint32 r;
+    in >> r >> *out >> *err;
+    *exitCode = r;
+
+    return in.status() == QDataStream::Ok;
+}
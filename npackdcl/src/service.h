@@ -0,0 +1,91 @@
+#ifndef SERVICE_H
+#define SERVICE_H
+
+#include <windows.h>
+
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QLocalServer>
+#include <QLocalSocket>
+
+/**
+ * @brief npackdcl running as a resident process ("ncl service"). The
+ *     database stays open and the installed packages are only read again
+ *     from the registry if they were changed. Other npackdcl processes send
+ *     the read-only commands (see isServed()) over a local socket and print
+ *     the returned output.
+ *
+ * Only processes of the same user can connect to the service. The client
+ * only sends requests to a service that runs as the same user and is
+ * elevated if the client is elevated.
+ *
+ * Protocol: the client sends the command line arguments, the service answers
+ * with the exit code and the output for stdout and stderr (see
+ * ServiceProtocol).
+ *
+ * The cached data of the default DBRepository is discarded before a request
+ * if the database was changed by another process (e.g. by F5 in the GUI).
+ */
+class Service: public QObject
+{
+    Q_OBJECT
+
+    /** a client waits at most this amount of milliseconds for the service */
+    static const int TIMEOUT = 30000;
+
+    QLocalServer server;
+
+    /** HKLM\SOFTWARE\Npackd\Npackd\Packages or 0 */
+    HKEY packagesKey;
+
+    /** signalled if packagesKey was changed */
+    HANDLE packagesChanged;
+
+    /**
+     * @brief reads the installed packages from the registry if they were
+     *     changed since the last call
+     * @return error message
+     */
+    QString refreshInstalledPackages();
+
+    /**
+     * @param request serialized command line arguments
+     * @return serialized response
+     */
+    QByteArray execute(const QByteArray& request);
+private slots:
+    void newConnection();
+    void readRequest();
+public:
+    /**
+     * @return name of the local server. Only the processes with the same
+     *     version of npackdcl communicate with each other.
+     */
+    static QString getServerName();
+
+    /**
+     * @brief executes a command in the running service
+     * @param args command line arguments without the program name
+     * @param exitCode exit code will be stored here
+     * @param out the output for stdout will be stored here
+     * @param err the output for stderr will be stored here
+     * @return true if the service is running and the command was executed.
+     *     false means that the command should be executed locally.
+     */
+    static bool call(const QStringList& args, int* exitCode, QString* out,
+            QString* err);
+
+    explicit Service(QObject *parent = 0);
+
+    ~Service();
+
+    /**
+     * @brief starts listening for requests
+     * @return error message
+     */
+    QString start();
+};
+
+#endif // SERVICE_H
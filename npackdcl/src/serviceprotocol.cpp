@@ -0,0 +1,49 @@
+#include <QFileInfo>
+
+#include "serviceprotocol.h"
+
+bool ServiceProtocol::readMessage(QIODevice* in, QByteArray* msg)
+{
+    if (in->bytesAvailable() < (qint64) sizeof(quint32))
+        return false;
+
+    quint32 len;
+    in->peek((char*) &len, sizeof(len));
+    if (in->bytesAvailable() < (qint64) (sizeof(len) + len))
+        return false;
+
+    in->read((char*) &len, sizeof(len));
+    *msg = in->read(len);
+
+    return true;
+}
+
+void ServiceProtocol::writeMessage(QIODevice* out, const QByteArray& msg)
+{
+    quint32 len = msg.length();
+    out->write((const char*) &len, sizeof(len));
+    out->write(msg);
+}
+
+bool ServiceProtocol::isServed(const QString& cmd)
+{
+    return cmd == "info" || cmd == "list" || cmd == "path" ||
+            cmd == "search" || cmd == "where" || cmd == "which";
+}
+
+QStringList ServiceProtocol::createRequest(CommandLine& cl)
+{
+    QStringList args = cl.getFreeArguments();
+    QList<CommandLine::ParsedOption*> pos = cl.getParsedOptions();
+    for (int i = 0; i < pos.count(); i++) {
+        CommandLine::ParsedOption* po = pos.at(i);
+        QString v = po->value;
+        if (po->opt->name == "file")
+            v = QFileInfo(v).absoluteFilePath();
+        if (po->opt->valueDescription.isEmpty())
+            args.append("--" + po->opt->name);
+        else
+            args.append("--" + po->opt->name + "=" + v);
+    }
+    return args;
+}
@@ -0,0 +1,53 @@
+#ifndef SERVICEPROTOCOL_H
+#define SERVICEPROTOCOL_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QIODevice>
+
+#include "commandline.h"
+
+/**
+ * @brief the parts of the communication with the service (see Service) that
+ *     do not depend on the execution of the commands.
+ *
+ * Both the request and the response are serialized using QDataStream and
+ * prefixed by their length as quint32.
+ */
+class ServiceProtocol
+{
+public:
+    /**
+     * @brief reads one length-prefixed message. Nothing is read if the
+     *     message is not yet complete.
+     * @param in device
+     * @param msg the message will be stored here
+     * @return true if the whole message was available
+     */
+    static bool readMessage(QIODevice* in, QByteArray* msg);
+
+    /**
+     * @brief writes one length-prefixed message
+     * @param out device
+     * @param msg the message
+     */
+    static void writeMessage(QIODevice* out, const QByteArray& msg);
+
+    /**
+     * @param cmd npackdcl command
+     * @return true if the command can be executed by the service
+     */
+    static bool isServed(const QString& cmd);
+
+    /**
+     * @brief creates the arguments for the service from a parsed command
+     *     line. The service has another current directory. Relative paths
+     *     are converted the same way as in the local execution.
+     * @param cl parsed command line
+     * @return command line arguments without the program name
+     */
+    static QStringList createRequest(CommandLine& cl);
+};
+
+#endif // SERVICEPROTOCOL_H
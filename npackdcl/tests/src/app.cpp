@@ -4,6 +4,23 @@
 #include <QRegExp>
 #include <QScopedPointer>
 #include <QProcess>
+#include <QThread>
+#include <QTemporaryDir>
+#include <QTime>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QBuffer>
+#include <QDir>
+#include <QMutex>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include <quazip.h>
+#include <quazipfile.h>
 
 #include "app.h"
 #include "wpmutils.h"
@@ -14,6 +31,19 @@
 #include "abstractrepository.h"
 #include "dbrepository.h"
 #include "hrtimer.h"
+#include "dependency.h"
+#include "processrunner.h"
+#include "dependencyindex.h"
+#include "installoperation.h"
+#include "repositoryxmlreader.h"
+#include "stringpool.h"
+#include "repositoryxmlhandler.h"
+#include "packageversionfile.h"
+#include "arena.h"
+#include "serviceprotocol.h"
+#include "directorywalker.h"
+#include "searchsession.h"
+#include "mysqlquery.h"
 
 void App::test()
 {
@@ -67,6 +97,323 @@ void App::test()
     QVERIFY(a > b);
 }
 
+void App::testVersion()
+{
+    Version a;
+    QVERIFY(a.setVersion(" 1 . 2 "));
+    QVERIFY(a.getVersionString() == "1.2");
+
+    QVERIFY(!a.setVersion(""));
+    QVERIFY(!a.setVersion("1..2"));
+    QVERIFY(!a.setVersion("1.2a"));
+    QVERIFY(!a.setVersion("99999999999"));
+    QVERIFY(a.getVersionString() == "1.2");
+
+    QString s = "[3.4.5.6]";
+    QVERIFY(a.setVersion(s.midRef(1, s.length() - 2)));
+    QVERIFY(a.getVersionString() == "3.4.5.6");
+
+    // parts that do not fit in 16 bits
+    Version b;
+    a.setVersion("1.70000");
+    b.setVersion("1.65535");
+    QVERIFY(a > b);
+    QVERIFY(b < a);
+
+    // more than 4 parts
+    a.setVersion("1.2.3.4.5");
+    b.setVersion("1.2.3.4");
+    QVERIFY(a > b);
+    b.setVersion("1.2.3.4.5.0");
+    QVERIFY(a == b);
+
+    a.setVersion("1.2.0.0.0.0");
+    b.setVersion(1, 2);
+    QVERIFY(a == b);
+    a.normalize();
+    QVERIFY(a == b);
+
+    QVERIFY(Version::EMPTY < Version(0, 0));
+
+    Dependency d;
+    QVERIFY(d.setVersions("[1.2, 3)"));
+    QVERIFY(d.test(Version(1, 2)));
+    QVERIFY(!d.test(Version(3, 0)));
+    QVERIFY(!d.setVersions("[1.2, 3, 4)"));
+    QVERIFY(!d.setVersions("[1.2)"));
+}
+
+void App::testJob()
+{
+    Job* job = new Job();
+    QSignalSpy spy(job, SIGNAL(changed(Job*)));
+
+    // the changes are coalesced
+    Job* sub = job->newSubJob(0.5, "Sub-job");
+    for (int i = 0; i < 10000; i++) {
+        sub->setProgress(i / 10000.0);
+    }
+    QVERIFY2(spy.count() < 1000, qPrintable(QString::number(spy.count())));
+
+    // the last change is published by the trailing flush
+    QTest::qWait(200);
+    int m = spy.count();
+    sub->setTitle("A");
+    sub->setTitle("B");
+    QTest::qWait(200);
+    QVERIFY2(spy.count() >= m + 2, qPrintable(QString::number(spy.count() - m)));
+    QVERIFY(spy.last().at(0).value<Job*>() == sub);
+
+    // the trailing flush does not need an event loop (npackdcl)
+    QThread::msleep(200);
+    m = spy.count();
+    sub->setTitle("C");
+    sub->setTitle("D");
+    QThread::msleep(200);
+    QVERIFY2(spy.count() >= m + 2, qPrintable(QString::number(spy.count() - m)));
+    QVERIFY(spy.last().at(0).value<Job*>() == sub);
+
+    // cancelling is always published
+    int n = spy.count();
+    job->cancel();
+    QVERIFY(spy.count() > n);
+    QVERIFY(sub->isCancelled());
+
+    // sub-jobs created after the cancellation are cancelled too
+    Job* sub2 = job->newSubJob(0.5, "Sub-job 2");
+    QVERIFY(sub2->isCancelled());
+
+    job->complete();
+
+    delete job;
+}
+
+void App::testJobStep()
+{
+    Job* job = new Job();
+
+    JobStep* step = job->newStep(0.5);
+    step->setProgress(0.5);
+    QVERIFY(qAbs(job->getProgress() - 0.25) < 0.0001);
+
+    JobStep* sub = step->newSubStep(0.5, true);
+    sub->completeWithProgress();
+    QVERIFY(qAbs(job->getProgress() - 0.5) < 0.0001);
+
+    // errors propagate only if requested
+    sub->setErrorMessage("failed");
+    QVERIFY(step->getErrorMessage() == "failed");
+    QVERIFY(job->getErrorMessage().isEmpty());
+    QVERIFY(!step->shouldProceed());
+    sub->release();
+    step->release();
+
+    // released steps are re-used
+    JobStep* step2 = job->newStep(0.5);
+    QVERIFY(step2 == step);
+    QVERIFY(step2->getErrorMessage().isEmpty());
+
+    Job* visible = step2->promote("Visible");
+    QVERIFY(visible->getTitle() == "Visible");
+    step2->setProgress(1);
+    QVERIFY(qAbs(job->getProgress() - 1) < 0.0001);
+    step2->complete();
+    QVERIFY(visible->isCompleted());
+    step2->release();
+
+    job->cancel();
+    JobStep* step3 = job->newStep(0.1);
+    QVERIFY(step3->isCancelled());
+    step3->release();
+
+    job->complete();
+
+    delete job;
+}
+
+/**
+ * Cancels a job after a delay.
+ */
+class CancelJobThread: public QThread
+{
+public:
+    Job* job;
+protected:
+    void run() {
+        msleep(300);
+        job->cancel();
+    }
+};
+
+void App::testProcessRunner()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // output is saved in the file
+    Job* job = new Job();
+    ProcessRunner runner;
+    runner.where = dir.path();
+#ifdef Q_OS_WIN
+    runner.program = WPMUtils::findCmdExe();
+    runner.nativeArguments = "/C \"echo hello& echo %NPACKD_TEST%\"";
+#else
+    runner.program = "/bin/sh";
+    runner.arguments << "-c" << "echo hello; echo $NPACKD_TEST";
+#endif
+    runner.env.insert("NPACKD_TEST", "world");
+    runner.outputFile = dir.path() + "/out.log";
+    runner.run(job);
+    QVERIFY2(job->getErrorMessage().isEmpty(),
+            qPrintable(job->getErrorMessage()));
+    QVERIFY(job->isCompleted());
+    QVERIFY(runner.exitCode == 0);
+    delete job;
+
+    QFile f(dir.path() + "/out.log");
+    QVERIFY(f.open(QIODevice::ReadOnly));
+    QString out = QString::fromLocal8Bit(f.readAll()).simplified();
+    f.close();
+    QVERIFY2(out == "hello world", qPrintable(out));
+
+    // the end of the output is also available in memory
+    QString tail = QString::fromLocal8Bit(runner.tail).simplified();
+    QVERIFY2(tail == "hello world", qPrintable(tail));
+
+    // non-zero exit code
+    job = new Job();
+    ProcessRunner runner2;
+    runner2.where = dir.path();
+#ifdef Q_OS_WIN
+    runner2.program = WPMUtils::findCmdExe();
+    runner2.nativeArguments = "/C \"exit 3\"";
+#else
+    runner2.program = "/bin/sh";
+    runner2.arguments << "-c" << "exit 3";
+#endif
+    runner2.run(job);
+    QVERIFY(runner2.exitCode == 3);
+    QVERIFY(!job->getErrorMessage().isEmpty());
+    delete job;
+
+    // cancellation does not wait for the output
+    job = new Job();
+    ProcessRunner runner3;
+    runner3.where = dir.path();
+#ifdef Q_OS_WIN
+    runner3.program = WPMUtils::findCmdExe();
+    runner3.nativeArguments = "/C \"ping -n 30 127.0.0.1 > nul\"";
+#else
+    runner3.program = "/bin/sh";
+    runner3.arguments << "-c" << "sleep 30";
+#endif
+    CancelJobThread t;
+    t.job = job;
+    QTime time;
+    time.start();
+    t.start();
+    runner3.run(job);
+    t.wait();
+    QVERIFY(job->isCancelled());
+    QVERIFY2(time.elapsed() < 10000, qPrintable(QString::number(time.elapsed())));
+    delete job;
+
+    // the log file cannot be written. The process produces output endlessly
+    // and is stopped.
+    job = new Job();
+    ProcessRunner runner4;
+    runner4.where = dir.path();
+#ifdef Q_OS_WIN
+    QString log = dir.path() + "/readonly.log";
+    QFile ro(log);
+    QVERIFY(ro.open(QIODevice::WriteOnly));
+    ro.close();
+    QVERIFY(ro.setPermissions(QFile::ReadOwner));
+    runner4.program = WPMUtils::findCmdExe();
+    runner4.nativeArguments = "/C \"for /L %i in (0,0,1) do @echo x\"";
+#else
+    QString log = "/dev/full";
+    runner4.program = "/bin/sh";
+    runner4.arguments << "-c" << "while true; do echo x; done";
+#endif
+    runner4.outputFile = log;
+    time.restart();
+    runner4.run(job);
+    QVERIFY(job->isCompleted());
+    QVERIFY(!job->getErrorMessage().isEmpty());
+    QVERIFY2(time.elapsed() < 10000, qPrintable(QString::number(time.elapsed())));
+    delete job;
+#ifdef Q_OS_WIN
+    ro.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+#endif
+}
+
+static PackageVersion* createPackageVersion(const QString& package,
+        const QString& version, const QString& dependency="",
+        const QString& versions="")
+{
+    Version v;
+    v.setVersion(version);
+    PackageVersion* pv = new PackageVersion(package, v);
+    if (!dependency.isEmpty()) {
+        Dependency* d = new Dependency();
+        d->package = dependency;
+        d->setVersions(versions);
+        pv->dependencies.append(d);
+    }
+    return pv;
+}
+
+void App::testPlanUninstallation()
+{
+    QList<PackageVersion*> all;
+    all.append(createPackageVersion("vc", "1"));
+    all.append(createPackageVersion("vc", "2"));
+    all.append(createPackageVersion("a", "1", "vc", "[1, 3)"));
+    all.append(createPackageVersion("b", "1", "vc", "[1, 1.5)"));
+    all.append(createPackageVersion("c", "1", "b", "[1, 2)"));
+
+    DependencyIndex index(all);
+    QList<DependencyIndex::Edge*> edges = index.getDependents("vc");
+    QVERIFY(edges.count() == 2);
+    QVERIFY(edges.at(0)->owner == all.at(2));
+    QVERIFY(edges.at(0)->satisfied == 2);
+    QVERIFY(edges.at(1)->satisfied == 1);
+    index.remove("vc", Version(1, 0));
+    QVERIFY(edges.at(0)->satisfied == 1);
+    QVERIFY(edges.at(1)->satisfied == 0);
+    QVERIFY(!index.contains("vc", Version(1, 0)));
+    QVERIFY(index.contains("vc", Version(2, 0)));
+
+    // removing vc 1 also removes b and c, but not a
+    QList<PackageVersion*> installed = all;
+    QList<InstallOperation*> ops;
+    QString err = all.at(0)->planUninstallation(installed, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(ops.count() == 3);
+    QVERIFY(ops.at(0)->package == "c" && !ops.at(0)->install);
+    QVERIFY(ops.at(1)->package == "b" && !ops.at(1)->install);
+    QVERIFY(ops.at(2)->package == "vc" && !ops.at(2)->install);
+    QVERIFY(installed.count() == 2);
+    qDeleteAll(ops);
+    ops.clear();
+    qDeleteAll(all);
+    all.clear();
+
+    // cyclic dependencies
+    all.append(createPackageVersion("x", "1", "y", "[1, 1]"));
+    all.append(createPackageVersion("y", "1", "x", "[1, 1]"));
+    installed = all;
+    err = all.at(0)->planUninstallation(installed, ops);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(ops.count() == 2);
+    QVERIFY(ops.at(0)->package == "y");
+    QVERIFY(ops.at(1)->package == "x");
+    QVERIFY(installed.count() == 0);
+    qDeleteAll(ops);
+    qDeleteAll(all);
+}
+
 void App::testCommandLine()
 {
     QString err;
@@ -79,3 +426,1174 @@ void App::testCommandLine()
     QVERIFY2(params.at(0) == "C:\\Program Files (x86)\\InstallShield Installation Information\\{96D0B6C6-5A72-4B47-8583-A87E55F5FE81}\\setup.exe",
             qPrintable(params.at(0)));
 }
+
+void App::testRepositoryXMLReader()
+{
+    QByteArray xml =
+            "<root>"
+            "<spec-version>3</spec-version>"
+            "<license name=\"org.gnu.GPLv3\">"
+            "<title>GPLv3</title><url>http://www.gnu.org/licenses/gpl.html</url>"
+            "</license>"
+            "<package name=\"com.example.Test\">"
+            "<title>Test</title><description>A test package</description>"
+            "<license>org.gnu.GPLv3</license>"
+            "<category>Development/Tools</category>"
+            "<link rel=\"homepage\" href=\"http://www.example.com/\"/>"
+            "<unknown><title>ignored</title></unknown>"
+            "</package>"
+            "<version name=\"1.2\" package=\"com.example.Test\" type=\"one-file\">"
+            "<url>http://www.example.com/test.exe</url>"
+            "<hash-sum>"
+            "5ae6e27a2d5cc3f5a9a4a3b4f2b8d1a3b6c8e9f0a1b2c3d4e5f60718293a4b5c"
+            "</hash-sum>"
+            "<important-file path=\"test.exe\" title=\"Test\"/>"
+            "<dependency package=\"com.example.Lib\" versions=\"[1, 2)\">"
+            "<variable>LIB</variable></dependency>"
+            "<detect-file><path>bin/test.exe</path>"
+            "<sha1>da39a3ee5e6b4b0d3255bfef95601890afd80709</sha1></detect-file>"
+            "<file path=\".Npackd\\Install.bat\">echo 1</file>"
+            "</version>"
+            "</root>";
+
+    Repository rep;
+    RepositoryXMLReader reader(&rep);
+    QString err = reader.read(xml);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    Repository rep2;
+    RepositoryXMLHandler handler(&rep2);
+    QXmlSimpleReader sr;
+    sr.setContentHandler(&handler);
+    sr.setErrorHandler(&handler);
+    QXmlInputSource inputSource;
+    inputSource.setData(xml);
+    QVERIFY2(sr.parse(inputSource), qPrintable(handler.errorString()));
+
+    QCOMPARE(rep.licenses.count(), 1);
+    QCOMPARE(rep.licenses.at(0)->title, rep2.licenses.at(0)->title);
+    QCOMPARE(rep.licenses.at(0)->url, rep2.licenses.at(0)->url);
+
+    QCOMPARE(rep.packages.count(), 1);
+    Package* p = rep.packages.at(0);
+    Package* p2 = rep2.packages.at(0);
+    QCOMPARE(p->title, p2->title);
+    QCOMPARE(p->description, p2->description);
+    QCOMPARE(p->license, p2->license);
+    QCOMPARE(p->categories, p2->categories);
+    QCOMPARE(p->links, p2->links);
+
+    QCOMPARE(rep.packageVersions.count(), 1);
+    PackageVersion* pv = rep.packageVersions.at(0);
+    PackageVersion* pv2 = rep2.packageVersions.at(0);
+    QCOMPARE(pv->toString(), pv2->toString());
+    QCOMPARE(pv->type, 1);
+    QCOMPARE(pv->download, pv2->download);
+    QCOMPARE(pv->sha1, pv2->sha1);
+    QCOMPARE((int) pv->hashSumType, (int) pv2->hashSumType);
+    QCOMPARE(pv->importantFiles, pv2->importantFiles);
+    QCOMPARE(pv->importantFilesTitles, pv2->importantFilesTitles);
+    QCOMPARE(pv->dependencies.count(), 1);
+    QCOMPARE(pv->dependencies.at(0)->var, QString("LIB"));
+    QCOMPARE(pv->detectFiles.count(), 1);
+    QCOMPARE(pv->detectFiles.at(0)->path, QString("bin\\test.exe"));
+    QCOMPARE(pv->files.count(), 1);
+    QCOMPARE(pv->files.at(0)->content, pv2->files.at(0)->content);
+
+    // one <version> as the root element
+    QByteArray v = "<version name=\"2\" package=\"com.example.Test\">"
+            "<url>http://www.example.com/test.zip</url></version>";
+    PackageVersion* pv3 = reader.readVersion(v, &err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(pv3 != 0);
+    QCOMPARE(pv3->version.getVersionString(), QString("2"));
+    delete pv3;
+
+    // the same constraints are validated
+    Repository rep3;
+    RepositoryXMLReader reader3(&rep3);
+    err = reader3.read("<root><version name=\"1\" package=\"com.example.Test\">"
+            "<sha1>xyz</sha1></version></root>");
+    QVERIFY(!err.isEmpty());
+
+    err = reader3.read("<root><version name=\"1\" package=\"com.example.Test\">"
+            "<url>not a URL</url></version></root>");
+    QVERIFY(!err.isEmpty());
+
+    err = reader3.read("<root><version name=\"1\" package=\"com.example.Test\">"
+            "<hash-sum type=\"MD5\">123</hash-sum></version></root>");
+    QVERIFY(!err.isEmpty());
+
+    err = reader3.read("<root><package name=\"com.example.Test\">"
+            "<category>/</category></package></root>");
+    QVERIFY(!err.isEmpty());
+
+    err = reader3.read("<root><package name=\"com.example.Test\">");
+    QVERIFY(!err.isEmpty());
+}
+
+void App::testRepositoryXMLReaderSplit()
+{
+    QByteArray xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<root>\n<spec-version>3</spec-version>\n";
+    for (int i = 0; i < 100; i++) {
+        QByteArray name = "com.example.Test" + QByteArray::number(i);
+        xml += "<!-- <package name=\"com.example.Comment\"> -->"
+                "<package name=\"" + name + "\">"
+                "<title>Test &lt;" + QByteArray::number(i) + "&gt;</title>"
+                "<link rel=\"homepage\" href=\"http://www.example.com/?a>b\"/>"
+                "</package>\n"
+                "<version name=\"1\" package=\"" + name + "\">"
+                "<file path=\"a.bat\"><![CDATA[echo </version>]]></file>"
+                "</version>\n";
+    }
+    xml += "</root>\n";
+
+    QList<int> bounds = RepositoryXMLReader::split(xml, 8);
+    QVERIFY(bounds.count() > 2);
+    QVERIFY(bounds.count() <= 9);
+
+    Repository rep;
+    RepositoryXMLReader reader(&rep);
+    for (int i = 0; i < bounds.count() - 1; i++) {
+        QString err = reader.readPart(xml, bounds.at(i), bounds.at(i + 1));
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+
+    QCOMPARE(rep.packages.count(), 100);
+    QCOMPARE(rep.packageVersions.count(), 100);
+    QCOMPARE(rep.packages.at(42)->name, QString("com.example.Test42"));
+    QCOMPARE(rep.packages.at(42)->title, QString("Test <42>"));
+    QCOMPARE(rep.packageVersions.at(99)->files.at(0)->content,
+            QString("echo </version>"));
+
+    // these documents cannot be split
+    QVERIFY(RepositoryXMLReader::split("<?xml version=\"1.0\" "
+            "encoding=\"ISO-8859-1\"?><root><package/></root>", 2).isEmpty());
+    QVERIFY(RepositoryXMLReader::split("<!DOCTYPE root><root><package/>"
+            "</root>", 2).isEmpty());
+    QVERIFY(RepositoryXMLReader::split("<root><package>", 2).isEmpty());
+    QVERIFY(RepositoryXMLReader::split("<root><package/></root>text",
+            2).isEmpty());
+}
+
+void App::testStringPool()
+{
+    StringPool pool;
+    QString a = pool.intern(QString("com.example.") + "Test");
+    QString b = pool.intern(QString("com.example.") + "Test");
+    QCOMPARE(a, b);
+    QVERIFY(a.constData() == b.constData());
+    QCOMPARE(pool.count(), 1);
+
+    pool.intern("com.example.Other");
+    QCOMPARE(pool.count(), 2);
+
+    // the versions of a package share the name. Only the in-memory
+    // repository adds the name to the shared pool, the reader uses its own.
+    int count = StringPool::getDefault()->count();
+    Repository rep;
+    RepositoryXMLReader reader(&rep);
+    QString err = reader.read("<root>"
+            "<version name=\"1\" package=\"com.example.Shared\"/>"
+            "<version name=\"2\" package=\"com.example.Shared\">"
+            "<dependency package=\"com.example.Shared\" versions=\"[1, 1]\"/>"
+            "</version></root>");
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(rep.packageVersions.count(), 2);
+    QVERIFY(rep.packageVersions.at(0)->package.constData() ==
+            rep.packageVersions.at(1)->package.constData());
+    QVERIFY(rep.packageVersions.at(1)->dependencies.at(0)->package.
+            constData() == rep.packageVersions.at(0)->package.constData());
+    QCOMPARE(StringPool::getDefault()->count(), count + 1);
+}
+
+void App::testInternetSession()
+{
+    // all requests use the same session
+    QString err;
+    HINTERNET a = Downloader::getInternetSession(&err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(a != 0);
+    HINTERNET b = Downloader::getInternetSession(&err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(a == b);
+
+    // a new session is created after closing the old one
+    Downloader::closeInternetSession();
+    HINTERNET c = Downloader::getInternetSession(&err);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QVERIFY(c != 0);
+
+    Downloader::closeInternetSession();
+    Downloader::closeInternetSession();
+}
+
+/**
+ * @brief creates a database with the packages from a repository
+ * @param dbr the database will be opened here
+ * @param connectionName name for the database connection
+ * @param file database file
+ * @param xml repository XML
+ * @return error message
+ */
+static QString createTestDatabase(DBRepository* dbr,
+        const QString& connectionName, const QString& file,
+        const QByteArray& xml)
+{
+    Repository rep;
+    RepositoryXMLReader reader(&rep);
+    QString err = reader.read(xml);
+
+    if (err.isEmpty())
+        err = dbr->open(connectionName, file);
+
+    if (err.isEmpty()) {
+        Job* job = new Job();
+        Job* sub = job->newSubJob(0.5, "Saving", true, true);
+        dbr->saveAll(sub, &rep);
+        if (job->shouldProceed()) {
+            sub = job->newSubJob(0.5, "Updating the status", true, true);
+            dbr->updateStatusForAll(sub);
+        }
+        err = job->getErrorMessage();
+        delete job;
+    }
+
+    return err;
+}
+
+void App::testArena()
+{
+    // two structures followed by the strings
+    const size_t header = 2 * sizeof(LPCWSTR);
+    Arena a(header);
+    a.reserve("abc");
+    a.reserve("");
+    QString err = a.allocate();
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    LPCWSTR* items = (LPCWSTR*) a.data();
+    QVERIFY(items[0] == 0 && items[1] == 0);
+    items[0] = a.copy("abc");
+    items[1] = a.copy("");
+
+    // the strings fill the block exactly
+    QVERIFY((const char*) items[0] == (const char*) items + header);
+    QVERIFY((const char*) (items[1] + 1) ==
+            (const char*) items + header + 5 * sizeof(WCHAR));
+
+    LPCWSTR* p = (LPCWSTR*) a.release();
+    QVERIFY(p == items);
+    QVERIFY(a.data() == 0);
+    QCOMPARE(QString::fromWCharArray(p[0]), QString("abc"));
+    QCOMPARE(QString::fromWCharArray(p[1]), QString(""));
+    Arena::free(p);
+
+    // error messages are also returned as one block
+    LPCWSTR e = Arena::toError("Error");
+    QVERIFY(e != 0);
+    QCOMPARE(QString::fromWCharArray(e), QString("Error"));
+    Arena::free(e);
+    Arena::free(0);
+}
+
+void App::testFindPackagesPage()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // the titles define the order
+    QString xml = "<root><spec-version>3</spec-version>";
+    for (int i = 0; i < 25; i++) {
+        xml += QString("<package name=\"org.example.Page%1\">"
+                "<title>Page %2</title></package>").arg(i).
+                arg(i, 2, 10, QChar('0'));
+    }
+    xml += "</root>";
+
+    {
+        DBRepository dbr;
+        QString err = createTestDatabase(&dbr, "testFindPackagesPage",
+                dir.path() + "/test.db", xml.toUtf8());
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // first page
+        QList<Package*> r = dbr.findPackagesPage(Package::INSTALLED, false,
+                "", 0, 10, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(r.count(), 10);
+        QCOMPARE(r.at(0)->title, QString("Page 00"));
+        QCOMPARE(r.at(9)->title, QString("Page 09"));
+        qDeleteAll(r);
+
+        // the last page is incomplete
+        r = dbr.findPackagesPage(Package::INSTALLED, false, "", 20, 10, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(r.count(), 5);
+        QCOMPARE(r.at(0)->title, QString("Page 20"));
+        QCOMPARE(r.at(0)->name, QString("org.example.Page20"));
+        qDeleteAll(r);
+
+        // after the end
+        r = dbr.findPackagesPage(Package::INSTALLED, false, "", 30, 10, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(r.count(), 0);
+
+        // -1 means "no limit"
+        r = dbr.findPackagesPage(Package::INSTALLED, false, "", 5, -1, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(r.count(), 20);
+        QCOMPARE(r.at(0)->title, QString("Page 05"));
+        qDeleteAll(r);
+
+        // none of the packages is installed
+        r = dbr.findPackagesPage(Package::INSTALLED, true, "", 0, 10, &err);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(r.count(), 0);
+    }
+    QSqlDatabase::removeDatabase("testFindPackagesPage");
+}
+
+void App::testServiceProtocol()
+{
+    // two messages one after another
+    QBuffer buf;
+    QVERIFY(buf.open(QIODevice::ReadWrite));
+    ServiceProtocol::writeMessage(&buf, "first");
+    ServiceProtocol::writeMessage(&buf, QByteArray(100000, 'x'));
+    ServiceProtocol::writeMessage(&buf, "");
+    QByteArray all = buf.data();
+    QCOMPARE(all.length(), 3 * 4 + 5 + 100000);
+
+    buf.seek(0);
+    QByteArray msg;
+    QVERIFY(ServiceProtocol::readMessage(&buf, &msg));
+    QCOMPARE(msg, QByteArray("first"));
+    QVERIFY(ServiceProtocol::readMessage(&buf, &msg));
+    QCOMPARE(msg, QByteArray(100000, 'x'));
+    QVERIFY(ServiceProtocol::readMessage(&buf, &msg));
+    QVERIFY(msg.isEmpty());
+    QVERIFY(!ServiceProtocol::readMessage(&buf, &msg));
+
+    // an incomplete message is not consumed
+    QBuffer part;
+    part.setData(all.left(4 + 3));
+    QVERIFY(part.open(QIODevice::ReadOnly));
+    QVERIFY(!ServiceProtocol::readMessage(&part, &msg));
+    QCOMPARE(part.pos(), (qint64) 0);
+    part.close();
+    part.setData(all.left(2));
+    QVERIFY(part.open(QIODevice::ReadOnly));
+    QVERIFY(!ServiceProtocol::readMessage(&part, &msg));
+    part.close();
+
+    // only the read-only commands are executed by the service
+    QVERIFY(ServiceProtocol::isServed("info"));
+    QVERIFY(ServiceProtocol::isServed("list"));
+    QVERIFY(ServiceProtocol::isServed("path"));
+    QVERIFY(ServiceProtocol::isServed("search"));
+    QVERIFY(ServiceProtocol::isServed("where"));
+    QVERIFY(ServiceProtocol::isServed("which"));
+    QVERIFY(!ServiceProtocol::isServed("add"));
+    QVERIFY(!ServiceProtocol::isServed("detect"));
+    QVERIFY(!ServiceProtocol::isServed("service"));
+    QVERIFY(!ServiceProtocol::isServed(""));
+
+    // relative paths are resolved in the current directory of the client
+    CommandLine cl;
+    cl.add("file", 'f', "file or directory", "file", false, "which");
+    cl.add("bare-format", 'b', "bare format", "", false);
+    QString err = cl.parse(QStringList() << "which" << "-f" <<
+            "sub/file.txt" << "--bare-format");
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QStringList args = ServiceProtocol::createRequest(cl);
+    QCOMPARE(args.count(), 3);
+    QCOMPARE(args.at(0), QString("which"));
+    QString file = QDir::current().absoluteFilePath("sub/file.txt");
+    QCOMPARE(args.at(1), "--file=" + file);
+    QCOMPARE(args.at(2), QString("--bare-format"));
+
+    // the created arguments are parsed the same way by the service
+    CommandLine cl2;
+    cl2.add("file", 'f', "file or directory", "file", false, "which");
+    cl2.add("bare-format", 'b', "bare format", "", false);
+    err = cl2.parse(args);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+    QCOMPARE(cl2.get("file"), file);
+    QVERIFY(cl2.isPresent("bare-format"));
+}
+
+void App::testRefreshCaches()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString file = dir.path() + "/test.db";
+
+    {
+        DBRepository dbr;
+        QString err = createTestDatabase(&dbr, "testRefreshCaches", file,
+                "<root><spec-version>3</spec-version>"
+                "<package name=\"org.example.Test\">"
+                "<title>Test</title><category>Development</category>"
+                "</package></root>");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        err = dbr.refreshCaches();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // another process changes the categories (e.g. F5)
+        QSqlDatabase other = QSqlDatabase::addDatabase("QSQLITE",
+                "testRefreshCaches2");
+        other.setDatabaseName(file);
+        QVERIFY(other.open());
+        int id;
+        {
+            QSqlQuery q(other);
+            QVERIFY(q.exec("SELECT ID FROM CATEGORY WHERE NAME = 'Development'"));
+            QVERIFY(q.next());
+            id = q.value(0).toInt();
+
+            QCOMPARE(dbr.findCategory(id, &err), QString("Development"));
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+
+            QVERIFY(q.exec("UPDATE CATEGORY SET NAME = 'Changed'"));
+        }
+        other.close();
+
+        // the cached name is used until the change is detected
+        QCOMPARE(dbr.findCategory(id, &err), QString("Development"));
+        err = dbr.refreshCaches();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(dbr.findCategory(id, &err), QString("Changed"));
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // without changes the cache stays
+        err = dbr.refreshCaches();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(dbr.findCategory(id, &err), QString("Changed"));
+    }
+    QSqlDatabase::removeDatabase("testRefreshCaches2");
+    QSqlDatabase::removeDatabase("testRefreshCaches");
+}
+
+void App::testSnapshot()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString file = dir.path() + "/test.db";
+
+    {
+        DBRepository writer;
+        QString err = createTestDatabase(&writer, "testSnapshot", file,
+                "<root><spec-version>3</spec-version>"
+                "<package name=\"org.example.Test\">"
+                "<title>Test</title></package></root>");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        DBRepository reader;
+        err = reader.open("testSnapshot2", file, true);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        QSqlQuery q(QSqlDatabase::database("testSnapshot"));
+        QVERIFY(q.exec("BEGIN IMMEDIATE TRANSACTION"));
+        QVERIFY(q.exec("DELETE FROM PACKAGE"));
+
+        // the uncommitted changes are not visible and do not block the
+        // reader
+        err = reader.beginSnapshot();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        Package* p = reader.findPackage_("org.example.Test");
+        QVERIFY(p != 0);
+        delete p;
+
+        // the snapshot stays the same after the commit
+        QVERIFY(q.exec("COMMIT"));
+        p = reader.findPackage_("org.example.Test");
+        QVERIFY(p != 0);
+        delete p;
+        err = reader.endSnapshot();
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // the committed state is visible after the snapshot
+        p = reader.findPackage_("org.example.Test");
+        QVERIFY(p == 0);
+    }
+    QSqlDatabase::removeDatabase("testSnapshot2");
+    QSqlDatabase::removeDatabase("testSnapshot");
+}
+
+/**
+ * @brief compares the precomputed categories (CATEGORY_FACET) with the
+ *     categories computed using GROUP BY for all status filters on both
+ *     levels
+ * @param dbr repository. All packages must contain "npackdtest" in the name.
+ * @return description of the first difference or error message
+ */
+static QString compareCategoryFacets(DBRepository* dbr)
+{
+    QString err;
+
+    // a search query that matches all packages disables the facets
+    const QString all = "npackdtest";
+
+    // the parents for the level 1. 0 means "Uncategorized"
+    QList<int> parents;
+    parents.append(0);
+    QList<QStringList> cats = dbr->findCategories(Package::INSTALLED, false,
+            all, 0, -1, -1, &err);
+    for (int i = 0; i < cats.count() && err.isEmpty(); i++) {
+        if (!cats.at(i).at(0).isEmpty())
+            parents.append(cats.at(i).at(0).toInt());
+    }
+
+    QList<int> filters;
+    filters << -1 << Package::INSTALLED << Package::UPDATEABLE;
+    for (int i = 0; i < filters.count() && err.isEmpty(); i++) {
+        bool filterByStatus = filters.at(i) >= 0;
+        Package::Status status = filterByStatus ?
+                (Package::Status) filters.at(i) : Package::INSTALLED;
+
+        for (int j = -1; j < parents.count() && err.isEmpty(); j++) {
+            int level = j < 0 ? 0 : 1;
+            int cat0 = j < 0 ? -1 : parents.at(j);
+
+            QList<QStringList> facets = dbr->findCategories(status,
+                    filterByStatus, "", level, cat0, -1, &err);
+            QList<QStringList> expected;
+            if (err.isEmpty())
+                expected = dbr->findCategories(status, filterByStatus, all,
+                        level, cat0, -1, &err);
+
+            if (err.isEmpty() && facets != expected) {
+                err = QString("Different categories for the status filter "
+                        "%1 on the level %2 in the category %3").
+                        arg(filters.at(i)).arg(level).arg(cat0);
+            }
+        }
+    }
+
+    return err;
+}
+
+void App::testCategoryFacets()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString a = "org.example.npackdtest.FacetsA";
+    const QString b = "org.example.npackdtest.FacetsB";
+    const QString c = "org.example.npackdtest.FacetsC";
+
+    QStringList errors;
+    {
+        DBRepository dbr;
+        QString err = createTestDatabase(&dbr, "testCategoryFacets",
+                dir.path() + "/test.db",
+                "<root><spec-version>3</spec-version>"
+                "<package name=\"org.example.npackdtest.FacetsA\">"
+                "<title>A</title><category>Dev/Tools</category></package>"
+                "<package name=\"org.example.npackdtest.FacetsB\">"
+                "<title>B</title><category>Dev</category></package>"
+                "<package name=\"org.example.npackdtest.FacetsC\">"
+                "<title>C</title></package>"
+                "<package name=\"org.example.npackdtest.FacetsD\">"
+                "<title>D</title><category>Games/Cards</category></package>"
+                "<version name=\"1\" package=\"org.example.npackdtest.FacetsA\">"
+                "<url>https://example.org/a1.zip</url></version>"
+                "<version name=\"2\" package=\"org.example.npackdtest.FacetsA\">"
+                "<url>https://example.org/a2.zip</url></version>"
+                "<version name=\"1\" package=\"org.example.npackdtest.FacetsB\">"
+                "<url>https://example.org/b1.zip</url></version>"
+                "<version name=\"1\" package=\"org.example.npackdtest.FacetsC\">"
+                "<url>https://example.org/c1.zip</url></version>"
+                "</root>");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        err = compareCategoryFacets(&dbr);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // install and uninstall one package at a time: an update is
+        // available (A), the newest version (B), an uncategorized package
+        // (C)
+        InstalledPackages* ip = InstalledPackages::getDefault();
+        QStringList packages;
+        packages << a << b << c;
+        // InstalledPackages stores the versions as they are passed
+        Version v1(1, 0);
+        v1.normalize();
+        QList<Version> versions;
+        versions << v1 << v1 << v1;
+        for (int i = 0; i < 2 * packages.count(); i++) {
+            int k = i % packages.count();
+            QString where = i < packages.count() ? dir.path() : "";
+            err = ip->setPackageVersionPath(packages.at(k), versions.at(k),
+                    where);
+            if (err.isEmpty())
+                err = dbr.updateStatus(packages.at(k));
+            if (err.isEmpty())
+                err = compareCategoryFacets(&dbr);
+            if (!err.isEmpty())
+                errors.append(packages.at(k) + ": " + err);
+        }
+
+        // the packages are not left installed if a step failed
+        for (int i = 0; i < packages.count(); i++) {
+            ip->setPackageVersionPath(packages.at(i), versions.at(i), "");
+        }
+    }
+    QSqlDatabase::removeDatabase("testCategoryFacets");
+
+    QVERIFY2(errors.isEmpty(), qPrintable(errors.join("\n")));
+}
+
+void App::testUpdateStatusForAll()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // the versions are read ordered by the package name. "Z" is the last
+    // package.
+    const QString a = "org.example.npackdtest.StatusA";
+    const QString b = "org.example.npackdtest.StatusB";
+    const QString c = "org.example.npackdtest.StatusC";
+    const QString z = "org.example.npackdtest.StatusZ";
+
+    Version v1(1, 0);
+    v1.normalize();
+
+    QString err;
+    QMap<QString, QStringList> summaries;
+    {
+        DBRepository dbr;
+        err = createTestDatabase(&dbr, "testUpdateStatusForAll",
+                dir.path() + "/test.db",
+                "<root><spec-version>3</spec-version>"
+                "<package name=\"org.example.npackdtest.StatusA\">"
+                "<title>A</title></package>"
+                "<package name=\"org.example.npackdtest.StatusB\">"
+                "<title>B</title></package>"
+                "<package name=\"org.example.npackdtest.StatusC\">"
+                "<title>C</title></package>"
+                "<package name=\"org.example.npackdtest.StatusZ\">"
+                "<title>Z</title></package>"
+                "<version name=\"1\" package=\"org.example.npackdtest.StatusA\">"
+                "<url>https://example.org/a1.zip</url></version>"
+                "<version name=\"2\" package=\"org.example.npackdtest.StatusA\">"
+                "<url>https://example.org/a2.zip</url></version>"
+                "<version name=\"1\" package=\"org.example.npackdtest.StatusC\">"
+                "<url>https://example.org/c1.zip</url></version>"
+                "<version name=\"1\" package=\"org.example.npackdtest.StatusZ\">"
+                "<url>https://example.org/z1.zip</url></version>"
+                "<version name=\"2\" package=\"org.example.npackdtest.StatusZ\">"
+                "<url>https://example.org/z2.zip</url></version>"
+                "</root>");
+
+        // a stale status for a package without versions and a version
+        // number that cannot be parsed
+        if (err.isEmpty()) {
+            QSqlQuery q(QSqlDatabase::database("testUpdateStatusForAll"));
+            if (!q.exec("UPDATE PACKAGE SET STATUS = 2, "
+                    "INSTALLED_VERSIONS = '1' WHERE NAME = '" + b + "'") ||
+                    !q.exec("INSERT INTO PACKAGE_VERSION(NAME, PACKAGE, URL) "
+                    "VALUES('not a version', '" + c +
+                    "', 'https://example.org/c.zip')"))
+                err = q.lastError().text();
+        }
+
+        if (err.isEmpty())
+            err = InstalledPackages::getDefault()->setPackageVersionPath(
+                    z, v1, dir.path());
+
+        if (err.isEmpty()) {
+            Job* job = new Job();
+            dbr.updateStatusForAll(job);
+            err = job->getErrorMessage();
+            delete job;
+        }
+
+        if (err.isEmpty())
+            summaries = dbr.getPackageSummaries(QStringList() << a << b <<
+                    c << z, &err);
+
+        // the package is not left installed if a step failed
+        InstalledPackages::getDefault()->setPackageVersionPath(z, v1, "");
+    }
+    QSqlDatabase::removeDatabase("testUpdateStatusForAll");
+
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    // installed versions, newest version, download URL, status
+    QCOMPARE(summaries.value(a), QStringList() << "" << "2" <<
+            "https://example.org/a2.zip" <<
+            QString::number(Package::NOT_INSTALLED));
+    QCOMPARE(summaries.value(b), QStringList() << "" << "" << "" <<
+            QString::number(Package::NOT_INSTALLED));
+    QCOMPARE(summaries.value(c), QStringList() << "" << "1" <<
+            "https://example.org/c1.zip" <<
+            QString::number(Package::NOT_INSTALLED));
+    QCOMPARE(summaries.value(z), QStringList() << "1" << "2" <<
+            "https://example.org/z2.zip" <<
+            QString::number(Package::UPDATEABLE));
+}
+
+/**
+ * @brief counts the visits for every directory
+ */
+class CountingVisitor: public DirectoryWalker::Visitor
+{
+public:
+    QMutex mutex;
+    QMap<QString, int> visits;
+
+    /** the job is cancelled after the first directory */
+    Job* cancel;
+
+    CountingVisitor(): cancel(0)
+    {
+    }
+
+    bool visit(const QString& dir)
+    {
+        mutex.lock();
+        visits[dir]++;
+        mutex.unlock();
+
+        // the walk would be finished before the cancellation is noticed
+        if (cancel) {
+            cancel->cancel();
+            QThread::msleep(50);
+        }
+
+        return true;
+    }
+};
+
+void App::testDirectoryWalker()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // 10 directories with 10 sub-directories each
+    QString root = WPMUtils::normalizePath(dir.path());
+    QStringList all;
+    all.append(root);
+    QDir d(dir.path());
+    for (int i = 0; i < 10; i++) {
+        QString name = "d" + QString::number(i);
+        all.append(root + "\\" + name);
+        for (int j = 0; j < 10; j++) {
+            QString sub = name + "/e" + QString::number(j);
+            QVERIFY(d.mkpath(sub));
+            all.append(root + "\\" + name + "\\e" + QString::number(j));
+        }
+    }
+
+    QList<int> threads;
+    threads << 1 << 4;
+    for (int t = 0; t < threads.count(); t++) {
+        // every directory is visited exactly once
+        DirectoryWalker w(threads.at(t));
+        CountingVisitor v;
+        Job* job = new Job();
+        w.walk(job, QStringList() << root, &v);
+        QVERIFY2(job->getErrorMessage().isEmpty(),
+                qPrintable(job->getErrorMessage()));
+        delete job;
+        QStringList visited = v.visits.keys();
+        QCOMPARE(visited.count(), all.count());
+        for (int i = 0; i < all.count(); i++) {
+            QCOMPARE(v.visits.value(all.at(i)), 1);
+        }
+
+        // the ignored directories are not visited with all sub-directories
+        DirectoryWalker w2(threads.at(t));
+        w2.ignore.append(root + "\\d3");
+        CountingVisitor v2;
+        job = new Job();
+        w2.walk(job, QStringList() << root, &v2);
+        delete job;
+        QCOMPARE(v2.visits.count(), all.count() - 11);
+        QVERIFY(!v2.visits.contains(root + "\\d3"));
+        QVERIFY(!v2.visits.contains(root + "\\d3\\e0"));
+        QCOMPARE(v2.visits.value(root + "\\d4\\e0"), 1);
+
+        // the walk ends after the cancellation. Visiting all directories
+        // would take 111 * 50 ms divided by the number of threads.
+        DirectoryWalker w3(threads.at(t));
+        CountingVisitor v3;
+        job = new Job();
+        v3.cancel = job;
+        w3.walk(job, QStringList() << root, &v3);
+        QVERIFY(job->isCancelled());
+        delete job;
+        QVERIFY(v3.visits.count() < all.count());
+    }
+}
+
+void App::testFileHash()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QString path = dir.path() + "/file.txt";
+    QFile f(path);
+    QVERIFY(f.open(QFile::WriteOnly));
+    f.write("abc");
+    f.close();
+
+    QFileInfo fi(path);
+    QString p = WPMUtils::normalizePath(path);
+    qint64 size = fi.size();
+    qint64 modified = fi.lastModified().toMSecsSinceEpoch();
+
+    {
+        DBRepository dbr;
+        QString err = dbr.open("testFileHash", dir.path() + "/test.db");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // not cached yet
+        QCOMPARE(dbr.findFileHash(p, size, modified, &err), QString());
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        const QString sha1 = "a9993e364706816aba3e25717850c26c9cd0d89d";
+        err = dbr.saveFileHash(p, size, modified, sha1);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(dbr.findFileHash(p, size, modified, &err), sha1);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // another file
+        QCOMPARE(dbr.findFileHash(p + "2", size, modified, &err), QString());
+
+        // the modification time changed
+        QCOMPARE(dbr.findFileHash(p, size, modified + 1000, &err), QString());
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // the size changed
+        QVERIFY(f.open(QFile::Append));
+        f.write("d");
+        f.close();
+        fi.refresh();
+        QCOMPARE(dbr.findFileHash(p, fi.size(), modified, &err), QString());
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // the new value replaces the old one
+        const QString sha1b = "81fe8bfe87576c3ecb22426f8e57847382917acf";
+        err = dbr.saveFileHash(p, fi.size(),
+                fi.lastModified().toMSecsSinceEpoch(), sha1b);
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        QCOMPARE(dbr.findFileHash(p, fi.size(),
+                fi.lastModified().toMSecsSinceEpoch(), &err), sha1b);
+        QCOMPARE(dbr.findFileHash(p, size, modified, &err), QString());
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+    }
+    QSqlDatabase::removeDatabase("testFileHash");
+}
+
+/**
+ * @brief creates a repository in ZIP format
+ * @param zipFile path to the created file
+ * @param entry name of the only entry in the file
+ * @param content content of the entry
+ * @return error message
+ */
+static QString createZIP(const QString& zipFile, const QString& entry,
+        const QByteArray& content)
+{
+    QString err;
+
+    QuaZip zip(zipFile);
+    if (!zip.open(QuaZip::mdCreate))
+        err = QString("Cannot create the ZIP file: %1").
+                arg(zip.getZipError());
+
+    if (err.isEmpty()) {
+        QuaZipFile zf(&zip);
+        if (!zf.open(QIODevice::WriteOnly, QuaZipNewInfo(entry)) ||
+                zf.write(content) != content.length())
+            err = QString("Cannot write %1: %2").arg(entry).
+                    arg(zf.getZipError());
+        zf.close();
+        zip.close();
+    }
+
+    return err;
+}
+
+void App::testLoadOne()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    QByteArray xml = "<root><spec-version>3</spec-version>"
+            "<package name=\"org.example.LoadOne\">"
+            "<title>Load one</title></package>"
+            "<version name=\"1\" package=\"org.example.LoadOne\">"
+            "<url>https://example.org/a.zip</url></version></root>";
+
+    QString xmlFile = dir.path() + "/Rep.xml";
+    QFile f(xmlFile);
+    QVERIFY(f.open(QFile::WriteOnly));
+    QCOMPARE(f.write(xml), (qint64) xml.length());
+    f.close();
+
+    QString zipFile = dir.path() + "/Rep.zip";
+    QString err = createZIP(zipFile, "Rep.xml", xml);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    QString otherFile = dir.path() + "/Other.zip";
+    err = createZIP(otherFile, "Other.xml", xml);
+    QVERIFY2(err.isEmpty(), qPrintable(err));
+
+    {
+        DBRepository dbr;
+        err = dbr.open("testLoadOne", dir.path() + "/test.db");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+        dbr.currentRepository = 0;
+
+        // the XML file is read from the mapped memory on a local drive and
+        // the ZIP file through QuaZip
+        QStringList files;
+        files << xmlFile << zipFile;
+        for (int i = 0; i < files.count(); i++) {
+            err = dbr.clear();
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+
+            QFile in(files.at(i));
+            Job* job = new Job();
+            dbr.loadOne(job, &in);
+            err = job->getErrorMessage();
+            delete job;
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+            QVERIFY(!in.isOpen());
+
+            QScopedPointer<Package> p(dbr.findPackage_("org.example.LoadOne"));
+            QVERIFY(p);
+            QCOMPARE(p->title, QString("Load one"));
+            QScopedPointer<PackageVersion> pv(dbr.findPackageVersion_(
+                    "org.example.LoadOne", Version(1, 0), &err));
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+            QVERIFY(pv);
+        }
+
+        // Rep.xml is missing
+        QFile in(otherFile);
+        Job* job = new Job();
+        dbr.loadOne(job, &in);
+        err = job->getErrorMessage();
+        delete job;
+        QVERIFY(err.contains("Rep.xml"));
+    }
+    QSqlDatabase::removeDatabase("testLoadOne");
+}
+
+void App::testSearchSession()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    {
+        DBRepository dbr;
+        QString err = createTestDatabase(&dbr, "testSearchSession",
+                dir.path() + "/test.db",
+                "<root><spec-version>3</spec-version>"
+                "<package name=\"org.example.TextEditor\">"
+                "<title>Text editor</title><category>Dev/Editors</category>"
+                "</package>"
+                "<package name=\"org.example.HexEditor\">"
+                "<title>Hex editor</title><category>Dev/Editors</category>"
+                "</package>"
+                "<package name=\"org.example.Edge\">"
+                "<title>Edge</title><category>Internet</category>"
+                "</package>"
+                "<package name=\"org.example.Education\">"
+                "<title>Education</title>"
+                "<description>Text books</description></package>"
+                "<package name=\"org.example.Compiler\">"
+                "<title>Compiler</title><category>Dev/Tools</category>"
+                "</package>"
+                "</root>");
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        // every query extends the previous one
+        QStringList queries;
+        queries << "" << "e" << "ed" << "edi" << "edi tex" << "edi text";
+
+        SearchSession refined;
+        err = refined.load(&dbr, Package::INSTALLED, false, queries.at(0));
+        QVERIFY2(err.isEmpty(), qPrintable(err));
+
+        for (int i = 1; i < queries.count(); i++) {
+            const QString& query = queries.at(i);
+            QVERIFY2(refined.canRefine(Package::INSTALLED, false, query),
+                    qPrintable(query));
+            refined.refine(query);
+            QVERIFY(refined.isFor(Package::INSTALLED, false, query));
+
+            SearchSession fresh;
+            err = fresh.load(&dbr, Package::INSTALLED, false, query);
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+
+            // the rows from the database in the same order
+            QList<QStringList> rows = dbr.findPackageRows(Package::INSTALLED,
+                    false, query, &err);
+            QVERIFY2(err.isEmpty(), qPrintable(err));
+            QStringList names;
+            for (int j = 0; j < rows.count(); j++) {
+                names.append(rows.at(j).at(0));
+            }
+
+            // all packages, "Uncategorized", "Dev"
+            QList<int> cat0s;
+            cat0s << -1 << 0;
+            QList<QStringList> all = dbr.findCategories(Package::INSTALLED,
+                    false, "", 0, -1, -1, &err);
+            for (int j = 0; j < all.count(); j++) {
+                if (all.at(j).at(2) == "Dev")
+                    cat0s.append(all.at(j).at(0).toInt());
+            }
+
+            for (int j = 0; j < cat0s.count(); j++) {
+                QStringList found, found2;
+                QList<QStringList> cats, cats2, cats1, cats12;
+                err = refined.filter(&dbr, cat0s.at(j), -1, &found, &cats,
+                        &cats1);
+                QVERIFY2(err.isEmpty(), qPrintable(err));
+                err = fresh.filter(&dbr, cat0s.at(j), -1, &found2, &cats2,
+                        &cats12);
+                QVERIFY2(err.isEmpty(), qPrintable(err));
+
+                QString msg = query + " / " + QString::number(cat0s.at(j));
+                QVERIFY2(found == found2, qPrintable(msg));
+                QVERIFY2(cats == cats2, qPrintable(msg));
+                QVERIFY2(cats1 == cats12, qPrintable(msg));
+                if (cat0s.at(j) < 0)
+                    QVERIFY2(found == names, qPrintable(msg));
+            }
+        }
+
+        // the query was changed, not extended
+        QVERIFY(!refined.canRefine(Package::INSTALLED, false, "edit"));
+        QVERIFY(!refined.canRefine(Package::INSTALLED, true, "edi text"));
+    }
+    QSqlDatabase::removeDatabase("testSearchSession");
+}
+
+/**
+ * @param sql SQL statement
+ * @return the entry for the statement from MySQLQuery::getStatistics() after
+ *     a round trip through the JSON text (as saved by npackdcl --sql-stats)
+ */
+static QJsonObject findStatistics(const QString& sql)
+{
+    QByteArray json = QJsonDocument(MySQLQuery::getStatistics()).toJson();
+    QJsonArray statements = QJsonDocument::fromJson(json).object().
+            value("statements").toArray();
+    for (int i = 0; i < statements.count(); i++) {
+        QJsonObject obj = statements.at(i).toObject();
+        if (obj.value("sql").toString() == sql)
+            return obj;
+    }
+    return QJsonObject();
+}
+
+void App::testMySQLQueryStatistics()
+{
+    int threshold = MySQLQuery::slowQueryThreshold;
+    MySQLQuery::resetStatistics();
+
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE",
+                "testMySQLQueryStatistics");
+        db.setDatabaseName(":memory:");
+        QVERIFY(db.open());
+
+        // nothing is recorded by default
+        MySQLQuery::collectStatistics.store(0);
+        MySQLQuery c(db);
+        QVERIFY(c.exec("CREATE TABLE T(ID INTEGER)"));
+        QVERIFY(c.exec("INSERT INTO T(ID) VALUES(1), (2), (3)"));
+        QVERIFY(MySQLQuery::getStatistics().value("statements").
+                toArray().isEmpty());
+
+        MySQLQuery::collectStatistics.store(1);
+
+        // the plan is only saved for slow statements
+        MySQLQuery::slowQueryThreshold = 1000000;
+        const QString sql = "SELECT ID FROM T ORDER BY ID";
+        {
+            MySQLQuery q(db);
+            QVERIFY(q.exec(sql));
+            int n = 0;
+            while (q.next())
+                n++;
+            QCOMPARE(n, 3);
+        }
+        QJsonObject s = findStatistics(sql);
+        QCOMPARE(s.value("count").toInt(), 1);
+        QCOMPARE(s.value("rows").toDouble(), 3.0);
+        QVERIFY(!s.contains("plan"));
+
+        // the second execution fetches only one row. It is recorded when the
+        // query is destroyed.
+        MySQLQuery::slowQueryThreshold = 0;
+        {
+            MySQLQuery q(db);
+            QVERIFY(q.exec(sql));
+            QVERIFY(q.next());
+            QVERIFY(findStatistics(sql).value("count").toInt() == 1);
+        }
+        s = findStatistics(sql);
+        QCOMPARE(s.value("count").toInt(), 2);
+        QCOMPARE(s.value("rows").toDouble(), 4.0);
+        QVERIFY(s.value("totalTime").toDouble() >= s.value("maxTime").
+                toDouble());
+        QVERIFY(s.value("maxTime").toDouble() >= 0);
+        QVERIFY2(s.value("plan").toString().contains("SCAN"),
+                qPrintable(s.value("plan").toString()));
+
+        // a prepared statement is recorded before the next execution and
+        // explained with the bound values
+        const QString sql2 = "SELECT ID FROM T WHERE ID > :ID";
+        {
+            MySQLQuery q(db);
+            QVERIFY(q.prepare(sql2));
+            q.bindValue(":ID", 1);
+            QVERIFY(q.exec());
+            q.bindValue(":ID", 2);
+            QVERIFY(q.exec());
+            QCOMPARE(findStatistics(sql2).value("count").toInt(), 1);
+            QVERIFY(q.next());
+            QVERIFY(!q.next());
+        }
+        s = findStatistics(sql2);
+        QCOMPARE(s.value("count").toInt(), 2);
+        QCOMPARE(s.value("rows").toDouble(), 1.0);
+        QVERIFY(!s.value("plan").toString().isEmpty());
+
+        // statements without rows are recorded immediately
+        QVERIFY(c.exec("DELETE FROM T WHERE ID = 3"));
+        QCOMPARE(findStatistics("DELETE FROM T WHERE ID = 3").
+                value("count").toInt(), 1);
+
+        // the statements are sorted by the total time
+        QJsonObject top = MySQLQuery::getStatistics();
+        QCOMPARE(top.value("slowQueryThreshold").toInt(), 0);
+        QJsonArray statements = top.value("statements").toArray();
+        QCOMPARE(statements.count(), 3);
+        for (int i = 1; i < statements.count(); i++) {
+            QVERIFY(statements.at(i - 1).toObject().value("totalTime").
+                    toDouble() >= statements.at(i).toObject().
+                    value("totalTime").toDouble());
+        }
+
+        MySQLQuery::resetStatistics();
+        QVERIFY(MySQLQuery::getStatistics().value("statements").
+                toArray().isEmpty());
+
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("testMySQLQueryStatistics");
+
+    MySQLQuery::collectStatistics.store(0);
+    MySQLQuery::slowQueryThreshold = threshold;
+}
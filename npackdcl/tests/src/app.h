@@ -26,10 +26,120 @@ private slots:
      */
     void test();
 
+    /**
+     * Tests for Version parsing and comparison
+     */
+    void testVersion();
+
+    /**
+     * Tests for Job
+     */
+    void testJob();
+
+    /**
+     * Tests for JobStep
+     */
+    void testJobStep();
+
+    /**
+     * Tests for ProcessRunner
+     */
+    void testProcessRunner();
+
+    /**
+     * Tests for PackageVersion::planUninstallation and DependencyIndex
+     */
+    void testPlanUninstallation();
+
     /**
      * Tests für CommandLine
      */
     void testCommandLine();
+
+    /**
+     * Tests for RepositoryXMLReader. The results are compared with
+     * RepositoryXMLHandler.
+     */
+    void testRepositoryXMLReader();
+
+    /**
+     * Tests for RepositoryXMLReader::split() and readPart(). The parts
+     * together should contain the same data as the whole document.
+     */
+    void testRepositoryXMLReaderSplit();
+
+    /**
+     * Tests for StringPool
+     */
+    void testStringPool();
+
+    /**
+     * Tests for the shared WinINet session in Downloader
+     */
+    void testInternetSession();
+
+    /**
+     * Tests for Arena from npackdlib
+     */
+    void testArena();
+
+    /**
+     * Tests for the paging in DBRepository::findPackagesPage
+     */
+    void testFindPackagesPage();
+
+    /**
+     * Tests for the message framing, the served commands and the request
+     *     arguments in ServiceProtocol
+     */
+    void testServiceProtocol();
+
+    /**
+     * Tests for DBRepository::refreshCaches
+     */
+    void testRefreshCaches();
+
+    /**
+     * Tests for DBRepository::beginSnapshot on a read-only connection while
+     *     another connection writes
+     */
+    void testSnapshot();
+
+    /**
+     * Tests for the categories precomputed by DBRepository after changes of
+     *     the package status
+     */
+    void testCategoryFacets();
+
+    /**
+     * Tests for DBRepository::updateStatusForAll
+     */
+    void testUpdateStatusForAll();
+
+    /**
+     * Tests for DirectoryWalker
+     */
+    void testDirectoryWalker();
+
+    /**
+     * Tests for DBRepository::findFileHash and DBRepository::saveFileHash
+     */
+    void testFileHash();
+
+    /**
+     * Tests for DBRepository::loadOne
+     */
+    void testLoadOne();
+
+    /**
+     * Tests for the refinement of the results in SearchSession
+     */
+    void testSearchSession();
+
+    /**
+     * Tests for the statistics collected by MySQLQuery
+     */
+    void testMySQLQueryStatistics();
 };
 
 #endif // APP_H
@@ -26,9 +26,13 @@ SOURCES += main.cpp \
     ../../../wpmcpp/src/package.cpp \
     ../../../wpmcpp/src/packageversion.cpp \
     ../../../wpmcpp/src/job.cpp \
+    ../../../wpmcpp/src/directorywalker.cpp \
+    ../../../wpmcpp/src/searchsession.cpp \
     ../../../wpmcpp/src/installoperation.cpp \
     ../../../wpmcpp/src/dependency.cpp \
+    ../../../wpmcpp/src/dependencyindex.cpp \
     ../../../wpmcpp/src/wpmutils.cpp \
+    ../../../wpmcpp/src/processrunner.cpp \
     ../../../wpmcpp/src/downloader.cpp \
     ../../../wpmcpp/src/license.cpp \
     ../../../wpmcpp/src/windowsregistry.cpp \
@@ -46,9 +50,13 @@ SOURCES += main.cpp \
     ../../../wpmcpp/src/wellknownprogramsthirdpartypm.cpp \
     ../../../wpmcpp/src/hrtimer.cpp \
     ../../../wpmcpp/src/repositoryxmlhandler.cpp \
+    ../../../wpmcpp/src/repositoryxmlreader.cpp \
+    ../../../wpmcpp/src/stringpool.cpp \
     ../../../wpmcpp/src/mysqlquery.cpp \
     ../../../wpmcpp/src/installedpackagesthirdpartypm.cpp \
-    ../../../wpmcpp/src/cbsthirdpartypm.cpp
+    ../../../wpmcpp/src/cbsthirdpartypm.cpp \
+    ../../../npackdlib/arena.cpp \
+    ../../src/serviceprotocol.cpp
 HEADERS += ../../../wpmcpp/src/visiblejobs.h \
     ../../../wpmcpp/src/repository.h \
     ../../../wpmcpp/src/version.h \
@@ -56,9 +64,13 @@ HEADERS += ../../../wpmcpp/src/visiblejobs.h \
     ../../../wpmcpp/src/package.h \
     ../../../wpmcpp/src/packageversion.h \
     ../../../wpmcpp/src/job.h \
+    ../../../wpmcpp/src/directorywalker.h \
+    ../../../wpmcpp/src/searchsession.h \
     ../../../wpmcpp/src/installoperation.h \
     ../../../wpmcpp/src/dependency.h \
+    ../../../wpmcpp/src/dependencyindex.h \
     ../../../wpmcpp/src/wpmutils.h \
+    ../../../wpmcpp/src/processrunner.h \
     ../../../wpmcpp/src/downloader.h \
     ../../../wpmcpp/src/license.h \
     ../../../wpmcpp/src/windowsregistry.h \
@@ -76,9 +88,13 @@ HEADERS += ../../../wpmcpp/src/visiblejobs.h \
     ../../../wpmcpp/src/wellknownprogramsthirdpartypm.h \
     ../../../wpmcpp/src/hrtimer.h \
     ../../../wpmcpp/src/repositoryxmlhandler.h \
+    ../../../wpmcpp/src/repositoryxmlreader.h \
+    ../../../wpmcpp/src/stringpool.h \
     ../../../wpmcpp/src/mysqlquery.h \
     ../../../wpmcpp/src/installedpackagesthirdpartypm.h \
-    ../../../wpmcpp/src/cbsthirdpartypm.h
+    ../../../wpmcpp/src/cbsthirdpartypm.h \
+    ../../../npackdlib/arena.h \
+    ../../src/serviceprotocol.h
 FORMS += 
 
 CONFIG += static
@@ -88,6 +104,8 @@ DEFINES+=QUAZIP_STATIC=1
 INCLUDEPATH+=$$[QT_INSTALL_PREFIX]/src/3rdparty/zlib
 INCLUDEPATH+=$$(QUAZIP_PATH)/quazip
 INCLUDEPATH+=../../../wpmcpp/src/
+INCLUDEPATH+=../../../npackdlib/
+INCLUDEPATH+=../../src/
 
 QMAKE_LIBDIR+=$$(QUAZIP_PATH)/quazip/release
 
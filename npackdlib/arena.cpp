@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <QObject>
+
+#include "arena.h"
+
+Arena::Arena(size_t header): header(header), size(header), block(0), next(0)
+{
+}
+
+Arena::~Arena()
+{
+    ::free(block);
+}
+
+void Arena::reserve(const QString& s)
+{
+    size += (s.length() + 1) * sizeof(WCHAR);
+}
+
+QString Arena::allocate()
+{
+    QString err;
+
+    // malloc(0) may return 0
+    block = (char*) malloc(size == 0 ? 1 : size);
+    if (!block)
+        err = QObject::tr("Out of memory");
+    else {
+        memset(block, 0, header);
+        next = block + header;
+    }
+
+    return err;
+}
+
+void* Arena::data() const
+{
+    return block;
+}
+
+LPCWSTR Arena::copy(const QString& s)
+{
+    WCHAR* r = (WCHAR*) next;
+    memcpy(r, s.utf16(), s.length() * sizeof(WCHAR));
+    r[s.length()] = 0;
+    next += (s.length() + 1) * sizeof(WCHAR);
+    return r;
+}
+
+void* Arena::release()
+{
+    void* r = block;
+    block = 0;
+    next = 0;
+    return r;
+}
+
+void Arena::free(const void* p)
+{
+    ::free(const_cast<void*>(p));
+}
+
+LPCWSTR Arena::toError(const QString& s)
+{
+    Arena a(0);
+    a.reserve(s);
+    if (!a.allocate().isEmpty())
+        return 0;
+
+    a.copy(s);
+    return (LPCWSTR) a.release();
+}
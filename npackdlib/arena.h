@@ -0,0 +1,86 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <windows.h>
+
+#include <QString>
+
+/**
+ * @brief one memory block for an array of structures and all the strings
+ *     referenced by them. The caller of the library frees the whole result
+ *     with one call to NpackdFree.
+ *
+ * The sizes of all strings are first added using reserve(). After allocate()
+ * the structures can be filled and the strings copied using copy().
+ */
+class Arena
+{
+    /** size of the structures at the start of the block */
+    size_t header;
+
+    /** size of the whole block */
+    size_t size;
+
+    char* block;
+
+    /** next free position for a string */
+    char* next;
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+public:
+    /**
+     * @param header size of the structures at the start of the block in bytes
+     */
+    explicit Arena(size_t header);
+
+    /**
+     * @brief frees the block if it was not released
+     */
+    ~Arena();
+
+    /**
+     * @brief adds the necessary space for a string
+     * @param s a string that will be copied later
+     */
+    void reserve(const QString& s);
+
+    /**
+     * @brief allocates the block. The structures are filled with zeros.
+     * @return error message
+     */
+    QString allocate();
+
+    /**
+     * @return the structures at the start of the block
+     */
+    void* data() const;
+
+    /**
+     * @brief copies a string into the block. The space should be reserved
+     *     using reserve().
+     * @param s a string
+     * @return the copy of the string
+     */
+    LPCWSTR copy(const QString& s);
+
+    /**
+     * @return [ownership:caller] the block. The block should be freed with
+     *     Arena::free.
+     */
+    void* release();
+
+    /**
+     * @brief frees a block returned by release()
+     * @param p the block or 0
+     */
+    static void free(const void* p);
+
+    /**
+     * @param s a message
+     * @return [ownership:caller] the message as one block
+     */
+    static LPCWSTR toError(const QString& s);
+};
+
+#endif // ARENA_H
@@ -0,0 +1,27 @@
+#include "libprogress.h"
+
+LibProgress::LibProgress(PROGRESSCHANGEPROC pf, QObject *parent) :
+    QObject(parent), pf(pf)
+{
+}
+
+Job* LibProgress::createJob()
+{
+    Job* job = new Job();
+
+    // the signal may be emitted from other threads. The callback function is
+    // called directly from them.
+    connect(job, SIGNAL(changed(Job*)), this,
+            SLOT(jobChanged(Job*)), Qt::DirectConnection);
+
+    return job;
+}
+
+void LibProgress::jobChanged(Job* s)
+{
+    if (pf && !s->isCancelled()) {
+        QString hint = s->getFullTitle();
+        if (!pf(s->getProgress(), (LPCWSTR) hint.utf16()))
+            s->cancel();
+    }
+}
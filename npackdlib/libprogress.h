@@ -0,0 +1,34 @@
+#ifndef LIBPROGRESS_H
+#define LIBPROGRESS_H
+
+#include <QObject>
+
+#include "npackdlib.h"
+#include "job.h"
+
+/**
+ * @brief reports the progress of a job to a callback function of the library
+ *     caller. The job is cancelled if the function returns FALSE.
+ */
+class LibProgress : public QObject
+{
+    Q_OBJECT
+
+    PROGRESSCHANGEPROC pf;
+private slots:
+    void jobChanged(Job *s);
+public:
+    /**
+     * @param pf callback function or 0
+     * @param parent parent object
+     */
+    explicit LibProgress(PROGRESSCHANGEPROC pf, QObject *parent = 0);
+
+    /**
+     * @return [ownership:caller] a new job object connected to the callback
+     *     function
+     */
+    Job* createJob();
+};
+
+#endif // LIBPROGRESS_H
@@ -1,53 +1,685 @@
+#include <limits.h>
+
+#include <QCoreApplication>
+#include <QList>
+#include <QUrl>
+#include <QMutex>
+#include <QSet>
+#include <QThread>
+#include <QSqlDatabase>
+
 #include "npackdlib.h"
+#include "arena.h"
+#include "libprogress.h"
+#include "dbrepository.h"
+#include "abstractrepository.h"
+#include "installedpackages.h"
+#include "installedpackageversion.h"
+#include "installoperation.h"
+#include "packageversion.h"
+#include "version.h"
+#include "wpmutils.h"
+
+/**
+ * The default database is opened by the first call to NpackdOpen and stays
+ * open until the library is unloaded. It is used for the installation. Each
+ * handle has its own read-only connection for the queries.
+ */
+struct _NPACKD_HANDLE {
+    /** true if COM was initialized by NpackdOpen */
+    bool comInitialized;
+
+    /** thread that created this handle */
+    Qt::HANDLE thread;
+
+    /** name of the connection used by "dbr" */
+    QString connectionName;
+
+    /** [ownership:this] read-only connection for this handle */
+    DBRepository* dbr;
+
+    /** true if the installed packages were read from the registry */
+    bool registryRead;
+};
+
+/**
+ * protects "handles", "handleCount" and the one-time initialization
+ * ("databaseOpen", "databaseThread" and the QCoreApplication)
+ */
+static QMutex handlesMutex;
+
+/** all open handles */
+static QSet<HNPACKD> handles;
+
+/** number of handles created till now. Used for the connection names. */
+static int handleCount = 0;
+
+/** arguments for the QCoreApplication created by the library */
+static int appArgc = 1;
+static char appName[] = "npackdlib";
+static char* appArgv[] = {appName, 0};
+
+/** true if the default DBRepository was successfully opened */
+static bool databaseOpen = false;
+
+/**
+ * thread that opened the default DBRepository. The connection can only be
+ * used from this thread.
+ */
+static Qt::HANDLE databaseThread = 0;
+
+/**
+ * @param s a string from the caller or 0
+ * @return the string
+ */
+static QString toQString(LPCWSTR s)
+{
+    if (s)
+        return QString::fromWCharArray(s);
+    else
+        return QString();
+}
+
+/**
+ * @param h a handle
+ * @return error message or "" if the handle was created by NpackdOpen, is
+ *     not yet closed and is used by the thread that created it
+ */
+static QString checkHandle(HNPACKD h)
+{
+    QMutexLocker ml(&handlesMutex);
+
+    if (!h || !handles.contains(h))
+        return QObject::tr("Invalid handle");
+
+    if (h->thread != QThread::currentThreadId())
+        return QObject::tr(
+                "The handle can only be used by the thread that created it");
+
+    return "";
+}
+
+/**
+ * @return error message or "" if the current thread opened the default
+ *     database and can use it for the installation
+ */
+static QString checkDatabaseThread()
+{
+    QMutexLocker ml(&handlesMutex);
+
+    if (databaseThread != QThread::currentThreadId())
+        return QObject::tr(
+                "Packages can only be installed or removed by the thread that called NpackdOpen first");
+
+    return "";
+}
+
+/**
+ * @brief reads the installed packages from the registry once per handle
+ * @param h a valid handle
+ * @param refresh true = read the registry even if it was already read
+ * @return error message
+ */
+static QString readRegistry(HNPACKD h, bool refresh)
+{
+    QString e;
+    if (refresh || !h->registryRead) {
+        e = InstalledPackages::getDefault()->readRegistryDatabase();
+        h->registryRead = e.isEmpty();
+    }
+    return e;
+}
+
+/**
+ * @brief stores the operations as one block
+ * @param ops operations
+ * @param nops number of operations will be stored here
+ * @param r the operations will be stored here
+ * @return error message
+ */
+static QString toInstallOperations(const QList<InstallOperation*>& ops,
+        PDWORD nops, LPINSTALL_OPERATION* r)
+{
+    Arena a(ops.count() * sizeof(INSTALL_OPERATION));
+    QStringList versions;
+    for (int i = 0; i < ops.count(); i++) {
+        InstallOperation* op = ops.at(i);
+        versions.append(op->version.getVersionString());
+        a.reserve(op->package);
+        a.reserve(versions.at(i));
+    }
 
+    QString err = a.allocate();
+    if (err.isEmpty()) {
+        LPINSTALL_OPERATION items = (LPINSTALL_OPERATION) a.data();
+        for (int i = 0; i < ops.count(); i++) {
+            InstallOperation* op = ops.at(i);
+            items[i].install = op->install ? TRUE : FALSE;
+            items[i].package = a.copy(op->package);
+            items[i].version = a.copy(versions.at(i));
+        }
+        *nops = ops.count();
+        *r = (LPINSTALL_OPERATION) a.release();
+    }
 
-BOOL GetInstalledInfo(PDWORD ninfo,
+    return err;
+}
+
+BOOL NpackdOpen(HNPACKD* h, LPCWSTR* err)
+{
+    *h = 0;
+    *err = 0;
+
+    HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+
+    // only one thread initializes the library
+    QString e;
+    handlesMutex.lock();
+
+    // the SQLite driver plugin needs an application object
+    if (!QCoreApplication::instance())
+        new QCoreApplication(appArgc, appArgv);
+
+    if (!databaseOpen) {
+        qRegisterMetaType<Version>("Version");
+        AbstractRepository::setDefault_(DBRepository::getDefault());
+        e = DBRepository::getDefault()->openDefault();
+        if (e.isEmpty()) {
+            databaseOpen = true;
+            databaseThread = QThread::currentThreadId();
+        }
+    }
+    handlesMutex.unlock();
+
+    HNPACKD r = 0;
+    if (e.isEmpty()) {
+        r = new _NPACKD_HANDLE();
+        r->comInitialized = SUCCEEDED(hr);
+        r->thread = QThread::currentThreadId();
+        r->registryRead = false;
+        handlesMutex.lock();
+        r->connectionName = "npackdlib" + QString::number(handleCount++);
+        handlesMutex.unlock();
+        r->dbr = new DBRepository();
+        e = r->dbr->openDefault(r->connectionName, true);
+    }
+
+    if (e.isEmpty()) {
+        handlesMutex.lock();
+        handles.insert(r);
+        handlesMutex.unlock();
+        *h = r;
+    } else {
+        if (r) {
+            delete r->dbr;
+            QSqlDatabase::removeDatabase(r->connectionName);
+            delete r;
+        }
+        if (SUCCEEDED(hr))
+            CoUninitialize();
+        *err = Arena::toError(e);
+    }
+
+    return e.isEmpty();
+}
+
+void NpackdClose(HNPACKD h)
+{
+    // unknown and already closed handles are ignored
+    handlesMutex.lock();
+    bool valid = h && handles.remove(h);
+    handlesMutex.unlock();
+
+    if (valid) {
+        delete h->dbr;
+        QSqlDatabase::removeDatabase(h->connectionName);
+        if (h->comInitialized)
+            CoUninitialize();
+        delete h;
+    }
+}
+
+BOOL NpackdRefresh(HNPACKD h, LPCWSTR* err)
+{
+    *err = 0;
+
+    QString e = checkHandle(h);
+    if (e.isEmpty())
+        e = readRegistry(h, true);
+
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    return e.isEmpty();
+}
+
+void NpackdFree(LPCVOID p)
+{
+    Arena::free(p);
+}
+
+BOOL GetInstalledInfo(HNPACKD h, PDWORD ninfo,
         LPINSTALLED_PACKAGE_VERSION* info,
         PROGRESSCHANGEPROC pf,
         LPCWSTR* err)
 {
-    return FALSE;
+    *ninfo = 0;
+    *info = 0;
+    *err = 0;
+
+    LibProgress lp(pf);
+    Job* job = lp.createJob();
+    job->setTitle(QObject::tr("Detecting installed packages"));
+
+    InstalledPackages* ip = InstalledPackages::getDefault();
+
+    QString e = checkHandle(h);
+    if (!e.isEmpty())
+        job->setErrorMessage(e);
+
+    if (job->shouldProceed()) {
+        QString e = readRegistry(h, false);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.5);
+    }
+
+    if (job->shouldProceed()) {
+        QList<InstalledPackageVersion*> all = ip->getAll();
+
+        Arena a(all.count() * sizeof(INSTALLED_PACKAGE_VERSION));
+        QStringList versions;
+        for (int i = 0; i < all.count(); i++) {
+            InstalledPackageVersion* ipv = all.at(i);
+            versions.append(ipv->version.getVersionString());
+            a.reserve(ipv->package);
+            a.reserve(versions.at(i));
+            a.reserve(ipv->directory);
+        }
+
+        QString e = a.allocate();
+        if (e.isEmpty()) {
+            LPINSTALLED_PACKAGE_VERSION items =
+                    (LPINSTALLED_PACKAGE_VERSION) a.data();
+            for (int i = 0; i < all.count(); i++) {
+                InstalledPackageVersion* ipv = all.at(i);
+                items[i].package = a.copy(ipv->package);
+                items[i].version = a.copy(versions.at(i));
+                items[i].path = a.copy(ipv->directory);
+            }
+            *ninfo = all.count();
+            *info = (LPINSTALLED_PACKAGE_VERSION) a.release();
+            job->setProgress(1);
+        } else
+            job->setErrorMessage(e);
+
+        qDeleteAll(all);
+    }
+
+    job->complete();
+
+    e = job->getErrorMessage();
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    delete job;
+
+    return e.isEmpty();
 }
 
-BOOL Process(PDWORD nops, LPINSTALL_OPERATION* ops,
+BOOL Process(HNPACKD h, DWORD nops, const INSTALL_OPERATION* ops,
         PROGRESSCHANGEPROC pf, LPCWSTR* err)
 {
-    return FALSE;
+    *err = 0;
+
+    LibProgress lp(pf);
+    Job* job = lp.createJob();
+    job->setTitle(QObject::tr("Installing packages"));
+
+    // the installation code works with the default connection
+    QString e = checkHandle(h);
+    if (e.isEmpty())
+        e = checkDatabaseThread();
+    if (!e.isEmpty())
+        job->setErrorMessage(e);
+
+    QList<InstallOperation*> list;
+    for (DWORD i = 0; i < nops; i++) {
+        InstallOperation* op = new InstallOperation();
+        op->install = ops[i].install != FALSE;
+        op->package = toQString(ops[i].package);
+        if (!op->version.setVersion(toQString(ops[i].version))) {
+            job->setErrorMessage(QString(
+                    QObject::tr("Invalid version number: %1")).
+                    arg(toQString(ops[i].version)));
+        }
+        list.append(op);
+    }
+
+    if (job->shouldProceed()) {
+        QString e = readRegistry(h, false);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.1);
+    }
+
+    // the installation code works with the default repository
+    if (job->shouldProceed() && list.count() > 0) {
+        Job* sub = job->newSubJob(0.9, QObject::tr("Processing"));
+        DBRepository::getDefault()->process(sub, list,
+                WPMUtils::CLOSE_WINDOW, false, false);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
+
+    qDeleteAll(list);
+
+    job->complete();
+
+    e = job->getErrorMessage();
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    delete job;
+
+    return e.isEmpty();
 }
 
-BOOL Plan(BOOL install, LPCWSTR package,
+BOOL Plan(HNPACKD h, BOOL install, LPCWSTR package,
         LPCWSTR version, PDWORD nops, LPINSTALL_OPERATION* ops,
         PROGRESSCHANGEPROC pf, LPCWSTR* err)
 {
-    return FALSE;
+    *nops = 0;
+    *ops = 0;
+    *err = 0;
+
+    LibProgress lp(pf);
+    Job* job = lp.createJob();
+    job->setTitle(QObject::tr("Planning"));
+
+    QString e = checkHandle(h);
+    if (!e.isEmpty())
+        job->setErrorMessage(e);
+
+    DBRepository* dbr = e.isEmpty() ? h->dbr : 0;
+
+    QString package_ = toQString(package);
+    Version v;
+    if (job->shouldProceed() && !v.setVersion(toQString(version))) {
+        job->setErrorMessage(QString(
+                QObject::tr("Invalid version number: %1")).
+                arg(toQString(version)));
+    }
+
+    if (job->shouldProceed()) {
+        QString e = readRegistry(h, false);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.3);
+    }
+
+    PackageVersion* pv = 0;
+    if (job->shouldProceed()) {
+        QString e;
+        pv = dbr->findPackageVersion_(package_, v, &e);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else if (!pv)
+            job->setErrorMessage(QString(
+                    QObject::tr("Package version %1 %2 not found")).
+                    arg(package_, v.getVersionString()));
+    }
+
+    QList<PackageVersion*> installed;
+    if (job->shouldProceed()) {
+        QString e;
+        installed = dbr->getInstalled_(&e);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.5);
+    }
+
+    QList<InstallOperation*> list;
+    if (job->shouldProceed()) {
+        QString e;
+        if (install) {
+            QList<PackageVersion*> avoid;
+            e = pv->planInstallation(installed, list, avoid, "", dbr);
+        } else {
+            e = pv->planUninstallation(installed, list);
+        }
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.9);
+    }
+
+    if (job->shouldProceed()) {
+        QString e = toInstallOperations(list, nops, ops);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(1);
+    }
+
+    qDeleteAll(list);
+    qDeleteAll(installed);
+    delete pv;
+
+    job->complete();
+
+    e = job->getErrorMessage();
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    delete job;
+
+    return e.isEmpty();
 }
 
-BOOL Find(LPCWSTR text, BOOL finstalled,
+BOOL Find(HNPACKD h, LPCWSTR text, BOOL finstalled,
         DWORD offset, DWORD max,
         PDWORD npackages,
         LPPACKAGE* packages, PROGRESSCHANGEPROC pf, LPCWSTR* err)
 {
-    return FALSE;
+    *npackages = 0;
+    *packages = 0;
+    *err = 0;
+
+    LibProgress lp(pf);
+    Job* job = lp.createJob();
+    job->setTitle(QObject::tr("Searching for packages"));
+
+    QString e = checkHandle(h);
+    if (!e.isEmpty())
+        job->setErrorMessage(e);
+
+    // the paging is done by the database. -1 means "no limit".
+    int offset_ = offset > (DWORD) INT_MAX ? INT_MAX : (int) offset;
+    int max_ = max > (DWORD) INT_MAX ? -1 : (int) max;
+
+    QList<Package*> found;
+    if (job->shouldProceed()) {
+        QString e;
+        found = h->dbr->findPackagesPage(
+                Package::INSTALLED, finstalled != FALSE, toQString(text),
+                offset_, max_, &e);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.9);
+    }
+
+    if (job->shouldProceed()) {
+        Arena a(found.count() * sizeof(PACKAGE));
+        for (int i = 0; i < found.count(); i++) {
+            Package* p = found.at(i);
+            a.reserve(p->name);
+            a.reserve(p->title);
+            a.reserve(p->description);
+        }
+
+        QString e = a.allocate();
+        if (e.isEmpty()) {
+            LPPACKAGE items = (LPPACKAGE) a.data();
+            for (int i = 0; i < found.count(); i++) {
+                Package* p = found.at(i);
+                items[i].name = a.copy(p->name);
+                items[i].title = a.copy(p->title);
+                items[i].description = a.copy(p->description);
+            }
+            *npackages = found.count();
+            *packages = (LPPACKAGE) a.release();
+            job->setProgress(1);
+        } else
+            job->setErrorMessage(e);
+    }
+
+    qDeleteAll(found);
+
+    job->complete();
+
+    e = job->getErrorMessage();
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    delete job;
+
+    return e.isEmpty();
 }
 
-BOOL GetVersions(LPCWSTR package,
+BOOL GetVersions(HNPACKD h, LPCWSTR package,
         PDWORD nversions,
         LPPACKAGE_VERSION* versions, PROGRESSCHANGEPROC pf, LPCWSTR* err)
 {
-    return FALSE;
+    *nversions = 0;
+    *versions = 0;
+    *err = 0;
+
+    LibProgress lp(pf);
+    Job* job = lp.createJob();
+    job->setTitle(QObject::tr("Searching for package versions"));
+
+    QString e = checkHandle(h);
+    if (!e.isEmpty())
+        job->setErrorMessage(e);
+
+    QList<PackageVersion*> pvs;
+    if (job->shouldProceed()) {
+        QString e;
+        pvs = h->dbr->getPackageVersions_(
+                toQString(package), &e);
+        if (!e.isEmpty())
+            job->setErrorMessage(e);
+        else
+            job->setProgress(0.9);
+    }
+
+    if (job->shouldProceed()) {
+        Arena a(pvs.count() * sizeof(PACKAGE_VERSION));
+        QStringList vs;
+        for (int i = 0; i < pvs.count(); i++) {
+            PackageVersion* pv = pvs.at(i);
+            vs.append(pv->version.getVersionString());
+            a.reserve(pv->package);
+            a.reserve(vs.at(i));
+        }
+
+        QString e = a.allocate();
+        if (e.isEmpty()) {
+            LPPACKAGE_VERSION items = (LPPACKAGE_VERSION) a.data();
+            for (int i = 0; i < pvs.count(); i++) {
+                items[i].package = a.copy(pvs.at(i)->package);
+                items[i].version = a.copy(vs.at(i));
+            }
+            *nversions = pvs.count();
+            *versions = (LPPACKAGE_VERSION) a.release();
+            job->setProgress(1);
+        } else
+            job->setErrorMessage(e);
+    }
+
+    qDeleteAll(pvs);
+
+    job->complete();
+
+    e = job->getErrorMessage();
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    delete job;
+
+    return e.isEmpty();
 }
 
 BOOL GetRepositories(
         PDWORD nreps,
         LPREPOSITORY* reps, LPCWSTR* err)
 {
-    return FALSE;
+    *nreps = 0;
+    *reps = 0;
+    *err = 0;
+
+    QString e;
+    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(&e);
+
+    if (e.isEmpty()) {
+        Arena a(urls.count() * sizeof(REPOSITORY));
+        QStringList sl;
+        for (int i = 0; i < urls.count(); i++) {
+            sl.append(urls.at(i)->toString());
+            a.reserve(sl.at(i));
+        }
+
+        e = a.allocate();
+        if (e.isEmpty()) {
+            LPREPOSITORY items = (LPREPOSITORY) a.data();
+            for (int i = 0; i < sl.count(); i++) {
+                items[i].url = a.copy(sl.at(i));
+            }
+            *nreps = sl.count();
+            *reps = (LPREPOSITORY) a.release();
+        }
+    }
+
+    qDeleteAll(urls);
+
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    return e.isEmpty();
 }
 
 BOOL SetRepositories(
         DWORD nreps,
         LPREPOSITORY reps, LPCWSTR* err)
 {
-    return FALSE;
-}
+    *err = 0;
+
+    QString e;
+    QList<QUrl*> urls;
+    for (DWORD i = 0; i < nreps; i++) {
+        QString s = toQString(reps[i].url);
+        QUrl* url = new QUrl(s);
+        urls.append(url);
+        if (!url->isValid()) {
+            e = QString(QObject::tr("%1 is not a valid repository address")).
+                    arg(s);
+            break;
+        }
+    }
+
+    if (e.isEmpty())
+        AbstractRepository::setRepositoryURLs(urls, &e);
 
+    qDeleteAll(urls);
+
+    if (!e.isEmpty())
+        *err = Arena::toError(e);
+
+    return e.isEmpty();
+}
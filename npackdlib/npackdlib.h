@@ -9,6 +9,15 @@
 extern "C" {
 #endif
 
+/**
+ * Handle for the Npackd database. Each handle has its own connection to the
+ * database. The installed packages are read from the registry by the first
+ * call that needs them and then only by NpackdRefresh. A handle can only be
+ * used by the thread that created it. Functions called with an invalid or
+ * closed handle fail.
+ */
+typedef struct _NPACKD_HANDLE* HNPACKD;
+
 /**
  * A primitive installation/uninstallation operation.
  */
@@ -78,11 +87,53 @@ typedef struct _INSTALLED_PACKAGE_VERSION {
  * @param hint one-line description of the current operation
  * @return FALSE, if the whole operation should be cancelled, TRUE otherwise
  */
-typedef BOOL _stdcall *PROGRESSCHANGEPROC(double progress, LPCWSTR hint);
+typedef BOOL (_stdcall *PROGRESSCHANGEPROC)(double progress, LPCWSTR hint);
+
+/*
+ * Memory management: all arrays and error messages returned by the functions
+ * below are allocated as one block each. All strings referenced by an array
+ * are stored in the same block. The block should be freed with one call
+ * to NpackdFree.
+ */
 
 /**
- * Plans installation/uninstallation.
+ * Opens the Npackd database.
+ *
+ * @param h the new handle will be stored here. It should be closed with
+ *     NpackdClose.
+ * @param err error message will be stored here or 0 if none
+ * @return TRUE if the call succeeds
+ */
+BOOL _stdcall NPACKDLIBSHARED_EXPORT NpackdOpen(HNPACKD* h, LPCWSTR* err);
+
+/**
+ * Closes a handle.
  *
+ * @param h handle created by NpackdOpen
+ */
+void _stdcall NPACKDLIBSHARED_EXPORT NpackdClose(HNPACKD h);
+
+/**
+ * Reads the installed packages from the registry again. This is only
+ * necessary if packages were installed or uninstalled outside of this handle.
+ *
+ * @param h handle
+ * @param err error message will be stored here or 0 if none
+ * @return TRUE if the call succeeds
+ */
+BOOL _stdcall NPACKDLIBSHARED_EXPORT NpackdRefresh(HNPACKD h, LPCWSTR* err);
+
+/**
+ * Frees an array or an error message returned by this library.
+ *
+ * @param p the array, the error message or 0
+ */
+void _stdcall NPACKDLIBSHARED_EXPORT NpackdFree(LPCVOID p);
+
+/**
+ * Returns the installed package versions.
+ *
+ * @param h handle
  * @param ninfo number of installed packages will be stored here
  * @param info information about installed packages will be stored here
  * @param pf this function will be called to notify about the progress of this
@@ -90,7 +141,7 @@ typedef BOOL _stdcall *PROGRESSCHANGEPROC(double progress, LPCWSTR hint);
  * @param err error message will be stored here or 0 if none
  * @return TRUE if the call succeeds
  */
-BOOL _stdcall NPACKDLIBSHARED_EXPORT GetInstalledInfo(PDWORD ninfo,
+BOOL _stdcall NPACKDLIBSHARED_EXPORT GetInstalledInfo(HNPACKD h, PDWORD ninfo,
         LPINSTALLED_PACKAGE_VERSION* info,
         PROGRESSCHANGEPROC pf,
         LPCWSTR* err);
@@ -98,6 +149,7 @@ BOOL _stdcall NPACKDLIBSHARED_EXPORT GetInstalledInfo(PDWORD ninfo,
 /**
  * Plans installation/uninstallation.
  *
+ * @param h handle
  * @param install TRUE = plan installatioon, FALSE = plan uninstallation
  * @package full package name. This package should be installed or uninstalled.
  * @param version version number like "1.1"
@@ -110,27 +162,30 @@ BOOL _stdcall NPACKDLIBSHARED_EXPORT GetInstalledInfo(PDWORD ninfo,
  * @param err error message will be stored here or 0 if none
  * @return TRUE if the call succeeds
  */
-BOOL _stdcall NPACKDLIBSHARED_EXPORT Plan(BOOL install, LPCWSTR package,
+BOOL _stdcall NPACKDLIBSHARED_EXPORT Plan(HNPACKD h, BOOL install,
+        LPCWSTR package,
         LPCWSTR version, PDWORD nops, LPINSTALL_OPERATION* ops,
         PROGRESSCHANGEPROC pf, LPCWSTR* err);
 
 /**
- * Plans installation/uninstallation.
+ * Performs installation/uninstallation operations. This function can only be
+ * called by the thread that called NpackdOpen first.
  *
+ * @param h handle
  * @param nops number of operations
- * @param ops a pointer to an array of installation operations will be stored
- *     here.
+ * @param ops installation operations (e.g. returned by Plan)
  * @param pf this function will be called to notify about the progress of this
  *     call.
  * @param err error message will be stored here or 0 if none
  * @return TRUE if the call succeeds
  */
-BOOL _stdcall NPACKDLIBSHARED_EXPORT Process(PDWORD nops,
-        LPINSTALL_OPERATION* ops, PROGRESSCHANGEPROC pf, LPCWSTR* err);
+BOOL _stdcall NPACKDLIBSHARED_EXPORT Process(HNPACKD h, DWORD nops,
+        const INSTALL_OPERATION* ops, PROGRESSCHANGEPROC pf, LPCWSTR* err);
 
 /**
- * Searches for packages.
+ * Searches for packages. The packages are sorted by title.
  *
+ * @param h handle
  * @param text a piece of text to search in package description and title
  * @param finstalled TRUE = search only in installed packages, FALSE = search
  *     in all available packages
@@ -143,7 +198,8 @@ BOOL _stdcall NPACKDLIBSHARED_EXPORT Process(PDWORD nops,
  * @param err error message will be stored here or 0 if none
  * @return TRUE if the call succeeds
  */
-BOOL _stdcall NPACKDLIBSHARED_EXPORT Find(LPCWSTR text, BOOL finstalled,
+BOOL _stdcall NPACKDLIBSHARED_EXPORT Find(HNPACKD h, LPCWSTR text,
+        BOOL finstalled,
         DWORD offset, DWORD max,
         PDWORD npackages,
         LPPACKAGE* packages, PROGRESSCHANGEPROC pf, LPCWSTR* err);
@@ -151,6 +207,7 @@ BOOL _stdcall NPACKDLIBSHARED_EXPORT Find(LPCWSTR text, BOOL finstalled,
 /**
  * Returns all versions for the specified package.
  *
+ * @param h handle
  * @param package full package name
  * @param nops number of found versions will be stored here
  * @param ops a pointer to an array of found versions will be stored here
@@ -159,7 +216,7 @@ BOOL _stdcall NPACKDLIBSHARED_EXPORT Find(LPCWSTR text, BOOL finstalled,
  * @param err error message will be stored here or 0 if none
  * @return TRUE if the call succeeds
  */
-BOOL _stdcall NPACKDLIBSHARED_EXPORT GetVersions(LPCWSTR package,
+BOOL _stdcall NPACKDLIBSHARED_EXPORT GetVersions(HNPACKD h, LPCWSTR package,
         PDWORD nversions,
         LPPACKAGE_VERSION* versions, PROGRESSCHANGEPROC pf, LPCWSTR* err);
 
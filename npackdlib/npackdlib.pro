@@ -4,7 +4,10 @@
 #
 #-------------------------------------------------
 
-QT       += network xml
+NPACKD_VERSION = $$system(type ..\\wpmcpp\\version.txt)
+DEFINES += NPACKD_VERSION=\\\"$$NPACKD_VERSION\\\"
+
+QT       += network xml sql
 
 QT       -= gui
 
@@ -13,10 +16,100 @@ TEMPLATE = lib
 
 DEFINES += NPACKDLIB_LIBRARY
 
-SOURCES += npackdlib.cpp
+SOURCES += npackdlib.cpp \
+    arena.cpp \
+    libprogress.cpp \
+    ../wpmcpp/src/visiblejobs.cpp \
+    ../wpmcpp/src/repository.cpp \
+    ../wpmcpp/src/version.cpp \
+    ../wpmcpp/src/packageversionfile.cpp \
+    ../wpmcpp/src/package.cpp \
+    ../wpmcpp/src/packageversion.cpp \
+    ../wpmcpp/src/job.cpp \
+    ../wpmcpp/src/installoperation.cpp \
+    ../wpmcpp/src/dependency.cpp \
+    ../wpmcpp/src/dependencyindex.cpp \
+    ../wpmcpp/src/wpmutils.cpp \
+    ../wpmcpp/src/processrunner.cpp \
+    ../wpmcpp/src/downloader.cpp \
+    ../wpmcpp/src/license.cpp \
+    ../wpmcpp/src/windowsregistry.cpp \
+    ../wpmcpp/src/detectfile.cpp \
+    ../wpmcpp/src/commandline.cpp \
+    ../wpmcpp/src/installedpackages.cpp \
+    ../wpmcpp/src/installedpackageversion.cpp \
+    ../wpmcpp/src/clprogress.cpp \
+    ../wpmcpp/src/dbrepository.cpp \
+    ../wpmcpp/src/abstractrepository.cpp \
+    ../wpmcpp/src/abstractthirdpartypm.cpp \
+    ../wpmcpp/src/msithirdpartypm.cpp \
+    ../wpmcpp/src/controlpanelthirdpartypm.cpp \
+    ../wpmcpp/src/wellknownprogramsthirdpartypm.cpp \
+    ../wpmcpp/src/hrtimer.cpp \
+    ../wpmcpp/src/repositoryxmlhandler.cpp \
+    ../wpmcpp/src/repositoryxmlreader.cpp \
+    ../wpmcpp/src/stringpool.cpp \
+    ../wpmcpp/src/mysqlquery.cpp \
+    ../wpmcpp/src/installedpackagesthirdpartypm.cpp
+
+HEADERS += npackdlib.h \
+    npackdlib_global.h \
+    arena.h \
+    libprogress.h \
+    ../wpmcpp/src/visiblejobs.h \
+    ../wpmcpp/src/repository.h \
+    ../wpmcpp/src/version.h \
+    ../wpmcpp/src/packageversionfile.h \
+    ../wpmcpp/src/package.h \
+    ../wpmcpp/src/packageversion.h \
+    ../wpmcpp/src/job.h \
+    ../wpmcpp/src/installoperation.h \
+    ../wpmcpp/src/dependency.h \
+    ../wpmcpp/src/dependencyindex.h \
+    ../wpmcpp/src/wpmutils.h \
+    ../wpmcpp/src/processrunner.h \
+    ../wpmcpp/src/downloader.h \
+    ../wpmcpp/src/license.h \
+    ../wpmcpp/src/windowsregistry.h \
+    ../wpmcpp/src/detectfile.h \
+    ../wpmcpp/src/installedpackages.h \
+    ../wpmcpp/src/installedpackageversion.h \
+    ../wpmcpp/src/commandline.h \
+    ../wpmcpp/src/clprogress.h \
+    ../wpmcpp/src/dbrepository.h \
+    ../wpmcpp/src/abstractrepository.h \
+    ../wpmcpp/src/abstractthirdpartypm.h \
+    ../wpmcpp/src/msithirdpartypm.h \
+    ../wpmcpp/src/controlpanelthirdpartypm.h \
+    ../wpmcpp/src/wellknownprogramsthirdpartypm.h \
+    ../wpmcpp/src/hrtimer.h \
+    ../wpmcpp/src/repositoryxmlhandler.h \
+    ../wpmcpp/src/repositoryxmlreader.h \
+    ../wpmcpp/src/stringpool.h \
+    ../wpmcpp/src/mysqlquery.h \
+    ../wpmcpp/src/installedpackagesthirdpartypm.h
+
+LIBS += -lquazip \
+    -lz \
+    -lole32 \
+    -luuid \
+    -lwininet \
+    -lpsapi \
+    -lversion \
+    -lshlwapi \
+    -lmsi \
+    -lnetapi32
+
+DEFINES+=QUAZIP_STATIC=1
+
+INCLUDEPATH+=$$[QT_INSTALL_PREFIX]/src/3rdparty/zlib
+INCLUDEPATH+=$$(QUAZIP_PATH)/quazip
+INCLUDEPATH+=../wpmcpp/src/
+
+QMAKE_LIBDIR+=$$(QUAZIP_PATH)/quazip/release
 
-HEADERS += npackdlib.h\
-        npackdlib_global.h
+QMAKE_CXXFLAGS += -Werror -Wno-missing-field-initializers \
+    -Wno-unused-parameter
 
 symbian {
     MMP_RULES += EXPORTUNFROZEN
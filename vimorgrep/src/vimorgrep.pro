@@ -27,7 +27,9 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/job.cpp \
     ../../wpmcpp/src/installoperation.cpp \
     ../../wpmcpp/src/dependency.cpp \
+    ../../wpmcpp/src/dependencyindex.cpp \
     ../../wpmcpp/src/wpmutils.cpp \
+    ../../wpmcpp/src/processrunner.cpp \
     ../../wpmcpp/src/downloader.cpp \
     ../../wpmcpp/src/license.cpp \
     ../../wpmcpp/src/windowsregistry.cpp \
@@ -46,6 +48,8 @@ SOURCES += main.cpp \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.cpp \
     ../../wpmcpp/src/hrtimer.cpp \
     ../../wpmcpp/src/repositoryxmlhandler.cpp \
+    ../../wpmcpp/src/repositoryxmlreader.cpp \
+    ../../wpmcpp/src/stringpool.cpp \
     ../../wpmcpp/src/mysqlquery.cpp \
     ../../wpmcpp/src/installedpackagesthirdpartypm.cpp \
     ../../wpmcpp/src/cbsthirdpartypm.cpp
@@ -59,7 +63,9 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/job.h \
     ../../wpmcpp/src/installoperation.h \
     ../../wpmcpp/src/dependency.h \
+    ../../wpmcpp/src/dependencyindex.h \
     ../../wpmcpp/src/wpmutils.h \
+    ../../wpmcpp/src/processrunner.h \
     ../../wpmcpp/src/downloader.h \
     ../../wpmcpp/src/license.h \
     ../../wpmcpp/src/windowsregistry.h \
@@ -78,6 +84,8 @@ HEADERS += ../../wpmcpp/src/visiblejobs.h \
     ../../wpmcpp/src/wellknownprogramsthirdpartypm.h \
     ../../wpmcpp/src/hrtimer.h \
     ../../wpmcpp/src/repositoryxmlhandler.h \
+    ../../wpmcpp/src/repositoryxmlreader.h \
+    ../../wpmcpp/src/stringpool.h \
     ../../wpmcpp/src/mysqlquery.h \
     ../../wpmcpp/src/installedpackagesthirdpartypm.h \
     ../../wpmcpp/src/cbsthirdpartypm.h
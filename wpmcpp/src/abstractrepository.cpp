@@ -627,7 +627,7 @@ QString AbstractRepository::planUpdates(const QList<Package*> packages,
                         where = b->getPath();
 
                     err = newest.at(i)->planInstallation(installedCopy, ops2,
-                            avoid, where);
+                            avoid, where, this);
                     if (err.isEmpty()) {
                         if (ops2.count() == 2) {
                             used[i] = true;
@@ -654,7 +654,7 @@ QString AbstractRepository::planUpdates(const QList<Package*> packages,
 
                 QList<PackageVersion*> avoid;
                 err = newest.at(i)->planInstallation(installed, ops, avoid,
-                        where);
+                        where, this);
                 if (!err.isEmpty())
                     break;
             }
@@ -11,6 +11,8 @@ CLProgress::CLProgress(QObject *parent) :
 
 void CLProgress::jobChanged(Job* s)
 {
+    QMutexLocker locker(&mutex);
+
     HANDLE hOutputHandle = GetStdHandle(STD_OUTPUT_HANDLE);
 
     time_t now = time(0);
@@ -49,6 +51,8 @@ void CLProgress::jobChanged(Job* s)
 
 void CLProgress::jobChangedSimple(Job* s)
 {
+    QMutexLocker locker(&mutex);
+
     bool output = false;
     time_t now = time(0);
     if (now - this->lastJobChange >= this->updateRate) {
@@ -99,8 +103,10 @@ Job* CLProgress::createJob()
     }
 
     Job* job = new Job();
+    // the main thread of npackdcl does not return to the event loop while a
+    // command is executed
     connect(job, SIGNAL(changed(Job*)), this,
-            SLOT(jobChangedSimple(Job*)));
+            SLOT(jobChangedSimple(Job*)), Qt::DirectConnection);
 
     // -updateRate so that we do not have the initial delay
     this->lastJobChange = time(0) - this->updateRate;
@@ -6,6 +6,7 @@
 
 #include <QObject>
 #include <QString>
+#include <QMutex>
 
 #include "job.h"
 
@@ -23,6 +24,12 @@ private:
     CONSOLE_SCREEN_BUFFER_INFO progressPos;
     time_t lastJobChange;
     QString lastHint;
+
+    /**
+     * the changes are received directly in the thread that published them
+     * (see Job). This mutex protects the fields above.
+     */
+    QMutex mutex;
 public:
     explicit CLProgress(QObject *parent = 0);
 
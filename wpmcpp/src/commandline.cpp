@@ -217,16 +217,33 @@ QString CommandLine::parse()
         }
         LocalFree(szArglist);
 
-        while (params.count() > 0) {
-            err = processOneParam(&params);
-            if (!err.isEmpty())
-                break;
-        }
+        err = parse(params);
+    }
+
+    return err;
+}
+
+QString CommandLine::parse(const QStringList& params)
+{
+    QString err;
+
+    this->arguments = params;
+
+    QStringList ps = params;
+    while (ps.count() > 0) {
+        err = processOneParam(&ps);
+        if (!err.isEmpty())
+            break;
     }
 
     return err;
 }
 
+QStringList CommandLine::getArguments() const
+{
+    return arguments;
+}
+
 bool CommandLine::isPresent(const QString& name)
 {
     bool r = false;
@@ -64,6 +64,7 @@ private:
     QList<Option*> options;
     QList<ParsedOption*> parsedOptions;
     QStringList freeArguments;
+    QStringList arguments;
 
     Option* findOption(const QString& name);
     QString processOneParam(QStringList* params);
@@ -109,6 +110,19 @@ public:
      */
     QString parse();
 
+    /**
+     * Parses the specified arguments
+     *
+     * @param params arguments without the program name
+     * @return error message or ""
+     */
+    QString parse(const QStringList& params);
+
+    /**
+     * @return all arguments passed to parse() without the program name
+     */
+    QStringList getArguments() const;
+
     /**
      * @param name name of the option
      * @return true if the given option is present at least once in the command
@@ -6,16 +6,22 @@
 #include <QSqlError>
 #include <QSqlQuery>
 #include <QDir>
+#include <QFileInfo>
 #include <QVariant>
 #include <QTextStream>
 #include <QByteArray>
 #include <QDebug>
 #include <QXmlStreamWriter>
 #include <QSqlRecord>
-#include <QTemporaryDir>
 #include <QtConcurrent/QtConcurrentRun>
 #include <QFuture>
 #include <QSqlResult>
+#include <QBuffer>
+#include <QThread>
+#include <QSet>
+
+#include <quazip.h>
+#include <quazipfile.h>
 
 #include "package.h"
 #include "repository.h"
@@ -24,7 +30,7 @@
 #include "installedpackages.h"
 #include "hrtimer.h"
 #include "mysqlquery.h"
-#include "repositoryxmlhandler.h"
+#include "repositoryxmlreader.h"
 #include "downloader.h"
 
 static bool packageVersionLessThan3(const PackageVersion* a,
@@ -38,8 +44,59 @@ static bool packageVersionLessThan3(const PackageVersion* a,
     return r > 0;
 }
 
+/**
+ * @brief stores one part of a repository parsed in a separate thread.
+ *     Duplicates are not searched for here. They are ignored while saving
+ *     the data in the database.
+ */
+class RepositoryPart: public Repository
+{
+public:
+    QString savePackage(Package* p, bool /*replace*/)
+    {
+        packages.append(p->clone());
+        return "";
+    }
+
+    QString savePackageVersion(PackageVersion* p, bool /*replace*/)
+    {
+        packageVersions.append(p->clone());
+        return "";
+    }
+
+    QString saveLicense(License* p, bool /*replace*/)
+    {
+        licenses.append(p->clone());
+        return "";
+    }
+};
+
+/**
+ * @brief parses a part of a repository. This function is called from
+ *     multiple threads.
+ * @param xml repository XML
+ * @param from start of the part
+ * @param to end of the part
+ * @param rep the data will be stored here
+ * @return error message
+ */
+static QString parseRepositoryPart(const QByteArray& xml, int from, int to,
+        RepositoryPart* rep)
+{
+    RepositoryXMLReader reader(rep);
+    return reader.readPart(xml, from, to);
+}
+
+/**
+ * repositories starting from this size (uncompressed, in bytes) are parsed
+ * using multiple threads
+ */
+static const qint64 PARALLEL_PARSING_SIZE = 1024 * 1024;
+
 DBRepository DBRepository::def;
 
+QThreadStorage<DBRepository*> DBRepository::readOnlyRepositories;
+
 DBRepository::DBRepository()
 {
     currentRepository = -1;
@@ -50,6 +107,9 @@ DBRepository::DBRepository()
     deleteLinkQuery = 0;
     replacePackageQuery = 0;
     selectCategoryQuery = 0;
+    categoriesLoaded = false;
+    removeConnection = false;
+    dataVersion = -1;
 }
 
 DBRepository::~DBRepository()
@@ -61,6 +121,15 @@ DBRepository::~DBRepository()
     delete replacePackageQuery;
     delete replacePackageVersionQuery;
     delete insertPackageVersionQuery;
+
+    // QThreadStorage deletes the per-thread repositories when the thread
+    // ends (or when QCoreApplication is destroyed for the main thread)
+    if (removeConnection) {
+        QString name = db.connectionName();
+        db.close();
+        db = QSqlDatabase();
+        QSqlDatabase::removeDatabase(name);
+    }
 }
 
 DBRepository* DBRepository::getDefault()
@@ -68,6 +137,41 @@ DBRepository* DBRepository::getDefault()
     return &def;
 }
 
+DBRepository* DBRepository::getReadOnly(QString* err)
+{
+    *err = "";
+
+    if (!readOnlyRepositories.hasLocalData()) {
+        // a connection can only be used in the thread where it was created
+        DBRepository* r = new DBRepository();
+        *err = r->openDefault("readonly" + QString::number(
+                (qulonglong) QThread::currentThreadId()), true);
+        r->removeConnection = true;
+        if (!err->isEmpty()) {
+            delete r;
+            return 0;
+        }
+        readOnlyRepositories.setLocalData(r);
+    }
+
+    return readOnlyRepositories.localData();
+}
+
+QString DBRepository::beginSnapshot()
+{
+    // the snapshot is taken with the first SELECT. Reading from a small
+    // table is enough.
+    QString err = exec("BEGIN DEFERRED TRANSACTION");
+    if (err.isEmpty())
+        count("SELECT COUNT(*) FROM REPOSITORY", &err);
+    return err;
+}
+
+QString DBRepository::endSnapshot()
+{
+    return exec("COMMIT");
+}
+
 QString DBRepository::exec(const QString& sql)
 {
     MySQLQuery q(db);
@@ -210,15 +314,15 @@ Package *DBRepository::findPackage_(const QString &name)
         int cat4 = q.value(9).toInt();
         QString c;
         if (cat0 > 0) {
-            c.append(findCategory(cat0));
-            if (cat1 > 0) {
-                c.append('/').append(findCategory(cat1));
-                if (cat2 > 0) {
-                    c.append('/').append(findCategory(cat2));
-                    if (cat3 > 0) {
-                        c.append('/').append(findCategory(cat3));
-                        if (cat4 > 0)
-                            c.append('/').append(findCategory(cat4));
+            c.append(findCategory(cat0, &err));
+            if (cat1 > 0 && err.isEmpty()) {
+                c.append('/').append(findCategory(cat1, &err));
+                if (cat2 > 0 && err.isEmpty()) {
+                    c.append('/').append(findCategory(cat2, &err));
+                    if (cat3 > 0 && err.isEmpty()) {
+                        c.append('/').append(findCategory(cat3, &err));
+                        if (cat4 > 0 && err.isEmpty())
+                            c.append('/').append(findCategory(cat4, &err));
                     }
                 }
             }
@@ -307,8 +411,31 @@ QList<Package*> DBRepository::findPackages(const QStringList& names)
     return ret;
 }
 
-QString DBRepository::findCategory(int cat) const
+QString DBRepository::refreshCaches()
+{
+    QString err;
+
+    // the value only changes if another connection commits a change
+    int v = count("PRAGMA data_version", &err);
+    if (err.isEmpty() && v != dataVersion) {
+        this->categories.clear();
+        this->categoriesLoaded = false;
+        this->licenses.clear();
+        dataVersion = v;
+    }
+
+    return err;
+}
+
+QString DBRepository::findCategory(int cat, QString* err) const
 {
+    *err = "";
+
+    // the categories are only necessary for some commands and the GUI and are
+    // not read during the start
+    if (!categoriesLoaded)
+        *err = readCategories();
+
     return categories.value(cat);
 }
 
@@ -443,14 +570,11 @@ License *DBRepository::findLicense_(const QString& name, QString *err)
     return r;
 }
 
-QStringList DBRepository::findPackages(Package::Status status,
+QString DBRepository::createWhere(Package::Status status,
         bool filterByStatus,
-        const QString& query, int cat0, int cat1, QString *err) const
+        const QString& query, int cat0, int cat1, QList<QVariant>* params)
 {
-    // qDebug() << "DBRepository::findPackages.0";
-
     QString where;
-    QList<QVariant> params;
 
     QStringList keywords = query.toLower().simplified().split(" ",
             QString::SkipEmptyParts);
@@ -461,7 +585,7 @@ QStringList DBRepository::findPackages(Package::Status status,
             if (!where.isEmpty())
                 where += " AND ";
             where += "FULLTEXT LIKE :FULLTEXT" + QString::number(i);
-            params.append(QString("%" + kw.toLower() + "%"));
+            params->append(QString("%" + kw.toLower() + "%"));
         }
     }
     if (filterByStatus) {
@@ -471,7 +595,7 @@ QStringList DBRepository::findPackages(Package::Status status,
             where += "STATUS >= :STATUS";
         else
             where += "STATUS = :STATUS";
-        params.append(QVariant((int) status));
+        params->append(QVariant((int) status));
     }
 
     if (cat0 == 0) {
@@ -482,7 +606,7 @@ QStringList DBRepository::findPackages(Package::Status status,
         if (!where.isEmpty())
             where += " AND ";
         where += "CATEGORY0 = :CATEGORY0";
-        params.append(QVariant((int) cat0));
+        params->append(QVariant((int) cat0));
     }
 
     if (cat1 == 0) {
@@ -493,17 +617,75 @@ QStringList DBRepository::findPackages(Package::Status status,
         if (!where.isEmpty())
             where += " AND ";
         where += "CATEGORY1 = :CATEGORY1";
-        params.append(QVariant((int) cat1));
+        params->append(QVariant((int) cat1));
     }
 
     if (!where.isEmpty())
         where = "WHERE " + where;
 
+    return where;
+}
+
+QStringList DBRepository::findPackages(Package::Status status,
+        bool filterByStatus,
+        const QString& query, int cat0, int cat1, QString *err) const
+{
+    // qDebug() << "DBRepository::findPackages.0";
+
+    QList<QVariant> params;
+    QString where = createWhere(status, filterByStatus, query, cat0, cat1,
+            &params);
+
     // qDebug() << "DBRepository::findPackages.1";
 
     return findPackagesWhere(where, params, err);
 }
 
+QList<QStringList> DBRepository::findPackageRows(Package::Status status,
+        bool filterByStatus, const QString& query, QString *err) const
+{
+    *err = "";
+
+    QList<QVariant> params;
+    QString where = createWhere(status, filterByStatus, query, -1, -1,
+            &params);
+
+    QList<QStringList> r;
+    MySQLQuery q(db);
+
+    QString sql = "SELECT NAME, FULLTEXT, CATEGORY0, CATEGORY1 FROM PACKAGE";
+
+    if (!where.isEmpty())
+        sql += " " + where;
+
+    sql += " ORDER BY TITLE";
+
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        for (int i = 0; i < params.count(); i++) {
+            q.bindValue(i, params.at(i));
+        }
+    }
+
+    if (err->isEmpty()) {
+        if (!q.exec())
+            *err = getErrorString(q);
+
+        while (q.next()) {
+            QStringList sl;
+            sl.append(q.value(0).toString());
+            sl.append(q.value(1).toString());
+            sl.append(q.value(2).toString());
+            sl.append(q.value(3).toString());
+            r.append(sl);
+        }
+    }
+
+    return r;
+}
+
 QStringList DBRepository::getCategories(const QStringList& ids, QString* err)
 {
     *err = "";
@@ -542,6 +724,24 @@ QList<QStringList> DBRepository::findCategories(Package::Status status,
     QStringList keywords = query.toLower().simplified().split(" ",
             QString::SkipEmptyParts);
 
+    // the categories for the navigation without a search query are
+    // precomputed
+    if (keywords.isEmpty() && cat1 < 0 &&
+            ((level == 0 && cat0 < 0) || (level == 1 && cat0 >= 0))) {
+        int statusFilter = -1;
+        if (filterByStatus) {
+            if (status == Package::INSTALLED ||
+                    status == Package::UPDATEABLE)
+                statusFilter = status;
+            else
+                statusFilter = -2;
+        }
+
+        if (statusFilter != -2)
+            return findCategoryFacets(statusFilter, level,
+                    level == 0 ? -1 : cat0, err);
+    }
+
     for (int i = 0; i < keywords.count(); i++) {
         if (!where.isEmpty())
             where += " AND ";
@@ -618,6 +818,52 @@ QList<QStringList> DBRepository::findCategories(Package::Status status,
     return r;
 }
 
+QList<Package*> DBRepository::findPackagesPage(Package::Status status,
+        bool filterByStatus, const QString& query, int offset, int max,
+        QString* err) const
+{
+    *err = "";
+
+    QList<Package*> r;
+
+    QList<QVariant> params;
+    QString where = createWhere(status, filterByStatus, query, -1, -1,
+            &params);
+
+    QString sql = "SELECT NAME, TITLE, DESCRIPTION FROM PACKAGE";
+    if (!where.isEmpty())
+        sql += " " + where;
+
+    // LIMIT -1 means "no limit" in SQLite
+    sql += " ORDER BY TITLE LIMIT :LIMIT OFFSET :OFFSET";
+    params.append(max);
+    params.append(offset);
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        for (int i = 0; i < params.count(); i++) {
+            q.bindValue(i, params.at(i));
+        }
+
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty()) {
+        while (q.next()) {
+            Package* p = new Package(q.value(0).toString(),
+                    q.value(1).toString());
+            p->description = q.value(2).toString();
+            r.append(p);
+        }
+    }
+
+    return r;
+}
+
 QStringList DBRepository::findPackagesWhere(const QString& where,
         const QList<QVariant>& params,
         QString *err) const
@@ -961,7 +1207,7 @@ QList<Package*> DBRepository::findPackagesByShortName(const QString &name)
                 q.value(7).toInt(),
                 q.value(8).toInt(),
                 q.value(9).toInt(),
-                q.value(10).toInt());
+                q.value(10).toInt(), &err);
         if (!path.isEmpty())
             p->categories.append(path);
 
@@ -1091,6 +1337,7 @@ QString DBRepository::clear()
     Job* job = new Job();
 
     this->categories.clear();
+    this->categoriesLoaded = false;
 
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.1,
@@ -1136,6 +1383,8 @@ QString DBRepository::clear()
         Job* sub = job->newSubJob(0.04,
                 QObject::tr("Clearing the categories table"));
         QString err = exec("DELETE FROM CATEGORY");
+        if (err.isEmpty())
+            err = exec("DELETE FROM CATEGORY_FACET");
         if (!err.isEmpty())
             job->setErrorMessage(err);
         else {
@@ -1154,7 +1403,14 @@ QString DBRepository::clear()
 void DBRepository::load(Job* job, bool useCache, bool interactive)
 {
     QString err;
-    QList<QUrl*> urls = AbstractRepository::getRepositoryURLs(&err);
+    QList<QUrl*> urls;
+    if (repositoryURLs.isEmpty())
+        urls = AbstractRepository::getRepositoryURLs(&err);
+    else {
+        for (int i = 0; i < repositoryURLs.count(); i++) {
+            urls.append(new QUrl(repositoryURLs.at(i)));
+        }
+    }
     if (urls.count() > 0) {
         QStringList reps;
         for (int i = 0; i < urls.size(); i++) {
@@ -1168,8 +1424,29 @@ void DBRepository::load(Job* job, bool useCache, bool interactive)
                     err));
 
         QList<QFuture<QTemporaryFile*> > files;
+        QList<Downloader::Response*> responses;
+
+        // local files and files on network shares are parsed in place.
+        // 0 for downloaded repositories.
+        QList<QFile*> localFiles;
         for (int i = 0; i < urls.count(); i++) {
             QUrl* url = urls.at(i);
+            Downloader::Response* response = new Downloader::Response();
+            responses.append(response);
+
+            QString localFile;
+            if (url->scheme() == "file")
+                localFile = url->toLocalFile();
+            if (!localFile.isEmpty() && QFileInfo(localFile).isAbsolute()) {
+                localFiles.append(new QFile(localFile));
+                files.append(QFuture<QTemporaryFile*>());
+                continue;
+            }
+            localFiles.append(0);
+
+            // a real Job and not a JobStep: the downloads run in parallel
+            // threads and Downloader reports its progress and the
+            // cancellation through a Job. There is only one per repository.
             Job* s = job->newSubJob(0.1,
                     QObject::tr("Downloading %1").
                     arg(url->toDisplayString()), false, true);
@@ -1177,8 +1454,15 @@ void DBRepository::load(Job* job, bool useCache, bool interactive)
             Downloader::Request request = *url;
             request.useCache = useCache;
             request.interactive = interactive;
+
+            // the errors are ignored here. The repository will be
+            // downloaded fully.
+            if (useCache)
+                getRepositoryValidators(reps.at(i), &request.ifNoneMatch,
+                        &request.ifModifiedSince);
+
             QFuture<QTemporaryFile*> future = QtConcurrent::run(
-                    Downloader::downloadToTemporary, s, request);
+                    Downloader::downloadToTemporary, s, request, response);
             files.append(future);
         }
 
@@ -1192,13 +1476,37 @@ void DBRepository::load(Job* job, bool useCache, bool interactive)
             if (!job->shouldProceed())
                 break;
 
-            QTemporaryFile* tf = files.at(i).result();
+            QFile* f = localFiles.at(i);
+            QTemporaryFile* tf = f ? 0 : files.at(i).result();
+            if (!f)
+                f = tf;
+
+            // loadOne() creates visible sub-jobs for the parsing
             Job* s = job->newSubJob(0.49 / urls.count(), QString(
                     QObject::tr("Repository %1 of %2")).arg(i + 1).
                     arg(urls.count()));
-            this->currentRepository = i;
-            // this is currently unnecessary clearRepository(i);
-            loadOne(s, tf);
+
+            // 304 Not Modified: the repository stored by the last download
+            // is used
+            Downloader::Response* response = responses.at(i);
+            if (tf && response->notModified) {
+                QByteArray content = getRepositoryContent(reps.at(i), &err);
+                if (err.isEmpty()) {
+                    if (!tf->open() || tf->write(content) != content.length())
+                        err = tf->errorString();
+                    tf->close();
+                }
+                if (!err.isEmpty()) {
+                    s->setErrorMessage(err);
+                    s->complete();
+                }
+            }
+
+            if (s->shouldProceed()) {
+                this->currentRepository = i;
+                // this is currently unnecessary clearRepository(i);
+                loadOne(s, f);
+            }
             if (!s->getErrorMessage().isEmpty()) {
                 job->setErrorMessage(QString(
                         QObject::tr("Error loading the repository %1: %2")).arg(
@@ -1206,15 +1514,36 @@ void DBRepository::load(Job* job, bool useCache, bool interactive)
                         s->getErrorMessage()));
                 break;
             }
+
+            // the repository is stored for the next conditional request
+            if (!response->notModified && (!response->etag.isEmpty() ||
+                    !response->lastModified.isEmpty())) {
+                QByteArray content;
+                if (tf->open()) {
+                    content = tf->readAll();
+                    tf->close();
+                }
+                err = setRepositoryContent(reps.at(i), response->etag,
+                        response->lastModified, content);
+                if (!err.isEmpty()) {
+                    job->setErrorMessage(err);
+                    break;
+                }
+            }
         }
 
         for (int i = 0; i < urls.count(); i++) {
             if (!job->shouldProceed())
                 break;
 
-            QTemporaryFile* tf = files.at(i).result();
-            delete tf;
+            if (!localFiles.at(i)) {
+                QTemporaryFile* tf = files.at(i).result();
+                delete tf;
+            }
         }
+
+        qDeleteAll(localFiles);
+        qDeleteAll(responses);
     } else {
         job->setErrorMessage(QObject::tr("No repositories defined"));
         job->setProgress(1);
@@ -1229,54 +1558,191 @@ void DBRepository::load(Job* job, bool useCache, bool interactive)
 }
 
 void DBRepository::loadOne(Job* job, QFile* f) {
-    QTemporaryDir* dir = 0;
+    // the data is read from the file or from the memory mapped file
+    QIODevice* in = f;
+    QByteArray mappedData;
+    QBuffer mappedBuffer;
+    if (job->shouldProceed()) {
+        if (!f->open(QFile::ReadOnly))
+            job->setErrorMessage(QObject::tr("Cannot open the file %1: %2").
+                    arg(f->fileName()).arg(f->errorString()));
+        else {
+            // a mapped file on a network share or a removable drive causes
+            // an access violation if the connection is lost. UNC paths are
+            // never mapped.
+            QString path = QDir::toNativeSeparators(
+                    QFileInfo(*f).absoluteFilePath());
+            bool fixed = false;
+            if (path.length() >= 3 && path.at(1) == ':' &&
+                    path.at(2) == '\\') {
+                QString root = path.left(3);
+                fixed = GetDriveType((WCHAR*) root.utf16()) == DRIVE_FIXED;
+            }
+
+            uchar* mapped = fixed && f->size() > 0 ?
+                    f->map(0, f->size()) : 0;
+            if (mapped) {
+                // fromRawData does not copy the data
+                mappedData = QByteArray::fromRawData((const char*) mapped,
+                        f->size());
+                mappedBuffer.setBuffer(&mappedData);
+                mappedBuffer.open(QIODevice::ReadOnly);
+                in = &mappedBuffer;
+            }
+            job->setProgress(0.05);
+        }
+    }
+
+    // Rep.xml is read directly from a repository in ZIP format
+    QuaZip* zip = 0;
+    QuaZipFile* zipFile = 0;
     if (job->shouldProceed()) {
-        if (f->open(QFile::ReadOnly) &&
-                f->seek(0) && f->read(4) == QByteArray::fromRawData(
-                "PK\x03\x04", 4)) {
-            f->close();
-
-            dir = new QTemporaryDir();
-            if (dir->isValid()) {
-                Job* sub = job->newSubJob(0.1, QObject::tr("Extracting"));
-                WPMUtils::unzip(sub, f->fileName(), dir->path() + "\\");
-                if (!sub->getErrorMessage().isEmpty()) {
+        bool isZIP = in->peek(4) == QByteArray::fromRawData(
+                "PK\x03\x04", 4);
+        if (isZIP) {
+            zip = new QuaZip(in);
+            if (!zip->open(QuaZip::mdUnzip)) {
+                job->setErrorMessage(
+                        QObject::tr("Unzipping the repository %1 failed: %2").
+                        arg(f->fileName()).arg(zip->getZipError()));
+            } else if (!zip->setCurrentFile("Rep.xml",
+                    QuaZip::csInsensitive)) {
+                job->setErrorMessage(QObject::tr(
+                        "Rep.xml is missing in a repository in ZIP format"));
+            } else {
+                zipFile = new QuaZipFile(zip);
+                if (!zipFile->open(QIODevice::ReadOnly)) {
                     job->setErrorMessage(
                             QObject::tr("Unzipping the repository %1 failed: %2").
-                            arg(f->fileName()).
-                            arg(sub->getErrorMessage()));
+                            arg(f->fileName()).arg(zipFile->getZipError()));
                 } else {
-                    QString repfn = dir->path() + "\\Rep.xml";
-                    if (QFile::exists(repfn)) {
-                        f = new QFile(repfn);
-                    } else {
-                        job->setErrorMessage(QObject::tr(
-                                "Rep.xml is missing in a repository in ZIP format"));
-                    }
+                    in = zipFile;
                 }
             }
         }
-        f->close();
+        if (job->shouldProceed())
+            job->setProgress(0.1);
+    }
+
+    // big repositories are parsed using multiple threads
+    QByteArray xml;
+    bool parsed = false;
+    int threads = QThread::idealThreadCount();
+    if (job->shouldProceed() && threads > 1) {
+        qint64 size = zipFile ? zipFile->usize() : f->size();
+        if (size >= PARALLEL_PARSING_SIZE) {
+            xml = in == &mappedBuffer ? mappedData : in->readAll();
+            Job* sub = job->newSubJob(0.9, QObject::tr("Parsing XML"));
+            parsed = loadParts(sub, xml, threads);
+            if (parsed) {
+                if (!sub->getErrorMessage().isEmpty())
+                    job->setErrorMessage(sub->getErrorMessage());
+                else
+                    job->setProgress(1);
+            }
+        }
     }
 
-    if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.9, QObject::tr("Parsing XML"));
-        RepositoryXMLHandler handler(this);
-        QXmlSimpleReader reader;
-        reader.setContentHandler(&handler);
-        reader.setErrorHandler(&handler);
-        QXmlInputSource inputSource(f);
-        if (!reader.parse(inputSource))
-            job->setErrorMessage(handler.errorString());
+    // the reader reports errors exactly as they occur in the document
+    if (job->shouldProceed() && !parsed) {
+        // the progress was already reported by the failed parallel parsing
+        Job* sub = job->newSubJob(xml.isNull() ? 0.9 : 0,
+                QObject::tr("Parsing XML"));
+        RepositoryXMLReader reader(this);
+        QString err = xml.isNull() ? reader.read(in) : reader.read(xml);
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
         else {
             sub->completeWithProgress();
             job->setProgress(1);
         }
     }
 
-    delete dir;
+    delete zipFile;
+    delete zip;
+    mappedBuffer.close();
+    f->close();
+
+    job->complete();
+}
+
+bool DBRepository::loadParts(Job* job, const QByteArray& xml, int threads)
+{
+    QString initialTitle = job->getTitle();
+
+    // more parts than threads even out the different parsing speed
+    QList<int> bounds = RepositoryXMLReader::split(xml, threads * 4);
+    int n = bounds.count() - 1;
+    if (n < 2) {
+        job->complete();
+        return false;
+    }
+
+    // the saved parts are rolled back if one of the following parts cannot
+    // be parsed. A savepoint also works inside of the transaction from
+    // updateF5.
+    QString err = exec("SAVEPOINT LOAD_PARTS");
+    if (!err.isEmpty()) {
+        job->setErrorMessage(err);
+        job->complete();
+        return true;
+    }
+
+    QList<RepositoryPart*> parts;
+    QList<QFuture<QString> > results;
+    for (int i = 0; i < n; i++) {
+        RepositoryPart* rep = new RepositoryPart();
+        parts.append(rep);
+        results.append(QtConcurrent::run(parseRepositoryPart, xml,
+                bounds.at(i), bounds.at(i + 1), rep));
+    }
+
+    // the parts are saved by this thread in the document order. The
+    // following parts are parsed in the mean time.
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        err = results[i].result();
+        if (!err.isEmpty())
+            ok = false;
+
+        if (ok && job->shouldProceed()) {
+            RepositoryPart* rep = parts.at(i);
+            err = savePackages(rep, false);
+            if (err.isEmpty())
+                err = savePackageVersions(rep, false);
+            if (err.isEmpty())
+                err = saveLicenses(rep, false);
+            if (!err.isEmpty())
+                job->setErrorMessage(err);
+            else
+                job->setProgress((i + 1.0) / n);
+        }
+
+        // the memory is released as early as possible
+        delete parts.at(i);
+        parts[i] = 0;
+
+        if (ok)
+            job->setTitle(initialTitle + " / " +
+                    QObject::tr("%1 of %2 parts").arg(i + 1).arg(n));
+    }
+
+    if (!ok || !job->getErrorMessage().isEmpty())
+        exec("ROLLBACK TO LOAD_PARTS");
+    err = exec("RELEASE LOAD_PARTS");
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+
+    job->setTitle(initialTitle);
 
     job->complete();
+
+    return ok;
+}
+
+void DBRepository::useRepositories(const QStringList& urls)
+{
+    this->repositoryURLs = urls;
 }
 
 void DBRepository::updateF5(Job* job, bool interactive)
@@ -1334,8 +1800,8 @@ void DBRepository::updateF5(Job* job, bool interactive)
 
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.1,
-                QObject::tr("Updating the status for installed packages in the database (tempdb)"));
-        updateStatusForInstalled(sub);
+                QObject::tr("Updating the status for packages in the database (tempdb)"));
+        updateStatusForAll(sub);
         if (!sub->getErrorMessage().isEmpty())
             job->setErrorMessage(sub->getErrorMessage());
     }
@@ -1417,6 +1883,12 @@ void DBRepository::updateF5Runnable(Job *job)
         }
     }
 
+    if (job->shouldProceed()) {
+        // the error is ignored here. All repositories will be downloaded
+        // fully in this case.
+        tempdb.importRepositories();
+    }
+
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.77,
                 QObject::tr("Updating the temporary database"), true, true);
@@ -1459,72 +1931,231 @@ void DBRepository::updateF5Runnable(Job *job)
     */
 }
 
+void DBRepository::prefetchUpdates(Job* job, qint64 maxBytesPerSecond)
+{
+    QString initialTitle = job->getTitle();
+
+    QList<Package*> packages;
+    if (job->shouldProceed()) {
+        QString err;
+        QStringList names = findPackages(Package::UPDATEABLE, true, "", -1, -1,
+                &err);
+        if (err.isEmpty()) {
+            packages = findPackages(names);
+            job->setProgress(0.05);
+        } else {
+            job->setErrorMessage(err);
+        }
+    }
+
+    // every package is planned separately so that a problem with one of
+    // them does not prevent the other downloads
+    QStringList errors;
+    QList<PackageVersion*> pvs;
+    if (job->shouldProceed()) {
+        QSet<QString> used;
+        for (int i = 0; i < packages.count(); i++) {
+            Package* p = packages.at(i);
+            QList<Package*> one;
+            one.append(p);
+            QList<InstallOperation*> ops;
+            QString err = planUpdates(one, QList<Dependency*>(), ops);
+            for (int j = 0; err.isEmpty() && j < ops.count(); j++) {
+                InstallOperation* op = ops.at(j);
+                if (op->install) {
+                    PackageVersion* pv = op->findPackageVersion(&err, this);
+
+                    // PackageVersion::toString() would use the default
+                    // repository from another thread
+                    QString key = pv ? pv->package + " " +
+                            pv->version.getVersionString() : QString();
+                    if (pv && !used.contains(key)) {
+                        used.insert(key);
+                        pvs.append(pv);
+                    } else {
+                        delete pv;
+                    }
+                }
+            }
+            qDeleteAll(ops);
+
+            if (!err.isEmpty())
+                errors.append(p->title + ": " + err);
+        }
+        job->setProgress(0.1);
+    }
+
+    for (int i = 0; i < pvs.count(); i++) {
+        if (!job->shouldProceed())
+            break;
+
+        PackageVersion* pv = pvs.at(i);
+        QString title = pv->package + " " + pv->version.getVersionString();
+        Job* sub = job->newSubJob(0.9 / pvs.count(),
+                QObject::tr("Downloading %1").arg(title));
+        pv->prefetch(sub, maxBytesPerSecond);
+        if (!sub->getErrorMessage().isEmpty())
+            errors.append(title + ": " + sub->getErrorMessage());
+    }
+
+    if (job->shouldProceed() && !errors.isEmpty())
+        job->setErrorMessage(errors.join("\n"));
+
+    qDeleteAll(pvs);
+    qDeleteAll(packages);
+
+    job->setTitle(initialTitle);
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+}
+
+void DBRepository::prefetchUpdatesRunnable(Job* job, qint64 maxBytesPerSecond)
+{
+    QThread::currentThread()->setPriority(QThread::IdlePriority);
+    bool b = SetThreadPriority(GetCurrentThread(),
+            THREAD_MODE_BACKGROUND_BEGIN);
+
+    QString err;
+    DBRepository* r = getReadOnly(&err);
+    if (r) {
+        r->prefetchUpdates(job, maxBytesPerSecond);
+    } else {
+        job->setErrorMessage(err);
+        job->complete();
+    }
+
+    if (b)
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+}
+
 void DBRepository::saveAll(Job* job, Repository* r, bool replace)
 {
+    // this function is called very often. No sub-jobs are created here.
+    QString initialTitle = job->getTitle();
+
     if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.07,
+        job->setTitle(initialTitle + " / " +
                 QObject::tr("Inserting data in the packages table"));
         QString err = savePackages(r, replace);
         if (err.isEmpty())
-            sub->completeWithProgress();
+            job->setProgress(0.07);
         else
             job->setErrorMessage(err);
     }
 
     if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.89,
+        job->setTitle(initialTitle + " / " +
                 QObject::tr("Inserting data in the package versions table"));
         QString err = savePackageVersions(r, replace);
         if (err.isEmpty())
-            sub->completeWithProgress();
+            job->setProgress(0.96);
         else
             job->setErrorMessage(err);
     }
 
     if (job->shouldProceed()) {
-        Job* sub = job->newSubJob(0.04,
+        job->setTitle(initialTitle + " / " +
                 QObject::tr("Inserting data in the licenses table"));
         QString err = saveLicenses(r, replace);
         if (err.isEmpty())
-            sub->completeWithProgress();
+            job->setProgress(1);
         else
             job->setErrorMessage(err);
     }
 
+    job->setTitle(initialTitle);
+
     job->complete();
 }
 
-void DBRepository::updateStatusForInstalled(Job* job)
+void DBRepository::updateStatusForAll(Job* job)
 {
     QString initialTitle = job->getTitle();
 
-    QSet<QString> packages;
+    // a savepoint starts a transaction if there is none and also works inside
+    // of an outer transaction (e.g. from updateF5)
+    bool savepoint = false;
     if (job->shouldProceed()) {
-        QList<InstalledPackageVersion*> pvs = InstalledPackages::getDefault()->getAll();
-        for (int i = 0; i < pvs.count(); i++) {
-            InstalledPackageVersion* pv = pvs.at(i);
-            packages.insert(pv->package);
-        }
-        qDeleteAll(pvs);
-        pvs.clear();
-        job->setProgress(0.1);
+        QString err = exec("SAVEPOINT UPDATE_STATUS");
+        if (err.isEmpty())
+            savepoint = true;
+        else
+            job->setErrorMessage(err);
+    }
+
+    int total = 0;
+    if (job->shouldProceed()) {
+        QString err;
+        total = count("SELECT COUNT(*) FROM PACKAGE_VERSION", &err);
+        if (err.isEmpty())
+            job->setProgress(0.05);
+        else
+            job->setErrorMessage(err);
+    }
+
+    // all versions are read only once. The versions of one package are
+    // consecutive.
+    MySQLQuery q(db);
+    if (job->shouldProceed()) {
+        QString err;
+        if (!q.prepare("SELECT PACKAGE, NAME, URL FROM PACKAGE_VERSION "
+                "ORDER BY PACKAGE"))
+            err = getErrorString(q);
+        if (err.isEmpty() && !q.exec())
+            err = getErrorString(q);
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
     }
 
     if (job->shouldProceed()) {
         job->setTitle(initialTitle + " / " +
                 QObject::tr("Updating statuses"));
-        QList<QString> packages_ = packages.values();
-        for (int i = 0; i < packages_.count(); i++) {
-            QString package = packages_.at(i);
-            updateStatus(package);
-
-            if (!job->shouldProceed())
-                break;
+        Job* sub = job->newSubJob(0.85);
+        updateStatuses(sub, &q, total);
+        if (!sub->getErrorMessage().isEmpty())
+            job->setErrorMessage(sub->getErrorMessage());
+    }
 
-            job->setProgress(0.1 + 0.9 * (i + 1) / packages_.count());
+    // packages without versions
+    if (job->shouldProceed()) {
+        QString err;
+        MySQLQuery u(db);
+        if (!u.prepare("UPDATE PACKAGE SET STATUS=:STATUS, "
+                "INSTALLED_VERSIONS='', NEWEST_VERSION='', NEWEST_URL='' "
+                "WHERE NOT EXISTS (SELECT * FROM PACKAGE_VERSION "
+                "WHERE PACKAGE = PACKAGE.NAME)"))
+            err = getErrorString(u);
+        if (err.isEmpty()) {
+            u.bindValue(":STATUS", Package::NOT_INSTALLED);
+            if (!u.exec())
+                err = getErrorString(u);
         }
+        if (err.isEmpty())
+            job->setProgress(0.95);
+        else
+            job->setErrorMessage(err);
     }
 
+    if (job->shouldProceed()) {
+        QString err = refreshCategoryFacets();
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (savepoint) {
+        if (!job->shouldProceed())
+            exec("ROLLBACK TO UPDATE_STATUS");
+        QString err = exec("RELEASE UPDATE_STATUS");
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
     job->setTitle(initialTitle);
 
     job->complete();
@@ -1581,11 +2212,12 @@ QString DBRepository::getErrorString(const MySQLQuery &q)
             " (" + q.lastQuery() + ")";
 }
 
-QString DBRepository::readCategories()
+QString DBRepository::readCategories() const
 {
     QString err;
 
     this->categories.clear();
+    this->categoriesLoaded = false;
 
     QString sql = "SELECT ID, NAME FROM CATEGORY";
 
@@ -1602,6 +2234,7 @@ QString DBRepository::readCategories()
                 categories.insert(q.value(0).toInt(),
                         q.value(1).toString());
             }
+            categoriesLoaded = true;
         }
     }
 
@@ -1678,12 +2311,116 @@ void DBRepository::setRepositorySHA1(const QString& url, const QString& sha1,
 }
 
 
+QString DBRepository::getRepositoryValidators(const QString& url,
+        QString* etag, QString* lastModified)
+{
+    QString err;
+
+    MySQLQuery q(db);
+
+    // the values are useless without the stored content
+    QString sql = "SELECT ETAG, LAST_MODIFIED FROM REPOSITORY "
+            "WHERE URL=:URL AND CONTENT IS NOT NULL";
+    if (!q.prepare(sql))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(":URL", url);
+        if (!q.exec())
+            err = getErrorString(q);
+        else if (q.next()) {
+            *etag = q.value(0).toString();
+            *lastModified = q.value(1).toString();
+        }
+    }
+
+    return err;
+}
+
+QByteArray DBRepository::getRepositoryContent(const QString& url,
+        QString* err)
+{
+    *err = "";
+
+    QByteArray r;
+
+    MySQLQuery q(db);
+
+    if (!q.prepare("SELECT CONTENT FROM REPOSITORY WHERE URL=:URL"))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(":URL", url);
+        if (!q.exec())
+            *err = getErrorString(q);
+        else if (q.next())
+            r = q.value(0).toByteArray();
+    }
+
+    return r;
+}
+
+QString DBRepository::setRepositoryContent(const QString& url,
+        const QString& etag, const QString& lastModified,
+        const QByteArray& content)
+{
+    QString err;
+
+    MySQLQuery q(db);
+
+    QString sql = "UPDATE REPOSITORY SET ETAG=:ETAG, "
+            "LAST_MODIFIED=:LAST_MODIFIED, CONTENT=:CONTENT WHERE URL=:URL";
+    if (!q.prepare(sql))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        bool store = !etag.isEmpty() || !lastModified.isEmpty();
+        q.bindValue(":ETAG", store ? QVariant(etag) : QVariant());
+        q.bindValue(":LAST_MODIFIED", store ? QVariant(lastModified) :
+                QVariant());
+        q.bindValue(":CONTENT", store ? QVariant(content) : QVariant());
+        q.bindValue(":URL", url);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
+
+    return err;
+}
+
+QString DBRepository::importRepositories()
+{
+    QString err = exec("ATTACH '" + getDefaultPath() + "' as maindb");
+    if (err.isEmpty()) {
+        err = exec("DELETE FROM REPOSITORY");
+        if (err.isEmpty())
+            err = exec("INSERT INTO REPOSITORY(ID, URL, SHA1, ETAG, "
+                    "LAST_MODIFIED, CONTENT) SELECT ID, URL, SHA1, ETAG, "
+                    "LAST_MODIFIED, CONTENT FROM maindb.REPOSITORY");
+
+        QString e = exec("DETACH maindb");
+        if (err.isEmpty())
+            err = e;
+    }
+
+    return err;
+}
+
 QString DBRepository::saveRepositories(const QStringList &reps)
 {
-    QString err = exec("DELETE FROM REPOSITORY");
+    // the rows for the existing URLs are kept together with the data for
+    // conditional requests. The IDs are negated first as they must be
+    // unique.
+    QString err = exec("UPDATE REPOSITORY SET ID = -ID");
 
+    MySQLQuery update(db);
     MySQLQuery q(db);
 
+    if (err.isEmpty()) {
+        QString sql = "UPDATE REPOSITORY SET ID=:ID WHERE URL=:URL AND ID < 0";
+        if (!update.prepare(sql))
+            err = getErrorString(update);
+    }
+
     if (err.isEmpty()) {
         QString sql = "INSERT INTO REPOSITORY "
                 "(ID, URL)"
@@ -1694,26 +2431,44 @@ QString DBRepository::saveRepositories(const QStringList &reps)
 
     if (err.isEmpty()) {
         for (int i = 0; i < reps.size(); i++) {
-            q.bindValue(":ID", i + 1);
-            q.bindValue(":URL", reps.at(i));
-            if (!q.exec())
-                err = getErrorString(q);
+            update.bindValue(":ID", i + 1);
+            update.bindValue(":URL", reps.at(i));
+            if (!update.exec()) {
+                err = getErrorString(update);
+                break;
+            }
+
+            if (update.numRowsAffected() <= 0) {
+                q.bindValue(":ID", i + 1);
+                q.bindValue(":URL", reps.at(i));
+                if (!q.exec()) {
+                    err = getErrorString(q);
+                    break;
+                }
+            }
         }
     }
 
+    if (err.isEmpty())
+        err = exec("DELETE FROM REPOSITORY WHERE ID < 0");
+
     return err;
 }
 
 QString DBRepository::getCategoryPath(int c0, int c1, int c2, int c3,
-        int c4) const
+        int c4, QString* err) const
 {
     QString r;
 
-    QString cat0 = findCategory(c0);
-    QString cat1 = findCategory(c1);
-    QString cat2 = findCategory(c2);
-    QString cat3 = findCategory(c3);
-    QString cat4 = findCategory(c4);
+    // all names are read at once, the first call returns the error
+    QString cat0 = findCategory(c0, err);
+    if (!err->isEmpty())
+        return r;
+
+    QString cat1 = findCategory(c1, err);
+    QString cat2 = findCategory(c2, err);
+    QString cat3 = findCategory(c3, err);
+    QString cat4 = findCategory(c4, err);
 
     r = cat0;
     if (!cat1.isEmpty())
@@ -1728,60 +2483,445 @@ QString DBRepository::getCategoryPath(int c0, int c1, int c2, int c3,
     return r;
 }
 
-QString DBRepository::updateStatus(const QString& package)
+int DBRepository::updateStatuses(Job* job, MySQLQuery* q, int total)
 {
-    QString err;
-
-    QList<PackageVersion*> pvs = getPackageVersions_(package, &err);
-    PackageVersion* newestInstallable = 0;
-    PackageVersion* newestInstalled = 0;
-    if (err.isEmpty()) {
-        for (int j = 0; j < pvs.count(); j++) {
-            PackageVersion* pv = pvs.at(j);
-            if (pv->installed()) {
-                if (!newestInstalled ||
-                        newestInstalled->version.compare(pv->version) < 0)
-                    newestInstalled = pv;
+    InstalledPackages* ip = InstalledPackages::getDefault();
+
+    MySQLQuery u(db);
+    if (!u.prepare("UPDATE PACKAGE "
+            "SET STATUS=:STATUS, INSTALLED_VERSIONS=:INSTALLED_VERSIONS, "
+            "NEWEST_VERSION=:NEWEST_VERSION, NEWEST_URL=:NEWEST_URL "
+            "WHERE NAME=:NAME"))
+        job->setErrorMessage(getErrorString(u));
+
+    // data for the current package
+    QString package;
+    QList<Version> installed;
+    Version newestInstallable;
+    QString newestURL;
+    bool installable = false;
+
+    int rows = 0;
+    int packages = 0;
+    while (job->shouldProceed()) {
+        bool more = q->next();
+        QString p;
+        if (more)
+            p = q->value(0).toString();
+
+        if (!package.isEmpty() && (!more || p != package)) {
+            QString err = writeStatus(&u, package, &installed,
+                    installable ? &newestInstallable : 0, newestURL);
+            if (!err.isEmpty()) {
+                job->setErrorMessage(err);
+                break;
             }
+            packages++;
+
+            installed.clear();
+            newestURL.clear();
+            installable = false;
+        }
+
+        if (!more)
+            break;
+
+        package = p;
 
-            // qDebug() << pv->download.toString();
+        Version v;
+        if (v.setVersion(q->value(1).toString())) {
+            if (ip->isInstalled(package, v))
+                installed.append(v);
 
-            if (pv->download.isValid()) {
-                if (!newestInstallable ||
-                        newestInstallable->version.compare(pv->version) < 0)
-                    newestInstallable = pv;
+            QUrl url(q->value(2).toString());
+            if (url.isValid()) {
+                if (!installable || newestInstallable.compare(v) < 0) {
+                    newestInstallable = v;
+                    newestURL = url.toString(QUrl::FullyEncoded);
+                    installable = true;
+                }
             }
         }
+
+        rows++;
+        if (total > 0 && rows % 1000 == 0)
+            job->setProgress(((double) rows) / total);
+    }
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+
+    return packages;
+}
+
+QString DBRepository::writeStatus(MySQLQuery* u, const QString& package,
+        QList<Version>* installed, const Version* newest,
+        const QString& newestURL)
+{
+    QString err;
+
+    qSort(installed->begin(), installed->end());
+
+    QString installedVersions;
+    for (int i = installed->count() - 1; i >= 0; i--) {
+        if (!installedVersions.isEmpty())
+            installedVersions.append(", ");
+        installedVersions.append(installed->at(i).getVersionString());
     }
 
+    Package::Status status;
+    if (installed->count() > 0) {
+        bool up2date = !(newest && newest->compare(installed->last()) > 0);
+        if (up2date)
+            status = Package::INSTALLED;
+        else
+            status = Package::UPDATEABLE;
+    } else {
+        status = Package::NOT_INSTALLED;
+    }
+
+    u->bindValue(":STATUS", status);
+    u->bindValue(":INSTALLED_VERSIONS", installedVersions);
+    u->bindValue(":NEWEST_VERSION", newest ?
+            newest->getVersionString() : QString(""));
+    u->bindValue(":NEWEST_URL", newestURL);
+    u->bindValue(":NAME", package);
+    if (!u->exec())
+        err = getErrorString(*u);
+
+    return err;
+}
+
+QString DBRepository::updateStatus(const QString& package)
+{
+    // a savepoint starts a transaction if there is none and also works inside
+    // of an outer transaction
+    QString err = exec("SAVEPOINT UPDATE_PACKAGE_STATUS");
+    if (!err.isEmpty())
+        return err;
+
+    // the status and the categories before the change. Only the counts for
+    // these categories may change.
+    int oldStatus = -1, cat0 = 0, cat1 = 0;
+    bool found = false;
+    MySQLQuery s(db);
+    if (!s.prepare("SELECT STATUS, IFNULL(CATEGORY0, 0), "
+            "IFNULL(CATEGORY1, 0) FROM PACKAGE WHERE NAME = :NAME"))
+        err = getErrorString(s);
     if (err.isEmpty()) {
-        Package::Status status;
-        if (newestInstalled) {
-            bool up2date = !(newestInstalled && newestInstallable &&
-                    newestInstallable->version.compare(
-                    newestInstalled->version) > 0);
-            if (up2date)
-                status = Package::INSTALLED;
-            else
-                status = Package::UPDATEABLE;
-        } else {
-            status = Package::NOT_INSTALLED;
-        }
+        s.bindValue(":NAME", package);
+        if (!s.exec())
+            err = getErrorString(s);
+    }
+    if (err.isEmpty() && s.next()) {
+        found = true;
+        oldStatus = s.value(0).toInt();
+        cat0 = s.value(1).toInt();
+        cat1 = s.value(2).toInt();
+    }
+    s.finish();
 
-        MySQLQuery q(db);
-        if (!q.prepare("UPDATE PACKAGE "
-                "SET STATUS=:STATUS "
-                "WHERE NAME=:NAME"))
+    // only the version numbers and download URLs are necessary here. Parsing
+    // the XML for every package version would be too slow.
+    MySQLQuery q(db);
+    if (!q.prepare("SELECT PACKAGE, NAME, URL FROM PACKAGE_VERSION "
+            "WHERE PACKAGE = :PACKAGE"))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(":PACKAGE", package);
+        if (!q.exec())
             err = getErrorString(q);
+    }
 
+    int n = 0;
+    if (err.isEmpty()) {
+        Job* job = new Job();
+        n = updateStatuses(job, &q, 0);
+        err = job->getErrorMessage();
+        delete job;
+    }
+
+    // a package without versions
+    if (err.isEmpty() && n == 0) {
+        MySQLQuery u(db);
+        if (!u.prepare("UPDATE PACKAGE SET STATUS=:STATUS, "
+                "INSTALLED_VERSIONS='', NEWEST_VERSION='', NEWEST_URL='' "
+                "WHERE NAME=:NAME"))
+            err = getErrorString(u);
         if (err.isEmpty()) {
-            q.bindValue(":STATUS", status);
-            q.bindValue(":NAME", package);
-            if (!q.exec())
-                err = getErrorString(q);
+            u.bindValue(":STATUS", Package::NOT_INSTALLED);
+            u.bindValue(":NAME", package);
+            if (!u.exec())
+                err = getErrorString(u);
         }
     }
-    qDeleteAll(pvs);
+
+    // the counts without a status filter do not depend on the status
+    if (err.isEmpty() && found) {
+        s.bindValue(":NAME", package);
+        if (!s.exec())
+            err = getErrorString(s);
+        bool changed = err.isEmpty() && s.next() &&
+                s.value(0).toInt() != oldStatus;
+        s.finish();
+        if (changed)
+            err = refreshCategoryFacets(cat0, cat1);
+    }
+
+    if (!err.isEmpty())
+        exec("ROLLBACK TO UPDATE_PACKAGE_STATUS");
+    QString e = exec("RELEASE UPDATE_PACKAGE_STATUS");
+    if (err.isEmpty())
+        err = e;
+
+    return err;
+}
+
+QString DBRepository::refreshCategoryFacets(int cat0, int cat1)
+{
+    QString err;
+
+    // the status filters used by the GUI. -1 means "no filter".
+    QList<int> filters;
+    if (cat0 < 0)
+        filters.append(-1);
+    filters.append(Package::INSTALLED);
+    filters.append(Package::UPDATEABLE);
+
+    // the affected rows on both levels. Uncategorized packages have NULL in
+    // CATEGORY_FACET.CATEGORY and NULL or 0 in PACKAGE.CATEGORYx.
+    QString c0 = QString::number(cat0);
+    QString c1 = QString::number(cat1);
+    QString facets0, facets1, packages0, packages1;
+    if (cat0 >= 0) {
+        facets0 = "LEVEL = 0 AND IFNULL(CATEGORY, 0) = " + c0;
+        facets1 = "LEVEL = 1 AND PARENT = " + c0 +
+                " AND IFNULL(CATEGORY, 0) = " + c1;
+        packages0 = "IFNULL(PACKAGE.CATEGORY0, 0) = " + c0;
+        packages1 = packages0 + " AND IFNULL(PACKAGE.CATEGORY1, 0) = " + c1;
+    }
+
+    for (int i = 0; i < filters.count(); i++) {
+        if (!err.isEmpty())
+            break;
+
+        QString f = QString::number(filters.at(i));
+
+        if (cat0 < 0) {
+            err = exec("DELETE FROM CATEGORY_FACET WHERE STATUS_FILTER = " +
+                    f);
+        } else {
+            err = exec("DELETE FROM CATEGORY_FACET WHERE STATUS_FILTER = " +
+                    f + " AND ((" + facets0 + ") OR (" + facets1 + "))");
+        }
+
+        // the same condition as in createWhere
+        QString status;
+        if (filters.at(i) == Package::INSTALLED)
+            status = "PACKAGE.STATUS >= " + f;
+        else if (filters.at(i) >= 0)
+            status = "PACKAGE.STATUS = " + f;
+
+        QStringList where0, where1;
+        if (!status.isEmpty()) {
+            where0.append(status);
+            where1.append(status);
+        }
+        if (!packages0.isEmpty()) {
+            where0.append(packages0);
+            where1.append(packages1);
+        }
+
+        if (err.isEmpty())
+            err = exec("INSERT INTO CATEGORY_FACET(STATUS_FILTER, LEVEL, "
+                    "PARENT, CATEGORY, NAME, COUNT) "
+                    "SELECT " + f + ", 0, -1, CATEGORY.ID, CATEGORY.NAME, "
+                    "COUNT(*) FROM PACKAGE LEFT JOIN CATEGORY ON "
+                    "PACKAGE.CATEGORY0 = CATEGORY.ID" +
+                    (where0.isEmpty() ? QString() :
+                    " WHERE " + where0.join(" AND ")) +
+                    " GROUP BY CATEGORY.ID, CATEGORY.NAME");
+
+        if (err.isEmpty())
+            err = exec("INSERT INTO CATEGORY_FACET(STATUS_FILTER, LEVEL, "
+                    "PARENT, CATEGORY, NAME, COUNT) "
+                    "SELECT " + f + ", 1, IFNULL(PACKAGE.CATEGORY0, 0), "
+                    "CATEGORY.ID, CATEGORY.NAME, COUNT(*) FROM PACKAGE "
+                    "LEFT JOIN CATEGORY ON "
+                    "PACKAGE.CATEGORY1 = CATEGORY.ID" +
+                    (where1.isEmpty() ? QString() :
+                    " WHERE " + where1.join(" AND ")) +
+                    " GROUP BY IFNULL(PACKAGE.CATEGORY0, 0), CATEGORY.ID, "
+                    "CATEGORY.NAME");
+    }
+
+    return err;
+}
+
+QList<QStringList> DBRepository::findCategoryFacets(int statusFilter,
+        int level, int parent, QString* err) const
+{
+    *err = "";
+
+    QList<QStringList> r;
+
+    MySQLQuery q(db);
+    if (!q.prepare("SELECT CATEGORY, COUNT, NAME FROM CATEGORY_FACET "
+            "WHERE STATUS_FILTER = :STATUS_FILTER AND LEVEL = :LEVEL AND "
+            "PARENT = :PARENT ORDER BY NAME"))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(":STATUS_FILTER", statusFilter);
+        q.bindValue(":LEVEL", level);
+        q.bindValue(":PARENT", parent);
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty()) {
+        while (q.next()) {
+            QStringList sl;
+            sl.append(q.value(0).toString());
+            sl.append(q.value(1).toString());
+            sl.append(q.value(2).toString());
+            r.append(sl);
+        }
+    }
+
+    return r;
+}
+
+bool DBRepository::getPackageSummary(const QString& package,
+        QString* installed, QString* newest, QString* newestURL,
+        bool* up2date, QString* err) const
+{
+    *err = "";
+
+    bool r = false;
+
+    MySQLQuery q(db);
+    if (!q.prepare("SELECT INSTALLED_VERSIONS, NEWEST_VERSION, NEWEST_URL, "
+            "STATUS FROM PACKAGE WHERE NAME = :NAME"))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(":NAME", package);
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty() && q.next()) {
+        // INSTALLED_VERSIONS is NULL until updateStatus() was called
+        if (!q.value(0).isNull()) {
+            *installed = q.value(0).toString();
+            *newest = q.value(1).toString();
+            *newestURL = q.value(2).toString();
+            *up2date = q.value(3).toInt() != Package::UPDATEABLE;
+            r = true;
+        }
+    }
+
+    return r;
+}
+
+QMap<QString, QStringList> DBRepository::getPackageSummaries(
+        const QStringList& packages, QString* err) const
+{
+    *err = "";
+
+    QMap<QString, QStringList> r;
+
+    int start = 0;
+    int c = packages.count();
+    const int block = 50;
+
+    QString sql = "SELECT NAME, INSTALLED_VERSIONS, NEWEST_VERSION, "
+            "NEWEST_URL, STATUS FROM PACKAGE WHERE NAME IN (:NAME0";
+    for (int i = 1; i < block; i++) {
+        sql = sql + ", :NAME" + QString::number(i);
+    }
+    sql += ")";
+
+    MySQLQuery q(db);
+    if (!q.prepare(sql))
+        *err = getErrorString(q);
+
+    while (err->isEmpty() && start < c) {
+        // unused parameters match no package
+        for (int i = 0; i < block; i++) {
+            q.bindValue(":NAME" + QString::number(i),
+                    start + i < c ? packages.at(start + i) : QString());
+        }
+
+        if (!q.exec())
+            *err = getErrorString(q);
+
+        while (err->isEmpty() && q.next()) {
+            // INSTALLED_VERSIONS is NULL until updateStatus() was called
+            if (!q.value(1).isNull()) {
+                QStringList sl;
+                sl.append(q.value(1).toString());
+                sl.append(q.value(2).toString());
+                sl.append(q.value(3).toString());
+                sl.append(q.value(4).toString());
+                r.insert(q.value(0).toString(), sl);
+            }
+        }
+
+        start += block;
+    }
+
+    return r;
+}
+
+QString DBRepository::findFileHash(const QString& path, qint64 size,
+        qint64 modified, QString* err) const
+{
+    *err = "";
+
+    QString r;
+
+    MySQLQuery q(db);
+    if (!q.prepare("SELECT SHA1 FROM FILE_HASH WHERE PATH = :PATH AND "
+            "SIZE = :SIZE AND MODIFIED = :MODIFIED"))
+        *err = getErrorString(q);
+
+    if (err->isEmpty()) {
+        q.bindValue(":PATH", path);
+        q.bindValue(":SIZE", size);
+        q.bindValue(":MODIFIED", modified);
+        if (!q.exec())
+            *err = getErrorString(q);
+    }
+
+    if (err->isEmpty() && q.next())
+        r = q.value(0).toString();
+
+    return r;
+}
+
+QString DBRepository::saveFileHash(const QString& path, qint64 size,
+        qint64 modified, const QString& sha1)
+{
+    QString err;
+
+    MySQLQuery q(db);
+    if (!q.prepare("INSERT OR REPLACE INTO FILE_HASH(PATH, SIZE, MODIFIED, "
+            "SHA1) VALUES(:PATH, :SIZE, :MODIFIED, :SHA1)"))
+        err = getErrorString(q);
+
+    if (err.isEmpty()) {
+        q.bindValue(":PATH", path);
+        q.bindValue(":SIZE", size);
+        q.bindValue(":MODIFIED", modified);
+        q.bindValue(":SHA1", sha1);
+        if (!q.exec())
+            err = getErrorString(q);
+    }
 
     return err;
 }
@@ -1841,9 +2981,11 @@ void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
         QString err = exec("INSERT INTO PACKAGE(NAME, TITLE, URL, ICON, "
                 "DESCRIPTION, LICENSE, FULLTEXT, STATUS, SHORT_NAME, "
                 "REPOSITORY, CATEGORY0, CATEGORY1, CATEGORY2, CATEGORY3, "
-                "CATEGORY4) SELECT NAME, TITLE, URL, ICON, DESCRIPTION, "
+                "CATEGORY4, INSTALLED_VERSIONS, NEWEST_VERSION, NEWEST_URL) "
+                "SELECT NAME, TITLE, URL, ICON, DESCRIPTION, "
                 "LICENSE, FULLTEXT, STATUS, SHORT_NAME, REPOSITORY, "
-                "CATEGORY0, CATEGORY1, CATEGORY2, CATEGORY3, CATEGORY4 "
+                "CATEGORY0, CATEGORY1, CATEGORY2, CATEGORY3, CATEGORY4, "
+                "INSTALLED_VERSIONS, NEWEST_VERSION, NEWEST_URL "
                 "FROM tempdb.PACKAGE");
         if (err.isEmpty())
             err = exec("INSERT INTO PACKAGE_VERSION(NAME, PACKAGE, URL, "
@@ -1859,6 +3001,19 @@ void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
         if (err.isEmpty())
             err = exec("INSERT INTO LINK(PACKAGE, INDEX_, REL, HREF) "
                     "SELECT PACKAGE, INDEX_, REL, HREF FROM tempdb.LINK");
+        if (err.isEmpty())
+            err = exec("INSERT INTO CATEGORY_FACET(STATUS_FILTER, LEVEL, "
+                    "PARENT, CATEGORY, NAME, COUNT) "
+                    "SELECT STATUS_FILTER, LEVEL, PARENT, CATEGORY, NAME, "
+                    "COUNT FROM tempdb.CATEGORY_FACET");
+
+        // the repositories are stored for conditional requests
+        if (err.isEmpty())
+            err = exec("DELETE FROM REPOSITORY");
+        if (err.isEmpty())
+            err = exec("INSERT INTO REPOSITORY(ID, URL, SHA1, ETAG, "
+                    "LAST_MODIFIED, CONTENT) SELECT ID, URL, SHA1, ETAG, "
+                    "LAST_MODIFIED, CONTENT FROM tempdb.REPOSITORY");
         if (err.isEmpty())
             job->setProgress(0.90);
         else
@@ -1919,7 +3074,7 @@ void DBRepository::transferFrom(Job* job, const QString& databaseFilename)
     job->complete();
 }
 
-QString DBRepository::openDefault(const QString& databaseName, bool readOnly)
+QString DBRepository::getDefaultPath()
 {
     QString dir = WPMUtils::getShellDir(CSIDL_COMMON_APPDATA) + "\\Npackd";
     QDir d;
@@ -1928,9 +3083,12 @@ QString DBRepository::openDefault(const QString& databaseName, bool readOnly)
 
     QString path = dir + "\\Data.db";
 
-    path = QDir::toNativeSeparators(path);
+    return QDir::toNativeSeparators(path);
+}
 
-    QString err = open(databaseName, path, readOnly);
+QString DBRepository::openDefault(const QString& databaseName, bool readOnly)
+{
+    QString err = open(databaseName, getDefaultPath(), readOnly);
 
     return err;
 }
@@ -1939,8 +3097,17 @@ QString DBRepository::updateDatabase()
 {
     QString err;
 
+    // checking every table and column separately is slow. Nothing has to be
+    // done if the schema was already created by this version.
+    int schemaVersion = count("PRAGMA user_version", &err);
+    if (err.isEmpty() && schemaVersion == SCHEMA_VERSION)
+        return err;
+
     bool e = false;
 
+    // true if CATEGORY_FACET was created and should be filled
+    bool facetsCreated = false;
+
     if (err.isEmpty()) {
         e = tableExists(&db, "PACKAGE", &err);
     }
@@ -1962,11 +3129,26 @@ QString DBRepository::updateDatabase()
                     "CATEGORY1 INTEGER, "
                     "CATEGORY2 INTEGER, "
                     "CATEGORY3 INTEGER, "
-                    "CATEGORY4 INTEGER"
+                    "CATEGORY4 INTEGER, "
+                    "INSTALLED_VERSIONS TEXT, "
+                    "NEWEST_VERSION TEXT, "
+                    "NEWEST_URL TEXT"
                     ")");
             err = toString(db.lastError());
         }
     }
+    if (err.isEmpty()) {
+        // PACKAGE.INSTALLED_VERSIONS, NEWEST_VERSION and NEWEST_URL are new
+        // in 1.22
+        if (e && !columnExists(&db, "PACKAGE", "INSTALLED_VERSIONS", &err) &&
+                err.isEmpty()) {
+            err = exec("ALTER TABLE PACKAGE ADD COLUMN INSTALLED_VERSIONS TEXT");
+            if (err.isEmpty())
+                err = exec("ALTER TABLE PACKAGE ADD COLUMN NEWEST_VERSION TEXT");
+            if (err.isEmpty())
+                err = exec("ALTER TABLE PACKAGE ADD COLUMN NEWEST_URL TEXT");
+        }
+    }
     if (err.isEmpty()) {
         if (!e) {
             db.exec("CREATE UNIQUE INDEX PACKAGE_NAME ON PACKAGE(NAME)");
@@ -2093,10 +3275,22 @@ QString DBRepository::updateDatabase()
             e = false;
         }
     }
+    if (err.isEmpty()) {
+        // REPOSITORY.ETAG, LAST_MODIFIED and CONTENT are new in 1.22
+        if (e && !columnExists(&db, "REPOSITORY", "ETAG", &err) &&
+                err.isEmpty()) {
+            err = exec("ALTER TABLE REPOSITORY ADD COLUMN ETAG TEXT");
+            if (err.isEmpty())
+                err = exec("ALTER TABLE REPOSITORY ADD COLUMN LAST_MODIFIED TEXT");
+            if (err.isEmpty())
+                err = exec("ALTER TABLE REPOSITORY ADD COLUMN CONTENT BLOB");
+        }
+    }
     if (err.isEmpty()) {
         if (!e) {
             db.exec("CREATE TABLE REPOSITORY(ID INTEGER PRIMARY KEY ASC, "
-                    "URL TEXT, SHA1 TEXT)");
+                    "URL TEXT, SHA1 TEXT, ETAG TEXT, LAST_MODIFIED TEXT, "
+                    "CONTENT BLOB)");
             err = toString(db.lastError());
         }
     }
@@ -2107,6 +3301,29 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // CATEGORY_FACET. This table is new in Npackd 1.22.
+    if (err.isEmpty()) {
+        e = tableExists(&db, "CATEGORY_FACET", &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            // CATEGORY is NULL for "Uncategorized"
+            db.exec("CREATE TABLE CATEGORY_FACET("
+                    "STATUS_FILTER INTEGER NOT NULL, LEVEL INTEGER NOT NULL, "
+                    "PARENT INTEGER NOT NULL, CATEGORY INTEGER, NAME TEXT, "
+                    "COUNT INTEGER NOT NULL)");
+            err = toString(db.lastError());
+        }
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec("CREATE INDEX CATEGORY_FACET_FILTER ON CATEGORY_FACET("
+                    "STATUS_FILTER, LEVEL, PARENT)");
+            err = toString(db.lastError());
+            facetsCreated = true;
+        }
+    }
+
     // LINK. This table is new in Npackd 1.20.
     if (err.isEmpty()) {
         e = tableExists(&db, "LINK", &err);
@@ -2128,6 +3345,29 @@ QString DBRepository::updateDatabase()
         }
     }
 
+    // FILE_HASH. This table is new in Npackd 1.22. The data is not removed
+    // by clear() and survives the updates of the repositories.
+    if (err.isEmpty()) {
+        e = tableExists(&db, "FILE_HASH", &err);
+    }
+    if (err.isEmpty()) {
+        if (!e) {
+            db.exec("CREATE TABLE FILE_HASH("
+                    "PATH TEXT NOT NULL PRIMARY KEY, SIZE INTEGER NOT NULL, "
+                    "MODIFIED INTEGER NOT NULL, SHA1 TEXT NOT NULL)");
+            err = toString(db.lastError());
+        }
+    }
+
+    // an existing database already contains packages. The counts are
+    // computed after all other tables and columns are available.
+    if (err.isEmpty() && facetsCreated)
+        err = refreshCategoryFacets();
+
+    // PRAGMA does not support parameters
+    if (err.isEmpty())
+        err = exec("PRAGMA user_version = " + QString::number(SCHEMA_VERSION));
+
     return err;
 }
 
@@ -2156,20 +3396,39 @@ QString DBRepository::open(const QString& connectionName, const QString& file,
     if (err.isEmpty())
         err = exec("PRAGMA busy_timeout = 30000");
 
+    // SQLite only reports missing access rights for the -wal and -shm files
+    // of a database in WAL mode on the first read. A read-only connection
+    // still has to create or open them.
+    if (err.isEmpty() && readOnly) {
+        count("SELECT COUNT(*) FROM sqlite_master", &err);
+        if (!err.isEmpty()) {
+            QString f = QDir::toNativeSeparators(file);
+            err = QObject::tr("Cannot read the database %1: %2. The files %1-wal and %1-shm could not be created or opened. Check the access rights for the directory %3.").
+                    arg(f, err, QDir::toNativeSeparators(
+                    QFileInfo(file).absolutePath()));
+        }
+    }
+
+    // with WAL readers do not block the writer and see the last committed
+    // state until the writer commits
     if (err.isEmpty()) {
         if (!readOnly)
-            err = exec("PRAGMA journal_mode = DELETE");
+            err = exec("PRAGMA journal_mode = WAL");
     }
 
     if (err.isEmpty()) {
         if (!readOnly)
-            err = updateDatabase();
+            err = exec("PRAGMA synchronous = NORMAL");
     }
 
     if (err.isEmpty()) {
-        err = readCategories();
+        if (!readOnly)
+            err = updateDatabase();
     }
 
+    // the categories are read on the first access
+    categoriesLoaded = false;
+
     return err;
 }
 
@@ -9,6 +9,7 @@
 #include <QWeakPointer>
 #include <QMultiMap>
 #include <QCache>
+#include <QThreadStorage>
 
 #include "package.h"
 #include "repository.h"
@@ -24,6 +25,9 @@ class DBRepository: public AbstractRepository
 {
 private:
     static DBRepository def;
+
+    /** read-only connections for the worker threads */
+    static QThreadStorage<DBRepository*> readOnlyRepositories;
     static bool tableExists(QSqlDatabase* db,
             const QString& table, QString* err);
     static bool columnExists(QSqlDatabase *db, const QString &table,
@@ -31,9 +35,26 @@ private:
     static QString toString(const QSqlError& e);
     static QString getErrorString(const MySQLQuery& q);
 
+    /**
+     * @brief version of the database schema created by updateDatabase().
+     *     The value is stored in "PRAGMA user_version" and should be
+     *     incremented each time a table, column or index is added.
+     */
+    static const int SCHEMA_VERSION = 4;
+
     QCache<QString, License> licenses;
 
-    QMap<int, QString> categories;
+    /** ID -> NAME. Loaded on the first access (see findCategory) */
+    mutable QMap<int, QString> categories;
+
+    /** true if "categories" contains the data from the CATEGORY table */
+    mutable bool categoriesLoaded;
+
+    /**
+     * value of "PRAGMA data_version" when the caches were last checked or
+     * -1
+     */
+    int dataVersion;
 
     MySQLQuery* replacePackageVersionQuery;
     MySQLQuery* insertPackageVersionQuery;
@@ -43,13 +64,25 @@ private:
     MySQLQuery* insertLinkQuery;
     MySQLQuery* deleteLinkQuery;
 
+    /**
+     * true = the connection is closed and removed in the destructor. Only
+     *     set for the per-thread connections (see getReadOnly()).
+     */
+    bool removeConnection;
+
     QSqlDatabase db;
 
-    QString readCategories();
-    QString getCategoryPath(int c0, int c1, int c2, int c3, int c4) const;
+    /** repositories for load(). Empty = the URLs stored in the registry */
+    QStringList repositoryURLs;
+
+    QString readCategories() const;
+    QString getCategoryPath(int c0, int c1, int c2, int c3, int c4,
+            QString* err) const;
     int insertCategory(int parent, int level,
             const QString &category, QString *err);
-    QString findCategory(int cat) const;
+
+    static QString createWhere(Package::Status status, bool filterByStatus,
+            const QString &query, int cat0, int cat1, QList<QVariant>* params);
 
     QStringList findPackagesWhere(const QString &where,
             const QList<QVariant> &params, QString *err) const;
@@ -88,21 +121,129 @@ private:
      * about installation path after this method was called.
      *
      * @param job job for this method
-     * @param useCache true = cache will be used
+     * @param useCache true = cache will be used. Repositories stored by a
+     *     previous call are only downloaded again if the server reports a
+     *     change (ETag or Last-Modified).
      * @param interactive true = allow the interaction with the user
      */
     void load(Job *job, bool useCache, bool interactive);
 
-    void loadOne(Job *job, QFile *f);
+    /**
+     * @brief parses a repository using multiple threads. The XML is split at
+     *     the child elements of the root element. The parts are parsed in
+     *     parallel and saved in the document order so that the first
+     *     definition of a package, version or license is used as with a
+     *     sequential parser.
+     * @param job job
+     * @param xml repository XML
+     * @param threads number of threads
+     * @return false if the XML cannot be split or one of the parts contains
+     *     an error. Nothing is saved in this case (the already saved parts
+     *     are rolled back) and the XML should be parsed sequentially.
+     */
+    bool loadParts(Job* job, const QByteArray& xml, int threads);
 
     int count(const QString &sql, QString *err);
     QString getRepositorySHA1(const QString &url, QString *err);
     void setRepositorySHA1(const QString &url, const QString &sha1, QString *err);
     QString clearRepository(int id);
+
+    /**
+     * @brief reads the values for a conditional request for a repository
+     * @param url repository URL
+     * @param etag ETag from the last download or "" will be stored here
+     * @param lastModified Last-Modified from the last download or "" will be
+     *     stored here
+     * @return error message
+     */
+    QString getRepositoryValidators(const QString& url, QString* etag,
+            QString* lastModified);
+
+    /**
+     * @param url repository URL
+     * @param err error message will be stored here
+     * @return content of the repository from the last download
+     */
+    QByteArray getRepositoryContent(const QString& url, QString* err);
+
+    /**
+     * @brief stores the downloaded repository for the next conditional
+     *     request
+     * @param url repository URL
+     * @param etag value of the ETag header or ""
+     * @param lastModified value of the Last-Modified header or ""
+     * @param content downloaded data. This is only stored if either etag or
+     *     lastModified is not empty.
+     * @return error message
+     */
+    QString setRepositoryContent(const QString& url, const QString& etag,
+            const QString& lastModified, const QByteArray& content);
+
+    /**
+     * @brief copies the REPOSITORY table from the default database so that
+     *     the stored ETags and repositories can be used by load()
+     * @return error message
+     */
+    QString importRepositories();
+
+    /**
+     * @return path to the default database file
+     */
+    static QString getDefaultPath();
     QString saveLinks(Package *p);
     QString readLinks(Package *p);
     QString deleteLinks(const QString &name);
     QString updateDatabase();
+
+    /**
+     * @brief updates the status and the summary for packages
+     * @param job job
+     * @param q executed query returning PACKAGE, NAME and URL from
+     *     PACKAGE_VERSION. The versions of one package should be consecutive.
+     * @param total number of rows returned by q for the progress or 0
+     * @return number of updated packages
+     */
+    int updateStatuses(Job* job, MySQLQuery* q, int total);
+
+    /**
+     * @brief executes the UPDATE for the status and the summary of one package
+     * @param u prepared UPDATE statement
+     * @param package full package name
+     * @param installed installed versions. The list will be sorted.
+     * @param newest newest installable version or 0
+     * @param newestURL download URL for "newest"
+     * @return error message
+     */
+    static QString writeStatus(MySQLQuery* u, const QString& package,
+            QList<Version>* installed, const Version* newest,
+            const QString& newestURL);
+
+    /**
+     * @brief re-computes the CATEGORY_FACET table. The table contains the
+     *     results of findCategories() for an empty query.
+     * @param cat0 -1 = re-compute the whole table. Otherwise only the counts
+     *     for the status filters in this category on the level 0
+     *     (0 = "Uncategorized") and in the category cat1 below it are
+     *     re-computed. This is enough after the status of one package in
+     *     these categories was changed.
+     * @param cat1 category on the level 1 (0 = "Uncategorized"). Only used if
+     *     cat0 is not -1.
+     * @return error message
+     */
+    QString refreshCategoryFacets(int cat0=-1, int cat1=-1);
+
+    /**
+     * @brief reads the categories from CATEGORY_FACET
+     * @param statusFilter -1 = no filter, Package::INSTALLED or
+     *     Package::UPDATEABLE
+     * @param level 0 or 1
+     * @param parent -1 for the level 0, CATEGORY0 (0 = "Uncategorized") for
+     *     the level 1
+     * @param err error message will be stored here
+     * @return see findCategories()
+     */
+    QList<QStringList> findCategoryFacets(int statusFilter, int level,
+            int parent, QString* err) const;
     void transferFrom(Job *job, const QString &databaseFilename);
 public:
     /** index of the current repository used for saving the packages */
@@ -115,6 +256,41 @@ public:
      */
     static DBRepository* getDefault();
 
+    /**
+     * @brief returns a read-only connection to the default database for the
+     *     current thread. The connection is opened on the first call and
+     *     closed when the thread ends. This can be used from any thread
+     *     (e.g. a thread pool) for searching without blocking the main
+     *     connection.
+     * @param err error message will be stored here
+     * @return [ownership:this] repository or 0 if an error occured
+     */
+    static DBRepository* getReadOnly(QString* err);
+
+    /**
+     * @brief starts a read transaction. All queries see the same state of the
+     *     database until endSnapshot() is called. Changes committed by other
+     *     connections in the mean time (e.g. by F5) only become visible
+     *     after that.
+     * @return error message
+     */
+    QString beginSnapshot();
+
+    /**
+     * @brief ends the read transaction started by beginSnapshot()
+     * @return error message
+     */
+    QString endSnapshot();
+
+    /**
+     * @brief discards the cached categories and licenses if the database was
+     *     changed by another connection since the last call. This is
+     *     necessary for connections that stay open for a long time (e.g. in
+     *     the service) because F5 re-creates the categories with new IDs.
+     * @return error message
+     */
+    QString refreshCaches();
+
     /**
      * @brief -
      */
@@ -149,13 +325,71 @@ public:
 
     /**
      * @brief update the status for the specified package
-     *     (see Package::Status)
+     *     (see Package::Status) and the precomputed summary (installed
+     *     versions, newest installable version) in the PACKAGE table. If the
+     *     status changes, the counts in CATEGORY_FACET are only updated for
+     *     the categories of this package. Everything is done in one
+     *     transaction.
      *
      * @param package full package name
      * @return error message
      */
     QString updateStatus(const QString &package);
 
+    /**
+     * @brief reads the summary for a package computed by updateStatus()
+     * @param package full package name
+     * @param installed installed versions separated by ", " (newest first)
+     *     will be stored here
+     * @param newest newest installable version or "" will be stored here
+     * @param newestURL download URL for the newest installable version or ""
+     *     will be stored here
+     * @param up2date true will be stored here if no update is available
+     * @param err error message will be stored here
+     * @return true if the summary is available, false if it was not yet
+     *     computed for this package
+     */
+    bool getPackageSummary(const QString& package, QString* installed,
+            QString* newest, QString* newestURL, bool* up2date,
+            QString* err) const;
+
+    /**
+     * @brief reads the summaries for multiple packages computed by
+     *     updateStatus() using one query for each block of packages
+     * @param packages full package names
+     * @param err error message will be stored here
+     * @return package name -> [installed versions, newest installable
+     *     version, download URL for the newest installable version,
+     *     status (Package::Status)]. Packages without a computed summary are
+     *     not contained in the result.
+     */
+    QMap<QString, QStringList> getPackageSummaries(const QStringList& packages,
+            QString* err) const;
+
+    /**
+     * @brief searches for a cached SHA-1 of a file. The cache entry is only
+     *     valid if the size and the last modification time did not change.
+     * @param path normalized path to the file (see WPMUtils::normalizePath)
+     * @param size size of the file in bytes
+     * @param modified last modification time in milliseconds since epoch
+     * @param err error message will be stored here
+     * @return SHA-1 in lower case or "" if not cached or outdated
+     */
+    QString findFileHash(const QString& path, qint64 size, qint64 modified,
+            QString* err) const;
+
+    /**
+     * @brief stores the SHA-1 of a file. An existing entry for the same path
+     *     is replaced.
+     * @param path normalized path to the file (see WPMUtils::normalizePath)
+     * @param size size of the file in bytes
+     * @param modified last modification time in milliseconds since epoch
+     * @param sha1 SHA-1 in lower case
+     * @return error message
+     */
+    QString saveFileHash(const QString& path, qint64 size, qint64 modified,
+            const QString& sha1);
+
     /**
      * @brief inserts the data from the given repository
      * @param job job
@@ -167,11 +401,20 @@ public:
     void saveAll(Job* job, Repository* r, bool replace=false);
 
     /**
-     * @brief updates the status for currently installed packages in
-     *     PACKAGE.STATUS
+     * @brief loads one repository from a file with the XML or from a
+     *     repository in ZIP format containing Rep.xml. The entries are
+     *     saved for the repository with the index currentRepository.
+     * @param job job for this method
+     * @param f the file. It must not be opened.
+     */
+    void loadOne(Job *job, QFile *f);
+
+    /**
+     * @brief updates the status and the summary (see updateStatus()) for
+     *     all packages
      * @param job job
      */
-    void updateStatusForInstalled(Job *job);
+    void updateStatusForAll(Job *job);
 
     Package* findPackage_(const QString& name);
 
@@ -191,8 +434,8 @@ public:
     /**
      * @brief searches for packages that match the specified keywords
      * @param status filter for the package status if filterByStatus is true
-     * @param statusInclude true = only return packages with the given status,
-     *     false = return all packages with the status not equal to the given
+     * @param filterByStatus true = only return packages with the given
+     *     status, false = ignore the status
      * @param query search query (keywords)
      * @param cat0 filter for the level 0 of categories. -1 means "All",
      *     0 means "Uncategorized"
@@ -204,6 +447,38 @@ public:
     QStringList findPackages(Package::Status status, bool filterByStatus,
             const QString &query, int cat0, int cat1, QString* err) const;
 
+    /**
+     * @brief searches for packages and returns one page of the result. The
+     *     paging is done by the database.
+     * @param status filter for the package status if filterByStatus is true
+     * @param filterByStatus true = filter by status
+     * @param query search query (keywords)
+     * @param offset index of the first returned package (0, 1, ...)
+     * @param max maximum number of returned packages or -1 for "unlimited"
+     * @param err error message will be stored here
+     * @return [ownership:caller] found packages sorted by title. Only the
+     *     name, title and description are filled.
+     */
+    QList<Package*> findPackagesPage(Package::Status status,
+            bool filterByStatus, const QString &query, int offset, int max,
+            QString* err) const;
+
+    /**
+     * @brief searches for packages that match the specified keywords. The
+     *     categories are not filtered. The result contains all the data
+     *     necessary to filter the packages further without accessing the
+     *     database (see SearchSession).
+     * @param status filter for the package status if filterByStatus is true
+     * @param filterByStatus true = only return packages with the given
+     *     status, false = ignore the status
+     * @param query search query (keywords)
+     * @param err error message will be stored here
+     * @return found packages sorted by title: NAME, FULLTEXT, CATEGORY0,
+     *     CATEGORY1. Empty category IDs are used for un-categorized packages.
+     */
+    QList<QStringList> findPackageRows(Package::Status status,
+            bool filterByStatus, const QString &query, QString* err) const;
+
     /**
      * @brief loads does all the necessary updates when F5 is pressed. The
      *    repositories from the Internet are loaded and the MSI database and
@@ -213,12 +488,39 @@ public:
      */
     void updateF5(Job *job, bool interactive=true);
 
+    /**
+     * @brief changes the repositories loaded by updateF5(). By default the
+     *     URLs stored in the registry are used.
+     * @param urls repository URLs or an empty list for the default
+     */
+    void useRepositories(const QStringList& urls);
+
     /**
      * @brief updateF5() that can be used with QtConcurrent::Run
      * @param job job
      */
     void updateF5Runnable(Job* job);
 
+    /**
+     * @brief downloads the binaries for all packages with available updates
+     *     (status Package::UPDATEABLE) in the download cache. A following
+     *     update does not need to download them again. See
+     *     PackageVersion::prefetch(). The errors for one package do not stop
+     *     the downloads for the others.
+     * @param job job
+     * @param maxBytesPerSecond maximum download speed or 0 for "unlimited"
+     */
+    void prefetchUpdates(Job* job, qint64 maxBytesPerSecond);
+
+    /**
+     * @brief prefetchUpdates() on the read-only connection for the current
+     *     thread (see getReadOnly()) that can be used with QtConcurrent::Run.
+     *     The thread runs with a background priority.
+     * @param job job
+     * @param maxBytesPerSecond maximum download speed or 0 for "unlimited"
+     */
+    static void prefetchUpdatesRunnable(Job* job, qint64 maxBytesPerSecond);
+
     PackageVersion* findPackageVersionByMSIGUID_(
             const QString& guid, QString *err) const;
 
@@ -234,8 +536,8 @@ public:
     /**
      * @brief searches for packages that match the specified keywords
      * @param status filter for the package status if filterByStatus is true
-     * @param statusInclude true = only return packages with the given status,
-     *     false = return all packages with the status not equal to the given
+     * @param filterByStatus true = only return packages with the given
+     *     status, false = ignore the status
      * @param query search query (keywords)
      * @param level level for the categories (0, 1, ...)
      * @param cat0 filter for the level 0 of categories. -1 means "All",
@@ -249,6 +551,13 @@ public:
     QList<QStringList> findCategories(Package::Status status,
             bool filterByStatus, const QString &query, int level, int cat0, int cat1, QString *err) const;
 
+    /**
+     * @param cat CATEGORY.ID
+     * @param err error message will be stored here
+     * @return category title or ""
+     */
+    QString findCategory(int cat, QString* err) const;
+
     /**
      * @brief converts category IDs in titles
      * @param ids CATEGORY.ID
@@ -266,7 +575,8 @@ public:
 
     /**
      * @brief saves the list of given repository URLs. The repositories will
-     *     get the IDs 1, 2, 3, ...
+     *     get the IDs 1, 2, 3, ... The stored data for conditional requests
+     *     is kept for the URLs that were already present.
      * @param reps URLs
      * @return error message
      */
@@ -78,39 +78,39 @@ bool Dependency::autoFulfilledIf(const Dependency& dep)
 
 bool Dependency::setVersions(const QString versions)
 {
-    QString versions_ = versions;
-
     bool minIncluded_, maxIncluded_;
 
     // qDebug() << "Repository::createDependency.1" << versions;
 
-    if (versions_.startsWith('['))
+    if (versions.startsWith('['))
         minIncluded_ = true;
-    else if (versions_.startsWith('('))
+    else if (versions.startsWith('('))
         minIncluded_ = false;
     else
         return false;
-    versions_.remove(0, 1);
 
     // qDebug() << "Repository::createDependency.1.1" << versions;
 
-    if (versions_.endsWith(']'))
+    if (versions.length() < 2)
+        return false;
+    if (versions.endsWith(']'))
         maxIncluded_ = true;
-    else if (versions_.endsWith(')'))
+    else if (versions.endsWith(')'))
         maxIncluded_ = false;
     else
         return false;
-    versions_.chop(1);
 
     // qDebug() << "Repository::createDependency.2";
 
-    QStringList parts = versions_.split(',');
-    if (parts.count() != 2)
+    // the versions are parsed in place without creating temporary strings
+    int comma = versions.indexOf(',');
+    if (comma < 0 || versions.indexOf(',', comma + 1) >= 0)
         return false;
 
     Version min_, max_;
-    if (!min_.setVersion(parts.at(0).trimmed()) ||
-            !max_.setVersion(parts.at(1).trimmed()))
+    if (!min_.setVersion(versions.midRef(1, comma - 1).trimmed()) ||
+            !max_.setVersion(versions.midRef(comma + 1,
+            versions.length() - comma - 2).trimmed()))
         return false;
     this->minIncluded = minIncluded_;
     this->min = min_;
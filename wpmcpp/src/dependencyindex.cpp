@@ -0,0 +1,112 @@
+#include "dependencyindex.h"
+#include "packageversion.h"
+
+DependencyIndex::DependencyIndex(const QList<PackageVersion*>& installed)
+{
+    for (int i = 0; i < installed.count(); i++) {
+        PackageVersion* pv = installed.at(i);
+        versions[pv->package].append(pv->version);
+    }
+
+    for (int i = 0; i < installed.count(); i++) {
+        PackageVersion* pv = installed.at(i);
+        QString k = key(pv->package, pv->version);
+        for (int j = 0; j < pv->dependencies.count(); j++) {
+            Dependency* d = pv->dependencies.at(j);
+
+            Edge* e = new Edge();
+            e->owner = pv;
+            e->dependency = d;
+            e->removed = false;
+            e->satisfied = 0;
+
+            const QList<Version> vs = versions.value(d->package);
+            for (int m = 0; m < vs.count(); m++) {
+                if (d->test(vs.at(m)))
+                    e->satisfied++;
+            }
+
+            edges.append(e);
+            incoming.insert(d->package, e);
+            outgoing.insert(k, e);
+        }
+    }
+}
+
+DependencyIndex::~DependencyIndex()
+{
+    qDeleteAll(edges);
+}
+
+QString DependencyIndex::key(const QString& package, const Version& version)
+{
+    Version v = version;
+    v.normalize();
+    return package + '/' + v.getVersionString();
+}
+
+bool DependencyIndex::contains(const QString& package,
+        const Version& version) const
+{
+    QHash<QString, QList<Version> >::const_iterator it =
+            versions.find(package);
+    if (it != versions.end()) {
+        const QList<Version>& vs = it.value();
+        for (int i = 0; i < vs.count(); i++) {
+            if (vs.at(i) == version)
+                return true;
+        }
+    }
+    return false;
+}
+
+QList<DependencyIndex::Edge*> DependencyIndex::getDependents(
+        const QString& package) const
+{
+    // QMultiHash returns the most recently inserted values first
+    QList<Edge*> values = incoming.values(package);
+    QList<Edge*> r;
+    r.reserve(values.count());
+    for (int i = values.count() - 1; i >= 0; i--) {
+        r.append(values.at(i));
+    }
+    return r;
+}
+
+const QList<DependencyIndex::Edge*>& DependencyIndex::getEdges() const
+{
+    return edges;
+}
+
+void DependencyIndex::remove(const QString& package, const Version& version)
+{
+    QHash<QString, QList<Version> >::iterator it = versions.find(package);
+    if (it == versions.end())
+        return;
+
+    QList<Version>& vs = it.value();
+    bool found = false;
+    for (int i = 0; i < vs.count(); i++) {
+        if (vs.at(i) == version) {
+            vs.removeAt(i);
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        return;
+
+    // the dependencies on this package version are less satisfied
+    QList<Edge*> in = incoming.values(package);
+    for (int i = 0; i < in.count(); i++) {
+        Edge* e = in.at(i);
+        if (e->dependency->test(version))
+            e->satisfied--;
+    }
+
+    // the dependencies of this package version are not relevant anymore
+    QList<Edge*> out = outgoing.values(key(package, version));
+    for (int i = 0; i < out.count(); i++) {
+        out.at(i)->removed = true;
+    }
+}
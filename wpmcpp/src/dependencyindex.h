@@ -0,0 +1,102 @@
+#ifndef DEPENDENCYINDEX_H
+#define DEPENDENCYINDEX_H
+
+#include <QString>
+#include <QList>
+#include <QHash>
+#include <QMultiHash>
+#include <QSet>
+
+#include "version.h"
+#include "dependency.h"
+
+class PackageVersion;
+
+/**
+ * @brief reverse dependencies for a set of installed package versions.
+ *
+ * For every dependency of an installed package version (an "edge") the index
+ * stores the number of installed versions satisfying it. The edges can be
+ * found by the package they point to. Removing a package version from the
+ * index updates the counters so that cascaded removals and integrity checks
+ * do not have to re-scan the list of installed package versions.
+ */
+class DependencyIndex
+{
+public:
+    /**
+     * @brief a dependency of an installed package version
+     */
+    class Edge
+    {
+    public:
+        /** the package version with the dependency */
+        PackageVersion* owner;
+
+        /** the dependency */
+        Dependency* dependency;
+
+        /** number of installed package versions satisfying the dependency */
+        int satisfied;
+
+        /** true if the owner was removed from the index */
+        bool removed;
+    };
+private:
+    /** all edges in the order of package versions and dependencies */
+    QList<Edge*> edges;
+
+    /** Dependency::package -> edges */
+    QMultiHash<QString, Edge*> incoming;
+
+    /** key(package, version) -> edges of this package version */
+    QMultiHash<QString, Edge*> outgoing;
+
+    /** package -> installed versions */
+    QHash<QString, QList<Version> > versions;
+
+    static QString key(const QString& package, const Version& version);
+
+    DependencyIndex(const DependencyIndex&);
+    DependencyIndex& operator=(const DependencyIndex&);
+public:
+    /**
+     * @param installed installed package versions. The objects should not be
+     *     destroyed while this index is in use.
+     */
+    DependencyIndex(const QList<PackageVersion*>& installed);
+
+    ~DependencyIndex();
+
+    /**
+     * @param package full package name
+     * @param version version number
+     * @return true if the package version is in the index
+     */
+    bool contains(const QString& package, const Version& version) const;
+
+    /**
+     * @param package full package name
+     * @return dependencies of the installed package versions on the
+     *     specified package in the order of the package versions passed to
+     *     the constructor. Edges of removed package versions are included
+     *     and have Edge::removed == true.
+     */
+    QList<Edge*> getDependents(const QString& package) const;
+
+    /**
+     * @return all edges in the order of the package versions and their
+     *     dependencies passed to the constructor
+     */
+    const QList<Edge*>& getEdges() const;
+
+    /**
+     * @brief removes a package version from the index. The counters for the
+     *     dependencies satisfied by this package version are decremented.
+     * @param package full package name
+     * @param version version number
+     */
+    void remove(const QString& package, const Version& version);
+};
+
+#endif // DEPENDENCYINDEX_H
@@ -0,0 +1,224 @@
+#include <QDir>
+#include <QThread>
+#include <QObject>
+
+#include "directorywalker.h"
+
+/**
+ * @brief one thread of the walker
+ */
+class DirectoryWalker::Worker: public QThread
+{
+    DirectoryWalker* walker;
+    int index;
+public:
+    Worker(DirectoryWalker* walker, int index): walker(walker), index(index)
+    {
+    }
+protected:
+    void run()
+    {
+        walker->work(index);
+    }
+};
+
+DirectoryWalker::Visitor::~Visitor()
+{
+}
+
+DirectoryWalker::DirectoryWalker(int threads): threads(threads), visitor(0),
+        running(0), done(0), visited(0)
+{
+    if (this->threads <= 0)
+        this->threads = qMax(1, QThread::idealThreadCount());
+}
+
+DirectoryWalker::~DirectoryWalker()
+{
+    qDeleteAll(queues);
+}
+
+bool DirectoryWalker::take(int index, Item* item)
+{
+    // the own queue is used as a stack: the last added directory is taken
+    // first
+    Queue* own = queues.at(index);
+    own->mutex.lock();
+    if (!own->items.isEmpty()) {
+        *item = own->items.takeLast();
+        own->mutex.unlock();
+        return true;
+    }
+    own->mutex.unlock();
+
+    // other queues are used from the beginning
+    for (int i = 1; i < queues.count(); i++) {
+        Queue* q = queues.at((index + i) % queues.count());
+        q->mutex.lock();
+        if (!q->items.isEmpty()) {
+            *item = q->items.takeFirst();
+            q->mutex.unlock();
+            return true;
+        }
+        q->mutex.unlock();
+    }
+
+    return false;
+}
+
+void DirectoryWalker::wakeAll()
+{
+    idleMutex.lock();
+    workAvailable.wakeAll();
+    idleMutex.unlock();
+}
+
+void DirectoryWalker::work(int index)
+{
+    // the shared counters are only updated after this number of directories
+    const int BATCH = 100;
+
+    double localDone = 0;
+    qint64 localVisited = 0;
+
+    Item item;
+    while (cancelled.load() == 0) {
+        if (!take(index, &item)) {
+            // other threads may still add new directories. The queues are
+            // checked again after "sleeping" was incremented so that a
+            // producer either sees a sleeping thread or its directories are
+            // found here.
+            idleMutex.lock();
+            sleeping.fetchAndAddOrdered(1);
+            bool found;
+            while (!(found = take(index, &item)) && pending.load() != 0 &&
+                    cancelled.load() == 0)
+                workAvailable.wait(&idleMutex);
+            sleeping.fetchAndAddOrdered(-1);
+            idleMutex.unlock();
+
+            if (!found)
+                break;
+        }
+
+        QList<Item> children;
+        if (!ignore.contains(item.path) && visitor->visit(item.path)) {
+            QDir d(item.path);
+            QStringList names = d.entryList(QDir::NoDotAndDotDot |
+                    QDir::Dirs | QDir::NoSymLinks);
+
+            // the directory and all sub-directories get equal parts
+            double w = item.weight / (names.count() + 1);
+            for (int i = 0; i < names.count(); i++) {
+                Item c;
+                c.path = item.path + "\\" + names.at(i).toLower();
+                c.weight = w;
+                children.append(c);
+            }
+            localDone += w;
+        } else {
+            localDone += item.weight;
+        }
+
+        // the new directories are counted before this one is removed so that
+        // "pending" does not reach 0 too early
+        if (!children.isEmpty()) {
+            pending.fetchAndAddOrdered(children.count());
+            Queue* own = queues.at(index);
+            own->mutex.lock();
+            own->items.append(children);
+            own->mutex.unlock();
+
+            if (sleeping.load() > 0)
+                wakeAll();
+        }
+
+        // the last directory was processed
+        if (pending.fetchAndAddOrdered(-1) == 1)
+            wakeAll();
+
+        localVisited++;
+        if (localVisited % BATCH == 0) {
+            mutex.lock();
+            done += localDone;
+            visited += BATCH;
+            mutex.unlock();
+            localDone = 0;
+        }
+    }
+
+    mutex.lock();
+    done += localDone;
+    visited += localVisited % BATCH;
+    running--;
+    finished.wakeAll();
+    mutex.unlock();
+}
+
+void DirectoryWalker::walk(Job* job, const QStringList& roots,
+        Visitor* visitor)
+{
+    QString initialTitle = job->getTitle();
+
+    this->visitor = visitor;
+    this->pending.store(roots.count());
+    this->cancelled.store(0);
+    this->sleeping.store(0);
+    this->done = 0;
+    this->visited = 0;
+    this->running = threads;
+
+    qDeleteAll(queues);
+    queues.clear();
+    for (int i = 0; i < threads; i++) {
+        queues.append(new Queue());
+    }
+
+    for (int i = 0; i < roots.count(); i++) {
+        Item item;
+        item.path = roots.at(i);
+        item.weight = 1.0 / roots.count();
+        queues.at(i % threads)->items.append(item);
+    }
+
+    QList<Worker*> workers;
+    for (int i = 0; i < threads; i++) {
+        Worker* w = new Worker(this, i);
+        workers.append(w);
+        w->start();
+    }
+
+    mutex.lock();
+    while (running > 0) {
+        finished.wait(&mutex, 500);
+
+        double d = done;
+        qint64 v = visited;
+        mutex.unlock();
+
+        if (job->isCancelled() && cancelled.testAndSetOrdered(0, 1))
+            wakeAll();
+
+        job->setProgress(qMin(d, 1.0));
+        job->setTitle(initialTitle + " / " +
+                QObject::tr("%L1 directories").arg(v));
+
+        mutex.lock();
+    }
+    mutex.unlock();
+
+    for (int i = 0; i < workers.count(); i++) {
+        workers.at(i)->wait();
+    }
+    qDeleteAll(workers);
+
+    qDeleteAll(queues);
+    queues.clear();
+
+    job->setTitle(initialTitle);
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+}
@@ -0,0 +1,140 @@
+#ifndef DIRECTORYWALKER_H
+#define DIRECTORYWALKER_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QAtomicInt>
+
+#include "job.h"
+
+/**
+ * @brief visits all directories under the specified roots using multiple
+ *     threads.
+ *
+ * Every thread has its own queue of directories. New sub-directories are
+ * added at the end of the queue of the current thread and taken from there
+ * (depth-first). A thread without work takes ("steals") directories from the
+ * beginning of the queue of another thread. These are normally directories
+ * near the root with big sub-trees.
+ */
+class DirectoryWalker
+{
+public:
+    /**
+     * @brief is called for each directory
+     */
+    class Visitor
+    {
+    public:
+        virtual ~Visitor();
+
+        /**
+         * @brief is called for each visited directory. This method is called
+         *     from multiple threads at the same time.
+         * @param dir normalized directory path (see WPMUtils::normalizePath)
+         * @return true = visit the sub-directories
+         * @threadsafe
+         */
+        virtual bool visit(const QString& dir) = 0;
+    };
+private:
+    class Item
+    {
+    public:
+        QString path;
+
+        /** part of the whole work represented by this directory */
+        double weight;
+    };
+
+    class Queue
+    {
+    public:
+        QMutex mutex;
+        QList<Item> items;
+    };
+
+    class Worker;
+    friend class Worker;
+
+    int threads;
+
+    Visitor* visitor;
+    QList<Queue*> queues;
+
+    /** number of directories in the queues or being processed */
+    QAtomicInt pending;
+
+    /** 1 = the walk was cancelled */
+    QAtomicInt cancelled;
+
+    /** number of threads waiting for work in workAvailable */
+    QAtomicInt sleeping;
+
+    /** mutex for workAvailable */
+    QMutex idleMutex;
+
+    /**
+     * signalled if new directories were added while some threads are
+     * sleeping, if "pending" reaches 0 or the walk is cancelled
+     */
+    QWaitCondition workAvailable;
+
+    /** protects the fields below */
+    QMutex mutex;
+    QWaitCondition finished;
+    int running;
+    double done;
+    qint64 visited;
+
+    /**
+     * @brief processes directories until no work is left
+     * @param index index of the queue for this thread
+     */
+    void work(int index);
+
+    /**
+     * @param index index of the queue for this thread
+     * @param item the directory will be stored here
+     * @return true if a directory was found in the own queue or stolen
+     *     from another one
+     */
+    bool take(int index, Item* item);
+
+    /**
+     * @brief wakes up all threads waiting for work
+     */
+    void wakeAll();
+
+    DirectoryWalker(const DirectoryWalker&);
+    DirectoryWalker& operator=(const DirectoryWalker&);
+public:
+    /**
+     * normalized paths of ignored directories (see WPMUtils::normalizePath).
+     * The sub-directories are not visited either.
+     */
+    QStringList ignore;
+
+    /**
+     * @param threads number of threads or 0 for
+     *     QThread::idealThreadCount()
+     */
+    DirectoryWalker(int threads=0);
+
+    ~DirectoryWalker();
+
+    /**
+     * @brief visits the directories. Symbolic links and junctions are not
+     *     followed.
+     * @param job job. The progress and the number of visited directories
+     *     are reported at most twice a second.
+     * @param roots normalized paths of the root directories
+     * @param visitor visitor
+     */
+    void walk(Job* job, const QStringList& roots, Visitor* visitor);
+};
+
+#endif // DIRECTORYWALKER_H
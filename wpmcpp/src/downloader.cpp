@@ -11,6 +11,8 @@
 #include <QWaitCondition>
 #include <QMutex>
 #include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QThread>
 
 #include "downloader.h"
 #include "job.h"
@@ -18,6 +20,9 @@
 
 bool Downloader::debug = false;
 
+HINTERNET Downloader::internet = 0;
+QMutex Downloader::internetMutex;
+
 HWND defaultPasswordWindow = 0;
 QMutex loginDialogMutex;
 
@@ -27,6 +32,55 @@ DWORD __stdcall myInternetAuthNotifyCallback(DWORD_PTR dwContext,
     return 0;
 }
 
+HINTERNET Downloader::getInternetSession(QString* err)
+{
+    *err = "";
+
+    QMutexLocker ml(&internetMutex);
+
+    if (!internet) {
+        QString agent("Npackd/");
+        agent.append(NPACKD_VERSION);
+
+        agent += " (compatible; MSIE 9.0)";
+
+        internet = InternetOpenW((WCHAR*) agent.utf16(),
+                INTERNET_OPEN_TYPE_PRECONFIG,
+                0, 0, 0);
+
+        if (internet == 0) {
+            WPMUtils::formatMessage(GetLastError(), err);
+        } else {
+            // enable automatic gzip decoding
+            const DWORD INTERNET_OPTION_HTTP_DECODING = 65;
+            BOOL b = TRUE;
+            InternetSetOption(internet, INTERNET_OPTION_HTTP_DECODING,
+                    &b, sizeof(b));
+
+            // the limits are process-wide. The default values (2 for
+            // HTTP 1.1) would serialize the parallel downloads from one
+            // server over the shared connections.
+            DWORD conns = MAX_CONNECTIONS_PER_SERVER;
+            InternetSetOption(0, INTERNET_OPTION_MAX_CONNS_PER_SERVER,
+                    &conns, sizeof(conns));
+            InternetSetOption(0, INTERNET_OPTION_MAX_CONNS_PER_1_0_SERVER,
+                    &conns, sizeof(conns));
+        }
+    }
+
+    return internet;
+}
+
+void Downloader::closeInternetSession()
+{
+    QMutexLocker ml(&internetMutex);
+
+    if (internet) {
+        InternetCloseHandle(internet);
+        internet = 0;
+    }
+}
+
 int64_t Downloader::downloadWin(Job* job, const Request& request,
         Downloader::Response* response)
 {
@@ -42,6 +96,8 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
     bool keepConnection = request.keepConnection;
     int timeout = request.timeout;
     bool interactive = request.interactive;
+    bool conditional = !request.ifNoneMatch.isEmpty() ||
+            !request.ifModifiedSince.isEmpty();
 
     QString initialTitle = job->getTitle();
 
@@ -56,43 +112,21 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
     if (!encQuery.isEmpty())
         resource.append('?').append(encQuery);
 
-    QString agent("Npackd/");
-    agent.append(NPACKD_VERSION);
-
-    agent += " (compatible; MSIE 9.0)";
-
-    HINTERNET internet = InternetOpenW((WCHAR*) agent.utf16(),
-            INTERNET_OPEN_TYPE_PRECONFIG,
-            0, 0, 0);
-
-    if (internet == 0) {
-        QString errMsg;
-        WPMUtils::formatMessage(GetLastError(), &errMsg);
-        job->setErrorMessage(errMsg);
-    }
-
-    if (job->shouldProceed()) {
-        // change the timeout to 5 minutes
-        DWORD rec_timeout = timeout * 1000;
-        InternetSetOption(internet, INTERNET_OPTION_RECEIVE_TIMEOUT,
-                &rec_timeout, sizeof(rec_timeout));
-        InternetSetOption(internet, INTERNET_OPTION_SEND_TIMEOUT,
-                &rec_timeout, sizeof(rec_timeout));
-
-        // enable automatic gzip decoding
-        const DWORD INTERNET_OPTION_HTTP_DECODING = 65;
-        BOOL b = TRUE;
-        InternetSetOption(internet, INTERNET_OPTION_HTTP_DECODING,
-                &b, sizeof(b));
-
+    // the session is shared between all requests and is not closed here
+    QString err;
+    HINTERNET session = getInternetSession(&err);
+    if (!err.isEmpty())
+        job->setErrorMessage(err);
+    else
         job->setProgress(0.01);
-    }
 
+    // InternetConnectW does not open a network connection. The connections
+    // are pooled by the session.
     HINTERNET hConnectHandle = 0;
     if (job->shouldProceed()) {
         INTERNET_PORT port = url.port(url.scheme() == "https" ?
                 INTERNET_DEFAULT_HTTPS_PORT: INTERNET_DEFAULT_HTTP_PORT);
-        hConnectHandle = InternetConnectW(internet,
+        hConnectHandle = InternetConnectW(session,
                 (WCHAR*) server.utf16(), port, 0, 0, INTERNET_SERVICE_HTTP, 0, 0);
 
         if (hConnectHandle == 0) {
@@ -102,6 +136,16 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
         }
     }
 
+    if (job->shouldProceed()) {
+        // the timeouts are set for this request only and are inherited by
+        // the request handle
+        DWORD rec_timeout = timeout * 1000;
+        InternetSetOption(hConnectHandle, INTERNET_OPTION_RECEIVE_TIMEOUT,
+                &rec_timeout, sizeof(rec_timeout));
+        InternetSetOption(hConnectHandle, INTERNET_OPTION_SEND_TIMEOUT,
+                &rec_timeout, sizeof(rec_timeout));
+    }
+
 
     // flags: http://msdn.microsoft.com/en-us/library/aa383661(v=vs.85).aspx
     // We support accepting any mime file type since this is a simple download
@@ -118,6 +162,11 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
         if (!useCache)
             flags |= INTERNET_FLAG_DONT_CACHE | INTERNET_FLAG_PRAGMA_NOCACHE |
                     INTERNET_FLAG_RELOAD;
+
+        // the caller stores the data itself. The WinINet cache would
+        // otherwise answer the conditional request instead of the server.
+        if (conditional)
+            flags |= INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_RELOAD;
         hResourceHandle = HttpOpenRequestW(hConnectHandle,
                 reinterpret_cast<LPCWSTR>(verb.utf16()),
                 (WCHAR*) resource.utf16(),
@@ -139,6 +188,19 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
         HttpAddRequestHeadersW(hResourceHandle,
                 L"Accept-Encoding: gzip, deflate", -1,
                 HTTP_ADDREQ_FLAG_ADD);
+
+        if (!request.ifNoneMatch.isEmpty()) {
+            QString h = "If-None-Match: " + request.ifNoneMatch;
+            HttpAddRequestHeadersW(hResourceHandle,
+                    (WCHAR*) h.utf16(), -1,
+                    HTTP_ADDREQ_FLAG_ADD | HTTP_ADDREQ_FLAG_REPLACE);
+        }
+        if (!request.ifModifiedSince.isEmpty()) {
+            QString h = "If-Modified-Since: " + request.ifModifiedSince;
+            HttpAddRequestHeadersW(hResourceHandle,
+                    (WCHAR*) h.utf16(), -1,
+                    HTTP_ADDREQ_FLAG_ADD | HTTP_ADDREQ_FLAG_REPLACE);
+        }
     }
 
     // qDebug() << "download.5";
@@ -179,6 +241,10 @@ int64_t Downloader::downloadWin(Job* job, const Request& request,
             DWORD hundreds = dwStatus / 100;
             if (hundreds == 2 || hundreds == 5)
                 break;
+
+            // 304 Not Modified is only expected for conditional requests
+            if (conditional && dwStatus == HTTP_STATUS_NOT_MODIFIED)
+                break;
         }
 
         // the InternetErrorDlg calls below can either handle
@@ -291,6 +357,8 @@ out:
             QString errMsg;
             WPMUtils::formatMessage(GetLastError(), &errMsg);
             job->setErrorMessage(errMsg);
+        } else if (conditional && dwStatus == HTTP_STATUS_NOT_MODIFIED) {
+            response->notModified = true;
         } else {
             // 2XX
             if (dwStatus / 100 != 2) {
@@ -300,6 +368,39 @@ out:
         }
     }
 
+    // ETag and Last-Modified are used for the next conditional request.
+    // Servers may repeat them in a 304 response.
+    if (job->shouldProceed()) {
+        WCHAR buffer[1024];
+        DWORD bufferLength = sizeof(buffer);
+        DWORD index = 0;
+        if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_ETAG,
+                buffer, &bufferLength, &index)) {
+            response->etag.setUtf16((ushort*) buffer, bufferLength / 2);
+        }
+
+        bufferLength = sizeof(buffer);
+        index = 0;
+        if (HttpQueryInfoW(hResourceHandle, HTTP_QUERY_LAST_MODIFIED,
+                buffer, &bufferLength, &index)) {
+            response->lastModified.setUtf16((ushort*) buffer,
+                    bufferLength / 2);
+        }
+    }
+
+    if (response->notModified) {
+        if (hResourceHandle)
+            InternetCloseHandle(hResourceHandle);
+        if (hConnectHandle)
+            InternetCloseHandle(hConnectHandle);
+
+        job->setTitle(initialTitle);
+        job->setProgress(1);
+        job->complete();
+
+        return -1;
+    }
+
     if (job->shouldProceed()) {
         job->setProgress(0.03);
         job->setTitle(initialTitle + " / " + QObject::tr("Downloading"));
@@ -377,7 +478,8 @@ out:
 
     if (job->shouldProceed()) {
         Job* sub = job->newSubJob(0.95, QObject::tr("Reading the data"));
-        readData(sub, hResourceHandle, file, sha1, gzip, contentLength, alg);
+        readData(sub, hResourceHandle, file, sha1, gzip, contentLength, alg,
+                request.maxBytesPerSecond);
         if (!sub->getErrorMessage().isEmpty())
             job->setErrorMessage(sub->getErrorMessage());
     }
@@ -386,8 +488,6 @@ out:
         InternetCloseHandle(hResourceHandle);
     if (hConnectHandle)
         InternetCloseHandle(hConnectHandle);
-    if (internet)
-        InternetCloseHandle(internet);
 
     if (job->shouldProceed())
         job->setProgress(1);
@@ -482,8 +582,20 @@ bool Downloader::internetReadFileFully(HINTERNET resourceHandle,
     return result;
 }
 
+void Downloader::throttle(const QElapsedTimer& timer, int64_t alreadyRead,
+        qint64 maxBytesPerSecond)
+{
+    if (maxBytesPerSecond > 0) {
+        qint64 expected = alreadyRead * 1000 / maxBytesPerSecond;
+        qint64 elapsed = timer.elapsed();
+        if (expected > elapsed)
+            QThread::msleep(expected - elapsed);
+    }
+}
+
 void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
-        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg)
+        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg,
+        qint64 maxBytesPerSecond)
 {
     QString initialTitle = job->getTitle();
 
@@ -499,6 +611,8 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
 
     int err = 0;
     int64_t alreadyRead = 0;
+    QElapsedTimer timer;
+    timer.start();
     DWORD bufferLength;
     do {
         if (!internetReadFileFully(hResourceHandle, buffer,
@@ -637,6 +751,7 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
             break;
 
         alreadyRead += bufferLength;
+        throttle(timer, alreadyRead, maxBytesPerSecond);
         if (contentLength > 0) {
             job->setProgress(((double) alreadyRead) / contentLength);
             job->setTitle(initialTitle + " / " +
@@ -671,7 +786,8 @@ void Downloader::readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
 }
 
 void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
-        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg)
+        QString* sha1, int64_t contentLength, QCryptographicHash::Algorithm alg,
+        qint64 maxBytesPerSecond)
 {
     if (debug) {
         WPMUtils::writeln("Downloader::readDataFlat");
@@ -685,6 +801,8 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
     unsigned char* buffer = new unsigned char[bufferSize];
 
     int64_t alreadyRead = 0;
+    QElapsedTimer timer;
+    timer.start();
     DWORD bufferLength;
     do {
         if (!InternetReadFile(hResourceHandle, buffer,
@@ -712,6 +830,7 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
             file->write((char*) buffer, bufferLength);
 
         alreadyRead += bufferLength;
+        throttle(timer, alreadyRead, maxBytesPerSecond);
         if (contentLength > 0) {
             job->setProgress(((double) alreadyRead) / contentLength);
             job->setTitle(initialTitle + " / " +
@@ -739,12 +858,14 @@ void Downloader::readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
 
 void Downloader::readData(Job* job, HINTERNET hResourceHandle, QFile* file,
         QString* sha1, bool gzip, int64_t contentLength,
-        QCryptographicHash::Algorithm alg)
+        QCryptographicHash::Algorithm alg, qint64 maxBytesPerSecond)
 {
     if (gzip && file)
-        readDataGZip(job, hResourceHandle, file, sha1, contentLength, alg);
+        readDataGZip(job, hResourceHandle, file, sha1, contentLength, alg,
+                maxBytesPerSecond);
     else
-        readDataFlat(job, hResourceHandle, file, sha1, contentLength, alg);
+        readDataFlat(job, hResourceHandle, file, sha1, contentLength, alg,
+                maxBytesPerSecond);
 }
 
 void Downloader::copyFile(Job* job, const QString& source, QFile* file,
@@ -755,7 +876,8 @@ void Downloader::copyFile(Job* job, const QString& source, QFile* file,
                 arg(source));
     } else {
         qint64 srcSize = srcFile.size();
-        const int SZ = 8192;
+        // bigger blocks are faster for files on network shares
+        const int SZ = 1024 * 1024;
         char* data = new char[SZ];
 
         qint64 progress = 0;
@@ -853,14 +975,16 @@ int64_t Downloader::getContentLength(Job* job, const QUrl &url,
 }
 
 QTemporaryFile* Downloader::downloadToTemporary(Job* job,
-        const Downloader::Request &request)
+        const Downloader::Request &request, Response* response)
 {
     QTemporaryFile* file = new QTemporaryFile();
     Downloader::Request r2(request);
     r2.file = file;
 
     if (file->open()) {
-        download(job, r2);
+        Response resp = download(job, r2);
+        if (response)
+            *response = resp;
         file->close();
 
         if (job->isCancelled() || !job->getErrorMessage().isEmpty()) {
@@ -10,7 +10,9 @@
 #include <QMetaType>
 #include <QObject>
 #include <QWaitCondition>
+#include <QMutex>
 #include <QCryptographicHash>
+#include <QElapsedTimer>
 
 #include "job.h"
 
@@ -29,14 +31,24 @@ class Downloader: QObject
      * @param sha1
      * @param contentLength
      * @param alg
+     * @param maxBytesPerSecond see Request::maxBytesPerSecond
      */
     static void readDataFlat(Job* job, HINTERNET hResourceHandle, QFile* file,
             QString* sha1, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+            QCryptographicHash::Algorithm alg, qint64 maxBytesPerSecond);
 
     static void readDataGZip(Job* job, HINTERNET hResourceHandle, QFile* file,
             QString* sha1, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+            QCryptographicHash::Algorithm alg, qint64 maxBytesPerSecond);
+
+    /**
+     * @brief waits if the data is read faster than allowed
+     * @param timer started at the beginning of the download
+     * @param alreadyRead number of bytes read until now
+     * @param maxBytesPerSecond see Request::maxBytesPerSecond
+     */
+    static void throttle(const QElapsedTimer& timer, int64_t alreadyRead,
+            qint64 maxBytesPerSecond);
 
     /**
      * @brief readData
@@ -47,10 +59,11 @@ class Downloader: QObject
      * @param gzip
      * @param contentLength
      * @param alg
+     * @param maxBytesPerSecond see Request::maxBytesPerSecond
      */
     static void readData(Job* job, HINTERNET hResourceHandle, QFile* file,
             QString* sha1, bool gzip, int64_t contentLength,
-            QCryptographicHash::Algorithm alg);
+            QCryptographicHash::Algorithm alg, qint64 maxBytesPerSecond);
 
     static bool internetReadFileFully(HINTERNET resourceHandle,
             PVOID buffer, DWORD bufferSize, PDWORD bufferLength);
@@ -76,7 +89,37 @@ class Downloader: QObject
                          QCryptographicHash::Algorithm alg);
 
     static QString inputPassword(HINTERNET hConnectHandle, DWORD dwStatus);
+
+    /** maximum number of parallel connections to one server */
+    static const DWORD MAX_CONNECTIONS_PER_SERVER = 6;
+
+    /** WinINet session shared by all requests or 0 */
+    static HINTERNET internet;
+
+    /** protects "internet" */
+    static QMutex internetMutex;
+
 public:
+    /**
+     * @brief returns the WinINet session shared by all HTTP requests. The
+     *     session is created on the first call and lives until
+     *     closeInternetSession() is called. WinINet keeps the open connections
+     *     and TLS sessions per session so that the following requests to the
+     *     same server do not need to connect and to negotiate TLS again.
+     * @param err error message will be stored here
+     * @return [ownership:Downloader] the session or 0 if an error occured
+     * @threadsafe
+     */
+    static HINTERNET getInternetSession(QString* err);
+
+    /**
+     * @brief closes the shared WinINet session. The next request creates a
+     *     new one. This should only be called if no download is running
+     *     (e.g. before the program ends).
+     * @threadsafe
+     */
+    static void closeInternetSession();
+
     /** true = print debug information during a download */
     static bool debug;
 
@@ -115,7 +158,8 @@ public:
         bool useCache;
 
         /**
-         * true = keep the connection open. This is only applicable to http:
+         * true = keep the connection open so that the following requests to
+         * the same server can re-use it. This is only applicable to http:
          * and https.
          */
         bool keepConnection;
@@ -142,6 +186,26 @@ public:
          */
         QString headers;
 
+        /**
+         * @brief if not empty, "If-None-Match" will be sent with this value
+         *     (ETag from a previous response). This is only applicable to
+         *     http: and https.
+         */
+        QString ifNoneMatch;
+
+        /**
+         * @brief if not empty, "If-Modified-Since" will be sent with this
+         *     value (Last-Modified from a previous response). This is only
+         *     applicable to http: and https.
+         */
+        QString ifModifiedSince;
+
+        /**
+         * @brief maximum download speed in bytes per second or 0 for
+         *     "unlimited". This is only applicable to http: and https.
+         */
+        qint64 maxBytesPerSecond;
+
         /**
          * @param url http:/https:/file: URL
          */
@@ -149,7 +213,7 @@ public:
                 parentWindow(0), url(url), hashSum(false),
                 alg(QCryptographicHash::Sha256), useCache(true),
                 keepConnection(true), httpMethod("GET"),
-                timeout(600) {
+                timeout(600), maxBytesPerSecond(0) {
         }
     };
 
@@ -167,6 +231,21 @@ public:
 
         /** if not null, Content-Disposition will be stored here */
         QString contentDisposition;
+
+        /** value of the ETag header or "" */
+        QString etag;
+
+        /** value of the Last-Modified header or "" */
+        QString lastModified;
+
+        /**
+         * true = the server answered a conditional request with
+         * "304 Not Modified". No data was read in this case.
+         */
+        bool notModified;
+
+        Response(): notModified(false) {
+        }
     };
 
     /**
@@ -190,10 +269,12 @@ public:
      * @brief HTTP download to a temporary file
      * @param job job
      * @param request HTTP request
+     * @param response the response will be stored here or 0. If
+     *     response->notModified is true, the temporary file is empty.
      * @return the created temporary file or 0 if an error occured
      */
     static QTemporaryFile *downloadToTemporary(Job *job,
-            const Downloader::Request &request);
+            const Downloader::Request &request, Response* response);
 private:
     /**
      * It would be nice to handle redirects explicitely so
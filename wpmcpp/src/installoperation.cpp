@@ -6,10 +6,12 @@ InstallOperation::InstallOperation()
     this->install = true;
 }
 
-PackageVersion *InstallOperation::findPackageVersion(QString* err) const
+PackageVersion *InstallOperation::findPackageVersion(QString* err,
+        AbstractRepository* rep) const
 {
-    return AbstractRepository::getDefault_()->findPackageVersion_(
-            this->package, this->version, err);
+    if (!rep)
+        rep = AbstractRepository::getDefault_();
+    return rep->findPackageVersion_(this->package, this->version, err);
 }
 
 InstallOperation *InstallOperation::clone() const
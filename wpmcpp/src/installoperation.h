@@ -5,6 +5,8 @@
 
 #include "packageversion.h"
 
+class AbstractRepository;
+
 /**
  * Installation operation.
  */
@@ -31,9 +33,12 @@ public:
     /**
      * @brief finds the corresponding package version
      * @param err error message will be stored here
+     * @param rep the package version is searched here. 0 means
+     *     AbstractRepository::getDefault_()
      * @return [ownership:caller] found package version or 0
      */
-    PackageVersion* findPackageVersion(QString *err) const;
+    PackageVersion* findPackageVersion(QString *err,
+            AbstractRepository* rep=0) const;
 
     /**
      * @return [ownership:caller] copy of this object
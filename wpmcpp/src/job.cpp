@@ -3,13 +3,114 @@
 
 #include "qdebug.h"
 #include "qmutex.h"
+#include "qthread.h"
+#include "qwaitcondition.h"
 
 #include "wpmutils.h"
 
 #include "job.h"
 
+/**
+ * @brief publishes the changes held back by Job::publishChanges. A separate
+ *     thread is used because the thread of a top-level job does not always
+ *     run an event loop (npackdcl executes the commands in the main thread).
+ */
+class JobNotifier: public QThread
+{
+    /** protects "jobs" and "stopped" */
+    QMutex mutex;
+
+    QWaitCondition jobAdded;
+
+    /** top-level jobs with held back changes */
+    QList<Job*> jobs;
+
+    bool stopped;
+
+    /**
+     * held while the changes are published so that a job cannot be deleted
+     * at the same time. Recursive because the receivers of
+     * Job::changed() may delete jobs.
+     */
+    QMutex publishing;
+public:
+    JobNotifier(): stopped(false), publishing(QMutex::Recursive)
+    {
+    }
+
+    ~JobNotifier()
+    {
+        mutex.lock();
+        stopped = true;
+        jobAdded.wakeAll();
+        mutex.unlock();
+        wait();
+    }
+
+    /**
+     * @brief publishes the changes for the job after Job::PUBLISH_INTERVAL ms
+     * @param job top-level job
+     * @threadsafe
+     */
+    void add(Job* job)
+    {
+        mutex.lock();
+        if (!jobs.contains(job))
+            jobs.append(job);
+        jobAdded.wakeAll();
+        if (!stopped && !isRunning())
+            start();
+        mutex.unlock();
+    }
+
+    /**
+     * @brief is called from the destructor of a top-level job
+     * @param job top-level job
+     * @threadsafe
+     */
+    void remove(Job* job)
+    {
+        publishing.lock();
+        mutex.lock();
+        jobs.removeAll(job);
+        mutex.unlock();
+        publishing.unlock();
+    }
+protected:
+    void run()
+    {
+        mutex.lock();
+        while (!stopped) {
+            if (jobs.isEmpty()) {
+                jobAdded.wait(&mutex);
+                continue;
+            }
+            mutex.unlock();
+
+            // more changes are collected in the mean time
+            msleep(Job::PUBLISH_INTERVAL);
+
+            publishing.lock();
+            mutex.lock();
+            QList<Job*> js = jobs;
+            jobs.clear();
+            mutex.unlock();
+            for (int i = 0; i < js.count(); i++) {
+                js.at(i)->flushChanges();
+            }
+            publishing.unlock();
+
+            mutex.lock();
+        }
+        mutex.unlock();
+    }
+};
+
+static JobNotifier notifier;
+
 Job::Job(const QString &title, Job *parent):
-        mutex(QMutex::Recursive), parentJob(parent)
+        mutex(QMutex::Recursive), changePending(0), lastPublished(0),
+        flushScheduled(0), freeSteps(0), parentJob(parent)
 {
     this->title = title;
     this->progress = 0.0;
@@ -24,7 +125,54 @@ Job::Job(const QString &title, Job *parent):
 
 Job::~Job()
 {
+    // the flag may be reset by the notifier while it publishes the changes
+    if (!parentJob)
+        notifier.remove(this);
+
     qDeleteAll(childJobs);
+    for (int i = 0; i < stepBlocks.count(); i++) {
+        delete[] stepBlocks.at(i);
+    }
+}
+
+JobStep* Job::allocateStep()
+{
+    this->mutex.lock();
+    if (!this->freeSteps) {
+        JobStep* block = new JobStep[STEP_BLOCK_SIZE];
+        this->stepBlocks.append(block);
+        for (int i = 0; i < STEP_BLOCK_SIZE; i++) {
+            block[i].nextFree = this->freeSteps;
+            this->freeSteps = &block[i];
+        }
+    }
+    JobStep* r = this->freeSteps;
+    this->freeSteps = r->nextFree;
+    this->mutex.unlock();
+
+    r->job = this;
+    r->nextFree = 0;
+
+    return r;
+}
+
+void Job::releaseStep(JobStep* step)
+{
+    step->reset();
+
+    this->mutex.lock();
+    step->nextFree = this->freeSteps;
+    this->freeSteps = step;
+    this->mutex.unlock();
+}
+
+JobStep* Job::newStep(double part, bool updateParentErrorMessage)
+{
+    JobStep* r = allocateStep();
+    r->start = this->getProgress();
+    r->part = part;
+    r->updateParentErrorMessage = updateParentErrorMessage;
+    return r;
 }
 
 time_t Job::remainingTime()
@@ -92,8 +240,12 @@ void Job::complete()
     }
     this->mutex.unlock();
 
-    if (f)
+    if (f) {
+        // the final state of a task should always be visible
+        fireChange(true);
+
         emit jobCompleted();
+    }
 }
 
 void Job::completeWithProgress()
@@ -118,12 +270,14 @@ void Job::cancel()
     bool changed = false;
     if (!this->cancelRequested && this->errorMessage.isEmpty()) {
         this->cancelRequested = true;
+        if (this->started == 0)
+            time(&this->started);
         changed = true;
     }
     this->mutex.unlock();
 
     if (changed) {
-        fireChange();
+        fireChange(true);
 
         this->mutex.lock();
         for (int i = 0; i < this->childJobs.size(); i++) {
@@ -133,12 +287,6 @@ void Job::cancel()
     }
 }
 
-void Job::parentJobChanged(Job* s)
-{
-    if (s->isCancelled() && !this->isCancelled())
-        this->cancel();
-}
-
 Job* Job::newSubJob(double part, const QString &title,
         bool updateParentProgress_,
         bool updateParentErrorMessage)
@@ -150,11 +298,12 @@ Job* Job::newSubJob(double part, const QString &title,
     r->uparentProgress = updateParentProgress_;
     r->updateParentErrorMessage = updateParentErrorMessage;
 
-    connect(this, SIGNAL(changed(Job*)),
-            r, SLOT(parentJobChanged(Job*)),
-            Qt::DirectConnection);
-
+    // cancel() propagates to the existing children. A sub-job created
+    // after the cancellation is cancelled from the beginning.
+    this->mutex.lock();
+    r->cancelRequested = this->cancelRequested;
     this->childJobs.append(r);
+    this->mutex.unlock();
 
     //qDebug() << "subJobCreated" << r->title;
 
@@ -181,24 +330,55 @@ bool Job::isCompleted()
     return completed_;
 }
 
-void Job::fireChange()
+void Job::fireChange(bool force)
 {
-    this->mutex.lock();
-    if (this->started == 0)
-        time(&this->started);
-
-    this->mutex.unlock();
-
     Job* top = this;
     while (top->parentJob)
         top = top->parentJob;
 
-    top->fireChange(this);
+    // only the first change after a publication needs the lock
+    if (this->changePending.testAndSetOrdered(0, 1)) {
+        top->dirtyMutex.lock();
+        top->dirtyJobs.append(this);
+        top->dirtyMutex.unlock();
+    }
+
+    top->publishChanges(force);
+}
+
+void Job::publishChanges(bool force)
+{
+    DWORD now = GetTickCount();
+    int last = this->lastPublished.load();
+    if (!force) {
+        // the changes will be published by the trailing flush or by
+        // another thread that is publishing them right now
+        if (now - (DWORD) last < (DWORD) PUBLISH_INTERVAL ||
+                !this->lastPublished.testAndSetOrdered(last, (int) now)) {
+            if (this->flushScheduled.testAndSetOrdered(0, 1))
+                notifier.add(this);
+            return;
+        }
+    } else {
+        this->lastPublished.store((int) now);
+    }
+
+    this->dirtyMutex.lock();
+    QList<Job*> jobs = this->dirtyJobs;
+    this->dirtyJobs.clear();
+    this->dirtyMutex.unlock();
+
+    for (int i = 0; i < jobs.count(); i++) {
+        Job* j = jobs.at(i);
+        j->changePending.store(0);
+        emit changed(j);
+    }
 }
 
-void Job::fireChange(Job* s)
+void Job::flushChanges()
 {
-    emit changed(s);
+    this->flushScheduled.store(0);
+    publishChanges(true);
 }
 
 void Job::setProgress(double progress)
@@ -212,6 +392,8 @@ void Job::setProgress(double progress)
                 "to" << progress << "in" << this->title;
     }
     this->progress = progress;
+    if (this->started == 0)
+        time(&this->started);
     this->mutex.unlock();
 
     fireChange();
@@ -303,6 +485,8 @@ void Job::setTitle(const QString &title)
 {
     this->mutex.lock();
     this->title = title;
+    if (this->started == 0)
+        time(&this->started);
     // qDebug() << hint;
     this->mutex.unlock();
 
@@ -344,12 +528,14 @@ void Job::setErrorMessage(const QString &errorMessage)
             QString msg = title + ": " + errorMessage;
             parentJob->setErrorMessage(msg);
         }
+        if (this->started == 0)
+            time(&this->started);
         changed = true;
     }
     this->mutex.unlock();
 
     if (changed) {
-        fireChange();
+        fireChange(true);
 
         this->mutex.lock();
         for (int i = 0; i < childJobs.count(); i++) {
@@ -359,3 +545,132 @@ void Job::setErrorMessage(const QString &errorMessage)
     }
 }
 
+
+JobStep::JobStep()
+{
+    this->job = 0;
+    this->nextFree = 0;
+    reset();
+}
+
+void JobStep::reset()
+{
+    this->parent = 0;
+    this->start = 0;
+    this->part = 0;
+    this->progress = 0;
+    this->errorMessage.clear();
+    this->updateParentErrorMessage = false;
+    this->completed = false;
+    this->promoted = 0;
+    this->promotedAt = 0;
+}
+
+JobStep* JobStep::newSubStep(double part, bool updateParentErrorMessage)
+{
+    JobStep* r = this->job->allocateStep();
+    r->parent = this;
+    r->start = this->start + this->progress * this->part;
+    r->part = this->part * part;
+    r->updateParentErrorMessage = updateParentErrorMessage;
+    return r;
+}
+
+bool JobStep::isCancelled() const
+{
+    if (this->promoted)
+        return this->promoted->isCancelled();
+
+    // Job cancels the children if an error occures
+    const JobStep* p = this->parent;
+    while (p) {
+        if (!p->errorMessage.isEmpty())
+            return true;
+        p = p->parent;
+    }
+
+    return this->job->isCancelled();
+}
+
+bool JobStep::shouldProceed() const
+{
+    return this->errorMessage.isEmpty() && !this->isCancelled();
+}
+
+double JobStep::getProgress() const
+{
+    return this->progress;
+}
+
+void JobStep::setProgress(double progress)
+{
+    this->progress = progress;
+    if (this->promoted) {
+        // the visible job covers the rest of the step
+        double rest = 1 - this->promotedAt;
+        this->promoted->setProgress(rest > 0 ?
+                (progress - this->promotedAt) / rest : 1);
+    } else
+        this->job->setProgress(this->start + progress * this->part);
+}
+
+QString JobStep::getErrorMessage() const
+{
+    return this->errorMessage;
+}
+
+void JobStep::setErrorMessage(const QString &errorMessage)
+{
+    if (!errorMessage.isEmpty() && this->errorMessage != errorMessage) {
+        this->errorMessage = errorMessage;
+        if (this->promoted)
+            this->promoted->setErrorMessage(errorMessage);
+        if (this->updateParentErrorMessage) {
+            if (this->parent)
+                this->parent->setErrorMessage(errorMessage);
+            else
+                this->job->setErrorMessage(errorMessage);
+        }
+    }
+}
+
+bool JobStep::isCompleted() const
+{
+    return this->completed;
+}
+
+void JobStep::complete()
+{
+    this->completed = true;
+    if (this->promoted)
+        this->promoted->complete();
+}
+
+void JobStep::completeWithProgress()
+{
+    setProgress(1);
+    complete();
+}
+
+Job* JobStep::promote(const QString& title)
+{
+    if (!this->promoted) {
+        double done = this->start + this->progress * this->part;
+        Job* r = this->job->newSubJob(this->part * (1 - this->progress),
+                title, true, false);
+        r->mutex.lock();
+        r->subJobStart = done;
+        if (!this->errorMessage.isEmpty())
+            r->errorMessage = this->errorMessage;
+        r->mutex.unlock();
+
+        this->promotedAt = this->progress;
+        this->promoted = r;
+    }
+    return this->promoted;
+}
+
+void JobStep::release()
+{
+    this->job->releaseStep(this);
+}
@@ -8,12 +8,159 @@
 #include <QQueue>
 #include <QTime>
 #include <QList>
+#include <QAtomicInt>
 
 class Job;
 
+/**
+ * Lightweight progress information for an internal step of a Job.
+ *
+ * A step has the same contract as a Job (shouldProceed, setProgress,
+ * setErrorMessage, complete), but it is not a QObject, has no title and
+ * does not send any signals. The progress is directly reported to the
+ * owning Job. Steps are allocated in blocks by the owning Job and should be
+ * returned with release() after the result was evaluated. Steps that were
+ * not released are freed together with the owning Job.
+ *
+ * If a step should become visible in the user interface, promote() creates
+ * a real sub-job for the rest of the step.
+ *
+ * A step should only be used by one thread at a time. Creating and releasing
+ * steps is thread-safe.
+ */
+class JobStep
+{
+    friend class Job;
+private:
+    /** owning job */
+    Job* job;
+
+    /** parent step or 0 */
+    JobStep* parent;
+
+    /** start of this step in the progress of the owning job */
+    double start;
+
+    /** part of the progress of the owning job covered by this step */
+    double part;
+
+    /** progress 0...1 */
+    double progress;
+
+    QString errorMessage;
+
+    bool updateParentErrorMessage;
+
+    bool completed;
+
+    /** the visible job or 0 if this step was not promoted */
+    Job* promoted;
+
+    /** progress of this step at the time of the promotion */
+    double promotedAt;
+
+    /** next step in the list of released steps */
+    JobStep* nextFree;
+
+    void reset();
+public:
+    JobStep();
+
+    /**
+     * Creates a sub-step for the specified part of this step.
+     *
+     * @param part 0..1 part of this step for the created sub-step
+     * @param updateParentErrorMessage true = update the error message of
+     *     this step
+     * @return [ownership:job] new step
+     * @threadsafe
+     */
+    JobStep* newSubStep(double part, bool updateParentErrorMessage=false);
+
+    /**
+     * @return true if the owning job was cancelled or one of the parent steps
+     *     failed
+     */
+    bool isCancelled() const;
+
+    /**
+     * @return true if this step is neither cancelled nor failed
+     */
+    bool shouldProceed() const;
+
+    /**
+     * @return progress of this step (0...1)
+     */
+    double getProgress() const;
+
+    /**
+     * Sets the progress. The progress of the owning job is updated
+     * accordingly.
+     *
+     * @param progress new progress (0...1)
+     */
+    void setProgress(double progress);
+
+    /**
+     * @return error message. If the error message is not empty, the
+     *     step ended with an error.
+     */
+    QString getErrorMessage() const;
+
+    /**
+     * Sets an error message for this step. The error message only
+     * propagates to the parent step (or the owning job) if
+     * updateParentErrorMessage is true.
+     *
+     * @param errorMessage new error message
+     */
+    void setErrorMessage(const QString &errorMessage);
+
+    /**
+     * @return true if this step was completed
+     */
+    bool isCompleted() const;
+
+    /**
+     * Completes this step.
+     */
+    void complete();
+
+    /**
+     * @brief sets the progress to 1 and completes the step
+     */
+    void completeWithProgress();
+
+    /**
+     * Creates a visible sub-job for the rest of this step. All further
+     * changes of this step are forwarded to the created job. Calling this
+     * function more than once returns the same job.
+     *
+     * @param title title for the visible job
+     * @return [ownership:job] the visible job
+     */
+    Job* promote(const QString& title);
+
+    /**
+     * Returns this step to the owning job for re-use. This object cannot be
+     * used after this call. Sub-steps should be released before their
+     * parent.
+     *
+     * @threadsafe
+     */
+    void release();
+};
+
 /**
  * A long-running task.
  *
+ * Changes in the progress, title etc. are coalesced. The top-level job
+ * collects the changed jobs and emits the changed() signal at most once per
+ * PUBLISH_INTERVAL milliseconds for each of them. Changes that were held
+ * back are published by a trailing flush PUBLISH_INTERVAL ms later from a
+ * separate thread. An event loop is not necessary. Cancellation, errors and
+ * the completion of a job are always published immediately.
+ *
  * A task is typically defined as a function with the following signature:
  *     void longRunning(Job* job)
  *
@@ -43,9 +190,59 @@ class Job;
 class Job: public QObject
 {
     Q_OBJECT
+
+    friend class JobStep;
+    friend class JobNotifier;
 private:
+    /** number of steps allocated at once by newStep() */
+    static const int STEP_BLOCK_SIZE = 64;
+
+    /** minimum time between two publications of changes in milliseconds */
+    static const int PUBLISH_INTERVAL = 50;
+
     mutable QMutex mutex;
 
+    /** 1 if this job was changed and the change was not yet published */
+    QAtomicInt changePending;
+
+    /**
+     * [top-level job only] jobs with changes that were not yet published.
+     * Protected by dirtyMutex.
+     */
+    QList<Job*> dirtyJobs;
+
+    /** [top-level job only] protects dirtyJobs */
+    QMutex dirtyMutex;
+
+    /** [top-level job only] GetTickCount() of the last publication */
+    QAtomicInt lastPublished;
+
+    /**
+     * [top-level job only] 1 if a trailing flush is scheduled (see
+     * JobNotifier)
+     */
+    QAtomicInt flushScheduled;
+
+    /** blocks of STEP_BLOCK_SIZE steps. Protected by mutex. */
+    QList<JobStep*> stepBlocks;
+
+    /** released steps that can be re-used. Protected by mutex. */
+    JobStep* freeSteps;
+
+    /**
+     * @return new step owned by this job
+     * @threadsafe
+     */
+    JobStep* allocateStep();
+
+    /**
+     * Returns a step for re-use.
+     *
+     * @param step a step owned by this job
+     * @threadsafe
+     */
+    void releaseStep(JobStep* step);
+
     QList<Job*> childJobs;
 
     /** progress 0...1 */
@@ -77,18 +274,31 @@ private:
     void updateParentProgress();
 
     /**
+     * Marks this job as changed. The change will be published by the
+     * top-level job.
+     *
+     * @param force true = publish all pending changes now regardless of the
+     *     time of the last publication
      * @threadsafe
      */
-    void fireChange();
+    void fireChange(bool force=false);
 
     void fireSubJobCreated(Job *sub);
 
-    void fireChange(Job *s);
-public slots:
     /**
+     * [top-level job only] emits changed() for all jobs with pending changes
+     * if the last publication was at least PUBLISH_INTERVAL ms ago.
+     *
+     * @param force true = ignore the time of the last publication
      * @threadsafe
      */
-    void parentJobChanged(Job *s);
+    void publishChanges(bool force);
+
+    /**
+     * [top-level job only] publishes all pending changes. Called from the
+     * thread of JobNotifier.
+     */
+    void flushChanges();
 public:
     /** parent job or 0 */
     Job* parentJob;
@@ -156,6 +366,20 @@ public:
             bool updateParentProgress_=true,
             bool updateParentErrorMessage=false);
 
+    /**
+     * Creates a lightweight step for the specified part of this job. Steps
+     * should be used instead of sub-jobs for internal steps that are not
+     * shown to the user.
+     *
+     * @param part 0..1 part of this job for the created step
+     * @param updateParentErrorMessage true = update the error message of
+     *     this job
+     * @return [ownership:this] new step. It should be returned with
+     *     JobStep::release()
+     * @threadsafe
+     */
+    JobStep* newStep(double part, bool updateParentErrorMessage=false);
+
     /**
      * @return progress of this job (0...1)
      * @threadsafe
@@ -266,8 +490,9 @@ public:
     void waitForChildren();
 signals:
     /**
-     * This signal will be fired each time something in this object
-     * changes (progress, hint etc.).
+     * This signal will be fired on the top-level job if something in this
+     * job or a sub-job changes (progress, hint etc.). Multiple changes are
+     * coalesced and reported at most every PUBLISH_INTERVAL milliseconds.
      */
     void changed(Job* s);
 
@@ -28,6 +28,7 @@
 #include "installoperation.h"
 #include "uiutils.h"
 #include "clprocessor.h"
+#include "downloader.h"
 
 // Modern and efficient C++ Thread Pool Library
 // https://github.com/vit-vit/CTPL
@@ -84,6 +85,8 @@ int main(int argc, char *argv[])
         errorCode = QApplication::exec();
     }
 
+    Downloader::closeInternetSession();
+
     //WPMUtils::timer.dump();
 
     return errorCode;
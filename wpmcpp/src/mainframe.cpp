@@ -8,6 +8,7 @@
 #include <QListWidgetItem>
 #include <QListWidget>
 #include <QDialogButtonBox>
+#include <QScrollBar>
 
 #include "mainwindow.h"
 #include "package.h"
@@ -50,6 +51,8 @@ MainFrame::MainFrame(QWidget *parent) :
             SIGNAL(selectionChanged(QItemSelection,QItemSelection)),
             this,
             SLOT(tableWidget_selectionChanged()));
+    connect(t->verticalScrollBar(), SIGNAL(valueChanged(int)),
+            this, SLOT(tableWidget_scrolled()));
 }
 
 MainFrame::~MainFrame()
@@ -336,6 +339,23 @@ void MainFrame::tableWidget_selectionChanged()
     MainWindow::getInstance()->updateActions();
 }
 
+void MainFrame::tableWidget_scrolled()
+{
+    QTableView* t = this->ui->tableWidget;
+    PackageItemModel* m = static_cast<PackageItemModel*>(t->model());
+
+    int first = t->rowAt(0);
+    if (first >= 0) {
+        int last = t->rowAt(t->viewport()->height() - 1);
+        if (last < 0)
+            last = m->rowCount(QModelIndex()) - 1;
+
+        // the information for the visible rows is computed in one batch
+        // before they are painted
+        m->prefetch(first, last);
+    }
+}
+
 void MainFrame::fillList()
 {
     MainWindow* mw = MainWindow::getInstance();
@@ -73,6 +73,14 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     instance = this;
 
+    this->searchSession = 0;
+    this->searchWatcher = 0;
+    this->searchTimer = new QTimer(this);
+    this->searchTimer->setSingleShot(true);
+    this->searchTimer->setInterval(150);
+    connect(this->searchTimer, SIGNAL(timeout()), this,
+            SLOT(searchTimerTimeout()));
+
     ui->setupUi(this);
 
     this->setMenuAccelerators();
@@ -86,6 +94,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
     this->hardDriveScanRunning = false;
     this->reloadRepositoriesThreadRunning = false;
+    this->prefetchJob = 0;
+    this->prefetchRestart = false;
 
     setWindowTitle("Npackd");
 
@@ -519,6 +529,8 @@ MainWindow::~MainWindow()
     DownloadSizeFinder::threadPool.clear();
     DownloadSizeFinder::threadPool.waitForDone(5000);
 
+    delete searchSession;
+
     delete ui;
 }
 
@@ -714,86 +726,186 @@ bool QCITableWidgetItem::operator<(const QTableWidgetItem &other) const
     return a.compare(b, Qt::CaseInsensitive) <= 0;
 }
 
-_SearchResult MainWindow::search(Package::Status status, boolean statusInclude,
-        const QString& query, int cat0, int cat1, QString* err)
+void MainWindow::getSearchFilter(Package::Status* status,
+        bool* statusInclude, QString* query, int* cat0, int* cat1) const
 {
-    //DWORD start = GetTickCount();
+    *query = this->mainFrame->getFilterLineEdit()->text();
 
-    _SearchResult r;
-    *err = "";
+    int statusFilter = this->mainFrame->getStatusFilter();
+    *status = Package::NOT_INSTALLED;
+    *statusInclude = false;
+    switch (statusFilter) {
+        case 1:
+            *status = Package::INSTALLED;
+            *statusInclude = true;
+            break;
+        case 2:
+            *status = Package::UPDATEABLE;
+            *statusInclude = true;
+            break;
+    }
 
-    DBRepository* dbr = DBRepository::getDefault();
-    r.found = dbr->findPackages(status, statusInclude, query,
-            cat0, cat1, err);
+    *cat0 = this->mainFrame->getCategoryFilter(0);
+    *cat1 = this->mainFrame->getCategoryFilter(1);
+}
 
-    //DWORD search = GetTickCount();
-    //qDebug() << "Only search" << (search - start) << query;
+SearchSession* MainWindow::searchRunnable(Package::Status status,
+        bool statusInclude, const QString& query)
+{
+    SearchSession* r = 0;
 
-    if (err->isEmpty()) {
-        r.cats = dbr->findCategories(status, statusInclude, query, 0, -1, -1,
-                err);
-    }
+    // the default connection can only be used from the UI thread
+    QString err;
+    DBRepository* dbr = DBRepository::getReadOnly(&err);
 
-    if (err->isEmpty()) {
-        if (cat0 >= 0) {
-            r.cats1 = dbr->findCategories(status, statusInclude, query, 1,
-                    cat0, -1, err);
+    if (err.isEmpty()) {
+        r = new SearchSession();
+        err = r->load(dbr, status, statusInclude, query);
+        if (!err.isEmpty()) {
+            delete r;
+            r = 0;
         }
     }
 
-    //qDebug() << "Only categories" << (GetTickCount() - search);
-
     return r;
 }
 
 void MainWindow::fillListInBackground()
 {
-    fillList();
+    DWORD start = GetTickCount();
+
+    Package::Status status;
+    bool statusInclude;
+    QString query;
+    int cat0, cat1;
+    getSearchFilter(&status, &statusInclude, &query, &cat0, &cat1);
+
+    if (searchSession && searchSession->isFor(status, statusInclude, query)) {
+        // only the categories have changed
+        searchTimer->stop();
+        searchWatcher = 0;
+        showSearchResult(start);
+    } else if (searchSession && searchSession->canRefine(status,
+            statusInclude, query)) {
+        searchTimer->stop();
+        searchWatcher = 0;
+        searchSession->refine(query);
+        showSearchResult(start);
+    } else {
+        searchTimer->start();
+    }
 }
 
-void MainWindow::fillList()
+void MainWindow::searchTimerTimeout()
+{
+    Package::Status status;
+    bool statusInclude;
+    QString query;
+    int cat0, cat1;
+    getSearchFilter(&status, &statusInclude, &query, &cat0, &cat1);
+
+    QFuture<SearchSession*> future = QtConcurrent::run(
+            &MainWindow::searchRunnable, status, statusInclude, query);
+    QFutureWatcher<SearchSession*>* w =
+            new QFutureWatcher<SearchSession*>(this);
+    connect(w, SIGNAL(finished()), this, SLOT(searchFinished()));
+    w->setFuture(future);
+
+    searchWatcher = w;
+}
+
+void MainWindow::searchFinished()
 {
     DWORD start = GetTickCount();
 
-    // qDebug() << "MainWindow::fillList";
-    QTableView* t = this->mainFrame->getTableWidget();
+    QFutureWatcher<SearchSession*>* w = static_cast<
+            QFutureWatcher<SearchSession*>*>(sender());
+    SearchSession* s = w->result();
+    w->deleteLater();
 
-    t->setUpdatesEnabled(false);
+    // results from older searches are ignored
+    if (w != searchWatcher) {
+        delete s;
+        return;
+    }
+    searchWatcher = 0;
 
-    QString query = this->mainFrame->getFilterLineEdit()->text();
+    if (!s) {
+        // report the error
+        fillList();
+        return;
+    }
 
-    //QSet<QString> requestedIcons;
-    int statusFilter = this->mainFrame->getStatusFilter();
-    Package::Status status = Package::NOT_INSTALLED;
-    bool statusInclude = false;
-    switch (statusFilter) {
-        case 1:
-            status = Package::INSTALLED;
-            statusInclude = true;
-            break;
-        case 2:
-            status = Package::UPDATEABLE;
-            statusInclude = true;
-            break;
+    Package::Status status;
+    bool statusInclude;
+    QString query;
+    int cat0, cat1;
+    getSearchFilter(&status, &statusInclude, &query, &cat0, &cat1);
+
+    if (s->isFor(status, statusInclude, query)) {
+        delete searchSession;
+        searchSession = s;
+        showSearchResult(start);
+    } else if (s->canRefine(status, statusInclude, query)) {
+        delete searchSession;
+        searchSession = s;
+        searchSession->refine(query);
+        showSearchResult(start);
+    } else {
+        delete s;
+        searchTimer->start();
     }
+}
 
-    int cat0 = this->mainFrame->getCategoryFilter(0);
-    int cat1 = this->mainFrame->getCategoryFilter(1);
+void MainWindow::fillList()
+{
+    DWORD start = GetTickCount();
 
-    QString err;
-    _SearchResult sr = search(status, statusInclude, query, cat0, cat1, &err);
+    // the database may have changed. Background searches are outdated.
+    searchTimer->stop();
+    searchWatcher = 0;
 
-    if (err.isEmpty()) {
-        this->mainFrame->setCategories(0, sr.cats);
-        this->mainFrame->setCategoryFilter(0, cat0);
-        this->mainFrame->setCategories(1, sr.cats1);
-        this->mainFrame->setCategoryFilter(1, cat1);
-    } else {
+    Package::Status status;
+    bool statusInclude;
+    QString query;
+    int cat0, cat1;
+    getSearchFilter(&status, &statusInclude, &query, &cat0, &cat1);
+
+    delete searchSession;
+    searchSession = new SearchSession();
+    QString err = searchSession->load(DBRepository::getDefault(), status,
+            statusInclude, query);
+    if (!err.isEmpty()) {
         addErrorMessage(err, err, true, QMessageBox::Critical);
     }
 
+    showSearchResult(start);
+}
+
+void MainWindow::showSearchResult(DWORD start)
+{
+    // qDebug() << "MainWindow::showSearchResult";
+    QTableView* t = this->mainFrame->getTableWidget();
+
+    t->setUpdatesEnabled(false);
+
+    int cat0 = this->mainFrame->getCategoryFilter(0);
+    int cat1 = this->mainFrame->getCategoryFilter(1);
+
+    QStringList found;
+    QList<QStringList> cats, cats1;
+    QString err = searchSession->filter(DBRepository::getDefault(), cat0,
+            cat1, &found, &cats, &cats1);
+    if (!err.isEmpty())
+        addErrorMessage(err, err, true, QMessageBox::Critical);
+
+    this->mainFrame->setCategories(0, cats);
+    this->mainFrame->setCategoryFilter(0, cat0);
+    this->mainFrame->setCategories(1, cats1);
+    this->mainFrame->setCategoryFilter(1, cat1);
+
     PackageItemModel* m = static_cast<PackageItemModel*>(t->model());
-    m->setPackages(sr.found);
+    m->setPackages(found);
     t->setUpdatesEnabled(true);
     t->horizontalHeader()->setSectionsMovable(true);
 
@@ -877,6 +989,11 @@ void MainWindow::processThreadFinished()
     }
     QModelIndex index = sm->currentIndex();
     fillList();
+
+    // the precomputed package summaries were updated in the database
+    PackageItemModel* m = static_cast<PackageItemModel*>(t->model());
+    m->clearCache();
+
     updateStatusInDetailTabs();
     sm->setCurrentIndex(index, QItemSelectionModel::Current);
     selectPackages(sel);
@@ -1454,6 +1571,38 @@ void MainWindow::recognizeAndLoadRepositoriesThreadFinished()
 
     this->reloadRepositoriesThreadRunning = false;
     updateActions();
+
+    prefetchUpdates();
+}
+
+void MainWindow::prefetchUpdates()
+{
+    // the binaries for the available updates are downloaded with a low
+    // priority so that "Update" does not need to wait for them later
+    DWORD kibPerSecond;
+    if (this->prefetchJob) {
+        // the same files could be downloaded twice at the same time
+        this->prefetchRestart = true;
+        this->prefetchJob->cancel();
+    } else if (WPMUtils::getPrefetchUpdates(&kibPerSecond)) {
+        this->prefetchRestart = false;
+        this->prefetchJob = new Job(QObject::tr("Downloading updates"));
+        connect(this->prefetchJob, SIGNAL(jobCompleted()), this,
+                SLOT(prefetchUpdatesCompleted()),
+                Qt::QueuedConnection);
+        monitor(this->prefetchJob);
+        QtConcurrent::run(DBRepository::prefetchUpdatesRunnable,
+                this->prefetchJob, ((qint64) kibPerSecond) * 1024);
+    }
+}
+
+void MainWindow::prefetchUpdatesCompleted()
+{
+    this->prefetchJob = 0;
+    if (this->prefetchRestart) {
+        this->prefetchRestart = false;
+        prefetchUpdates();
+    }
 }
 
 QList<void*> MainWindow::getSelected(const QString& type) const
@@ -1607,6 +1756,9 @@ void MainWindow::on_actionSettings_triggered()
 
         d->setCloseProcessType(WPMUtils::getCloseProcessType());
 
+        DWORD kibPerSecond;
+        d->setPrefetchUpdates(WPMUtils::getPrefetchUpdates(&kibPerSecond));
+
         this->ui->tabWidget->addTab(d, QObject::tr("Settings"));
         this->ui->tabWidget->setCurrentIndex(this->ui->tabWidget->count() - 1);
     }
@@ -17,6 +17,7 @@
 #include <QString>
 #include <QCache>
 #include <QList>
+#include <QFutureWatcher>
 
 #include "packageversion.h"
 #include "package.h"
@@ -26,6 +27,7 @@
 #include "mainframe.h"
 #include "progresstree2.h"
 #include "downloadsizefinder.h"
+#include "searchsession.h"
 
 namespace Ui {
     class MainWindow;
@@ -33,15 +35,6 @@ namespace Ui {
 
 const UINT WM_ICONTRAY = WM_USER + 1;
 
-/**
- * @brief search result
- */
-class _SearchResult {
-public:
-    QStringList found;
-    QList<QStringList> cats, cats1;
-};
-
 /**
  * Main window.
  */
@@ -111,8 +104,55 @@ private:
     QCache<QString, QIcon> icons;
 
     void updateDownloadSize(const QString &url);
-    _SearchResult search(Package::Status status, boolean statusInclude,
-            const QString &query, int cat0, int cat1, QString *err);
+
+    /**
+     * @brief result of the last search. The packages list is computed from
+     *     this object.
+     */
+    SearchSession* searchSession;
+
+    /** delays the background search while the user is typing */
+    QTimer* searchTimer;
+
+    /** the last started background search or 0 */
+    QFutureWatcher<SearchSession*>* searchWatcher;
+
+    /** the running download of the updates or 0 */
+    Job* prefetchJob;
+
+    /**
+     * true if the updates should be downloaded again after prefetchJob was
+     * cancelled
+     */
+    bool prefetchRestart;
+
+    /**
+     * @brief starts downloading the binaries for the available updates in a
+     *     background thread. Only one such download runs at a time. A
+     *     running download is cancelled and started again with the new
+     *     repository data.
+     */
+    void prefetchUpdates();
+
+    /**
+     * @brief reads the current search parameters from the UI
+     */
+    void getSearchFilter(Package::Status* status, bool* statusInclude,
+            QString* query, int* cat0, int* cat1) const;
+
+    /**
+     * @brief shows the search result from searchSession
+     * @param start GetTickCount() at the start of the search
+     */
+    void showSearchResult(DWORD start);
+
+    /**
+     * @brief searches for packages using a separate database connection.
+     *     This function is executed in a separate thread.
+     * @return [ownership:caller] search result or 0 if an error occured
+     */
+    static SearchSession* searchRunnable(Package::Status status,
+            bool statusInclude, const QString& query);
 public:
     /** URL -> full path to the file or "" in case of an error */
     QMap<QString, QString> downloadCache;
@@ -274,7 +314,11 @@ public:
     QIcon downloadScreenshot(const QString &url);
 
     /**
-     * @brief start filling the list asnchronously
+     * @brief start filling the list asnchronously. The last search result is
+     *     re-used without accessing the database if the query only got more
+     *     specific (e.g. more characters were typed or a category was chosen).
+     *     Otherwise the search is started in a background thread after a
+     *     short delay.
      */
     void fillListInBackground();
 protected:
@@ -289,6 +333,7 @@ private slots:
     void processThreadFinished();
     void hardDriveScanThreadFinished();
     void recognizeAndLoadRepositoriesThreadFinished();
+    void prefetchUpdatesCompleted();
     void on_actionScan_Hard_Drives_triggered();
     void on_actionShow_Details_triggered();
     void on_tabWidget_currentChanged(int index);
@@ -321,6 +366,8 @@ private slots:
     void on_actionToggle_toolbar_triggered(bool checked);
     void on_mainToolBar_visibilityChanged(bool visible);
     void monitoredJobCompleted();
+    void searchTimerTimeout();
+    void searchFinished();
 };
 
 #endif // MAINWINDOW_H
@@ -1,10 +1,139 @@
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QSqlError>
+#include <QStringList>
+#include <QVariant>
+
 #include "mysqlquery.h"
 #include "wpmutils.h"
 
 bool MySQLQuery::debug = false;
+QAtomicInt MySQLQuery::collectStatistics(0);
+int MySQLQuery::slowQueryThreshold = 100;
+QMutex MySQLQuery::statisticsMutex;
+QHash<QString, MySQLQuery::Statistics> MySQLQuery::statistics;
+
+MySQLQuery::Statistics::Statistics(): count(0), totalTime(0), maxTime(0),
+        rows(0)
+{
+}
+
+static bool statisticsLessThan(const QJsonObject& a, const QJsonObject& b)
+{
+    return a.value("totalTime").toDouble() > b.value("totalTime").toDouble();
+}
+
+MySQLQuery::MySQLQuery(QSqlDatabase db) : QSqlQuery(db), db(db),
+        executedPrepared(false), executedTime(0), executedRows(0)
+{
+}
+
+MySQLQuery::~MySQLQuery()
+{
+    if (!executed.isEmpty())
+        recordExecution();
+}
+
+QJsonObject MySQLQuery::getStatistics()
+{
+    QList<QJsonObject> list;
+
+    statisticsMutex.lock();
+    QHashIterator<QString, Statistics> it(statistics);
+    while (it.hasNext()) {
+        it.next();
+        const Statistics& s = it.value();
+
+        QJsonObject obj;
+        obj["sql"] = it.key();
+        obj["count"] = s.count;
+
+        // milliseconds
+        obj["totalTime"] = s.totalTime / 1000000.0;
+        obj["maxTime"] = s.maxTime / 1000000.0;
+        obj["rows"] = (double) s.rows;
+        if (!s.plan.isEmpty())
+            obj["plan"] = s.plan;
+        list.append(obj);
+    }
+    statisticsMutex.unlock();
+
+    qSort(list.begin(), list.end(), statisticsLessThan);
+
+    QJsonArray statements;
+    for (int i = 0; i < list.count(); i++) {
+        statements.append(list.at(i));
+    }
+
+    QJsonObject top;
+    top["slowQueryThreshold"] = slowQueryThreshold;
+    top["statements"] = statements;
+
+    return top;
+}
+
+void MySQLQuery::resetStatistics()
+{
+    QMutexLocker ml(&statisticsMutex);
+    statistics.clear();
+}
 
-MySQLQuery::MySQLQuery(QSqlDatabase db) : QSqlQuery(db)
+QString MySQLQuery::explain(const QString& sql, bool prepared)
 {
+    QString r;
+
+    // QSqlQuery and not MySQLQuery so that this statement is not recorded
+    QSqlQuery q(db);
+    bool ok;
+    if (prepared) {
+        ok = q.prepare("EXPLAIN QUERY PLAN " + sql);
+        if (ok) {
+            int n = boundValues().count();
+            for (int i = 0; i < n; i++) {
+                q.addBindValue(boundValue(i));
+            }
+            ok = q.exec();
+        }
+    } else {
+        ok = q.exec("EXPLAIN QUERY PLAN " + sql);
+    }
+
+    if (ok) {
+        // columns: selectid, order, from, detail
+        QStringList lines;
+        while (q.next()) {
+            lines.append(q.value(3).toString());
+        }
+        r = lines.join("\n");
+    } else {
+        r = q.lastError().text();
+    }
+
+    return r;
+}
+
+void MySQLQuery::recordExecution()
+{
+    QString sql = executed;
+    executed.clear();
+
+    bool slow = executedTime >= ((qint64) slowQueryThreshold) * 1000000;
+
+    QMutexLocker ml(&statisticsMutex);
+
+    Statistics& s = statistics[sql];
+    s.count++;
+    s.totalTime += executedTime;
+    if (executedTime > s.maxTime)
+        s.maxTime = executedTime;
+    s.rows += executedRows;
+
+    if (slow && s.plan.isEmpty()) {
+        ml.unlock();
+        QString plan = explain(sql, executedPrepared);
+        ml.relock();
+        statistics[sql].plan = plan;
+    }
 }
 
 bool MySQLQuery::exec(const QString &query)
@@ -12,9 +141,25 @@ bool MySQLQuery::exec(const QString &query)
     if (debug)
         WPMUtils::writeln(query);
 
-    //DWORD start = GetTickCount();
+    if (!collectStatistics.load())
+        return QSqlQuery::exec(query);
+
+    if (!executed.isEmpty())
+        recordExecution();
+
+    QElapsedTimer timer;
+    timer.start();
     bool r = QSqlQuery::exec(query);
-    // qDebug() << query << (GetTickCount() - start);
+    executedTime = timer.nsecsElapsed();
+
+    executed = query;
+    executedPrepared = false;
+    executedRows = 0;
+
+    // there are no rows to fetch
+    if (!r || !isSelect())
+        recordExecution();
+
     return r;
 }
 
@@ -23,9 +168,24 @@ bool MySQLQuery::exec()
     if (debug)
         WPMUtils::writeln(this->lastQuery());
 
-    //DWORD start = GetTickCount();
+    if (!collectStatistics.load())
+        return QSqlQuery::exec();
+
+    if (!executed.isEmpty())
+        recordExecution();
+
+    QElapsedTimer timer;
+    timer.start();
     bool r = QSqlQuery::exec();
-    // qDebug() << this->lastQuery() << (GetTickCount() - start);
+    executedTime = timer.nsecsElapsed();
+
+    executed = this->lastQuery();
+    executedPrepared = true;
+    executedRows = 0;
+
+    if (!r || !isSelect())
+        recordExecution();
+
     return r;
 }
 
@@ -36,6 +196,20 @@ bool MySQLQuery::prepare(const QString& query)
 
 bool MySQLQuery::next()
 {
-    return QSqlQuery::next();
-}
+    if (executed.isEmpty())
+        return QSqlQuery::next();
+
+    // SQLite computes the rows on demand. The time for fetching belongs to
+    // the statement.
+    QElapsedTimer timer;
+    timer.start();
+    bool r = QSqlQuery::next();
+    executedTime += timer.nsecsElapsed();
 
+    if (r)
+        executedRows++;
+    else
+        recordExecution();
+
+    return r;
+}
@@ -3,16 +3,105 @@
 
 #include <QSqlQuery>
 #include <QSqlDatabase>
+#include <QMutex>
+#include <QHash>
+#include <QString>
+#include <QJsonObject>
+#include <QAtomicInt>
 
 /**
  * @brief SQL query
  */
 class MySQLQuery: public QSqlQuery {
+    /**
+     * @brief statistics for one SQL statement
+     */
+    class Statistics {
+    public:
+        /** number of executions */
+        int count;
+
+        /** execution and fetching time in nanoseconds for all executions */
+        qint64 totalTime;
+
+        /** maximum execution and fetching time in nanoseconds */
+        qint64 maxTime;
+
+        /** number of returned rows for all executions */
+        qint64 rows;
+
+        /** EXPLAIN QUERY PLAN for a slow statement or "" */
+        QString plan;
+
+        Statistics();
+    };
+
+    /** protects "statistics" */
+    static QMutex statisticsMutex;
+
+    /** SQL -> statistics */
+    static QHash<QString, Statistics> statistics;
+
+    QSqlDatabase db;
+
+    /**
+     * SQL of the current execution or "" if it was already recorded. An
+     * execution is recorded after the last row was fetched or, if the rows
+     * were not fetched till the end, before the next execution.
+     */
+    QString executed;
+
+    /** true if "executed" is a prepared statement with bound values */
+    bool executedPrepared;
+
+    /** time in nanoseconds for the current execution */
+    qint64 executedTime;
+
+    /** rows returned by the current execution */
+    qint64 executedRows;
+
+    /**
+     * @brief adds the data for the current execution to the statistics
+     */
+    void recordExecution();
+
+    /**
+     * @param sql SQL statement
+     * @param prepared true if the statement is prepared and the bound values
+     *     of this query should be used
+     * @return output of EXPLAIN QUERY PLAN for the statement or the error
+     *     message
+     */
+    QString explain(const QString& sql, bool prepared);
 public:
     /** true = print the SQL statements */
     static bool debug;
 
+    /**
+     * 1 = collect the statistics for executed statements (see
+     * getStatistics()). Can be changed from any thread.
+     */
+    static QAtomicInt collectStatistics;
+
+    /**
+     * the query plan is saved for statements that need at least this amount
+     * of milliseconds
+     */
+    static int slowQueryThreshold;
+
+    /**
+     * @return statistics for all executed statements as JSON object with
+     *     the statements sorted by the total time
+     */
+    static QJsonObject getStatistics();
+
+    /**
+     * @brief removes all statistics
+     */
+    static void resetStatistics();
+
     explicit MySQLQuery(QSqlDatabase db);
+    ~MySQLQuery();
     bool exec(const QString& query);
     bool exec();
     bool next();
@@ -3,17 +3,34 @@
 #include <QSharedPointer>
 #include <QDebug>
 #include <QApplication>
+#include <QtConcurrent/QtConcurrentRun>
+#include <QFutureWatcher>
 
 #include "license.h"
 #include "packageitemmodel.h"
 #include "abstractrepository.h"
+#include "dbrepository.h"
 #include "mainwindow.h"
 #include "wpmutils.h"
 
+PackageItemModel::Fetched::~Fetched()
+{
+    qDeleteAll(infos);
+}
+
 PackageItemModel::PackageItemModel(const QStringList& packages) :
-        obsoleteBrush(QColor(255, 0xc7, 0xc7))
+        obsoleteBrush(QColor(255, 0xc7, 0xc7)), generation(0)
 {
-    this->packages = packages;
+    this->cache.setMaxCost(2 * PREFETCH_MAX);
+    this->loading.up2date = true;
+
+    // approximately one frame
+    this->repaintTimer.setSingleShot(true);
+    this->repaintTimer.setInterval(20);
+    connect(&this->repaintTimer, SIGNAL(timeout()), this,
+            SLOT(repaintTimeout()));
+
+    setPackages(packages);
 }
 
 PackageItemModel::~PackageItemModel()
@@ -30,16 +47,12 @@ int PackageItemModel::columnCount(const QModelIndex &parent) const
     return 7;
 }
 
-PackageItemModel::Info* PackageItemModel::createInfo(
-        Package* p) const
+void PackageItemModel::createVersionsInfo(DBRepository* dbr, Package* p,
+        Info* r)
 {
-    Info* r = new Info();
-
-    AbstractRepository* rep = AbstractRepository::getDefault_();
-
     // error is ignored here
     QString err;
-    QList<PackageVersion*> pvs = rep->getPackageVersions_(p->name, &err);
+    QList<PackageVersion*> pvs = dbr->getPackageVersions_(p->name, &err);
 
     PackageVersion* newestInstallable = 0;
     PackageVersion* newestInstalled = 0;
@@ -73,6 +86,26 @@ PackageItemModel::Info* PackageItemModel::createInfo(
 
     qDeleteAll(pvs);
     pvs.clear();
+}
+
+PackageItemModel::Info* PackageItemModel::createInfo(DBRepository* dbr,
+        Package* p, const QStringList& summary,
+        QHash<QString, QString>* licenseTitles)
+{
+    Info* r = new Info();
+
+    // error is ignored here
+    QString err;
+
+    // the summary is computed by DBRepository::updateStatus
+    if (summary.count() == 4) {
+        r->installed = summary.at(0);
+        r->avail = summary.at(1);
+        r->newestDownloadURL = summary.at(2);
+        r->up2date = summary.at(3).toInt() != Package::UPDATEABLE;
+    } else {
+        createVersionsInfo(dbr, p, r);
+    }
 
     QString s = p->description;
     if (s.length() > 200) {
@@ -82,30 +115,178 @@ PackageItemModel::Info* PackageItemModel::createInfo(
 
     r->title = p->title;
 
-    // the error message is ignored
-    QSharedPointer<License> lic(rep->findLicense_(
-            p->license, &err));
-    if (lic)
-        r->licenseTitle = lic->title;
+    // there are only few licenses
+    if (licenseTitles->contains(p->license)) {
+        r->licenseTitle = licenseTitles->value(p->license);
+    } else {
+        // the error message is ignored
+        QSharedPointer<License> lic(dbr->findLicense_(
+                p->license, &err));
+        if (lic)
+            r->licenseTitle = lic->title;
+        licenseTitles->insert(p->license, r->licenseTitle);
+    }
 
     r->icon = p->getIcon();
 
     return r;
 }
 
+PackageItemModel::Fetched* PackageItemModel::fetch(const QStringList& names,
+        int generation)
+{
+    Fetched* r = new Fetched();
+    r->names = names;
+    r->generation = generation;
+
+    DBRepository* dbr = DBRepository::getReadOnly(&r->err);
+
+    if (r->err.isEmpty()) {
+        QList<Package*> ps = dbr->findPackages(names);
+
+        // error is ignored here. The information will be computed from the
+        // package versions.
+        QString err;
+        QMap<QString, QStringList> summaries = dbr->getPackageSummaries(
+                names, &err);
+
+        // there are only few licenses
+        QHash<QString, QString> licenseTitles;
+        for (int i = 0; i < ps.count(); i++) {
+            Package* p = ps.at(i);
+            r->infos.insert(p->name, createInfo(dbr, p,
+                    summaries.value(p->name), &licenseTitles));
+        }
+
+        qDeleteAll(ps);
+    }
+
+    return r;
+}
+
+void PackageItemModel::prefetch(int first, int last) const
+{
+    first = qMax(0, first - PREFETCH_MARGIN);
+    last = qMin(this->packages.count() - 1, last + PREFETCH_MARGIN);
+    last = qMin(last, first + PREFETCH_MAX - 1);
+
+    QStringList names;
+    for (int i = first; i <= last; i++) {
+        const QString& p = this->packages.at(i);
+        if (!this->cache.contains(p) && !this->requested.contains(p)) {
+            names.append(p);
+            this->requested.insert(p);
+        }
+    }
+
+    if (names.isEmpty())
+        return;
+
+    // the watcher belongs to the GUI thread and reports the result using a
+    // queued signal
+    PackageItemModel* self = const_cast<PackageItemModel*>(this);
+    QFutureWatcher<Fetched*>* w = new QFutureWatcher<Fetched*>(self);
+    connect(w, SIGNAL(finished()), self, SLOT(fetched()));
+    w->setFuture(QtConcurrent::run(PackageItemModel::fetch, names,
+            this->generation));
+}
+
+void PackageItemModel::fetched()
+{
+    QFutureWatcher<Fetched*>* w = static_cast<
+            QFutureWatcher<Fetched*>*>(sender());
+    Fetched* f = w->result();
+    w->deleteLater();
+
+    // the cache was cleared in the mean time. The data may be outdated.
+    if (f->generation != this->generation) {
+        delete f;
+        return;
+    }
+
+    // the database could not be opened. Nothing is cached so that the rows
+    // are fetched again the next time they are painted.
+    if (!f->err.isEmpty()) {
+        for (int i = 0; i < f->names.count(); i++) {
+            this->requested.remove(f->names.at(i));
+        }
+        delete f;
+        return;
+    }
+
+    // the registered URLs only need to cover the cached rows
+    if (this->iconURLs.size() > MAX_URLS ||
+            this->downloadURLs.size() > MAX_URLS) {
+        this->iconURLs.clear();
+        this->downloadURLs.clear();
+        QList<QString> keys = this->cache.keys();
+        for (int i = 0; i < keys.count(); i++) {
+            addURLs(keys.at(i), this->cache.object(keys.at(i)));
+        }
+    }
+
+    int first = -1, last = -1;
+    for (int i = 0; i < f->names.count(); i++) {
+        const QString& package = f->names.at(i);
+        this->requested.remove(package);
+
+        Info* info = f->infos.take(package);
+
+        // the package does not exist anymore
+        if (!info) {
+            info = new Info();
+            info->up2date = true;
+            info->title = package;
+        }
+
+        addURLs(package, info);
+        this->cache.insert(package, info);
+
+        int row = this->rows.value(package, -1);
+        if (row >= 0) {
+            if (first < 0 || row < first)
+                first = row;
+            if (row > last)
+                last = row;
+        }
+    }
+
+    delete f;
+
+    if (first >= 0)
+        this->dataChanged(this->index(first, 0),
+                this->index(last, columnCount(QModelIndex()) - 1));
+}
+
+void PackageItemModel::addURLs(const QString& package, const Info* info)
+{
+    // used to find the rows that should be repainted
+    if (!info->icon.isEmpty() && !iconURLs.contains(info->icon, package))
+        iconURLs.insert(info->icon, package);
+    if (!info->newestDownloadURL.isEmpty() &&
+            !downloadURLs.contains(info->newestDownloadURL, package))
+        downloadURLs.insert(info->newestDownloadURL, package);
+}
+
+const PackageItemModel::Info* PackageItemModel::getInfo(
+        const QString& package) const
+{
+    const Info* r = this->cache.object(package);
+    if (!r) {
+        int row = this->rows.value(package, -1);
+        if (row >= 0)
+            prefetch(row, row);
+        r = &this->loading;
+    }
+
+    return r;
+}
+
 QVariant PackageItemModel::data(const QModelIndex &index, int role) const
 {
     QString p = this->packages.at(index.row());
     QVariant r;
-    AbstractRepository* rep = AbstractRepository::getDefault_();
-    Info* cached = this->cache.object(p);
-    bool insertIntoCache = false;
-    if (!cached) {
-        Package* pk = rep->findPackage_(p);
-        cached = createInfo(pk);
-        delete pk;
-        insertIntoCache = true;
-    }
+    const Info* cached = getInfo(p);
     if (role == Qt::DisplayRole) {
         switch (index.column()) {
             case 1:
@@ -188,9 +369,6 @@ QVariant PackageItemModel::data(const QModelIndex &index, int role) const
         }
     }
 
-    if (insertIntoCache)
-        this->cache.insert(p, cached);
-
     return r;
 }
 
@@ -234,19 +412,66 @@ void PackageItemModel::setPackages(const QStringList& packages)
 {
     this->beginResetModel();
     this->packages = packages;
+    this->rows.clear();
+    for (int i = 0; i < packages.count(); i++) {
+        this->rows.insert(packages.at(i), i);
+    }
+    this->changedIcons.clear();
+    this->changedSizes.clear();
     this->endResetModel();
 }
 
 void PackageItemModel::iconUpdated(const QString &url)
 {
-    this->dataChanged(this->index(0, 0), this->index(
-            this->packages.count() - 1, 0));
+    QList<QString> ps = this->iconURLs.values(url);
+    for (int i = 0; i < ps.count(); i++) {
+        int row = this->rows.value(ps.at(i), -1);
+        if (row >= 0)
+            this->changedIcons.insert(row);
+    }
+
+    if (!this->changedIcons.isEmpty() && !this->repaintTimer.isActive())
+        this->repaintTimer.start();
 }
 
 void PackageItemModel::downloadSizeUpdated(const QString &url)
 {
-    this->dataChanged(this->index(0, 5), this->index(
-            this->packages.count() - 1, 5));
+    QList<QString> ps = this->downloadURLs.values(url);
+    for (int i = 0; i < ps.count(); i++) {
+        int row = this->rows.value(ps.at(i), -1);
+        if (row >= 0)
+            this->changedSizes.insert(row);
+    }
+
+    if (!this->changedSizes.isEmpty() && !this->repaintTimer.isActive())
+        this->repaintTimer.start();
+}
+
+void PackageItemModel::emitDataChanged(QSet<int>* changed, int column)
+{
+    QList<int> list = changed->toList();
+    qSort(list);
+
+    int i = 0;
+    while (i < list.count()) {
+        int first = list.at(i);
+        int last = first;
+        while (i + 1 < list.count() && list.at(i + 1) == last + 1) {
+            i++;
+            last++;
+        }
+        this->dataChanged(this->index(first, column),
+                this->index(last, column));
+        i++;
+    }
+
+    changed->clear();
+}
+
+void PackageItemModel::repaintTimeout()
+{
+    emitDataChanged(&this->changedIcons, 0);
+    emitDataChanged(&this->changedSizes, 6);
 }
 
 void PackageItemModel::installedStatusChanged(const QString& package,
@@ -255,17 +480,18 @@ void PackageItemModel::installedStatusChanged(const QString& package,
     //qDebug() << "PackageItemModel::installedStatusChanged" << package <<
     //        version.getVersionString();
     this->cache.remove(package);
-    for (int i = 0; i < this->packages.count(); i++) {
-        QString p = this->packages.at(i);
-        if (p == package) {
-            this->dataChanged(this->index(i, 4), this->index(i, 4));
-        }
-    }
+    int row = this->rows.value(package, -1);
+    if (row >= 0)
+        this->dataChanged(this->index(row, 4), this->index(row, 4));
 }
 
 void PackageItemModel::clearCache()
 {
     this->cache.clear();
+    this->requested.clear();
+    this->generation++;
+    this->iconURLs.clear();
+    this->downloadURLs.clear();
     this->dataChanged(this->index(0, 3),
             this->index(this->packages.count() - 1, 4));
 }
@@ -6,19 +6,43 @@
 #include <QAbstractTableModel>
 #include <QCache>
 #include <QBrush>
+#include <QHash>
+#include <QMap>
+#include <QMultiHash>
+#include <QSet>
+#include <QTimer>
 
 #include "package.h"
 #include "version.h"
 
+class DBRepository;
+
 /**
  * @brief shows packages
  */
 class PackageItemModel: public QAbstractTableModel
 {
+    Q_OBJECT
+
+    /** number of rows fetched before and after the requested ones */
+    static const int PREFETCH_MARGIN = 20;
+
+    /** the maximum number of rows fetched at once */
+    static const int PREFETCH_MAX = 150;
+
+    /**
+     * iconURLs and downloadURLs are rebuilt from the cached rows if they
+     * contain more entries
+     */
+    static const int MAX_URLS = 4 * PREFETCH_MAX;
+
     QBrush obsoleteBrush;
 
     QStringList packages;
 
+    /** package name -> row */
+    QHash<QString, int> rows;
+
     class Info {
     public:
         QString avail;
@@ -31,9 +55,112 @@ class PackageItemModel: public QAbstractTableModel
         QString icon;
     };
 
+    /**
+     * @brief the result of a fetch in a background thread
+     */
+    class Fetched {
+    public:
+        /** requested package names */
+        QStringList names;
+
+        /** package name -> information. Missing packages are not contained */
+        QMap<QString, Info*> infos;
+
+        /** error message */
+        QString err;
+
+        /** value of "generation" when the fetch was started */
+        int generation;
+
+        ~Fetched();
+    };
+
     mutable QCache<QString, Info> cache;
 
-    Info *createInfo(Package *p) const;
+    /** shown while the information for a row is fetched */
+    Info loading;
+
+    /** packages that are being fetched in background threads */
+    mutable QSet<QString> requested;
+
+    /**
+     * incremented by clearCache(). Fetches started before that are
+     * outdated.
+     */
+    int generation;
+
+    /** icon URL -> package name */
+    mutable QMultiHash<QString, QString> iconURLs;
+
+    /** download URL -> package name */
+    mutable QMultiHash<QString, QString> downloadURLs;
+
+    /** rows with changed icons that were not yet repainted */
+    QSet<int> changedIcons;
+
+    /** rows with changed download sizes that were not yet repainted */
+    QSet<int> changedSizes;
+
+    /**
+     * icons and download sizes arriving in a short period of time are
+     * repainted together
+     */
+    QTimer repaintTimer;
+
+    /**
+     * @param dbr repository
+     * @param p a package
+     * @param summary summary from DBRepository::getPackageSummaries or an
+     *     empty list if not available
+     * @param licenseTitles license name -> title. Used as a cache.
+     * @return [ownership:caller] information about the package
+     */
+    static Info *createInfo(DBRepository* dbr, Package *p,
+            const QStringList& summary,
+            QHash<QString, QString>* licenseTitles);
+
+    /**
+     * @brief reads the information for the specified packages. This function
+     *     is executed in a background thread and uses its read-only
+     *     connection (see DBRepository::getReadOnly()).
+     * @param names package names
+     * @param generation see "generation"
+     * @return [ownership:caller] fetched information
+     */
+    static Fetched* fetch(const QStringList& names, int generation);
+
+    /**
+     * @brief registers the icon and the download URL of a row so that it can
+     *     be repainted if they change
+     * @param package full package name
+     * @param info information about the package
+     */
+    void addURLs(const QString& package, const Info* info);
+
+    /**
+     * @brief emits dataChanged() for contiguous ranges of rows
+     * @param changed changed rows. This set will be cleared.
+     * @param column changed column
+     */
+    void emitDataChanged(QSet<int>* changed, int column);
+
+    /**
+     * @param package full package name
+     * @return cached information about the package. If the information is
+     *     not available, it is fetched in a background thread and an empty
+     *     object is returned.
+     */
+    const Info* getInfo(const QString& package) const;
+
+    /**
+     * @brief computes the version information from the package versions.
+     *     This is only used if the precomputed summary in the database is not
+     *     available.
+     * @param dbr repository
+     * @param p a package
+     * @param r the information will be stored here
+     */
+    static void createVersionsInfo(DBRepository* dbr, Package *p, Info* r);
 public:
     /**
      * @param packages list of package names
@@ -80,6 +207,24 @@ public:
      * @param url URL of the binary
      */
     void downloadSizeUpdated(const QString &url);
+
+    /**
+     * @brief starts fetching the information for the specified rows and some
+     *     rows around them in one batch in a background thread. This avoids
+     *     database queries on the GUI thread for every single row while
+     *     painting. The rows are repainted when the information is
+     *     available.
+     * @param first first row
+     * @param last last row
+     */
+    void prefetch(int first, int last) const;
+private slots:
+    void repaintTimeout();
+
+    /**
+     * @brief a background fetch was finished
+     */
+    void fetched();
 };
 
 #endif // PACKAGEITEMMODEL_H
@@ -7,6 +7,8 @@
 #include <shellapi.h>
 #include <shlobj.h>
 #include <wininet.h>
+#include <aclapi.h>
+#include <sddl.h>
 #include <stdlib.h>
 #include <time.h>
 #include <ole2.h>
@@ -31,6 +33,7 @@
 
 #include "repository.h"
 #include "packageversion.h"
+#include "dependencyindex.h"
 #include "job.h"
 #include "downloader.h"
 #include "wpmutils.h"
@@ -40,7 +43,7 @@
 #include "installedpackages.h"
 #include "installedpackageversion.h"
 #include "dbrepository.h"
-#include "repositoryxmlhandler.h"
+#include "repositoryxmlreader.h"
 
 QSemaphore PackageVersion::httpConnections(3);
 QSemaphore PackageVersion::installationScripts(1);
@@ -328,18 +331,21 @@ void PackageVersion::fillFrom(PackageVersion *pv)
 
     qDeleteAll(this->files);
     this->files.clear();
+    this->files.reserve(pv->files.count());
     for (int i = 0; i < pv->files.count(); i++) {
         this->files.append(pv->files.at(i)->clone());
     }
 
     qDeleteAll(this->detectFiles);
     this->detectFiles.clear();
+    this->detectFiles.reserve(pv->detectFiles.count());
     for (int i = 0; i < pv->detectFiles.count(); i++) {
         this->detectFiles.append(pv->detectFiles.at(i)->clone());
     }
 
     qDeleteAll(this->dependencies);
     this->dependencies.clear();
+    this->dependencies.reserve(pv->dependencies.count());
     for (int i = 0; i < pv->dependencies.count(); i++) {
         this->dependencies.append(pv->dependencies.at(i)->clone());
     }
@@ -705,13 +711,14 @@ void PackageVersion::removeDirectory(Job* job, const QString& dir,
 
 QString PackageVersion::planInstallation(QList<PackageVersion*>& installed,
         QList<InstallOperation*>& ops, QList<PackageVersion*>& avoid,
-        const QString& where)
+        const QString& where, AbstractRepository* rep)
 {
     QString res;
 
     avoid.append(this->clone());
 
-    AbstractRepository* rep = AbstractRepository::getDefault_();
+    if (!rep)
+        rep = AbstractRepository::getDefault_();
 
     for (int i = 0; i < this->dependencies.count(); i++) {
         Dependency* d = this->dependencies.at(i);
@@ -773,7 +780,8 @@ QString PackageVersion::planInstallation(QList<PackageVersion*>& installed,
                     int opsCount = ops.count();
                     int avoidCount = avoid.count();
 
-                    res = pv->planInstallation(installed, ops, avoid);
+                    res = pv->planInstallation(installed, ops, avoid, "",
+                            rep);
                     if (!res.isEmpty()) {
                         // rollback
                         while (installed.count() > installedCount) {
@@ -823,40 +831,44 @@ QString PackageVersion::planUninstallation(QList<PackageVersion*>& installed,
     if (!PackageVersion::contains(installed, this))
         return res;
 
-    // this loop ensures that all the items in "installed" are processed
-    // even if changes in the list were done in nested calls to
+    DependencyIndex index(installed);
+    res = planUninstallation(index, installed, ops);
+
+    return res;
+}
+
+QString PackageVersion::planUninstallation(DependencyIndex& index,
+        QList<PackageVersion*>& installed, QList<InstallOperation*>& ops)
+{
+    QString res;
+
+    if (!index.contains(this->package, this->version))
+        return res;
+
+    // the package version is removed from the index first so that the
+    // counters for the dependencies do not include it anymore. This also
+    // breaks cycles in the dependencies.
+    index.remove(this->package, this->version);
+
+    QList<DependencyIndex::Edge*> edges = index.getDependents(this->package);
+
+    // this loop ensures that all the dependencies are processed
+    // even if the counters were changed in nested calls to
     // "planUninstallation"
     while (true) {
-        int oldCount = installed.count();
-        for (int i = 0; i < installed.count(); i++) {
-            PackageVersion* pv = installed.at(i);
-            if (pv->package != this->package || pv->version != this->version) {
-                for (int j = 0; j < pv->dependencies.count(); j++) {
-                    Dependency* d = pv->dependencies.at(j);
-                    if (d->package == this->package && d->test(this->version)) {
-                        int n = 0;
-                        for (int k = 0; k < installed.count(); k++) {
-                            PackageVersion* pv2 = installed.at(k);
-                            if (d->package == pv2->package &&
-                                    d->test(pv2->version)) {
-                                n++;
-                            }
-                            if (n > 1)
-                                break;
-                        }
-                        if (n <= 1) {
-                            res = pv->planUninstallation(installed, ops);
-                            if (!res.isEmpty())
-                                break;
-                        }
-                    }
-                }
+        bool changed = false;
+        for (int i = 0; i < edges.count(); i++) {
+            DependencyIndex::Edge* e = edges.at(i);
+            if (!e->removed && e->satisfied == 0 &&
+                    e->dependency->test(this->version)) {
+                res = e->owner->planUninstallation(index, installed, ops);
                 if (!res.isEmpty())
                     break;
+                changed = true;
             }
         }
 
-        if (oldCount == installed.count() || !res.isEmpty())
+        if (!changed || !res.isEmpty())
             break;
     }
 
@@ -900,7 +912,7 @@ QString PackageVersion::downloadAndComputeSHA1(Job* job)
 
     Job* djob = job->newSubJob(0.95, QObject::tr("Downloading"));
     Downloader::Request request(this->download);
-    QTemporaryFile* f = Downloader::downloadToTemporary(djob, request);
+    QTemporaryFile* f = Downloader::downloadToTemporary(djob, request, 0);
     if (!djob->getErrorMessage().isEmpty())
         job->setErrorMessage(QString(QObject::tr("Download failed: %1")).
                 arg(djob->getErrorMessage()));
@@ -919,6 +931,213 @@ QString PackageVersion::downloadAndComputeSHA1(Job* job)
     return r;
 }
 
+QString PackageVersion::getDownloadCacheDir()
+{
+    return WPMUtils::getShellDir(CSIDL_COMMON_APPDATA) +
+            "\\Npackd\\Downloads";
+}
+
+/**
+ * @param sid a SID
+ * @return true if the SID belongs to the Administrators group or to the
+ *     SYSTEM account
+ */
+static bool isAdminSID(PSID sid)
+{
+    return sid && (IsWellKnownSid(sid, WinBuiltinAdministratorsSid) ||
+            IsWellKnownSid(sid, WinLocalSystemSid));
+}
+
+/**
+ * @param path a file or a directory
+ * @return true if the path is a reparse point (e.g. a symbolic link or a
+ *     junction)
+ */
+static bool isReparsePoint(const QString& path)
+{
+    DWORD a = GetFileAttributesW((WCHAR*) path.utf16());
+    return a != INVALID_FILE_ATTRIBUTES && (a & FILE_ATTRIBUTE_REPARSE_POINT);
+}
+
+QString PackageVersion::checkDownloadCacheDir()
+{
+    QString err;
+
+    QString dir = getDownloadCacheDir();
+    QString parent = dir.left(dir.lastIndexOf('\\'));
+    DWORD a = GetFileAttributesW((WCHAR*) dir.utf16());
+    if (a == INVALID_FILE_ATTRIBUTES) {
+        WPMUtils::formatMessage(GetLastError(), &err);
+    } else if (!(a & FILE_ATTRIBUTE_DIRECTORY)) {
+        err = QObject::tr("%1 is not a directory").arg(dir);
+    } else if ((a & FILE_ATTRIBUTE_REPARSE_POINT) || isReparsePoint(parent)) {
+        err = QObject::tr("%1 is a reparse point").arg(dir);
+    }
+
+    // the files are executed with administrative rights. Nobody else should
+    // be able to change them.
+    if (err.isEmpty()) {
+        PSID owner = 0;
+        PACL dacl = 0;
+        PSECURITY_DESCRIPTOR sd = 0;
+        DWORD e = GetNamedSecurityInfoW((WCHAR*) dir.utf16(), SE_FILE_OBJECT,
+                OWNER_SECURITY_INFORMATION | DACL_SECURITY_INFORMATION,
+                &owner, 0, &dacl, 0, &sd);
+        if (e != ERROR_SUCCESS) {
+            WPMUtils::formatMessage(e, &err);
+        } else if (!isAdminSID(owner)) {
+            err = QObject::tr("%1 is not owned by the administrators").
+                    arg(dir);
+        } else if (!dacl) {
+            err = QObject::tr("%1 is accessible for everybody").arg(dir);
+        } else {
+            for (DWORD i = 0; i < dacl->AceCount && err.isEmpty(); i++) {
+                ACE_HEADER* h;
+                if (!GetAce(dacl, i, (LPVOID*) &h)) {
+                    WPMUtils::formatMessage(GetLastError(), &err);
+                } else if (h->AceType == ACCESS_ALLOWED_ACE_TYPE) {
+                    ACCESS_ALLOWED_ACE* ace = (ACCESS_ALLOWED_ACE*) h;
+                    if (!isAdminSID((PSID) &ace->SidStart))
+                        err = QObject::tr(
+                                "%1 is accessible for other users").arg(dir);
+                } else if (h->AceType != ACCESS_DENIED_ACE_TYPE) {
+                    err = QObject::tr(
+                            "Unexpected access control entry for %1").
+                            arg(dir);
+                }
+            }
+        }
+        if (sd)
+            LocalFree(sd);
+    }
+
+    return err;
+}
+
+QString PackageVersion::createDownloadCacheDir()
+{
+    QString err;
+
+    QString dir = getDownloadCacheDir();
+    QString parent = dir.left(dir.lastIndexOf('\\'));
+    QDir d;
+    if (!d.mkpath(parent))
+        err = QObject::tr("Cannot create directory: %0").arg(parent);
+
+    // ProgramData allows all users to create sub-directories. The
+    // permissions are not inherited from there.
+    if (err.isEmpty() && GetFileAttributesW((WCHAR*) dir.utf16()) ==
+            INVALID_FILE_ATTRIBUTES) {
+        PSECURITY_DESCRIPTOR sd = 0;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(
+                L"O:BAD:P(A;OICI;FA;;;SY)(A;OICI;FA;;;BA)",
+                SDDL_REVISION_1, &sd, 0)) {
+            WPMUtils::formatMessage(GetLastError(), &err);
+        } else {
+            SECURITY_ATTRIBUTES sa;
+            sa.nLength = sizeof(sa);
+            sa.lpSecurityDescriptor = sd;
+            sa.bInheritHandle = FALSE;
+            if (!CreateDirectoryW((WCHAR*) dir.utf16(), &sa)) {
+                DWORD e = GetLastError();
+                if (e != ERROR_ALREADY_EXISTS)
+                    WPMUtils::formatMessage(e, &err);
+            }
+            LocalFree(sd);
+        }
+        if (!err.isEmpty())
+            err = QObject::tr("Cannot create directory %1: %2").
+                    arg(dir).arg(err);
+    }
+
+    if (err.isEmpty())
+        err = checkDownloadCacheDir();
+
+    return err;
+}
+
+QString PackageVersion::getCachedDownload() const
+{
+    QString r;
+    if (!this->sha1.isEmpty() && checkDownloadCacheDir().isEmpty()) {
+        QString path = getDownloadCacheDir() + "\\" + this->sha1.toLower();
+        DWORD a = GetFileAttributesW((WCHAR*) path.utf16());
+        if (a != INVALID_FILE_ATTRIBUTES && !(a & (FILE_ATTRIBUTE_DIRECTORY |
+                FILE_ATTRIBUTE_REPARSE_POINT)))
+            r = path;
+    }
+    return r;
+}
+
+void PackageVersion::prefetch(Job* job, qint64 maxBytesPerSecond)
+{
+    QString initialTitle = job->getTitle();
+
+    // without a hash sum the file could not be checked before it is used
+    bool skip = this->sha1.isEmpty() || !this->download.isValid() ||
+            !getCachedDownload().isEmpty();
+
+    QString dir = getDownloadCacheDir();
+    if (job->shouldProceed() && !skip) {
+        QString err = createDownloadCacheDir();
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    // the file is downloaded under a temporary name so that an incomplete
+    // file is never used
+    QString path = dir + "\\" + this->sha1.toLower();
+    QFile f(path + ".part");
+    if (job->shouldProceed() && !skip) {
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            job->setErrorMessage(QObject::tr("Cannot open the file: %0").
+                    arg(f.fileName()));
+        } else {
+            Job* djob = job->newSubJob(0.95,
+                    QObject::tr("Downloading & computing hash sum"));
+            Downloader::Request request(this->download);
+            request.file = &f;
+            request.hashSum = true;
+            request.alg = this->hashSumType;
+            request.interactive = false;
+            request.maxBytesPerSecond = maxBytesPerSecond;
+            Downloader::Response response = Downloader::download(djob, request);
+            f.close();
+
+            if (!djob->getErrorMessage().isEmpty()) {
+                job->setErrorMessage(QObject::tr("Error downloading %1: %2").
+                        arg(this->download.toString()).
+                        arg(djob->getErrorMessage()));
+            } else if (!job->isCancelled() &&
+                    response.hashSum.toLower() != this->sha1.toLower()) {
+                job->setErrorMessage(QString(
+                        QObject::tr("Hash sum %1 found, but %2 was expected. The file has changed.")).
+                        arg(response.hashSum).arg(this->sha1));
+            }
+        }
+    }
+
+    if (job->shouldProceed() && !skip) {
+        job->setTitle(initialTitle + " / " +
+                QObject::tr("Renaming the downloaded file"));
+        QFile::remove(path);
+        if (!f.rename(path))
+            job->setErrorMessage(QString(QObject::tr("Cannot rename %0 to %1")).
+                    arg(f.fileName()).arg(path));
+    }
+    job->setTitle(initialTitle);
+
+    // the renamed QFile refers to the cached file now. Only an incomplete
+    // download is deleted.
+    if (!skip)
+        QFile::remove(path + ".part");
+
+    if (job->shouldProceed())
+        job->setProgress(1);
+
+    job->complete();
+}
+
 QString PackageVersion::getPackageTitle(
         bool includeFullPackageName) const
 {
@@ -1295,9 +1514,45 @@ QString PackageVersion::download_(Job* job, const QString& where,
     }
     job->setTitle(initialTitle);
 
+    // qDebug() << "install.3";
+    QFile* f = new QFile(npackdDir + "\\__NpackdPackageDownload");
+
+    bool downloadOK = false;
+    QString dsha1;
+
+    // the binary was already downloaded by prefetch()
+    QString cached = getCachedDownload();
+    if (!job->isCancelled() && job->getErrorMessage().isEmpty() &&
+            !cached.isEmpty()) {
+        if (!f->open(QIODevice::ReadWrite | QIODevice::Truncate)) {
+            job->setErrorMessage(QString(QObject::tr("Cannot open the file: %0")).
+                    arg(f->fileName()));
+        } else {
+            Job* djob = job->newSubJob(0.8,
+                    QObject::tr("Copying the downloaded file & computing hash sum"));
+            Downloader::Request request(QUrl::fromLocalFile(cached));
+            request.file = f;
+            request.hashSum = true;
+            request.alg = this->hashSumType;
+            Downloader::Response response = Downloader::download(djob, request);
+            downloadOK = !djob->isCancelled() &&
+                    djob->getErrorMessage().isEmpty() &&
+                    response.hashSum.toLower() == this->sha1.toLower();
+            if (downloadOK)
+                dsha1 = response.hashSum;
+            else
+                f->resize(0);
+            f->close();
+
+            // a damaged file is downloaded again
+            QFile::remove(cached);
+        }
+    }
+
     bool httpConnectionAcquired = false;
 
-    if (!job->isCancelled() && job->getErrorMessage().isEmpty()) {
+    if (!job->isCancelled() && job->getErrorMessage().isEmpty() &&
+            !downloadOK) {
         job->setTitle(initialTitle + " / " +
                 QObject::tr("Waiting for a free HTTP connection"));
 
@@ -1317,18 +1572,14 @@ QString PackageVersion::download_(Job* job, const QString& where,
     }
     job->setTitle(initialTitle);
 
-    // qDebug() << "install.3";
-    QFile* f = new QFile(npackdDir + "\\__NpackdPackageDownload");
-
-    bool downloadOK = false;
-    QString dsha1;
-
-    if (!job->isCancelled() && job->getErrorMessage().isEmpty()) {
+    if (!job->isCancelled() && job->getErrorMessage().isEmpty() &&
+            !downloadOK) {
         if (!f->open(QIODevice::ReadWrite)) {
             job->setErrorMessage(QString(QObject::tr("Cannot open the file: %0")).
                     arg(f->fileName()));
         } else {
-            Job* djob = job->newSubJob(0.8,
+            // less is left if the file from the download cache was damaged
+            Job* djob = job->newSubJob(qMax(0.0, 0.85 - job->getProgress()),
                     QObject::tr("Downloading & computing hash sum"));
 
             Downloader::Request request(this->download);
@@ -1807,6 +2058,11 @@ PackageVersion* PackageVersion::clone() const
     PackageVersion* r = new PackageVersion(this->package, this->version);
     r->importantFiles = this->importantFiles;
     r->importantFilesTitles = this->importantFilesTitles;
+
+    // the lists are allocated only once
+    r->files.reserve(this->files.count());
+    r->detectFiles.reserve(this->detectFiles.count());
+    r->dependencies.reserve(this->dependencies.count());
     for (int i = 0; i < this->files.count(); i++) {
         PackageVersionFile* f = this->files.at(i);
         r->files.append(f->clone());
@@ -1831,27 +2087,9 @@ PackageVersion* PackageVersion::clone() const
 
 PackageVersion *PackageVersion::parse(const QByteArray &xml, QString *err, bool validate)
 {
-    PackageVersion* r = 0;
-
-    Repository rep;
-    RepositoryXMLHandler handler(&rep);
-    QXmlSimpleReader reader;
-    reader.setContentHandler(&handler);
-    reader.setErrorHandler(&handler);
-    QXmlInputSource inputSource;
-    inputSource.setData(xml);
-    handler.enter("root");
-    if (!reader.parse(inputSource))
-        *err = handler.errorString();
-    else {
-        if (rep.packageVersions.size() == 1) {
-            r = rep.packageVersions.takeAt(0);
-            *err = "";
-        } else {
-            *err = QObject::tr("Expected one package version");
-        }
-    }
-    return r;
+    // the repository is not used for a single <version>
+    RepositoryXMLReader reader(0);
+    return reader.readVersion(xml, err);
 }
 
 bool PackageVersion::contains(const QList<PackageVersion *> &list,
@@ -25,6 +25,8 @@
 DEFINE_GUID(UUID_ClientID,0x30ed381dL,0x59ea,0x4ca5,0xbd,0x1d,0x5e,0xe8,0xec,0x97,0xb2,0xbe);
 
 class InstallOperation;
+class DependencyIndex;
+class AbstractRepository;
 
 /**
  * One version of a package (installed or not).
@@ -54,6 +56,18 @@ private:
 
     bool createShortcuts(const QString& dir, QString* errMsg);
 
+    /**
+     * Plans un-installation of this package and all the dependent recursively.
+     *
+     * @param index reverse dependencies for "installed". This object will be
+     *     updated.
+     * @param installed see planUninstallation(QList, QList)
+     * @param ops see planUninstallation(QList, QList)
+     * @return error message or ""
+     */
+    QString planUninstallation(DependencyIndex& index,
+            QList<PackageVersion*>& installed, QList<InstallOperation*>& ops);
+
     /**
      * @brief executes a script like .Npackd\Install.bat
      * @param job job for monitoring the progress
@@ -289,6 +303,47 @@ public:
      */
     QString downloadAndComputeSHA1(Job* job);
 
+    /**
+     * @return directory for the binaries downloaded in advance by prefetch()
+     */
+    static QString getDownloadCacheDir();
+
+    /**
+     * @brief checks that the download cache directory can be trusted. It
+     *     should not be a reparse point, should be owned by the
+     *     Administrators group or the SYSTEM account and only they should
+     *     have access.
+     * @return error message or ""
+     */
+    static QString checkDownloadCacheDir();
+
+    /**
+     * @brief creates the download cache directory if necessary. Only the
+     *     Administrators group and the SYSTEM account have access to a new
+     *     directory.
+     * @return error message or "" if the directory exists and can be trusted
+     *     (see checkDownloadCacheDir())
+     */
+    static QString createDownloadCacheDir();
+
+    /**
+     * @return the binary downloaded in advance by prefetch() or "" if it is
+     *     not available. Only package versions with a hash sum are cached.
+     *     Nothing is returned if the cache directory cannot be trusted.
+     */
+    QString getCachedDownload() const;
+
+    /**
+     * Downloads the binary in the download cache so that download_() does not
+     * need the network later. The hash sum is checked before the file is
+     * stored in the cache. Nothing is downloaded for package versions without
+     * a hash sum or if the file is already in the cache.
+     *
+     * @param job job for this method
+     * @param maxBytesPerSecond maximum download speed or 0 for "unlimited"
+     */
+    void prefetch(Job* job, qint64 maxBytesPerSecond);
+
     /**
      * Returns the extension of the package file (quessing from the URL).
      *
@@ -312,11 +367,13 @@ public:
      *     objects will be added to it on different recursion levels.
      * @param where target directory for the installation or "" if the
      *     directory should be chosen automatically
+     * @param rep the dependencies are searched here. 0 means
+     *     AbstractRepository::getDefault_()
      * @return error message or ""
      */
     QString planInstallation(QList<PackageVersion*>& installed,
             QList<InstallOperation*>& ops, QList<PackageVersion*>& avoid,
-            const QString &where="");
+            const QString &where="", AbstractRepository* rep=0);
 
     /**
      * Plans un-installation of this package and all the dependent recursively.
@@ -391,7 +448,9 @@ public:
 
     /**
      * Downloads the package binary, checks its hash sum, checks the binary for
-     * viruses, unpacks it in case of a .zip file, stores the text files.
+     * viruses, unpacks it in case of a .zip file, stores the text files. A
+     * binary from the download cache (see prefetch()) is used instead of
+     * downloading it again.
      *
      * @param job job for this method
      * @param where a non-existing directory for the package
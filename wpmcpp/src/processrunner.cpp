@@ -0,0 +1,339 @@
+#include <stdio.h>
+#include <time.h>
+
+#include <QProcess>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QFile>
+#include <QTime>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+#include "processrunner.h"
+
+/**
+ * Writes the output of a process to a file in a separate thread.
+ */
+class ProcessLogWriter: public QThread
+{
+    /** the writing thread waits if more than this amount of bytes is queued */
+    static const int MAX_QUEUED = 16 * 1024 * 1024;
+
+    QFile* file;
+
+    QMutex mutex;
+    QWaitCondition notEmpty;
+    QWaitCondition notFull;
+    QQueue<QByteArray> queue;
+    int queued;
+    bool finished;
+    QString error;
+public:
+    /**
+     * @param file an open file
+     */
+    ProcessLogWriter(QFile* file);
+
+    /**
+     * Adds the data to the queue. Blocks if too much data is waiting.
+     *
+     * @param data the data
+     */
+    void write(const QByteArray& data);
+
+    /**
+     * Writes the rest of the data and waits for the thread to end.
+     *
+     * @return error message or ""
+     */
+    QString finish();
+
+    /**
+     * @return error message or ""
+     */
+    QString getError();
+protected:
+    void run();
+};
+
+ProcessLogWriter::ProcessLogWriter(QFile* file): file(file), queued(0),
+        finished(false)
+{
+}
+
+void ProcessLogWriter::write(const QByteArray& data)
+{
+    QMutexLocker ml(&mutex);
+    while (queued > MAX_QUEUED && error.isEmpty())
+        notFull.wait(&mutex);
+
+    if (error.isEmpty()) {
+        queue.enqueue(data);
+        queued += data.length();
+        notEmpty.wakeOne();
+    }
+}
+
+QString ProcessLogWriter::finish()
+{
+    mutex.lock();
+    finished = true;
+    notEmpty.wakeOne();
+    mutex.unlock();
+
+    wait();
+
+    return getError();
+}
+
+QString ProcessLogWriter::getError()
+{
+    QMutexLocker ml(&mutex);
+    return error;
+}
+
+void ProcessLogWriter::run()
+{
+    while (true) {
+        mutex.lock();
+        while (queue.isEmpty() && !finished)
+            notEmpty.wait(&mutex);
+
+        if (queue.isEmpty()) {
+            mutex.unlock();
+            break;
+        }
+
+        // take everything that is available and write it without the lock
+        QList<QByteArray> items;
+        while (!queue.isEmpty())
+            items.append(queue.dequeue());
+        mutex.unlock();
+
+        QString err;
+        int n = 0;
+        for (int i = 0; i < items.size(); i++) {
+            const QByteArray& data = items.at(i);
+            if (err.isEmpty() && file->write(data) == -1)
+                err = file->errorString();
+            n += data.length();
+        }
+
+        mutex.lock();
+        queued -= n;
+        if (!err.isEmpty() && error.isEmpty()) {
+            error = err;
+            queue.clear();
+            queued = 0;
+        }
+        notFull.wakeAll();
+        mutex.unlock();
+    }
+}
+
+ProcessRunner::ProcessRunner(): env(QProcessEnvironment::systemEnvironment()),
+        writeUTF16LEBOM(false), printOutput(false), utf16Output(false),
+        exitCode(0)
+{
+}
+
+void ProcessRunner::printToConsole(const QByteArray& data)
+{
+#ifdef Q_OS_WIN
+    HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
+
+    // we do not check GetLastError here as it sometimes returns
+    // 2=The system cannot find the file specified.
+    // GetFileType returns 0 if an error occures so that the == check below
+    // is sufficient
+    DWORD ft = GetFileType(hStdout);
+    bool consoleOutput = (ft & ~(FILE_TYPE_REMOTE)) == FILE_TYPE_CHAR;
+
+    DWORD consoleMode;
+    if (consoleOutput) {
+        if (!GetConsoleMode(hStdout, &consoleMode))
+            consoleOutput = false;
+    }
+
+    DWORD dwWritten;
+    if (utf16Output && consoleOutput) {
+        WriteConsoleW(hStdout, data.constData(), data.length() / 2,
+                &dwWritten, 0);
+    } else if (utf16Output) {
+        // convert to UTF-8
+        QByteArray ba = QString::fromUtf16(
+                (const ushort*) data.constData(), data.length() / 2).toUtf8();
+        WriteFile(hStdout, ba.constData(), ba.length(), &dwWritten, 0);
+    } else {
+        WriteFile(hStdout, data.constData(), data.length(), &dwWritten, 0);
+    }
+#else
+    if (utf16Output) {
+        QByteArray ba = QString::fromUtf16(
+                (const ushort*) data.constData(), data.length() / 2).toUtf8();
+        fwrite(ba.constData(), 1, ba.length(), stdout);
+    } else {
+        fwrite(data.constData(), 1, data.length(), stdout);
+    }
+    fflush(stdout);
+#endif
+}
+
+void ProcessRunner::run(Job* job)
+{
+    QString initialTitle = job->getTitle();
+
+    time_t start = time(NULL);
+
+    exitCode = 0;
+    tail.clear();
+
+    QFile f(outputFile);
+    ProcessLogWriter* writer = 0;
+    if (job->shouldProceed() && !outputFile.isEmpty()) {
+        if (!f.open(QIODevice::WriteOnly))
+            job->setErrorMessage(f.errorString());
+    }
+
+    if (job->shouldProceed() && f.isOpen() && writeUTF16LEBOM) {
+        if (f.write("\xff\xfe") == -1)
+            job->setErrorMessage(f.errorString());
+    }
+
+    if (job->shouldProceed() && f.isOpen()) {
+        writer = new ProcessLogWriter(&f);
+        writer->start();
+    }
+
+    QProcess p;
+    p.setProcessChannelMode(QProcess::MergedChannels);
+    p.setWorkingDirectory(where);
+    p.setProcessEnvironment(env);
+#ifdef Q_OS_WIN
+    if (!nativeArguments.isEmpty())
+        p.setNativeArguments(nativeArguments);
+#endif
+
+    bool started = false;
+    if (job->shouldProceed()) {
+        p.start(program, arguments);
+        started = p.waitForStarted(-1);
+        if (!started)
+            job->setErrorMessage(QString(
+                    QObject::tr("Cannot start the process %1: %2")).
+                    arg(program, p.errorString()));
+    }
+
+    if (started) {
+        char* buf = new char[BUFFER_SIZE];
+
+        // console output that was not yet printed
+        QByteArray console;
+        QTime lastFlush;
+        lastFlush.start();
+
+        time_t lastUpdate = start;
+
+        while (true) {
+            if (job->isCancelled())
+                break;
+
+            if (writer) {
+                QString err = writer->getError();
+                if (!err.isEmpty()) {
+                    job->setErrorMessage(err);
+                    break;
+                }
+            }
+
+            qint64 r = p.read(buf, BUFFER_SIZE);
+            if (r < 0)
+                break;
+
+            if (r > 0) {
+                QByteArray data(buf, r);
+                if (writer)
+                    writer->write(data);
+                if (printOutput)
+                    console.append(data);
+                tail.append(data);
+                if (tail.length() > BUFFER_SIZE)
+                    tail.remove(0, tail.length() - BUFFER_SIZE);
+            } else {
+                if (p.state() == QProcess::NotRunning)
+                    break;
+
+                // returns after CANCEL_POLL_INTERVAL even without new output
+                // so that the cancellation is noticed
+                p.waitForReadyRead(CANCEL_POLL_INTERVAL);
+            }
+
+            if (!console.isEmpty() &&
+                    (console.length() >= CONSOLE_BATCH_SIZE ||
+                    lastFlush.elapsed() >= CONSOLE_FLUSH_INTERVAL)) {
+                // do not split an UTF-16 character
+                int len = console.length();
+                if (utf16Output)
+                    len = len - len % 2;
+                printToConsole(console.left(len));
+                console.remove(0, len);
+                lastFlush.restart();
+            }
+
+            time_t now = time(NULL);
+            if (now != lastUpdate) {
+                lastUpdate = now;
+                time_t seconds = now - start;
+                double percents = ((double) seconds) / 300; // 5 Minutes
+                if (percents > 0.9)
+                    percents = 0.9;
+                job->setProgress(percents);
+                job->setTitle(initialTitle + " / " +
+                        QString(QObject::tr("%1 minutes")).
+                        arg(seconds / 60));
+            }
+        }
+        delete[] buf;
+
+        if (printOutput && !console.isEmpty())
+            printToConsole(console);
+
+        // the loop also ends on cancellation or an error. Nobody reads the
+        // output anymore and the process would block on a full pipe.
+        if (p.state() != QProcess::NotRunning) {
+            p.kill();
+            p.waitForFinished(-1);
+        }
+
+        if (job->shouldProceed()) {
+            if (p.exitStatus() == QProcess::NormalExit)
+                exitCode = p.exitCode();
+            else
+                exitCode = -1;
+
+            if (exitCode != 0) {
+                job->setErrorMessage(
+                        QString(QObject::tr("Process %1 exited with the code %2")).
+                        arg(program).arg(exitCode));
+            }
+        }
+    }
+
+    if (writer) {
+        QString err = writer->finish();
+        if (!err.isEmpty() && job->getErrorMessage().isEmpty())
+            job->setErrorMessage(err);
+        delete writer;
+    }
+
+    // ignore possible errors here
+    f.close();
+
+    job->setTitle(initialTitle);
+
+    job->complete();
+}
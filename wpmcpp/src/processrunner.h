@@ -0,0 +1,100 @@
+#ifndef PROCESSRUNNER_H
+#define PROCESSRUNNER_H
+
+#include <QString>
+#include <QStringList>
+#include <QProcessEnvironment>
+#include <QByteArray>
+
+#include "job.h"
+
+/**
+ * Starts a child process, copies its output to a log file and optionally to
+ * the standard output and waits for the process to end.
+ *
+ * The output is read in large blocks. Writing to the log file happens in a
+ * separate thread so that a slow disk does not block reading from the pipe.
+ * The console output is collected and written in batches. The job is checked
+ * for cancellation every CANCEL_POLL_INTERVAL milliseconds even if the
+ * process does not produce any output.
+ *
+ * The class is based on QProcess and does not depend on Windows.
+ */
+class ProcessRunner
+{
+public:
+    /** size of the buffer for reading the output in bytes */
+    static const int BUFFER_SIZE = 64 * 1024;
+
+    /**
+     * the console output is written after this amount of bytes is collected
+     * or after CONSOLE_FLUSH_INTERVAL milliseconds
+     */
+    static const int CONSOLE_BATCH_SIZE = 64 * 1024;
+
+    /** interval for writing the collected console output in milliseconds */
+    static const int CONSOLE_FLUSH_INTERVAL = 200;
+
+    /** interval for checking the job for cancellation in milliseconds */
+    static const int CANCEL_POLL_INTERVAL = 100;
+
+    /** working directory */
+    QString where;
+
+    /** executable */
+    QString program;
+
+    /** arguments */
+    QStringList arguments;
+
+    /**
+     * native command line arguments (Windows only). They are appended after
+     * the "arguments".
+     */
+    QString nativeArguments;
+
+    /** environment for the process */
+    QProcessEnvironment env;
+
+    /** the output will be saved here. Empty = do not save the output. */
+    QString outputFile;
+
+    /** write UTF-16 LE BOM mark at the beginning of the output file? */
+    bool writeUTF16LEBOM;
+
+    /** true = redirect the output to the default output stream */
+    bool printOutput;
+
+    /**
+     * true = the process writes UTF-16 LE (e.g. cmd.exe /U), false = the
+     * output is 8 bit and is printed unchanged
+     */
+    bool utf16Output;
+
+    /**
+     * the last part of the output (up to BUFFER_SIZE bytes) is stored here
+     * after run()
+     */
+    QByteArray tail;
+
+    /** exit code of the process after run() */
+    int exitCode;
+
+    /**
+     * -
+     */
+    ProcessRunner();
+
+    /**
+     * Runs the process. The function returns after the process ended, the job
+     * was cancelled or an error occured.
+     *
+     * @param job job to monitor the progress. The error message will be set
+     *     to a non-empty string if the exit code of the process is not 0.
+     */
+    void run(Job* job);
+private:
+    void printToConsole(const QByteArray& data);
+};
+
+#endif // PROCESSRUNNER_H
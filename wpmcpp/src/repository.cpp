@@ -18,6 +18,8 @@
 #include "installedpackages.h"
 #include "dbrepository.h"
 #include "repositoryxmlhandler.h"
+#include "dependency.h"
+#include "stringpool.h"
 
 Repository Repository::def;
 QMutex Repository::mutex;
@@ -238,14 +240,15 @@ QString Repository::savePackage(Package *p, bool replace)
     Package* fp = findPackage(p->name);
     if (!fp || replace) {
         if (!fp) {
-            fp = new Package(p->name, p->title);
+            fp = new Package(StringPool::getDefault()->intern(p->name),
+                    p->title);
             this->packages.append(fp);
         }
         fp->title = p->title;
         fp->url = p->url;
         fp->setIcon(p->getIcon());
         fp->description = p->description;
-        fp->license = p->license;
+        fp->license = StringPool::getDefault()->intern(p->license);
         fp->categories = p->categories;
     }
 
@@ -256,13 +259,20 @@ QString Repository::savePackageVersion(PackageVersion *p, bool replace)
 {
     PackageVersion* fp = findPackageVersion(p->package, p->version);
     if (!fp || replace) {
+        // the package names are repeated in many versions and dependencies
+        StringPool* names = StringPool::getDefault();
         if (!fp) {
-            fp = new PackageVersion(p->package);
+            fp = new PackageVersion(names->intern(p->package));
             fp->version = p->version;
             this->packageVersions.append(fp);
-            this->package2versions.insert(p->package, fp);
+            this->package2versions.insert(fp->package, fp);
         }
         fp->fillFrom(p);
+        fp->package = names->intern(fp->package);
+        for (int i = 0; i < fp->dependencies.count(); i++) {
+            Dependency* d = fp->dependencies.at(i);
+            d->package = names->intern(d->package);
+        }
     }
 
     return "";
@@ -0,0 +1,568 @@
+#include "repositoryxmlreader.h"
+
+#include <QObject>
+#include <QScopedPointer>
+#include <QXmlStreamAttributes>
+
+#include "repository.h"
+#include "wpmutils.h"
+#include "packageversionfile.h"
+#include "dependency.h"
+#include "detectfile.h"
+#include "stringpool.h"
+
+// tag and attribute names
+static const QLatin1String TAG_VERSION("version");
+static const QLatin1String TAG_PACKAGE("package");
+static const QLatin1String TAG_LICENSE("license");
+static const QLatin1String TAG_SPEC_VERSION("spec-version");
+static const QLatin1String TAG_IMPORTANT_FILE("important-file");
+static const QLatin1String TAG_FILE("file");
+static const QLatin1String TAG_DEPENDENCY("dependency");
+static const QLatin1String TAG_DETECT_FILE("detect-file");
+static const QLatin1String TAG_URL("url");
+static const QLatin1String TAG_SHA1("sha1");
+static const QLatin1String TAG_HASH_SUM("hash-sum");
+static const QLatin1String TAG_DETECT_MSI("detect-msi");
+static const QLatin1String TAG_VARIABLE("variable");
+static const QLatin1String TAG_PATH("path");
+static const QLatin1String TAG_TITLE("title");
+static const QLatin1String TAG_DESCRIPTION("description");
+static const QLatin1String TAG_ICON("icon");
+static const QLatin1String TAG_CATEGORY("category");
+static const QLatin1String TAG_LINK("link");
+static const QLatin1String ATTR_NAME("name");
+static const QLatin1String ATTR_PACKAGE("package");
+static const QLatin1String ATTR_TYPE("type");
+static const QLatin1String ATTR_PATH("path");
+static const QLatin1String ATTR_TITLE("title");
+static const QLatin1String ATTR_VERSIONS("versions");
+static const QLatin1String ATTR_REL("rel");
+static const QLatin1String ATTR_HREF("href");
+
+RepositoryXMLReader::RepositoryXMLReader(AbstractRepository* rep): rep(rep)
+{
+}
+
+QString RepositoryXMLReader::read(QIODevice* in)
+{
+    error.clear();
+    r.setDevice(in);
+    readDocument();
+    r.setDevice(0);
+    return error;
+}
+
+QString RepositoryXMLReader::read(const QByteArray& xml)
+{
+    error.clear();
+    r.clear();
+    r.addData(xml);
+    readDocument();
+    r.clear();
+    return error;
+}
+
+PackageVersion* RepositoryXMLReader::readVersion(const QByteArray& xml,
+        QString* err)
+{
+    PackageVersion* pv = 0;
+
+    error.clear();
+    r.clear();
+    r.addData(xml);
+    if (r.readNextStartElement()) {
+        if (r.name() == TAG_VERSION)
+            pv = readVersionElement();
+    }
+    checkXMLError();
+    r.clear();
+
+    if (error.isEmpty() && !pv)
+        error = QObject::tr("Expected one package version");
+
+    if (!error.isEmpty()) {
+        delete pv;
+        pv = 0;
+    }
+
+    *err = error;
+
+    return pv;
+}
+
+QString RepositoryXMLReader::readPart(const QByteArray& xml, int from,
+        int to)
+{
+    error.clear();
+    r.clear();
+
+    // the part is parsed as the content of an artificial root element
+    r.addData(QByteArray::fromRawData("<root>", 6));
+    r.addData(QByteArray::fromRawData(xml.constData() + from, to - from));
+    r.addData(QByteArray::fromRawData("</root>", 7));
+    readDocument();
+    r.clear();
+    return error;
+}
+
+QList<int> RepositoryXMLReader::split(const QByteArray& xml, int parts)
+{
+    QList<int> r;
+
+    const char* p = xml.constData();
+    const int n = xml.length();
+    const int partSize = n / qMax(parts, 1);
+
+    int depth = 0;
+    int rootEnd = -1;
+    int i = 0;
+
+    // UTF-8 BOM
+    if (xml.startsWith("\xEF\xBB\xBF"))
+        i = 3;
+
+    bool ok = true;
+    while (ok) {
+        const char* lt = (const char*) memchr(p + i, '<', n - i);
+
+        // only white space is allowed outside of the root element
+        if (depth == 0) {
+            const char* e = lt ? lt : p + n;
+            for (const char* c = p + i; c < e; c++) {
+                if (*c != ' ' && *c != '\t' && *c != '\r' && *c != '\n') {
+                    ok = false;
+                    break;
+                }
+            }
+        }
+
+        if (!ok || !lt)
+            break;
+
+        i = lt - p;
+        char c = i + 1 < n ? p[i + 1] : 0;
+        int end;
+        if (c == '?') {
+            // processing instruction or XML declaration
+            end = xml.indexOf("?>", i + 2);
+            if (end < 0) {
+                ok = false;
+            } else {
+                QByteArray pi = xml.mid(i, end - i).toLower();
+                if (pi.startsWith("<?xml ") && pi.contains("encoding") &&
+                        !pi.contains("utf-8"))
+                    ok = false;
+                i = end + 2;
+            }
+        } else if (c == '!') {
+            if (xml.mid(i, 4) == "<!--") {
+                end = xml.indexOf("-->", i + 4);
+                i = end + 3;
+            } else if (depth > 0 && xml.mid(i, 9) == "<![CDATA[") {
+                end = xml.indexOf("]]>", i + 9);
+                i = end + 3;
+            } else {
+                // a DTD could define entities
+                end = -1;
+            }
+            ok = end >= 0;
+        } else if (c == '/') {
+            end = xml.indexOf('>', i + 2);
+            depth--;
+            if (end < 0 || depth < 0 || rootEnd >= 0) {
+                ok = false;
+            } else {
+                if (depth == 0)
+                    rootEnd = i;
+                i = end + 1;
+            }
+        } else if (c != 0 && rootEnd < 0) {
+            // start tag. '>' in attribute values is ignored.
+            if (depth == 1 && i - r.last() >= partSize)
+                r.append(i);
+
+            char quote = 0;
+            end = -1;
+            for (int j = i + 1; j < n; j++) {
+                char ch = p[j];
+                if (quote) {
+                    if (ch == quote)
+                        quote = 0;
+                } else if (ch == '"' || ch == '\'') {
+                    quote = ch;
+                } else if (ch == '>') {
+                    end = j;
+                    break;
+                }
+            }
+
+            bool empty = end > 0 && p[end - 1] == '/';
+            if (end < 0 || (depth == 0 && empty)) {
+                ok = false;
+            } else {
+                if (depth == 0)
+                    r.append(end + 1);
+                if (!empty)
+                    depth++;
+                i = end + 1;
+            }
+        } else {
+            ok = false;
+        }
+    }
+
+    if (ok && rootEnd >= 0) {
+        r.append(rootEnd);
+    } else {
+        r.clear();
+    }
+
+    return r;
+}
+
+void RepositoryXMLReader::checkXMLError()
+{
+    if (error.isEmpty() && r.hasError()) {
+        error = QObject::tr("XML parsing error at line %1, column %2: %3").
+                arg(r.lineNumber()).arg(r.columnNumber()).
+                arg(r.errorString());
+    }
+}
+
+QString RepositoryXMLReader::readText()
+{
+    return r.readElementText(QXmlStreamReader::SkipChildElements).trimmed();
+}
+
+void RepositoryXMLReader::readDocument()
+{
+    if (r.readNextStartElement()) {
+        while (error.isEmpty() && r.readNextStartElement()) {
+            QStringRef name = r.name();
+            if (name == TAG_VERSION)
+                readVersion();
+            else if (name == TAG_PACKAGE)
+                readPackage();
+            else if (name == TAG_LICENSE)
+                readLicense();
+            else if (name == TAG_SPEC_VERSION)
+                error = Repository::checkSpecVersion(readText());
+            else
+                r.skipCurrentElement();
+        }
+    }
+
+    // the rest of the document is checked for XML errors
+    while (error.isEmpty() && !r.atEnd()) {
+        r.readNext();
+    }
+
+    checkXMLError();
+}
+
+void RepositoryXMLReader::readVersion()
+{
+    PackageVersion* pv = readVersionElement();
+    if (pv) {
+        error = rep->savePackageVersion(pv, false);
+
+        if (!error.isEmpty())
+            error = QObject::tr("Error saving the package version %1 %2: %3").
+                    arg(pv->package).arg(pv->version.getVersionString()).
+                    arg(error);
+        delete pv;
+    }
+}
+
+PackageVersion* RepositoryXMLReader::readVersionElement()
+{
+    QScopedPointer<PackageVersion> pv(new PackageVersion());
+    QXmlStreamAttributes atts = r.attributes();
+
+    QString packageName = atts.value(ATTR_PACKAGE).toString();
+    error = WPMUtils::validateFullPackageName(packageName);
+    if (!error.isEmpty()) {
+        error = QObject::tr("Error in the attribute 'package' in <version>: %1").
+                arg(error);
+    } else {
+        pv->package = names.intern(packageName);
+    }
+
+    if (error.isEmpty()) {
+        QString name = atts.value(ATTR_NAME).toString();
+        if (name.isEmpty())
+            name = "1.0";
+
+        if (pv->version.setVersion(name)) {
+            pv->version.normalize();
+        } else {
+            error = QObject::tr("Not a valid version for %1: %2").
+                    arg(pv->package).arg(name);
+        }
+    }
+
+    if (error.isEmpty()) {
+        QStringRef type = atts.value(ATTR_TYPE);
+        if (type == QLatin1String("one-file"))
+            pv->type = 1;
+        else if (type.isEmpty() || type == QLatin1String("zip"))
+            pv->type = 0;
+        else {
+            error = QObject::tr("Wrong value for the attribute 'type' for %1: %3").
+                    arg(pv->toString()).arg(type.toString());
+        }
+    }
+
+    while (error.isEmpty() && r.readNextStartElement()) {
+        QStringRef name = r.name();
+        if (name == TAG_IMPORTANT_FILE) {
+            QXmlStreamAttributes a = r.attributes();
+            QString p = a.value(ATTR_PATH).toString();
+            if (p.isEmpty())
+                p = a.value(ATTR_NAME).toString();
+
+            if (p.isEmpty()) {
+                error = QObject::tr("Empty 'path' attribute value for <important-file> for %1").
+                        arg(pv->toString());
+            }
+
+            if (error.isEmpty()) {
+                if (pv->importantFiles.contains(p)) {
+                    error = QObject::tr("More than one <important-file> with the same 'path' attribute %1 for %2").
+                            arg(p).arg(pv->toString());
+                }
+            }
+
+            if (error.isEmpty()) {
+                pv->importantFiles.append(p);
+            }
+
+            QString title = a.value(ATTR_TITLE).toString();
+            if (error.isEmpty()) {
+                if (title.isEmpty()) {
+                    error = QObject::tr("Empty 'title' attribute value for <important-file> for %1").
+                            arg(pv->toString());
+                }
+            }
+
+            if (error.isEmpty()) {
+                pv->importantFilesTitles.append(title);
+                r.skipCurrentElement();
+            }
+        } else if (name == TAG_FILE) {
+            QString path = r.attributes().value(ATTR_PATH).toString();
+            QString content = r.readElementText(
+                    QXmlStreamReader::SkipChildElements);
+            pv->files.append(new PackageVersionFile(path, content));
+        } else if (name == TAG_URL) {
+            QString url = readText();
+            if (!url.isEmpty()) {
+                if (Package::isValidURL(url))
+                    pv->download.setUrl(url);
+                else
+                    error = QObject::tr("Not a valid download URL for %1: %2").
+                            arg(pv->package).arg(url);
+            }
+        } else if (name == TAG_SHA1) {
+            pv->sha1 = readText().toLower();
+            pv->hashSumType = QCryptographicHash::Sha1;
+            if (!pv->sha1.isEmpty()) {
+                error = WPMUtils::validateSHA1(pv->sha1);
+                if (!error.isEmpty()) {
+                    error = QObject::tr("Invalid SHA1 for %1: %2").
+                            arg(pv->toString()).arg(error);
+                }
+            }
+        } else if (name == TAG_HASH_SUM) {
+            QString type = r.attributes().value(ATTR_TYPE).toString().
+                    trimmed();
+            if (type.isEmpty() || type == "SHA-256")
+                pv->hashSumType = QCryptographicHash::Sha256;
+            else if (type == "SHA-1")
+                pv->hashSumType = QCryptographicHash::Sha1;
+            else
+                error = QObject::tr("Error in attribute 'type' in <hash-sum> in %1").
+                        arg(pv->toString());
+
+            if (error.isEmpty()) {
+                pv->sha1 = readText().toLower();
+                if (!pv->sha1.isEmpty()) {
+                    error = WPMUtils::validateSHA256(pv->sha1);
+                    if (!error.isEmpty()) {
+                        error = QObject::tr("Invalid SHA-256 for %1: %2").
+                                arg(pv->toString()).arg(error);
+                    }
+                }
+            }
+        } else if (name == TAG_DETECT_MSI) {
+            pv->msiGUID = readText().toLower();
+            if (!pv->msiGUID.isEmpty()) {
+                error = WPMUtils::validateGUID(pv->msiGUID);
+                if (!error.isEmpty())
+                    error = QObject::tr("Wrong MSI GUID for %1: %2 (%3)").
+                            arg(pv->toString()).arg(pv->msiGUID).arg(error);
+            }
+        } else if (name == TAG_DEPENDENCY) {
+            QXmlStreamAttributes a = r.attributes();
+            Dependency* dep = new Dependency();
+            pv->dependencies.append(dep);
+            dep->package = names.intern(a.value(ATTR_PACKAGE).toString());
+            if (!dep->setVersions(a.value(ATTR_VERSIONS).toString()))
+                error = QObject::tr("Error in attribute 'versions' in <dependency> in %1").
+                        arg(pv->toString());
+
+            while (error.isEmpty() && r.readNextStartElement()) {
+                if (r.name() == TAG_VARIABLE)
+                    dep->var = readText();
+                else
+                    r.skipCurrentElement();
+            }
+        } else if (name == TAG_DETECT_FILE) {
+            DetectFile* df = new DetectFile();
+            pv->detectFiles.append(df);
+
+            while (error.isEmpty() && r.readNextStartElement()) {
+                QStringRef child = r.name();
+                if (child == TAG_PATH) {
+                    df->path = readText();
+                    df->path.replace('/', '\\');
+                    if (df->path.isEmpty()) {
+                        error = QObject::tr("Empty tag <path> under <detect-file>");
+                    }
+                } else if (child == TAG_SHA1) {
+                    df->sha1 = readText();
+                    error = WPMUtils::validateSHA1(df->sha1);
+                    if (!error.isEmpty()) {
+                        error = QObject::tr("Wrong SHA1 in <detect-file>: %1").
+                                arg(error);
+                    }
+                } else {
+                    r.skipCurrentElement();
+                }
+            }
+        } else {
+            r.skipCurrentElement();
+        }
+    }
+
+    checkXMLError();
+
+    return error.isEmpty() ? pv.take() : 0;
+}
+
+void RepositoryXMLReader::readPackage()
+{
+    QString name = r.attributes().value(ATTR_NAME).toString();
+
+    error = WPMUtils::validateFullPackageName(name);
+    if (!error.isEmpty()) {
+        error.prepend(QObject::tr("Error in attribute 'name' in <package>: "));
+    } else {
+        name = names.intern(name);
+    }
+
+    QScopedPointer<Package> p(new Package(name, name));
+
+    while (error.isEmpty() && r.readNextStartElement()) {
+        QStringRef tag = r.name();
+        if (tag == TAG_TITLE) {
+            p->title = readText();
+        } else if (tag == TAG_URL) {
+            p->url = readText();
+        } else if (tag == TAG_DESCRIPTION) {
+            p->description = readText();
+        } else if (tag == TAG_ICON) {
+            p->setIcon(readText());
+            if (!p->getIcon().isEmpty()) {
+                if (!Package::isValidURL(p->getIcon())) {
+                    error = QString(
+                            QObject::tr("Invalid icon URL for %1: %2")).
+                            arg(p->title).arg(p->getIcon());
+                }
+            }
+        } else if (tag == TAG_LICENSE) {
+            p->license = names.intern(readText());
+        } else if (tag == TAG_CATEGORY) {
+            QString err;
+            QString c = Repository::checkCategory(readText(), &err);
+            if (!err.isEmpty()) {
+                error = QObject::tr("Error in category tag for %1: %2").
+                        arg(p->title).arg(err);
+            } else if (p->categories.contains(c)) {
+                error = QObject::tr("More than one <category> %1").arg(c);
+            } else {
+                p->categories.append(names.intern(c));
+            }
+        } else if (tag == TAG_LINK) {
+            QXmlStreamAttributes a = r.attributes();
+            QString rel = a.value(ATTR_REL).toString().trimmed();
+            QString href = a.value(ATTR_HREF).toString().trimmed();
+
+            if (rel.isEmpty()) {
+                error = QObject::tr("Empty 'rel' attribute value for <link> for %1").
+                        arg(p->name);
+            }
+
+            if (error.isEmpty()) {
+                if (!Package::isValidURL(href))
+                    error = QObject::tr("Not a valid href URL in <link> for %1: %2").
+                            arg(p->name).arg(href);
+            }
+
+            if (error.isEmpty()) {
+                p->links.insert(names.intern(rel), href);
+                r.skipCurrentElement();
+            }
+        } else {
+            r.skipCurrentElement();
+        }
+    }
+
+    checkXMLError();
+
+    if (error.isEmpty()) {
+        error = rep->savePackage(p.data(), false);
+
+        if (!error.isEmpty())
+            error = QObject::tr("Error saving the package %1: %2").
+                    arg(p->title).arg(error);
+    }
+}
+
+void RepositoryXMLReader::readLicense()
+{
+    QString name = r.attributes().value(ATTR_NAME).toString();
+
+    error = WPMUtils::validateFullPackageName(name);
+    if (!error.isEmpty()) {
+        error.prepend(QObject::tr("Error in attribute 'name' in <package>: "));
+    } else {
+        name = names.intern(name);
+    }
+
+    QScopedPointer<License> lic(new License(name, name));
+
+    while (error.isEmpty() && r.readNextStartElement()) {
+        QStringRef tag = r.name();
+        if (tag == TAG_TITLE)
+            lic->title = readText();
+        else if (tag == TAG_URL)
+            lic->url = readText();
+        else if (tag == TAG_DESCRIPTION)
+            lic->description = readText();
+        else
+            r.skipCurrentElement();
+    }
+
+    checkXMLError();
+
+    if (error.isEmpty()) {
+        error = rep->saveLicense(lic.data(), false);
+
+        if (!error.isEmpty())
+            error = QObject::tr("Error saving the license %1: %2").
+                    arg(lic->title).
+                    arg(error);
+    }
+}
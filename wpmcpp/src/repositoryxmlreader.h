@@ -0,0 +1,134 @@
+#ifndef REPOSITORYXMLREADER_H
+#define REPOSITORYXMLREADER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QIODevice>
+#include <QXmlStreamReader>
+
+#include "license.h"
+#include "package.h"
+#include "packageversion.h"
+#include "abstractrepository.h"
+#include "stringpool.h"
+
+/**
+ * @brief pull parser for the repository XML. This is a faster replacement
+ *     for RepositoryXMLHandler and validates the same constraints.
+ *
+ * The tag names are compared as QStringRef against constant Latin-1
+ * strings. QXmlStreamReader stores the names only once. Text is only read
+ * for the elements that are actually used. Package and license names are
+ * interned in a pool that belongs to the reader: all versions of a package
+ * read from one document share one copy of the name. The pool is released
+ * together with the reader.
+ */
+class RepositoryXMLReader
+{
+    AbstractRepository* rep;
+
+    /**
+     * package, license and category names from this document. Only used by
+     * one thread.
+     */
+    StringPool names;
+
+    QXmlStreamReader r;
+
+    QString error;
+
+    /**
+     * @brief reads the document. The name of the root element is not
+     *     checked.
+     */
+    void readDocument();
+
+    /**
+     * @brief reads a <version> and saves it in the repository
+     */
+    void readVersion();
+
+    /**
+     * @brief reads a <version>
+     * @return [ownership:caller] the package version or 0 if an error
+     *     occured
+     */
+    PackageVersion* readVersionElement();
+
+    /**
+     * @brief reads a <package> and saves it in the repository
+     */
+    void readPackage();
+
+    /**
+     * @brief reads a <license> and saves it in the repository
+     */
+    void readLicense();
+
+    /**
+     * @return trimmed text of the current element. Child elements are
+     *     skipped.
+     */
+    QString readText();
+
+    /**
+     * @brief checks the reader for an XML error and stores it in "error"
+     */
+    void checkXMLError();
+
+    RepositoryXMLReader(const RepositoryXMLReader&);
+    RepositoryXMLReader& operator=(const RepositoryXMLReader&);
+public:
+    /**
+     * @param rep [ownership:caller] the data will be stored here
+     */
+    RepositoryXMLReader(AbstractRepository* rep);
+
+    /**
+     * @brief parses a repository
+     * @param in the XML will be read from here
+     * @return error message
+     */
+    QString read(QIODevice* in);
+
+    /**
+     * @brief parses a repository
+     * @param xml repository XML
+     * @return error message
+     */
+    QString read(const QByteArray& xml);
+
+    /**
+     * @brief parses one package version with <version> as the root element.
+     *     The repository is not used.
+     * @param xml <version> XML
+     * @param err error message will be stored here
+     * @return [ownership:caller] the package version or 0
+     */
+    PackageVersion* readVersion(const QByteArray& xml, QString* err);
+
+    /**
+     * @brief parses a part of a repository: a sequence of child elements of
+     *     the root element like <package>, <version> or <license>
+     * @param xml repository XML
+     * @param from index of the first byte of the part in "xml"
+     * @param to index of the byte after the part in "xml"
+     * @return error message. The line numbers are relative to the part.
+     */
+    QString readPart(const QByteArray& xml, int from, int to);
+
+    /**
+     * @brief quickly scans a repository and finds the positions where it can
+     *     be split for parallel parsing with readPart(). The document is only
+     *     split between the child elements of the root element.
+     * @param xml repository XML
+     * @param parts the desired number of parts
+     * @return positions: the part i starts at r[i] and ends before r[i + 1].
+     *     An empty list is returned if the document cannot be split: it is
+     *     not in UTF-8, contains a DTD or is not well-formed. The document
+     *     should be parsed with read() in this case.
+     */
+    static QList<int> split(const QByteArray& xml, int parts);
+};
+
+#endif // REPOSITORYXMLREADER_H
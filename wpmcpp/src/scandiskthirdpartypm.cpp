@@ -4,125 +4,185 @@
 
 #include "wpmutils.h"
 #include "dbrepository.h"
-
-ScanDiskThirdPartyPM::ScanDiskThirdPartyPM()
+#include "installedpackages.h"
+#include "directorywalker.h"
+
+/**
+ * @brief searches for package versions with matching detect files in the
+ *     visited directories
+ */
+class DetectFilesVisitor: public DirectoryWalker::Visitor
 {
-}
+    QMutex mutex;
 
-void ScanDiskThirdPartyPM::scan(Job *job,
-        QList<InstalledPackageVersion *> *installed, Repository *rep) const
-{
-    QStringList ignore;
-    ignore.append(WPMUtils::normalizePath(WPMUtils::getWindowsDir()));
+    /** package versions that are not installed */
+    QList<PackageVersion*> packageVersions;
 
-    QFileInfoList fil = QDir::drives();
-    for (int i = 0; i < fil.count(); i++) {
-        if (job->isCancelled())
-            break;
+    /** true if the package version at the same index was found */
+    QList<bool> found;
+public:
+    /** computed SHA-1 values that are not yet stored in the cache */
+    QList<ScanDiskThirdPartyPM::FileHash> computed;
 
-        QFileInfo fi = fil.at(i);
+    /**
+     * @param packageVersions package versions with detect files
+     */
+    DetectFilesVisitor(const QList<PackageVersion*>& packageVersions);
 
-        Job* djob = job->newSubJob(1.0 / fil.count(),
-                QString(QObject::tr("Scanning %1")).arg(fi.absolutePath()));
-        QString path = WPMUtils::normalizePath(fi.absolutePath());
-        UINT t = GetDriveType((WCHAR*) path.utf16());
-        if (t == DRIVE_FIXED)
-            scan(path, djob, 0, ignore);
-    }
+    bool visit(const QString& dir);
+};
 
-    job->complete();
+DetectFilesVisitor::DetectFilesVisitor(
+        const QList<PackageVersion*>& packageVersions)
+{
+    for (int i = 0; i < packageVersions.count(); i++) {
+        PackageVersion* pv = packageVersions.at(i);
+        if (!pv->installed() && pv->detectFiles.count() > 0) {
+            this->packageVersions.append(pv);
+            this->found.append(false);
+        }
+    }
 }
 
-void ScanDiskThirdPartyPM::scan(const QString& path, Job* job, int level,
-        QStringList& ignore) const
+bool DetectFilesVisitor::visit(const QString& dir)
 {
-    if (ignore.contains(path))
-        return;
-
-    QDir aDir(path);
+    QDir aDir(dir);
 
     QMap<QString, QString> path2sha1;
 
-    DBRepository* r = DBRepository::getDefault();
-    QString err;
-    QList<PackageVersion*> packageVersions =
-            r->getPackageVersionsWithDetectFiles(&err);
-
-    // qDebug() << "package versions with detect files: " << packageVersions.count();
-
-    if (!err.isEmpty())
-        job->setErrorMessage(err);
-
     for (int i = 0; i < packageVersions.count(); i++) {
-        if (!job->shouldProceed())
-            break;
-
         PackageVersion* pv = packageVersions.at(i);
-        if (!pv->installed() && pv->detectFiles.count() > 0) {
-            boolean ok = true;
-            for (int j = 0; j < pv->detectFiles.count(); j++) {
-                bool fileOK = false;
-                DetectFile* df = pv->detectFiles.at(j);
-                if (aDir.exists(df->path)) {
-                    QString fullPath = path + "\\" + df->path;
-                    QFileInfo f(fullPath);
-                    if (f.isFile() && f.isReadable()) {
-                        QString sha1 = path2sha1.value(df->path);
-                        if (sha1.isEmpty()) {
-                            sha1 = WPMUtils::sha1(fullPath);
-                            path2sha1[df->path] = sha1;
-                        }
-                        if (df->sha1 == sha1) {
-                            fileOK = true;
+
+        mutex.lock();
+        bool done = found.at(i);
+        mutex.unlock();
+        if (done)
+            continue;
+
+        bool ok = true;
+        for (int j = 0; j < pv->detectFiles.count(); j++) {
+            bool fileOK = false;
+            DetectFile* df = pv->detectFiles.at(j);
+            if (aDir.exists(df->path)) {
+                QString fullPath = dir + "\\" + df->path;
+                QFileInfo f(fullPath);
+                if (f.isFile() && f.isReadable()) {
+                    QString sha1 = path2sha1.value(df->path);
+                    if (sha1.isEmpty()) {
+                        ScanDiskThirdPartyPM::FileHash fh;
+                        sha1 = ScanDiskThirdPartyPM::computeSHA1(fullPath, f,
+                                &fh);
+                        path2sha1[df->path] = sha1;
+                        if (!fh.sha1.isEmpty()) {
+                            mutex.lock();
+                            computed.append(fh);
+                            mutex.unlock();
                         }
                     }
-                }
-                if (!fileOK) {
-                    ok = false;
-                    break;
+                    if (df->sha1 == sha1) {
+                        fileOK = true;
+                    }
                 }
             }
+            if (!fileOK) {
+                ok = false;
+                break;
+            }
+        }
+
+        if (ok) {
+            // another thread could find the same package version
+            mutex.lock();
+            bool first = !found.at(i);
+            found[i] = true;
+            mutex.unlock();
 
-            if (ok) {
-                pv->setPath(path);
-                return;
+            if (first) {
+                pv->setPath(dir);
+                return false;
             }
         }
     }
 
-    if (job && !job->isCancelled()) {
-        QFileInfoList entries = aDir.entryInfoList(
-                QDir::NoDotAndDotDot | QDir::Dirs);
-        int count = entries.size();
-        for (int idx = 0; idx < count; idx++) {
-            if (job && job->isCancelled())
-                break;
+    return true;
+}
 
-            QFileInfo entryInfo = entries[idx];
-            QString name = entryInfo.fileName();
+ScanDiskThirdPartyPM::ScanDiskThirdPartyPM()
+{
+}
 
-            if (job) {
-                job->setTitle(name);
-                if (job->isCancelled())
-                    break;
-            }
+void ScanDiskThirdPartyPM::scan(Job *job,
+        QList<InstalledPackageVersion *> *installed, Repository *rep) const
+{
+    // the directories of the Windows and the installed packages cannot
+    // contain other packages
+    DirectoryWalker walker;
+    walker.ignore.append(WPMUtils::normalizePath(WPMUtils::getWindowsDir()));
+    QStringList paths = InstalledPackages::getDefault()->
+            getAllInstalledPackagePaths();
+    for (int i = 0; i < paths.count(); i++) {
+        walker.ignore.append(WPMUtils::normalizePath(paths.at(i)));
+    }
 
-            Job* djob;
-            if (level < 2)
-                djob = job->newSubJob(1.0 / count);
-            else
-                djob = 0;
-            scan(path + "\\" + name.toLower(), djob, level + 1, ignore);
+    QStringList roots;
+    QFileInfoList fil = QDir::drives();
+    for (int i = 0; i < fil.count(); i++) {
+        QString path = WPMUtils::normalizePath(fil.at(i).absolutePath());
+        UINT t = GetDriveType((WCHAR*) path.utf16());
+        if (t == DRIVE_FIXED)
+            roots.append(path);
+    }
 
-            if (job) {
-                job->setProgress(((double) idx) / count);
-            }
+    // the package versions are read only once for all directories
+    QList<PackageVersion*> packageVersions;
+    if (job->shouldProceed()) {
+        DBRepository* r = DBRepository::getDefault();
+        QString err;
+        packageVersions = r->getPackageVersionsWithDetectFiles(&err);
+        if (!err.isEmpty())
+            job->setErrorMessage(err);
+    }
+
+    if (job->shouldProceed()) {
+        Job* sub = job->newSubJob(1, QObject::tr("Scanning %1").
+                arg(roots.join(", ")), true, true);
+        DetectFilesVisitor visitor(packageVersions);
+        walker.walk(sub, roots, &visitor);
+
+        // the walker threads only read the cache. Errors are ignored, the
+        // values will be computed again next time.
+        DBRepository* r = DBRepository::getDefault();
+        for (int i = 0; i < visitor.computed.count(); i++) {
+            const FileHash& fh = visitor.computed.at(i);
+            r->saveFileHash(fh.path, fh.size, fh.modified, fh.sha1);
         }
     }
 
     qDeleteAll(packageVersions);
 
-    if (job)
-        job->complete();
+    job->complete();
 }
 
+QString ScanDiskThirdPartyPM::computeSHA1(const QString& fullPath,
+        const QFileInfo& f, FileHash* computed)
+{
+    computed->path = WPMUtils::normalizePath(fullPath);
+    computed->size = f.size();
+    computed->modified = f.lastModified().toMSecsSinceEpoch();
+    computed->sha1 = "";
+
+    // errors in the cache are ignored. The hash sum is computed again.
+    QString err;
+    QString sha1;
+    DBRepository* r = DBRepository::getReadOnly(&err);
+    if (err.isEmpty())
+        sha1 = r->findFileHash(computed->path, computed->size,
+                computed->modified, &err);
+
+    if (sha1.isEmpty()) {
+        sha1 = WPMUtils::sha1(fullPath);
+        computed->sha1 = sha1;
+    }
+
+    return sha1;
+}
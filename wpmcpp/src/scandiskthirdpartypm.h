@@ -1,23 +1,51 @@
 #ifndef SCANDISKTHIRDPARTYPM_H
 #define SCANDISKTHIRDPARTYPM_H
 
+#include <QFileInfo>
+#include <QMutex>
+
 #include "abstractthirdpartypm.h"
 
 class ScanDiskThirdPartyPM: public AbstractThirdPartyPM
 {
-private:
+public:
+    /**
+     * @brief SHA-1 of a file that should be stored in the cache
+     */
+    class FileHash
+    {
+    public:
+        /** normalized path */
+        QString path;
+
+        /** size of the file in bytes */
+        qint64 size;
+
+        /** last modification time in milliseconds since the epoch */
+        qint64 modified;
+
+        /** SHA-1 or "" if nothing should be stored */
+        QString sha1;
+    };
+
     /**
-     * All paths should be in lower case
-     * and separated with \ and not / and cannot end with \.
-     *
-     * @param path directory
-     * @param job job
-     * @param ignore ignored directories
+     * @brief computes SHA-1 for a file. The value is cached in the database
+     *     for the path, size and the last modification time of the file. The
+     *     cache is read using the read-only connection of the current thread
+     *     (see DBRepository::getReadOnly()). New values are not written to
+     *     the database, but returned in "computed" so that they can be saved
+     *     later from one thread.
+     * @param fullPath full path to the file
+     * @param f information about the file
+     * @param computed the computed value will be stored here. computed->sha1
+     *     is "" if the value was found in the cache or the file cannot be
+     *     read.
+     * @return SHA-1 or "" if the file cannot be read
      * @threadsafe
      */
-    void scan(const QString& path, Job* job, int level,
-            QStringList& ignore) const;
-public:
+    static QString computeSHA1(const QString& fullPath,
+            const QFileInfo& f, FileHash* computed);
+
     ScanDiskThirdPartyPM();
 
     void scan(Job *job, QList<InstalledPackageVersion *> *installed,
@@ -0,0 +1,197 @@
+#include <QMap>
+
+#include "searchsession.h"
+
+static bool categoryLessThan(const QStringList& a, const QStringList& b)
+{
+    return a.at(2) < b.at(2);
+}
+
+SearchSession::SearchSession(): status(Package::NOT_INSTALLED),
+        filterByStatus(false)
+{
+}
+
+QStringList SearchSession::parseKeywords(const QString& query)
+{
+    QStringList keywords = query.toLower().simplified().split(" ",
+            QString::SkipEmptyParts);
+
+    // the same rule as in DBRepository::findPackages
+    QStringList r;
+    for (int i = 0; i < keywords.count(); i++) {
+        if (keywords.at(i).length() > 1)
+            r.append(keywords.at(i));
+    }
+
+    return r;
+}
+
+bool SearchSession::matches(const Row& row, const QStringList& keywords)
+{
+    for (int i = 0; i < keywords.count(); i++) {
+        if (!row.fullText.contains(keywords.at(i)))
+            return false;
+    }
+    return true;
+}
+
+QString SearchSession::load(DBRepository* dbr, Package::Status status,
+        bool filterByStatus, const QString& query)
+{
+    QString err;
+
+    this->status = status;
+    this->filterByStatus = filterByStatus;
+    this->keywords = parseKeywords(query);
+    this->rows.clear();
+
+    QList<QStringList> found = dbr->findPackageRows(status, filterByStatus,
+            query, &err);
+    if (err.isEmpty()) {
+        this->rows.reserve(found.count());
+        for (int i = 0; i < found.count(); i++) {
+            const QStringList& sl = found.at(i);
+            Row row;
+            row.name = sl.at(0);
+            row.fullText = sl.at(1);
+            row.cat0 = sl.at(2).toInt();
+            row.cat1 = sl.at(3).toInt();
+            this->rows.append(row);
+        }
+    }
+
+    return err;
+}
+
+bool SearchSession::isFor(Package::Status status, bool filterByStatus,
+        const QString& query) const
+{
+    if (filterByStatus != this->filterByStatus)
+        return false;
+    if (filterByStatus && status != this->status)
+        return false;
+
+    return parseKeywords(query) == this->keywords;
+}
+
+bool SearchSession::canRefine(Package::Status status, bool filterByStatus,
+        const QString& query) const
+{
+    if (filterByStatus != this->filterByStatus)
+        return false;
+    if (filterByStatus && status != this->status)
+        return false;
+
+    QStringList kws = parseKeywords(query);
+
+    // % and _ are wildcards for LIKE in SQL
+    for (int i = 0; i < kws.count(); i++) {
+        const QString& kw = kws.at(i);
+        if (kw.contains('%') || kw.contains('_'))
+            return false;
+    }
+
+    // every old keyword should be contained in a new one
+    for (int i = 0; i < this->keywords.count(); i++) {
+        const QString& old = this->keywords.at(i);
+        bool found = false;
+        for (int j = 0; j < kws.count(); j++) {
+            if (kws.at(j).contains(old)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found)
+            return false;
+    }
+
+    return true;
+}
+
+void SearchSession::refine(const QString& query)
+{
+    QStringList kws = parseKeywords(query);
+
+    QList<Row> r;
+    r.reserve(this->rows.count());
+    for (int i = 0; i < this->rows.count(); i++) {
+        const Row& row = this->rows.at(i);
+        if (matches(row, kws))
+            r.append(row);
+    }
+
+    this->rows = r;
+    this->keywords = kws;
+}
+
+QString SearchSession::countCategories(const QList<const Row*>& rows,
+        int level, DBRepository* dbr, QList<QStringList>* cats)
+{
+    QString err;
+
+    QMap<int, int> counts;
+    for (int i = 0; i < rows.count(); i++) {
+        const Row* row = rows.at(i);
+        int c = level == 0 ? row->cat0 : row->cat1;
+        counts[c]++;
+    }
+
+    cats->clear();
+    QMapIterator<int, int> it(counts);
+    while (it.hasNext()) {
+        it.next();
+        QStringList sl;
+        if (it.key() == 0) {
+            sl.append("");
+            sl.append(QString::number(it.value()));
+            sl.append("");
+        } else {
+            sl.append(QString::number(it.key()));
+            sl.append(QString::number(it.value()));
+            sl.append(dbr->findCategory(it.key(), &err));
+            if (!err.isEmpty())
+                break;
+        }
+        cats->append(sl);
+    }
+
+    qSort(cats->begin(), cats->end(), categoryLessThan);
+
+    return err;
+}
+
+QString SearchSession::filter(DBRepository* dbr, int cat0, int cat1,
+        QStringList* found, QList<QStringList>* cats,
+        QList<QStringList>* cats1) const
+{
+    QList<const Row*> all;
+    all.reserve(this->rows.count());
+    for (int i = 0; i < this->rows.count(); i++) {
+        all.append(&this->rows.at(i));
+    }
+
+    QString err = countCategories(all, 0, dbr, cats);
+
+    QList<const Row*> inCat0;
+    if (cat0 >= 0) {
+        for (int i = 0; i < all.count(); i++) {
+            if (all.at(i)->cat0 == cat0)
+                inCat0.append(all.at(i));
+        }
+        if (err.isEmpty())
+            err = countCategories(inCat0, 1, dbr, cats1);
+    } else {
+        inCat0 = all;
+        cats1->clear();
+    }
+
+    found->clear();
+    for (int i = 0; i < inCat0.count(); i++) {
+        const Row* row = inCat0.at(i);
+        if (cat1 < 0 || row->cat1 == cat1)
+            found->append(row->name);
+    }
+
+    return err;
+}
@@ -0,0 +1,110 @@
+#ifndef SEARCHSESSION_H
+#define SEARCHSESSION_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+
+#include "package.h"
+#include "dbrepository.h"
+
+/**
+ * @brief result of a search for packages with a given status filter and
+ *     keywords. The categories are not filtered so that the filtering by
+ *     categories and the category counts can be computed in memory.
+ *
+ * If the user only adds characters to the search query, the new result is a
+ *     subset of the previous one and can be computed without accessing the
+ *     database (see canRefine()).
+ */
+class SearchSession
+{
+    class Row
+    {
+    public:
+        QString name;
+        QString fullText;
+
+        /** CATEGORY0 or 0 for un-categorized */
+        int cat0;
+
+        /** CATEGORY1 or 0 for un-categorized */
+        int cat1;
+    };
+
+    /** found packages sorted by title */
+    QList<Row> rows;
+
+    Package::Status status;
+    bool filterByStatus;
+
+    /** keywords in lower case. Only keywords with 2 or more characters. */
+    QStringList keywords;
+
+    static QStringList parseKeywords(const QString& query);
+    static bool matches(const Row& row, const QStringList& keywords);
+    static QString countCategories(const QList<const Row*>& rows, int level,
+            DBRepository* dbr, QList<QStringList>* cats);
+public:
+    /**
+     * @brief empty result
+     */
+    SearchSession();
+
+    /**
+     * @brief searches for packages in the database
+     * @param dbr repository
+     * @param status filter for the package status if filterByStatus is true
+     * @param filterByStatus true = filter by status
+     * @param query search query (keywords)
+     * @return error message
+     */
+    QString load(DBRepository* dbr, Package::Status status,
+            bool filterByStatus, const QString& query);
+
+    /**
+     * @param status filter for the package status if filterByStatus is true
+     * @param filterByStatus true = filter by status
+     * @param query search query (keywords)
+     * @return true if this object contains the result for the specified
+     *     search
+     */
+    bool isFor(Package::Status status, bool filterByStatus,
+            const QString& query) const;
+
+    /**
+     * @param status filter for the package status if filterByStatus is true
+     * @param filterByStatus true = filter by status
+     * @param query search query (keywords)
+     * @return true if the result for the specified search is a subset of
+     *     this result and can be computed using refine()
+     */
+    bool canRefine(Package::Status status, bool filterByStatus,
+            const QString& query) const;
+
+    /**
+     * @brief removes the packages that do not match the new query. This
+     *     function should only be called if canRefine() returns true.
+     * @param query new search query
+     */
+    void refine(const QString& query);
+
+    /**
+     * @brief filters the packages by categories
+     * @param dbr repository used for the category titles
+     * @param cat0 filter for the level 0 of categories. -1 means "All",
+     *     0 means "Uncategorized"
+     * @param cat1 filter for the level 1 of categories. -1 means "All",
+     *     0 means "Uncategorized"
+     * @param found names of the found packages will be stored here
+     * @param cats categories on the level 0 will be stored here (see
+     *     DBRepository::findCategories)
+     * @param cats1 categories on the level 1 will be stored here. The list is
+     *     empty if cat0 is -1
+     * @return error message or ""
+     */
+    QString filter(DBRepository* dbr, int cat0, int cat1, QStringList* found,
+            QList<QStringList>* cats, QList<QStringList>* cats1) const;
+};
+
+#endif // SEARCHSESSION_H
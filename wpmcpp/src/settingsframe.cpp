@@ -4,11 +4,13 @@
 #include "ui_settingsframe.h"
 
 #include <QApplication>
+#include <QJsonDocument>
 
 #include "repository.h"
 #include "mainwindow.h"
 #include "wpmutils.h"
 #include "installedpackages.h"
+#include "mysqlquery.h"
 
 SettingsFrame::SettingsFrame(QWidget *parent) :
     QFrame(parent),
@@ -31,6 +33,9 @@ SettingsFrame::SettingsFrame(QWidget *parent) :
 
     dirs.removeDuplicates();
     this->ui->comboBoxDir->addItems(dirs);
+
+    this->ui->checkBoxSQLStatistics->setChecked(
+            MySQLQuery::collectStatistics.load() != 0);
 }
 
 SettingsFrame::~SettingsFrame()
@@ -67,6 +72,18 @@ void SettingsFrame::on_buttonBox_accepted()
 {
 }
 
+void SettingsFrame::on_checkBoxSQLStatistics_toggled(bool checked)
+{
+    MySQLQuery::collectStatistics.store(checked ? 1 : 0);
+}
+
+void SettingsFrame::on_pushButtonSQLStatistics_clicked()
+{
+    QJsonDocument d(MySQLQuery::getStatistics());
+    this->ui->plainTextEditSQLStatistics->setPlainText(
+            QString::fromUtf8(d.toJson(QJsonDocument::Indented)));
+}
+
 void SettingsFrame::setCloseProcessType(DWORD v)
 {
     this->ui->checkBoxCloseWindows->setChecked(v &
@@ -89,6 +106,16 @@ DWORD SettingsFrame::getCloseProcessType()
     return cpt;
 }
 
+bool SettingsFrame::getPrefetchUpdates()
+{
+    return this->ui->checkBoxPrefetchUpdates->isChecked();
+}
+
+void SettingsFrame::setPrefetchUpdates(bool v)
+{
+    this->ui->checkBoxPrefetchUpdates->setChecked(v);
+}
+
 void SettingsFrame::on_buttonBox_clicked(QAbstractButton *button)
 {
     MainWindow* mw = MainWindow::getInstance();
@@ -132,6 +159,11 @@ void SettingsFrame::on_buttonBox_clicked(QAbstractButton *button)
     if (err.isEmpty()) {
         WPMUtils::setInstallationDirectory(getInstallationDirectory());
         WPMUtils::setCloseProcessType(getCloseProcessType());
+
+        // the download speed can only be changed in the registry
+        DWORD kibPerSecond;
+        WPMUtils::getPrefetchUpdates(&kibPerSecond);
+        WPMUtils::setPrefetchUpdates(getPrefetchUpdates(), kibPerSecond);
     }
 
     bool repsChanged = false;
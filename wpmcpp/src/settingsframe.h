@@ -47,11 +47,25 @@ public:
      * @param v how to close programs
      */
     void setCloseProcessType(DWORD v);
+
+    /**
+     * @return true = download the updates in the background
+     */
+    bool getPrefetchUpdates();
+
+    /**
+     * @param v true = download the updates in the background
+     */
+    void setPrefetchUpdates(bool v);
 private slots:
     void on_buttonBox_accepted();
 
     void on_buttonBox_clicked(QAbstractButton *button);
 
+    void on_checkBoxSQLStatistics_toggled(bool checked);
+
+    void on_pushButtonSQLStatistics_clicked();
+
 private:
     Ui::SettingsFrame *ui;
 };
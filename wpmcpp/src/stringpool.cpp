@@ -0,0 +1,41 @@
+#include "stringpool.h"
+
+#include <QReadLocker>
+#include <QWriteLocker>
+
+StringPool StringPool::def;
+
+StringPool* StringPool::getDefault()
+{
+    return &def;
+}
+
+StringPool::StringPool()
+{
+}
+
+QString StringPool::intern(const QString& s)
+{
+    // most strings are already in the pool. Several threads can search at
+    // the same time.
+    {
+        QReadLocker locker(&lock);
+        QSet<QString>::const_iterator it = strings.constFind(s);
+        if (it != strings.constEnd())
+            return *it;
+    }
+
+    QWriteLocker locker(&lock);
+    QSet<QString>::const_iterator it = strings.constFind(s);
+    if (it != strings.constEnd())
+        return *it;
+
+    strings.insert(s);
+    return s;
+}
+
+int StringPool::count()
+{
+    QReadLocker locker(&lock);
+    return strings.count();
+}
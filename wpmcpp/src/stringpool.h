@@ -0,0 +1,52 @@
+#ifndef STRINGPOOL_H
+#define STRINGPOOL_H
+
+#include <QString>
+#include <QSet>
+#include <QReadWriteLock>
+
+/**
+ * @brief stores one copy of often repeated strings like package or license
+ *     names. QString uses implicit sharing: all interned copies of a string
+ *     point to the same data.
+ *
+ * Strings are never removed from the pool. It should only be used for
+ * identifiers and not for arbitrary text. The shared pool (see getDefault())
+ * is only used for long-lived objects like the ones in the in-memory
+ * Repository. Short-lived objects use their own pool or none at all.
+ */
+class StringPool
+{
+    static StringPool def;
+
+    QReadWriteLock lock;
+    QSet<QString> strings;
+
+    StringPool(const StringPool&);
+    StringPool& operator=(const StringPool&);
+public:
+    /**
+     * @return the pool shared by the whole application
+     */
+    static StringPool* getDefault();
+
+    StringPool();
+
+    /**
+     * @brief returns the stored copy of a string. The string is added to the
+     *     pool if necessary.
+     * @param s a string
+     * @return a string equal to "s" that shares the data with other
+     *     interned copies
+     * @threadsafe
+     */
+    QString intern(const QString& s);
+
+    /**
+     * @return number of different strings in the pool
+     * @threadsafe
+     */
+    int count();
+};
+
+#endif // STRINGPOOL_H
@@ -1,4 +1,7 @@
+#include <limits>
+
 #include "qstringlist.h"
+#include "qvarlengtharray.h"
 
 #include "version.h"
 
@@ -9,6 +12,7 @@ Version::Version(): basic()
     this->parts = &this->basic[0];
     this->parts[0] = 1;
     this->nparts = 1;
+    updateKey();
 }
 
 Version::Version(int a, int b): basic()
@@ -17,6 +21,7 @@ Version::Version(int a, int b): basic()
     this->parts[0] = a;
     this->parts[1] = b;
     this->nparts = 2;
+    updateKey();
 }
 
 Version::Version(const Version &v): basic()
@@ -27,6 +32,8 @@ Version::Version(const Version &v): basic()
         this->parts = new int[v.nparts];
     this->nparts = v.nparts;
     memcpy(parts, v.parts, sizeof(parts[0]) * nparts);
+    this->key = v.key;
+    this->packed = v.packed;
 }
 
 Version& Version::operator =(const Version& v)
@@ -40,17 +47,23 @@ Version& Version::operator =(const Version& v)
             this->parts = new int[v.nparts];
         this->nparts = v.nparts;
         memcpy(parts, v.parts, sizeof(parts[0]) * nparts);
+        this->key = v.key;
+        this->packed = v.packed;
     }
     return *this;
 }
 
 bool Version::operator !=(const Version& v) const
 {
+    if (this->packed && v.packed)
+        return this->key != v.key;
     return this->compare(v) != 0;
 }
 
 bool Version::operator ==(const Version& v) const
 {
+    if (this->packed && v.packed)
+        return this->key == v.key;
     return this->compare(v) == 0;
 }
 
@@ -83,6 +96,7 @@ void Version::setVersion(int a, int b)
     this->parts[0] = a;
     this->parts[1] = b;
     this->nparts = 2;
+    updateKey();
 }
 
 void Version::setVersion(int a, int b, int c)
@@ -94,6 +108,7 @@ void Version::setVersion(int a, int b, int c)
     this->parts[1] = b;
     this->parts[2] = c;
     this->nparts = 3;
+    updateKey();
 }
 
 void Version::setVersion(int a, int b, int c, int d)
@@ -106,38 +121,134 @@ void Version::setVersion(int a, int b, int c, int d)
     this->parts[2] = c;
     this->parts[3] = d;
     this->nparts = 4;
+    updateKey();
+}
+
+void Version::updateKey()
+{
+    this->key = 0;
+    this->packed = this->nparts <= BASIC_PARTS;
+    for (int i = 0; i < BASIC_PARTS; i++) {
+        int p;
+        if (i < this->nparts)
+            p = this->parts[i];
+        else
+            p = 0;
+        if (p < 0 || p > KEY_PART_MAX) {
+            this->packed = false;
+            break;
+        }
+        this->key = (this->key << 16) | (quint64) p;
+    }
+}
+
+int Version::parsePart(const QChar* s, int len, bool* ok)
+{
+    *ok = false;
+
+    int i = 0;
+    while (i < len && s[i].isSpace())
+        i++;
+
+    bool negative = false;
+    if (i < len && (s[i] == '-' || s[i] == '+')) {
+        negative = s[i] == '-';
+        i++;
+    }
+
+    qint64 v = 0;
+    int ndigits = 0;
+    while (i < len) {
+        ushort c = s[i].unicode();
+        if (c < '0' || c > '9')
+            break;
+        v = v * 10 + (c - '0');
+        if (v > (qint64) std::numeric_limits<int>::max() + 1)
+            return 0;
+        ndigits++;
+        i++;
+    }
+
+    while (i < len && s[i].isSpace())
+        i++;
+
+    if (ndigits == 0 || i != len)
+        return 0;
+
+    if (negative)
+        v = -v;
+
+    if (v > std::numeric_limits<int>::max() ||
+            v < std::numeric_limits<int>::min())
+        return 0;
+
+    *ok = true;
+    return (int) v;
 }
 
 bool Version::setVersion(const QString& v)
 {
-    bool result = false;
-    if (!v.trimmed().isEmpty()) {
-        QStringList sl = v.split(".", QString::KeepEmptyParts);
-
-        if (sl.count() > 0) {
-            bool ok = true;
-            for (int i = 0; i < sl.count(); i++) {
-                sl.at(i).toInt(&ok);
-                if (!ok)
-                    break;
-            }
-
-            if (ok) {
-                if (this->parts != basic)
-                    delete[] this->parts;
-                this->nparts = sl.count();
-                if (nparts <= BASIC_PARTS)
-                    this->parts = basic;
-                else
-                    this->parts = new int[nparts];
-                for (int i = 0; i < nparts; i++) {
-                    this->parts[i] = sl.at(i).toInt();
-                }
-                result = true;
-            }
+    return setVersion(v.constData(), v.length());
+}
+
+bool Version::setVersion(const QStringRef& v)
+{
+    return setVersion(v.constData(), v.length());
+}
+
+bool Version::setVersion(const QChar* v, int len)
+{
+    // an empty string or a string with only spaces is not a valid version
+    bool blank = true;
+    int n = 1;
+    for (int i = 0; i < len; i++) {
+        if (v[i] == '.')
+            n++;
+        else if (!v[i].isSpace())
+            blank = false;
+    }
+    if (blank)
+        return false;
+
+    // the parts are parsed in a temporary buffer so that this object is not
+    // changed if the version is not valid
+    int tmp[BASIC_PARTS];
+    int* newParts;
+    if (n <= BASIC_PARTS)
+        newParts = tmp;
+    else
+        newParts = new int[n];
+
+    bool ok = true;
+    int start = 0;
+    int index = 0;
+    for (int i = 0; i <= len; i++) {
+        if (i == len || v[i] == '.') {
+            newParts[index] = parsePart(v + start, i - start, &ok);
+            if (!ok)
+                break;
+            index++;
+            start = i + 1;
         }
     }
-    return result;
+
+    if (ok) {
+        if (this->parts != basic)
+            delete[] this->parts;
+        this->nparts = n;
+        if (n <= BASIC_PARTS) {
+            this->parts = basic;
+            memcpy(this->parts, tmp, sizeof(parts[0]) * n);
+        } else {
+            this->parts = newParts;
+        }
+        updateKey();
+    } else {
+        if (newParts != tmp)
+            delete[] newParts;
+    }
+
+    return ok;
 }
 
 void Version::prepend(int number)
@@ -154,31 +265,61 @@ void Version::prepend(int number)
         delete[] this->parts;
     this->parts = newParts;
     this->nparts = this->nparts + 1;
+    updateKey();
+}
+
+/**
+ * Writes the decimal representation of a number.
+ *
+ * @param v a number
+ * @param out the characters will be written here. At least 11 characters
+ *     should be available.
+ * @return number of written characters
+ */
+static int formatPart(int v, QChar* out)
+{
+    QChar digits[11];
+    int n = 0;
+    unsigned int u;
+    bool negative = v < 0;
+    if (negative)
+        u = 0u - (unsigned int) v;
+    else
+        u = (unsigned int) v;
+
+    do {
+        digits[n++] = QChar((ushort) ('0' + u % 10));
+        u /= 10;
+    } while (u != 0);
+
+    int r = 0;
+    if (negative)
+        out[r++] = '-';
+    while (n > 0)
+        out[r++] = digits[--n];
+
+    return r;
 }
 
 QString Version::getVersionString(int nparts) const
 {
-    QString r;
+    // at most 11 characters per part and a dot
+    QVarLengthArray<QChar, 64> buf(nparts * 12);
+    int len = 0;
     for (int i = 0; i < nparts; i++) {
         if (i != 0)
-            r.append(".");
+            buf[len++] = '.';
         if (i >= this->nparts)
-            r.append('0');
+            buf[len++] = '0';
         else
-            r.append(QString::number(this->parts[i]));
+            len += formatPart(this->parts[i], buf.data() + len);
     }
-    return r;
+    return QString(buf.constData(), len);
 }
 
 QString Version::getVersionString() const
 {
-    QString r;
-    for (int i = 0; i < this->nparts; i++) {
-        if (i != 0)
-            r.append('.');
-        r.append(QString::number(this->parts[i]));
-    }
-    return r;
+    return getVersionString(this->nparts);
 }
 
 int Version::getNParts() const
@@ -207,6 +348,7 @@ void Version::normalize()
             delete[] this->parts;
         this->parts = newParts;
         this->nparts = this->nparts - n;
+        updateKey();
     }
 }
 
@@ -218,6 +360,15 @@ bool Version::isNormalized() const
 
 int Version::compare(const Version &other) const
 {
+    if (this->packed && other.packed) {
+        if (this->key < other.key)
+            return -1;
+        else if (this->key > other.key)
+            return 1;
+        else
+            return 0;
+    }
+
     int nmax = nparts;
     if (other.nparts > nmax)
         nmax = other.nparts;
@@ -8,6 +8,9 @@ class Version
 private:
     const static int BASIC_PARTS = 4;
 
+    /** maximum value of a version part that fits in the packed key */
+    const static int KEY_PART_MAX = 0xffff;
+
     /**
      * this is used instead of allocating memory on the heap for performance.
      * Version numbers with more than 4 parts are still stored on the heap.
@@ -18,6 +21,36 @@ private:
     int* parts;
 
     int nparts;
+
+    /**
+     * order-preserving representation of the version number with 16 bits
+     * per part (a.b.c.d => 0xaaaabbbbccccdddd). Only valid if *packed* is
+     * true.
+     */
+    quint64 key;
+
+    /**
+     * true if the version has at most 4 parts and each part is in the range
+     * 0..KEY_PART_MAX. In this case *key* can be used for the comparison.
+     */
+    bool packed;
+
+    /**
+     * Re-computes *key* and *packed*. Should be called after each change of
+     * *parts*.
+     */
+    void updateKey();
+
+    /**
+     * Parses one part of a version number. The behaviour corresponds to
+     * QString::toInt(): leading and trailing spaces and a sign are allowed.
+     *
+     * @param s first character
+     * @param len number of characters
+     * @param ok true will be stored here if the value is a valid number
+     * @return parsed value
+     */
+    static int parsePart(const QChar* s, int len, bool* ok);
 public:
     static const Version EMPTY;
 
@@ -55,6 +88,27 @@ public:
      */
     bool setVersion(const QString& version);
 
+    /**
+     * Changes the version. No memory is allocated on the heap for version
+     * numbers with up to 4 parts.
+     *
+     * @param version "1.2.3"
+     * @return true if it was a valid version. The internal value is not changed
+     *     if a not-valid version was supplied
+     */
+    bool setVersion(const QStringRef& version);
+
+    /**
+     * Changes the version. No memory is allocated on the heap for version
+     * numbers with up to 4 parts.
+     *
+     * @param version first character of the version like "1.2.3"
+     * @param len number of characters
+     * @return true if it was a valid version. The internal value is not changed
+     *     if a not-valid version was supplied
+     */
+    bool setVersion(const QChar* version, int len);
+
     /**
      * Changes the version.
      *
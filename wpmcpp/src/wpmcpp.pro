@@ -11,10 +11,13 @@ SOURCES += main.cpp \
     job.cpp \
     downloader.cpp \
     wpmutils.cpp \
+    processrunner.cpp \
+    searchsession.cpp \
     package.cpp \
     packageversionfile.cpp \
     version.cpp \
     dependency.cpp \
+    dependencyindex.cpp \
     fileloader.cpp \
     installoperation.cpp \
     packageversionform.cpp \
@@ -43,8 +46,11 @@ SOURCES += main.cpp \
     installedpackagesthirdpartypm.cpp \
     flowlayout.cpp \
     scandiskthirdpartypm.cpp \
+    directorywalker.cpp \
     mysqlquery.cpp \
     repositoryxmlhandler.cpp \
+    repositoryxmlreader.cpp \
+    stringpool.cpp \
     cbsthirdpartypm.cpp \
     scanharddrivesthread.cpp \
     visiblejobs.cpp \
@@ -57,10 +63,13 @@ HEADERS += mainwindow.h \
     job.h \
     downloader.h \
     wpmutils.h \
+    processrunner.h \
+    searchsession.h \
     package.h \
     packageversionfile.h \
     version.h \
     dependency.h \
+    dependencyindex.h \
     fileloader.h \
     installoperation.h \
     packageversionform.h \
@@ -90,8 +99,11 @@ HEADERS += mainwindow.h \
     installedpackagesthirdpartypm.h \
     flowlayout.h \
     scandiskthirdpartypm.h \
+    directorywalker.h \
     mysqlquery.h \
     repositoryxmlhandler.h \
+    repositoryxmlreader.h \
+    stringpool.h \
     cbsthirdpartypm.h \
     msoav2.h \
     scanharddrivesthread.h \
@@ -44,12 +44,15 @@
 #endif
 
 #include "wpmutils.h"
+#include "processrunner.h"
 #include "version.h"
 #include "windowsregistry.h"
 #include "mstask.h"
 
 HANDLE WPMUtils::hEventLog = 0;
 
+QThreadStorage<QPair<QString*, QString*> > WPMUtils::capturedOutput;
+
 const char* WPMUtils::UCS2LE_BOM = "\xFF\xFE";
 
 const char* WPMUtils::CRLF = "\r\n";
@@ -676,6 +679,41 @@ DWORD WPMUtils::getCloseProcessType()
     return cpt;
 }
 
+void WPMUtils::setPrefetchUpdates(bool enabled, DWORD kibPerSecond)
+{
+    WindowsRegistry m(HKEY_LOCAL_MACHINE, false, KEY_ALL_ACCESS);
+    QString err;
+    WindowsRegistry npackd = m.createSubKey("Software\\Npackd\\Npackd", &err,
+            KEY_ALL_ACCESS);
+    if (err.isEmpty()) {
+        npackd.setDWORD("prefetchUpdates", enabled ? 1 : 0);
+        npackd.setDWORD("prefetchBandwidth", kibPerSecond);
+    }
+}
+
+bool WPMUtils::getPrefetchUpdates(DWORD* kibPerSecond)
+{
+    bool enabled = false;
+
+    // a slow default speed leaves the bandwidth for the other programs
+    *kibPerSecond = 512;
+
+    WindowsRegistry npackd;
+    QString err = npackd.open(
+            HKEY_LOCAL_MACHINE, "Software\\Npackd\\Npackd", false, KEY_READ);
+    if (err.isEmpty()) {
+        DWORD v = npackd.getDWORD("prefetchUpdates", &err);
+        if (err.isEmpty())
+            enabled = v != 0;
+
+        v = npackd.getDWORD("prefetchBandwidth", &err);
+        if (err.isEmpty())
+            *kibPerSecond = v;
+    }
+
+    return enabled;
+}
+
 BOOL CALLBACK myEnumWindowsProc(HWND hwnd, LPARAM lParam)
 {
     QList<HWND>* p = (QList<HWND>*) lParam;
@@ -2173,6 +2211,17 @@ void WPMUtils::removeDirectory(Job* job, QDir &aDir, bool firstLevel)
                 arg(aDir.absolutePath().replace('/', '\\')));
     }
 
+    JobStep* step = job->newStep(1);
+    removeDirectory(step, aDir);
+    if (!step->getErrorMessage().isEmpty())
+        job->setErrorMessage(step->getErrorMessage());
+    step->release();
+
+    job->complete();
+}
+
+void WPMUtils::removeDirectory(JobStep* step, QDir &aDir)
+{
     if (aDir.exists()) {
         QFileInfoList entries = aDir.entryInfoList(
                 QDir::NoDotAndDotDot |
@@ -2183,40 +2232,41 @@ void WPMUtils::removeDirectory(Job* job, QDir &aDir, bool firstLevel)
             QString path = entryInfo.absoluteFilePath();
             if (entryInfo.isDir()) {
                 QDir dd(path);
-                Job* sub = job->newSubJob(1 / ((double) count + 1));
-                removeDirectory(sub, dd, false);
+                JobStep* sub = step->newSubStep(1 / ((double) count + 1));
+                removeDirectory(sub, dd);
                 if (!sub->getErrorMessage().isEmpty())
-                    job->setErrorMessage(sub->getErrorMessage());
+                    step->setErrorMessage(sub->getErrorMessage());
+                sub->release();
                 // if (!ok)
                 //    qDebug() << "WPMUtils::removeDirectory.3" << *errMsg;
             } else {
                 QFile file(path);
                 if (!file.remove() && file.exists()) {
-                    job->setErrorMessage(QString(QObject::tr("Cannot delete the file: %1")).
+                    step->setErrorMessage(QString(QObject::tr("Cannot delete the file: %1")).
                             arg(path));
                     // qDebug() << "WPMUtils::removeDirectory.1" << *errMsg;
                 } else {
-                    job->setProgress(idx / ((double) count + 1));
+                    step->setProgress(idx / ((double) count + 1));
                 }
             }
-            if (!job->getErrorMessage().isEmpty())
+            if (!step->getErrorMessage().isEmpty())
                 break;
         }
 
-        if (job->getErrorMessage().isEmpty()) {
+        if (step->getErrorMessage().isEmpty()) {
             if (!aDir.rmdir(aDir.absolutePath()))
                 // qDebug() << "WPMUtils::removeDirectory.2";
-                job->setErrorMessage(QString(
+                step->setErrorMessage(QString(
                         QObject::tr("Cannot delete the directory: %1")).
                         arg(aDir.absolutePath()));
             else
-                job->setProgress(1);
+                step->setProgress(1);
         }
     } else {
-        job->setProgress(1);
+        step->setProgress(1);
     }
 
-    job->complete();
+    step->complete();
 }
 
 QString WPMUtils::makeValidFilename(const QString &name, QChar rep)
@@ -2235,8 +2285,23 @@ void WPMUtils::writeln(const QString& txt, bool stdout_)
     outputTextConsole(txt + "\r\n", stdout_);
 }
 
+void WPMUtils::captureOutput(QString* stdout_, QString* stderr_)
+{
+    capturedOutput.setLocalData(qMakePair(stdout_, stderr_));
+}
+
 void WPMUtils::outputTextConsole(const QString& txt, bool stdout_)
 {
+    QString* captured = 0;
+    if (capturedOutput.hasLocalData()) {
+        QPair<QString*, QString*> p = capturedOutput.localData();
+        captured = stdout_ ? p.first : p.second;
+    }
+    if (captured) {
+        captured->append(txt);
+        return;
+    }
+
     HANDLE hStdout;
     if (stdout_)
         hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
@@ -2627,234 +2692,17 @@ void WPMUtils::executeFile(Job* job, const QString& where,
         const QString& outputFile, const QStringList& env,
         bool writeUTF16LEBOM, bool printScriptOutput)
 {
-    QString initialTitle = job->getTitle();
-
-    time_t start = time(NULL);
-
-    LPWCH env2 = GetEnvironmentStrings();
-    QMap<QString, QString> env_;
-    LPWCH e = env2;
-    while (true) {
-        int len = wcslen(e);
-        if (!len)
-            break;
-
-        QString s;
-        s.setUtf16((const ushort*) e, len);
-        int p = s.indexOf('=');
-
-        QString name, value;
-        if (p >= 0) {
-            name = s.left(p);
-            value = s.mid(p + 1);
-        } else {
-            name = s;
-        }
-        env_.insert(name, value);
-
-        e += len + 1;
-
-        // qDebug() << name << value;
-    }
+    ProcessRunner runner;
+    runner.where = where;
+    runner.program = path;
+    runner.nativeArguments = nativeArguments;
     for (int i = 0; i + 1 < env.size(); i += 2) {
-        env_.insert(env.at(i), env.at(i + 1));
+        runner.env.insert(env.at(i), env.at(i + 1));
     }
-    FreeEnvironmentStrings(env2);
-    QByteArray ba;
-    QMapIterator<QString, QString> i(env_);
-    while (i.hasNext()) {
-        i.next();
-        QString name = i.key();
-        QString value = i.value();
-        ba.append((char*) name.utf16(), name.length() * 2);
-        ba.append('=');
-        ba.append('\0');
-        ba.append((char*) value.utf16(), (value.length() + 1) * 2);
-    }
-    ba.append('\0');
-    ba.append('\0');
-
-    // qDebug() << ba;
-
-    PROCESS_INFORMATION pinfo;
-
-    SECURITY_ATTRIBUTES saAttr = {0};
-    saAttr.nLength = sizeof(saAttr);
-    saAttr.bInheritHandle = TRUE;
-    saAttr.lpSecurityDescriptor = NULL;
-
-    HANDLE g_hChildStd_IN_Rd = NULL;
-    HANDLE g_hChildStd_IN_Wr = NULL;
-    HANDLE g_hChildStd_OUT_Rd = NULL;
-    HANDLE g_hChildStd_OUT_Wr = NULL;
-
-    if (job->shouldProceed()) {
-        job->checkOSCall(
-                CreatePipe(&g_hChildStd_OUT_Rd, &g_hChildStd_OUT_Wr,
-                &saAttr, 0));
-    }
-
-    if (job->shouldProceed()) {
-        job->checkOSCall(
-                SetHandleInformation(g_hChildStd_OUT_Rd,
-                HANDLE_FLAG_INHERIT, 0));
-    }
-
-    if (job->shouldProceed()) {
-        job->checkOSCall(
-                CreatePipe(&g_hChildStd_IN_Rd, &g_hChildStd_IN_Wr, &saAttr, 0));
-    }
-
-    if (job->shouldProceed()) {
-        job->checkOSCall(
-                SetHandleInformation(g_hChildStd_IN_Wr,
-                HANDLE_FLAG_INHERIT, 0));
-    }
-
-    STARTUPINFOW startupInfo = {
-        sizeof(STARTUPINFO), 0, 0, 0,
-        (ulong) CW_USEDEFAULT, (ulong) CW_USEDEFAULT,
-        (ulong) CW_USEDEFAULT, (ulong) CW_USEDEFAULT,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-    };
-
-    startupInfo.dwFlags |= STARTF_USESTDHANDLES;
-    startupInfo.hStdInput = g_hChildStd_IN_Rd;
-    startupInfo.hStdOutput = g_hChildStd_OUT_Wr;
-    startupInfo.hStdError = g_hChildStd_OUT_Wr;
-
-    bool success = false;
-
-    if (job->shouldProceed()) {
-        QString args = "\"" + path + "\"";
-        if (!nativeArguments.isEmpty())
-            args = args + ' ' + nativeArguments;
-        success = CreateProcess(
-                (wchar_t*) path.utf16(),
-                (wchar_t*) args.utf16(),
-                0, &saAttr, TRUE,
-                CREATE_UNICODE_ENVIRONMENT | CREATE_NO_WINDOW,
-                ba.data(),
-                (wchar_t*) where.utf16(),
-                &startupInfo, &pinfo);
-
-        // ignore the possible errors here
-        CloseHandle(g_hChildStd_OUT_Wr);
-    }
-
-    QFile f(outputFile);
-    if (job->shouldProceed()) {
-        if (!f.open(QIODevice::WriteOnly))
-            job->setErrorMessage(f.errorString());
-    }
-
-    if (job->shouldProceed() && writeUTF16LEBOM) {
-        if (f.write("\xff\xfe") == -1)
-            job->setErrorMessage(f.errorString());
-    }
-
-    if (job->shouldProceed()) {
-        HANDLE hStdout;
-        bool consoleOutput;
-        if (printScriptOutput) {
-            hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-
-            // we do not check GetLastError here as it sometimes returns
-            // 2=The system cannot find the file specified.
-            // GetFileType returns 0 if an error occures so that the == check below
-            // is sufficient
-            DWORD ft = GetFileType(hStdout);
-            consoleOutput = (ft & ~(FILE_TYPE_REMOTE)) ==
-                    FILE_TYPE_CHAR;
-
-            DWORD consoleMode;
-            if (consoleOutput) {
-                if (!GetConsoleMode(hStdout, &consoleMode))
-                    consoleOutput = false;
-            }
-        } else {
-            hStdout = INVALID_HANDLE_VALUE;
-            consoleOutput = false;
-        }
-
-        int64_t outputLen = 0;
-        DWORD ec = 0;
-        const int BUFSIZE = 1024;
-        char* chBuf = new char[BUFSIZE];
-        while (true) {
-            if (job->isCancelled()) {
-                break;
-            }
-
-            DWORD dwRead;
-            bool bSuccess = ReadFile(g_hChildStd_OUT_Rd, chBuf, BUFSIZE,
-                    &dwRead, NULL);
-            if (!bSuccess || dwRead == 0)
-                break;
-
-            outputLen += dwRead;
-
-            if (hStdout != INVALID_HANDLE_VALUE) {
-                DWORD dwWritten;
-                if (consoleOutput)
-                    WriteConsoleW(hStdout, chBuf, dwRead / 2, &dwWritten, 0);
-                else {
-                    // convert to UTF-8
-                    QString s;
-                    s.setUtf16((const ushort*) chBuf, dwRead / 2);
-                    QByteArray ba = s.toUtf8();
-
-                    WriteFile(hStdout, ba.constData(), ba.length(),
-                            &dwWritten, 0);
-                }
-            }
-
-            if (f.write(chBuf, dwRead) == -1) {
-                job->setErrorMessage(f.errorString());
-                break;
-            }
-
-            time_t seconds = time(NULL) - start;
-            double percents = ((double) seconds) / 300; // 5 Minutes
-            if (percents > 0.9)
-                percents = 0.9;
-            job->setProgress(percents);
-            job->setTitle(initialTitle + " / " +
-                    QString(QObject::tr("%1 minutes")).
-                    arg(seconds / 60));
-        }
-        delete[] chBuf;
-
-        // ignore possible errors here
-        f.close();
-
-        // ignore possible errors here
-        CloseHandle(g_hChildStd_OUT_Rd);
-
-        if (GetExitCodeProcess(pinfo.hProcess, &ec) && ec == STILL_ACTIVE) {
-            if (job->isCancelled())
-                TerminateProcess(pinfo.hProcess, 0xFFFFFFFF);
-            WaitForSingleObject(pinfo.hProcess, INFINITE);
-        }
-
-        if (job->shouldProceed()) {
-            job->checkOSCall(GetExitCodeProcess(pinfo.hProcess, &ec));
-        }
-
-        if (ec != 0) {
-            job->setErrorMessage(
-                    QString(QObject::tr("Process %1 exited with the code %2")).
-                    arg(path).arg(ec));
-        }
-    }
-    job->setTitle(initialTitle);
-
-    if (success) {
-        // ignore possible errors here
-        CloseHandle(pinfo.hThread);
-        CloseHandle(pinfo.hProcess);
-    }
-
-    job->complete();
+    runner.outputFile = outputFile;
+    runner.writeUTF16LEBOM = writeUTF16LEBOM;
+    runner.printOutput = printScriptOutput;
+    runner.utf16Output = true;
+    runner.run(job);
 }
 
@@ -9,6 +9,8 @@
 #include <QTime>
 #include <QCryptographicHash>
 #include <QThreadPool>
+#include <QThreadStorage>
+#include <QPair>
 
 #include "job.h"
 #include "version.h"
@@ -24,6 +26,9 @@ class WPMUtils
 private:
     static HANDLE hEventLog;
 
+    /** stdout and stderr for each thread. See captureOutput() */
+    static QThreadStorage<QPair<QString*, QString*> > capturedOutput;
+
     WPMUtils();
 
     static bool isProcessRunning(HANDLE process);
@@ -109,6 +114,15 @@ public:
      */
     static void removeDirectory(Job* job, QDir &aDir, bool firstLevel=true);
 
+    /**
+     * Deletes a directory. A lightweight step is used for every
+     * sub-directory.
+     *
+     * @param step progress for this task
+     * @param aDir this directory will be deleted
+     */
+    static void removeDirectory(JobStep* step, QDir &aDir);
+
     /**
      * Uses the Shell's IShellLink and IPersistFile interfaces
      * to create and store a shortcut to the specified object.
@@ -331,6 +345,17 @@ public:
      */
     static void writeln(const QString& txt, bool stdout_=true);
 
+    /**
+     * Redirects the output of outputTextConsole() and writeln() in the
+     * current thread into strings. Other threads are not affected.
+     *
+     * @param stdout_ the text for stdout will be appended here or 0 for the
+     *     console output
+     * @param stderr_ the text for stderr will be appended here or 0 for the
+     *     console output
+     */
+    static void captureOutput(QString* stdout_, QString* stderr_);
+
     /**
      * Is the output redirected?
      *
@@ -561,6 +586,24 @@ public:
      */
     static DWORD getCloseProcessType();
 
+    /**
+     * @brief changes the settings for downloading the binaries of available
+     *     updates in the background
+     * @param enabled true = download the updates after the repositories were
+     *     reloaded
+     * @param kibPerSecond maximum download speed in KiB/s or 0 for
+     *     "unlimited"
+     */
+    static void setPrefetchUpdates(bool enabled, DWORD kibPerSecond);
+
+    /**
+     * @param kibPerSecond the maximum download speed in KiB/s or 0 for
+     *     "unlimited" will be stored here
+     * @return true if the binaries of available updates should be downloaded
+     *     in the background after the repositories were reloaded
+     */
+    static bool getPrefetchUpdates(DWORD* kibPerSecond);
+
     /**
      * @brief parses the command line and returns the chosen program close type
      * @param cl command line